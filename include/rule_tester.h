@@ -27,7 +27,8 @@ extern "C" {
 #endif
 
 //  @interface
-//  Create a new rule_tester
+//  Evaluate rule file on the host and print produced metrics. Returns 0 on
+//  success.
 ZM_METRIC_EXPORT int
     rule_tester (
         const char *file,
@@ -37,6 +38,21 @@ ZM_METRIC_EXPORT int
 
 ZM_METRIC_EXPORT void
     rule_tester_test (bool verbose);
+
+#ifdef ZM_METRIC_BUILD_DRAFT_API
+//  *** Draft method, for development use, may change without warning ***
+//  Evaluate rule file like rule_tester. With record all SNMP responses are
+//  saved to that file (snmpwalk -On format), with replay responses are read
+//  from the file and the host is not contacted. Both may be NULL.
+ZM_METRIC_EXPORT int
+    rule_tester_snapshot (
+        const char *file,
+        int snmpversion,
+        const char *community,
+        const char *addr,
+        const char *record,
+        const char *replay);
+#endif // ZM_METRIC_BUILD_DRAFT_API
 //  @end
 
 #ifdef __cplusplus
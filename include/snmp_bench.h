@@ -0,0 +1,87 @@
+/*  =========================================================================
+    snmp_bench - SNMP request throughput benchmark
+
+    Copyright (C) 2016 - 2017 Tomas Halman                                 
+                                                                           
+    This program is free software; you can redistribute it and/or modify   
+    it under the terms of the GNU General Public License as published by   
+    the Free Software Foundation; either version 2 of the License, or      
+    (at your option) any later version.                                    
+                                                                           
+    This program is distributed in the hope that it will be useful,        
+    but WITHOUT ANY WARRANTY; without even the implied warranty of         
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          
+    GNU General Public License for more details.                           
+                                                                           
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.            
+    =========================================================================
+*/
+
+#ifndef SNMP_BENCH_H_INCLUDED
+#define SNMP_BENCH_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//  @interface
+//  This is a draft class, and may change without notice. It is disabled in
+//  stable builds by default. If you use this in applications, please ask
+//  for it to be pushed to stable state. Use --enable-drafts to enable.
+//  Send count SNMP get requests for oid to the host, first from one thread,
+//  then from 16 threads sharing the sockets, and print requests per second
+//  of both runs. Returns 0 on success, nonzero if host does not respond.
+ZM_METRIC_EXPORT int
+    snmp_bench (
+        const char *host,
+        int snmpversion,
+        const char *community,
+        const char *oid,
+        int count);
+
+//  Parse and format count oids, first with net-snmp functions, then with
+//  zmsnmp intern table and numeric formatter, and print operations per
+//  second. Does not need any agent. Returns 0 on success.
+ZM_METRIC_EXPORT int
+    snmp_bench_oid (int count);
+
+//  Convert count received varbinds (counters, gauge, timeticks, string)
+//  to strings the way values were passed to lua before, and to typed
+//  values, and print conversions per second. Does not need any agent.
+//  Returns 0 on success.
+ZM_METRIC_EXPORT int
+    snmp_bench_value (int count);
+
+//  Load rules (of typical size) to hosts and evaluate them once, first in
+//  lua states of workers, then in lua state per host and rule, and print
+//  resident memory per host of both variants. Does not need any agent.
+//  Returns 0 on success.
+ZM_METRIC_EXPORT int
+    snmp_bench_memory (int hosts, int rules);
+
+//  Load rules to assets, first one chunk repeatedly from source and from
+//  bytecode, then deploy all rules to all assets through worker pool, from
+//  source and from bytecode, and print time of both variants. Does not
+//  need any agent. Returns 0 on success.
+ZM_METRIC_EXPORT int
+    snmp_bench_startup (int assets, int rules);
+
+//  Evaluate count times a rule which walks interface table of 256 rows
+//  (answered from snapshot) and post processes it in lua, and print
+//  evaluations per second together with lua backend. Does not need any
+//  agent. Returns 0 on success.
+ZM_METRIC_EXPORT int
+    snmp_bench_eval (int count);
+
+//  Self test of this class
+ZM_METRIC_EXPORT void
+    snmp_bench_test (bool verbose);
+//  @end
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
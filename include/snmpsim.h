@@ -0,0 +1,118 @@
+/*  =========================================================================
+    snmpsim - simulated SNMP agents serving recorded walks
+
+    Copyright (C) 2016 - 2017 Tomas Halman
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#ifndef SNMPSIM_H_INCLUDED
+#define SNMPSIM_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//  @interface
+//  This is a draft class, and may change without notice. It is disabled in
+//  stable builds by default. If you use this in applications, please ask
+//  for it to be pushed to stable state. Use --enable-drafts to enable.
+//  Create a new simulator without data and agents
+ZM_METRIC_EXPORT snmpsim_t *
+    snmpsim_new (void);
+
+//  Destroy the simulator, close all agents. Actor running the simulator
+//  must be destroyed first.
+ZM_METRIC_EXPORT void
+    snmpsim_destroy (snmpsim_t **self_p);
+
+//  Load data from snmpwalk -On output (".1.3.6.1.2.1.1.5.0 = STRING: x").
+//  Types INTEGER, STRING, Hex-STRING, OID, Timeticks, Counter32, Gauge32,
+//  Unsigned32, Counter64 and IpAddress are understood, other lines are
+//  skipped. Returns number of loaded values, -1 if file can't be read.
+ZM_METRIC_EXPORT int
+    snmpsim_load (snmpsim_t *self, const char *filename);
+
+//  Set value of numeric oid, type is snmpwalk type name (see above).
+//  Returns 0 on success, -1 if oid, type or value are not valid.
+ZM_METRIC_EXPORT int
+    snmpsim_set (snmpsim_t *self, const char *oid, const char *type, const char *value);
+
+//  Number of values served
+ZM_METRIC_EXPORT size_t
+    snmpsim_size (snmpsim_t *self);
+
+//  Accept only requests with this community, NULL accepts any. Requests
+//  with wrong community are silently dropped, like agents do. Default is
+//  "public".
+ZM_METRIC_EXPORT void
+    snmpsim_set_community (snmpsim_t *self, const char *community);
+
+//  Delay every response by latency ms
+ZM_METRIC_EXPORT void
+    snmpsim_set_latency (snmpsim_t *self, int latency);
+
+//  Drop percent of requests (0 - 100). Drops are pseudorandom, but the
+//  same for every run.
+ZM_METRIC_EXPORT void
+    snmpsim_set_loss (snmpsim_t *self, int percent);
+
+//  Answer GET/GETNEXT with more than max varbinds by tooBig and truncate
+//  GETBULK responses to max varbinds. 0 means no limit.
+ZM_METRIC_EXPORT void
+    snmpsim_set_max_varbinds (snmpsim_t *self, int max);
+
+//  Bind new agent to UDP address and port (0 = any free port). Returns
+//  endpoint of the agent ("127.0.0.1:16100") or NULL on error.
+ZM_METRIC_EXPORT const char *
+    snmpsim_bind (snmpsim_t *self, const char *address, int port);
+
+//  Number of bound agents
+ZM_METRIC_EXPORT size_t
+    snmpsim_agents (snmpsim_t *self);
+
+//  Endpoint of agent with given index, NULL if there is no such agent
+ZM_METRIC_EXPORT const char *
+    snmpsim_endpoint (snmpsim_t *self, size_t index);
+
+//  Serve requests of all agents for timeout ms. Returns number of
+//  received requests.
+ZM_METRIC_EXPORT size_t
+    snmpsim_run (snmpsim_t *self, int timeout);
+
+//  Zactor serving requests until $TERM, args is configured simulator
+ZM_METRIC_EXPORT void
+    snmpsim_actor (zsock_t *pipe, void *args);
+
+//  Number of received requests
+ZM_METRIC_EXPORT uint64_t
+    snmpsim_requests (snmpsim_t *self);
+
+//  Number of requests dropped (loss, wrong community, bad format)
+ZM_METRIC_EXPORT uint64_t
+    snmpsim_dropped (snmpsim_t *self);
+
+//  Self test of this class
+ZM_METRIC_EXPORT void
+    snmpsim_test (bool verbose);
+
+//  @end
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
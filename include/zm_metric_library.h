@@ -76,11 +76,22 @@ typedef struct _zm_metric_server_t zm_metric_server_t;
 #define ZM_METRIC_SERVER_T_DEFINED
 typedef struct _rule_tester_t rule_tester_t;
 #define RULE_TESTER_T_DEFINED
+#ifdef ZM_METRIC_BUILD_DRAFT_API
+//  Draft classes are by default not built in stable releases
+typedef struct _snmp_bench_t snmp_bench_t;
+#define SNMP_BENCH_T_DEFINED
+typedef struct _snmpsim_t snmpsim_t;
+#define SNMPSIM_T_DEFINED
+#endif // ZM_METRIC_BUILD_DRAFT_API
 
 
 //  Public classes, each with its own header file
 #include "zm_metric_server.h"
 #include "rule_tester.h"
+#ifdef ZM_METRIC_BUILD_DRAFT_API
+#include "snmp_bench.h"
+#include "snmpsim.h"
+#endif // ZM_METRIC_BUILD_DRAFT_API
 
 #ifdef ZM_METRIC_BUILD_DRAFT_API
 //  Self test for private classes
@@ -0,0 +1,602 @@
+/*  =========================================================================
+    host - state of one monitored host
+
+    Copyright (C) 2016 - 2017 Tomas Halman
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    host - state of one monitored host
+@discuss
+    Host is a plain record (asset, ip, credentials and lua functions). It
+    does not own any thread, it is owned by worker_pool which feeds it with
+    command messages from whatever worker thread is free. Pool guarantees
+    that only one worker handles particular host at a time. Functions are
+    just references to shared code, they are evaluated in the lua state of
+    the worker (lua_runtime). Every function keeps its ctx.state, so the
+    state goes with the host to any worker.
+@end
+*/
+
+#include "zm_metric_classes.h"
+
+#include <lualib.h>
+#include <lauxlib.h>
+
+struct _host_t {
+    char *asset;
+    char *ip;
+    snmp_credentials_t credentials;
+    zhash_t *functions;
+    snmp_cache_t *cache;    // responses shared by all functions
+    int64_t cachettl;       // ms, -1 = shortest function interval
+    bool broken;            // circuit breaker is open
+    int64_t probe_at;       // zclock_mono of next probe of broken host
+    int64_t backoff;        // ms between probes
+};
+
+//  Circuit breaker counters of all hosts
+static pthread_mutex_t s_breaker_mutex = PTHREAD_MUTEX_INITIALIZER;
+static size_t s_breakers_open = 0;
+static uint64_t s_breaker_trips = 0;
+static uint64_t s_breaker_probes = 0;
+static uint64_t s_breaker_skipped = 0;
+
+
+//  --------------------------------------------------------------------------
+//  private polling function class
+
+typedef struct {
+    unsigned int interval;  // seconds
+    lua_code_t *code;
+    uint64_t max_instructions;  // budget of evaluation, 0 = default
+    unsigned int max_time;      // ms, 0 = default
+    zhash_t *state;             // ctx.state of the function on the host
+} polling_function_t;
+
+polling_function_t *pf_new ()
+{
+    polling_function_t *self = (polling_function_t *) zmalloc (sizeof (polling_function_t));
+    assert (self);
+    self -> state = zhash_new ();
+    assert (self -> state);
+    return self;
+}
+
+void pf_destroy (polling_function_t **self_p)
+{
+    if (!self_p || !*self_p) return;
+
+    polling_function_t *self = *self_p;
+    lua_runtime_release (&self -> code);
+    zhash_destroy (&self -> state);
+    free (self);
+    *self_p = NULL;
+}
+
+void pf_set_interval (polling_function_t *self, unsigned int interval)
+{
+    if (!self) return;
+    self -> interval = interval;
+}
+
+void pf_set_budget (polling_function_t *self, uint64_t max_instructions, unsigned int max_time)
+{
+    if (!self) return;
+    self -> max_instructions = max_instructions;
+    self -> max_time = max_time;
+}
+
+void pf_set_code (polling_function_t *self, lua_code_t **code)
+{
+    if (!self) return;
+
+    lua_runtime_release (&self -> code);
+    self -> code = *code;
+    *code = NULL;
+}
+
+unsigned int pf_interval (polling_function_t *self)
+{
+    if (!self) return 60;
+    return self->interval;
+}
+
+lua_code_t *pf_code (polling_function_t *self)
+{
+    if (!self) return NULL;
+    return self->code;
+}
+
+void pf_freefn (void *self)
+{
+    if (!self) return;
+    polling_function_t *pf = (polling_function_t *)self;
+    pf_destroy (&pf);
+}
+
+//  --------------------------------------------------------------------------
+//  Create a new host
+
+host_t *
+host_new (const char *asset)
+{
+    host_t *self = (host_t *) zmalloc (sizeof (host_t));
+    assert (self);
+    self -> functions = zhash_new ();
+    self -> cache = snmp_cache_new (0);
+    self -> cachettl = -1;
+    if (asset) self -> asset = strdup (asset);
+    return self;
+}
+
+//  --------------------------------------------------------------------------
+//  Close circuit breaker, evaluate functions again
+
+static void
+s_host_close_breaker (host_t *self)
+{
+    if (!self->broken) return;
+    self->broken = false;
+    pthread_mutex_lock (&s_breaker_mutex);
+    --s_breakers_open;
+    pthread_mutex_unlock (&s_breaker_mutex);
+}
+
+//  --------------------------------------------------------------------------
+//  Destroy a host
+
+void
+host_destroy (host_t **self_p)
+{
+    if (!self_p || !*self_p) return;
+    host_t *self = *self_p;
+
+    s_host_close_breaker (self);
+    zstr_free (&self->asset);
+    zstr_free (&self->ip);
+    zstr_free (&self->credentials.community);
+    host_remove_functions (self);
+    zhash_destroy (&self->functions);
+    snmp_cache_destroy (&self->cache);
+    free (self);
+    *self_p = NULL;
+}
+
+//  --------------------------------------------------------------------------
+//  Get asset name
+
+const char *host_asset (host_t *self)
+{
+    if (!self) return NULL;
+    return self->asset;
+}
+
+//  --------------------------------------------------------------------------
+//  Shortest interval of functions in ms, 0 if there are no functions
+
+static int64_t
+s_host_min_interval (host_t *self)
+{
+    int64_t result = 0;
+    polling_function_t *pf = (polling_function_t *) zhash_first (self->functions);
+    while (pf) {
+        int64_t interval = (int64_t) pf_interval (pf) * 1000;
+        if (result == 0 || interval < result) result = interval;
+        pf = (polling_function_t *) zhash_next (self->functions);
+    }
+    return result;
+}
+
+//  --------------------------------------------------------------------------
+//  Update lifetime of cached responses. Unless configured, responses live
+//  for the shortest interval of functions, so every evaluation of the
+//  fastest rule gets fresh data.
+
+static void
+s_host_update_cache (host_t *self)
+{
+    int64_t ttl = self->cachettl;
+    if (ttl < 0) ttl = s_host_min_interval (self);
+    if (ttl != snmp_cache_ttl (self->cache)) {
+        snmp_cache_set_ttl (self->cache, ttl);
+        snmp_cache_clear (self->cache);
+    }
+}
+
+//  --------------------------------------------------------------------------
+//  Remove lua function
+
+void host_remove_function (host_t *self, const char *name)
+{
+    if (!self || ! name) return;
+    zhash_delete (self->functions, name);
+    s_host_update_cache (self);
+}
+
+//  --------------------------------------------------------------------------
+//  Remove lua function
+
+void host_remove_functions (host_t *self)
+{
+    if (!self) return;
+    zlist_t *keys = zhash_keys (self->functions);
+    char *key = (char *) zlist_first (keys);
+    while (key) {
+        host_remove_function (self, key);
+        key = (char *) zlist_next (keys);
+    }
+    zlist_destroy (&keys);
+}
+
+//  --------------------------------------------------------------------------
+//  register lua function (source or bytecode) and add it to list, errors
+//  are logged by runtime
+
+void host_add_lua_function (host_t *self, lua_runtime_t *runtime, const char *name, const char *func, size_t size, unsigned int interval, uint64_t max_instructions, unsigned int max_time)
+{
+    if (!self) return;
+
+    zsys_debug ("adding lua func");
+    lua_code_t *code = lua_runtime_add (runtime, name, func, size);
+    if (!code) return;
+
+    polling_function_t *pf = pf_new ();
+    pf_set_interval (pf, interval);
+    pf_set_budget (pf, max_instructions, max_time);
+    pf_set_code (pf, &code);
+
+    // new code of the rule replaces the old one
+    zhash_update (self -> functions, name, pf);
+    zhash_freefn (self -> functions, name, pf_freefn);
+    s_host_update_cache (self);
+    zsys_debug ("New function '%s' created", name);
+}
+
+//  --------------------------------------------------------------------------
+//  evaluate one function and send metric messages
+
+void host_evaluate (host_t *self, polling_function_t *pf, lua_runtime_t *runtime, zsock_t *output)
+{
+    const char *name = self->asset;
+    lua_State *l = lua_runtime_state (runtime);
+    luasnmp_set_cache (l, self->cache);
+
+    zsys_debug ("lua called for %s", name);
+    lua_runtime_set_budget (runtime, pf -> max_instructions, pf -> max_time);
+    lua_runtime_set_state (runtime, pf -> state);
+    int rc = lua_runtime_call (runtime, pf_code (pf), name, self->ip, &self->credentials);
+    lua_runtime_set_state (runtime, NULL);
+    if (rc == 0) {
+        // check if result is an array
+        if (! lua_istable (l, -1)) {
+            zsys_error ("function did not returned array");
+            lua_settop (l, 0);
+            luasnmp_set_cache (l, NULL);
+            return;
+        }
+        char *pollfreq = zsys_sprintf("%u", pf_interval (pf));
+        int i = 1;
+        while (true) {
+            const char *type = NULL;
+            const char *value = NULL;
+            const char *units = NULL;
+            const char *description = "";
+            char number [64];
+
+            lua_pushnumber(l, i++);
+            lua_gettable(l, -2);
+            if (lua_isstring (l, -1)) type = lua_tostring(l,-1);
+            lua_pop (l, 1);
+
+            lua_pushnumber(l, i++);
+            lua_gettable(l, -2);
+            value = luasnmp_tostring (l, -1, number, sizeof (number));
+            lua_pop (l, 1);
+
+            lua_pushnumber(l, i++);
+            lua_gettable(l, -2);
+            if (lua_isstring (l, -1)) units = lua_tostring(l,-1);
+            lua_pop (l, 1);
+
+            lua_pushnumber(l, i++);
+            lua_gettable(l, -2);
+            if (lua_isstring (l, -1)) description = lua_tostring(l,-1);
+            lua_pop (l, 1);
+
+            if (type && value && units) {
+                zsys_debug ("sending METRIC/%s/%s/%s/%s/%s/%s", name, type, value, units, pollfreq, description);
+                zstr_sendx (output, "METRIC", name, type, value, units, pollfreq, description, NULL);
+            } else {
+                break;
+            }
+        }
+        zstr_free (&pollfreq);
+        lua_settop (l, 0);
+    }
+    luasnmp_set_cache (l, NULL);
+}
+
+//  --------------------------------------------------------------------------
+//  Returns true if functions of the host should be evaluated. Broken host
+//  is probed when it is time to, otherwise evaluation is skipped.
+
+static bool
+s_host_reachable (host_t *self)
+{
+    if (!self->broken) return true;
+
+    int64_t now = zclock_mono ();
+    bool responds = false;
+    if (now >= self->probe_at && self->credentials.community) {
+        zmsnmp_value_t *value = zmsnmp_get (self->ip, HOST_BREAKER_PROBE, &self->credentials);
+        responds = value != NULL;
+        zmsnmp_value_destroy (&value);
+        if (!responds) {
+            self->backoff = self->backoff * 2 < HOST_BREAKER_BACKOFF_MAX ? self->backoff * 2 : HOST_BREAKER_BACKOFF_MAX;
+            self->probe_at = now + self->backoff;
+        }
+        pthread_mutex_lock (&s_breaker_mutex);
+        ++s_breaker_probes;
+        pthread_mutex_unlock (&s_breaker_mutex);
+    }
+    if (responds) {
+        zsys_info ("host '%s' (%s) responds again", self->asset, self->ip);
+        s_host_close_breaker (self);
+        return true;
+    }
+    pthread_mutex_lock (&s_breaker_mutex);
+    ++s_breaker_skipped;
+    pthread_mutex_unlock (&s_breaker_mutex);
+    return false;
+}
+
+//  --------------------------------------------------------------------------
+//  Open circuit breaker after evaluation if the device stopped responding
+
+static void
+s_host_check_breaker (host_t *self)
+{
+    if (self->broken || zmsnmp_host_failures (self->ip) < HOST_BREAKER_THRESHOLD) return;
+
+    self->broken = true;
+    self->backoff = s_host_min_interval (self);
+    if (self->backoff <= 0) self->backoff = 60000;
+    self->probe_at = zclock_mono () + self->backoff;
+    pthread_mutex_lock (&s_breaker_mutex);
+    ++s_breakers_open;
+    ++s_breaker_trips;
+    pthread_mutex_unlock (&s_breaker_mutex);
+    zsys_warning ("host '%s' (%s) does not respond, evaluation suspended", self->asset, self->ip);
+}
+
+//  --------------------------------------------------------------------------
+//  Append circuit breaker counters to the message
+
+void
+host_breaker_stats (zmsg_t *msg)
+{
+    if (!msg) return;
+
+    pthread_mutex_lock (&s_breaker_mutex);
+    zmsg_addstr (msg, "breakers-open");
+    zmsg_addstrf (msg, "%zu", s_breakers_open);
+    zmsg_addstr (msg, "breaker-trips");
+    zmsg_addstrf (msg, "%" PRIu64, s_breaker_trips);
+    zmsg_addstr (msg, "breaker-probes");
+    zmsg_addstrf (msg, "%" PRIu64, s_breaker_probes);
+    zmsg_addstr (msg, "breaker-skipped");
+    zmsg_addstrf (msg, "%" PRIu64, s_breaker_skipped);
+    pthread_mutex_unlock (&s_breaker_mutex);
+}
+
+//  --------------------------------------------------------------------------
+//  Process one command message
+
+void
+host_handle (host_t *self, zmsg_t **msg_p, zsock_t *output, lua_runtime_t *runtime)
+{
+    if (!msg_p || !*msg_p) return;
+    zmsg_t *msg = *msg_p;
+    if (!self) {
+        zmsg_destroy (msg_p);
+        return;
+    }
+
+    char *cmd = zmsg_popstr (msg);
+    if (cmd) {
+        if (streq (cmd, "WAKEUP")) {
+            zsys_debug ("host '%s' received WAKEUP command, (%s)", self->asset, self->ip);
+            if (self->ip && s_host_reachable (self)) {
+                snmp_cache_purge (self->cache);
+                polling_function_t *pf = (polling_function_t *) zhash_first (self->functions);
+                if (!pf) zsys_error ("asset '%s' has no defined function", self->asset);
+                while(pf && !self->broken) {
+                    host_evaluate (self, pf, runtime, output);
+                    s_host_check_breaker (self);
+                    pf = (polling_function_t *) zhash_next (self->functions);
+                }
+            }
+        }
+        else if (streq (cmd, "EVALUATE")) {
+            char *name = zmsg_popstr (msg);
+            polling_function_t *pf = name ? (polling_function_t *) zhash_lookup (self->functions, name) : NULL;
+            if (pf && self->ip && s_host_reachable (self)) {
+                snmp_cache_purge (self->cache);
+                host_evaluate (self, pf, runtime, output);
+                s_host_check_breaker (self);
+            }
+            // always confirm, scheduler waits for it
+            if (name) zstr_sendx (output, "DONE", self->asset, name, NULL);
+            zstr_free (&name);
+        }
+        else if (streq (cmd, "LUA")) {
+            char *name = zmsg_popstr (msg);
+            // bytecode is binary, keep it in frame
+            zframe_t *func = zmsg_pop (msg);
+            char *interval = zmsg_popstr (msg);
+            // optional budget of evaluation
+            char *instructions = zmsg_popstr (msg);
+            char *time = zmsg_popstr (msg);
+            if (name && func) {
+                unsigned int iinterval = interval ? atoi (interval) : 60;
+                host_add_lua_function (self, runtime, name, (const char *) zframe_data (func), zframe_size (func), iinterval ? iinterval : 60,
+                    instructions ? strtoull (instructions, NULL, 10) : 0,
+                    time ? (unsigned int) atoi (time) : 0);
+            }
+            zstr_free (&name);
+            zframe_destroy (&func);
+            zstr_free (&interval);
+            zstr_free (&instructions);
+            zstr_free (&time);
+        }
+        else if (streq (cmd, "DROPLUA")) {
+            host_remove_functions (self);
+        }
+        else if (streq (cmd, "CREDENTIALS")) {
+            char *version = zmsg_popstr (msg);
+            char *community = zmsg_popstr (msg);
+            if (version && community) {
+                zstr_free (&self->credentials.community);
+                self -> credentials.version = atoi (version);
+                self -> credentials.community = community;
+                snmp_cache_clear (self->cache);
+                // timeouts may have been caused by wrong credentials
+                s_host_close_breaker (self);
+                community = NULL;
+            }
+            zstr_free (&version);
+            zstr_free (&community);
+        }
+        else if (streq (cmd, "ASSETNAME")) {
+            zstr_free (&self -> asset);
+            self -> asset = zmsg_popstr (msg);
+        }
+        else if (streq (cmd, "IP")) {
+            zstr_free (&self -> ip);
+            self -> ip = zmsg_popstr (msg);
+            snmp_cache_clear (self->cache);
+            s_host_close_breaker (self);
+        }
+        else if (streq (cmd, "CACHETTL")) {
+            char *ttl = zmsg_popstr (msg);
+            if (ttl) {
+                self -> cachettl = atoll (ttl);
+                s_host_update_cache (self);
+            }
+            zstr_free (&ttl);
+        }
+    }
+    zstr_free (&cmd);
+    zmsg_destroy (msg_p);
+}
+
+//  --------------------------------------------------------------------------
+//  freefn for zhash/zlist
+
+void host_freefn (void *self)
+{
+    if (!self) return;
+    host_t *host = (host_t *) self;
+    host_destroy (&host);
+}
+
+//  --------------------------------------------------------------------------
+//  Self test of this class
+
+void
+host_test (bool verbose)
+{
+    printf (" * host: ");
+    //  @selftest
+    zsock_t *output = zsock_new_pull ("inproc://host-test");
+    assert (output);
+    zsock_t *input = zsock_new_push ("inproc://host-test");
+    assert (input);
+
+    lua_runtime_t *runtime = lua_runtime_new ();
+    assert (runtime);
+    host_t *self = host_new ("localhost");
+    assert (self);
+    assert (streq (host_asset (self), "localhost"));
+
+    zmsg_t *msg = zmsg_new ();
+    zmsg_addstr (msg, "IP");
+    zmsg_addstr (msg, "127.0.0.1");
+    host_handle (self, &msg, input, runtime);
+    assert (msg == NULL);
+
+    msg = zmsg_new ();
+    zmsg_addstr (msg, "CREDENTIALS");
+    zmsg_addstr (msg, "1");
+    zmsg_addstr (msg, "public");
+    host_handle (self, &msg, input, runtime);
+
+    msg = zmsg_new ();
+    zmsg_addstr (msg, "LUA");
+    zmsg_addstr (msg, "load");
+    zmsg_addstr (msg, "function main(host) return { 'load', 15, '%' } end");
+    zmsg_addstr (msg, "60");
+    host_handle (self, &msg, input, runtime);
+
+    msg = zmsg_new ();
+    zmsg_addstr (msg, "EVALUATE");
+    zmsg_addstr (msg, "load");
+    host_handle (self, &msg, input, runtime);
+
+    msg = zmsg_recv (output);
+    char *c = zmsg_popstr (msg);
+    assert (c);
+    assert (streq (c, "METRIC"));
+    zstr_free (&c);
+    c = zmsg_popstr (msg);
+    assert (c);
+    assert (streq (c, "localhost"));
+    zstr_free (&c);
+    c = zmsg_popstr (msg);
+    assert (c);
+    assert (streq (c, "load"));
+    zstr_free (&c);
+    c = zmsg_popstr (msg);
+    assert (c);
+    assert (streq (c, "15"));
+    zstr_free (&c);
+    c = zmsg_popstr (msg);
+    assert (c);
+    assert (streq (c, "%"));
+    zstr_free (&c);
+    zmsg_destroy (&msg);
+
+    // healthy host keeps breaker closed
+    zmsg_t *stats = zmsg_new ();
+    host_breaker_stats (stats);
+    assert (zmsg_size (stats) == 8);
+    char *name = zmsg_popstr (stats);
+    char *value = zmsg_popstr (stats);
+    assert (streq (name, "breakers-open") && streq (value, "0"));
+    zstr_free (&name);
+    zstr_free (&value);
+    zmsg_destroy (&stats);
+
+    host_destroy (&self);
+    lua_runtime_destroy (&runtime);
+    zsock_destroy (&input);
+    zsock_destroy (&output);
+    //  @end
+    printf ("OK\n");
+}
@@ -0,0 +1,90 @@
+/*  =========================================================================
+    host - state of one monitored host
+
+    Copyright (C) 2016 - 2017 Tomas Halman
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#ifndef HOST_H_INCLUDED
+#define HOST_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//  Circuit breaker of unreachable host
+#define HOST_BREAKER_THRESHOLD      3           // consecutive timeouts which open it
+#define HOST_BREAKER_BACKOFF_MAX    3600000     // ms, max time between probes
+#define HOST_BREAKER_PROBE          ".1.3.6.1.2.1.1.3.0"    // sysUpTime
+
+#ifndef HOST_T_DEFINED
+typedef struct _host_t host_t;
+#define HOST_T_DEFINED
+#endif
+
+//  @interface
+//  Create a new host record
+ZM_METRIC_PRIVATE host_t *
+    host_new (const char *asset);
+
+//  Destroy the host record
+ZM_METRIC_PRIVATE void
+    host_destroy (host_t **self_p);
+
+//  Get asset name of the host
+ZM_METRIC_PRIVATE const char *
+    host_asset (host_t *self);
+
+//  Process one command message (WAKEUP, EVALUATE, LUA, DROPLUA, CREDENTIALS,
+//  ASSETNAME, IP, CACHETTL). Metrics produced by evaluation are sent to output.
+//  WAKEUP evaluates all functions, EVALUATE just the named one and sends
+//  DONE asset name when finished. Functions are evaluated in the lua state
+//  of the runtime of calling thread. Message is destroyed.
+//  After HOST_BREAKER_THRESHOLD consecutive SNMP timeouts the host stops
+//  evaluating functions, it just probes the device with one get request,
+//  first after the shortest function interval, then with doubling backoff.
+//  Evaluation resumes once the probe is answered.
+ZM_METRIC_PRIVATE void
+    host_handle (host_t *self, zmsg_t **msg_p, zsock_t *output, lua_runtime_t *runtime);
+
+ZM_METRIC_PRIVATE void
+    host_remove_function (host_t *self, const char *name);
+
+ZM_METRIC_PRIVATE void
+    host_remove_functions (host_t *self);
+
+//  Append circuit breaker counters of all hosts (breakers-open,
+//  breaker-trips, breaker-probes, breaker-skipped) to the message as
+//  name/value frame pairs
+ZM_METRIC_PRIVATE void
+    host_breaker_stats (zmsg_t *msg);
+
+//  freefn for zhash/zlist
+ZM_METRIC_PRIVATE void
+    host_freefn (void *self);
+
+//  Self test of this class
+ZM_METRIC_PRIVATE void
+    host_test (bool verbose);
+
+//  @end
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,448 @@
+/*  =========================================================================
+    lua_arena - Size class pool allocator with memory cap for lua states
+
+    Copyright (C) 2016 - 2017 Tomas Halman
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    lua_arena - Size class pool allocator with memory cap for lua states
+@discuss
+    Most allocations of lua are small objects (strings, tables, closures,
+    table nodes) created and freed on every evaluation. Arena keeps them
+    in pools of 16 byte size classes, freed blocks go to the free list of
+    their class and are reused without malloc. Lua passes the old size on
+    every free and realloc, so blocks need no header. Pools grow by chunks
+    which are returned to the system only when the arena is destroyed.
+
+    Arena counts bytes allocated by lua and refuses to grow over the
+    limit, so one rule can't bloat the whole process. Peak of the usage
+    can be reset before an evaluation to get the high-water mark of one
+    rule. Arena is used by one thread only, like its lua state.
+@end
+*/
+
+#include "zm_metric_classes.h"
+
+#include <lualib.h>
+#include <lauxlib.h>
+
+#define ARENA_GRAIN 16                      // size class step and alignment
+#define ARENA_CLASSES 16                    // pooled blocks up to 256 bytes
+#define ARENA_POOLED (ARENA_GRAIN * ARENA_CLASSES)
+#define ARENA_CHUNK_MIN 1024
+#define ARENA_CHUNK_MAX 65536
+
+//  Pool of one size class
+
+typedef struct {
+    void *free;                 // list of freed blocks
+    char *bump;                 // unused part of the last chunk
+    char *end;
+    size_t chunk;               // size of the next chunk
+} arena_class_t;
+
+//  Structure of our class
+
+struct _lua_arena_t {
+    arena_class_t classes [ARENA_CLASSES];
+    void *chunks;               // list of all chunks
+    size_t limit;               // 0 = unlimited
+    size_t used;
+    size_t peak;
+    size_t pooled;              // bytes of chunks
+    size_t large;               // bytes of blocks from malloc
+    uint64_t refused;
+};
+
+//  --------------------------------------------------------------------------
+//  Create a new lua_arena
+
+lua_arena_t *
+lua_arena_new (size_t limit)
+{
+    lua_arena_t *self = (lua_arena_t *) zmalloc (sizeof (lua_arena_t));
+    assert (self);
+    self->limit = limit;
+    for (int i = 0; i < ARENA_CLASSES; i++) {
+        size_t size = (size_t) (i + 1) * ARENA_GRAIN;
+        size_t chunk = 8 * size;
+        self->classes [i].chunk = chunk < ARENA_CHUNK_MIN ? ARENA_CHUNK_MIN : chunk;
+    }
+    return self;
+}
+
+//  --------------------------------------------------------------------------
+//  Destroy the lua_arena
+
+void
+lua_arena_destroy (lua_arena_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        lua_arena_t *self = *self_p;
+        void *chunk = self->chunks;
+        while (chunk) {
+            void *next = *(void **) chunk;
+            free (chunk);
+            chunk = next;
+        }
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+//  --------------------------------------------------------------------------
+//  Bytes counted for allocation of size
+
+static size_t
+s_cost (size_t size)
+{
+    if (size == 0) return 0;
+    if (size > ARENA_POOLED) return size;
+    return (size + ARENA_GRAIN - 1) / ARENA_GRAIN * ARENA_GRAIN;
+}
+
+//  --------------------------------------------------------------------------
+//  Get block of size, pooled or from malloc. Returns NULL if the system
+//  has no memory.
+
+static void *
+s_acquire (lua_arena_t *self, size_t size)
+{
+    if (size > ARENA_POOLED) {
+        void *block = malloc (size);
+        if (block) self->large += size;
+        return block;
+    }
+    size_t cost = s_cost (size);
+    arena_class_t *pool = &self->classes [cost / ARENA_GRAIN - 1];
+    if (pool->free) {
+        void *block = pool->free;
+        pool->free = *(void **) block;
+        return block;
+    }
+    if (pool->bump + cost > pool->end) {
+        // chunk starts with link to the previous one, blocks stay aligned
+        char *chunk = (char *) malloc (ARENA_GRAIN + pool->chunk);
+        if (!chunk) return NULL;
+        *(void **) chunk = self->chunks;
+        self->chunks = chunk;
+        self->pooled += ARENA_GRAIN + pool->chunk;
+        pool->bump = chunk + ARENA_GRAIN;
+        pool->end = pool->bump + pool->chunk;
+        if (pool->chunk < ARENA_CHUNK_MAX) pool->chunk *= 2;
+    }
+    void *block = pool->bump;
+    pool->bump += cost;
+    return block;
+}
+
+//  --------------------------------------------------------------------------
+//  Return block of size to its pool or to the system
+
+static void
+s_release (lua_arena_t *self, void *block, size_t size)
+{
+    if (size > ARENA_POOLED) {
+        free (block);
+        self->large -= size;
+        return;
+    }
+    arena_class_t *pool = &self->classes [s_cost (size) / ARENA_GRAIN - 1];
+    *(void **) block = pool->free;
+    pool->free = block;
+}
+
+//  --------------------------------------------------------------------------
+//  Large block shrinks to pooled size, but its class can't get a chunk.
+//  Block itself becomes the chunk, data move after the chunk link. Returns
+//  the new place of data or NULL if the system has no memory even for that.
+
+static void *
+s_adopt (lua_arena_t *self, void *ptr, size_t osize, size_t nsize)
+{
+    size_t cost = s_cost (nsize);
+    size_t size = osize;
+    if (size < ARENA_GRAIN + cost) {
+        // a few bytes short of the link
+        ptr = realloc (ptr, ARENA_GRAIN + cost);
+        if (!ptr) return NULL;
+        size = ARENA_GRAIN + cost;
+    }
+    char *chunk = (char *) ptr;
+    memmove (chunk + ARENA_GRAIN, chunk, nsize);
+    *(void **) chunk = self->chunks;
+    self->chunks = chunk;
+    self->large -= osize;
+    self->pooled += size;
+    // rest of the block serves the class
+    arena_class_t *pool = &self->classes [cost / ARENA_GRAIN - 1];
+    pool->bump = chunk + ARENA_GRAIN + cost;
+    pool->end = chunk + size;
+    return chunk + ARENA_GRAIN;
+}
+
+//  --------------------------------------------------------------------------
+//  Allocation function of lua
+
+void *
+lua_arena_alloc (void *ud, void *ptr, size_t osize, size_t nsize)
+{
+    lua_arena_t *self = (lua_arena_t *) ud;
+    // lua 5.2+ passes type of the new object in osize
+    if (!ptr) osize = 0;
+    size_t ocost = s_cost (osize);
+    size_t ncost = s_cost (nsize);
+
+    if (nsize == 0) {
+        if (ptr) {
+            s_release (self, ptr, osize);
+            self->used -= ocost;
+        }
+        return NULL;
+    }
+    if (ncost > ocost && self->limit && self->used - ocost + ncost > self->limit) {
+        ++self->refused;
+        return NULL;
+    }
+    // the same size class, block fits already
+    if (ptr && ncost == ocost)
+        return ptr;
+
+    void *block;
+    if (ptr && osize > ARENA_POOLED && nsize > ARENA_POOLED) {
+        block = realloc (ptr, nsize);
+        if (block)
+            self->large = self->large - osize + nsize;
+        else
+        if (nsize < osize) {
+            // lua expects shrinking never fails, keep the bigger block,
+            // it is freed later with the smaller size
+            block = ptr;
+            self->large = self->large - osize + nsize;
+        }
+    }
+    else {
+        block = s_acquire (self, nsize);
+        if (block && ptr) {
+            memcpy (block, ptr, osize < nsize ? osize : nsize);
+            s_release (self, ptr, osize);
+        }
+        else
+        if (!block && ptr && nsize < osize) {
+            if (osize > ARENA_POOLED)
+                block = s_adopt (self, ptr, osize, nsize);
+            else
+                // pooled block is safe to free later to a smaller class
+                block = ptr;
+        }
+    }
+    if (!block)
+        return NULL;
+    self->used = self->used - ocost + ncost;
+    if (self->used > self->peak) self->peak = self->used;
+    return block;
+}
+
+//  --------------------------------------------------------------------------
+//  Set max bytes allocated by lua
+
+void
+lua_arena_set_limit (lua_arena_t *self, size_t limit)
+{
+    if (!self) return;
+    self->limit = limit;
+}
+
+//  --------------------------------------------------------------------------
+//  Max bytes allocated by lua
+
+size_t
+lua_arena_limit (lua_arena_t *self)
+{
+    if (!self) return 0;
+    return self->limit;
+}
+
+//  --------------------------------------------------------------------------
+//  Bytes allocated by lua now
+
+size_t
+lua_arena_used (lua_arena_t *self)
+{
+    if (!self) return 0;
+    return self->used;
+}
+
+//  --------------------------------------------------------------------------
+//  Max bytes allocated by lua since the last reset
+
+size_t
+lua_arena_peak (lua_arena_t *self)
+{
+    if (!self) return 0;
+    return self->peak;
+}
+
+//  --------------------------------------------------------------------------
+//  Start measuring the peak again
+
+void
+lua_arena_reset_peak (lua_arena_t *self)
+{
+    if (!self) return;
+    self->peak = self->used;
+}
+
+//  --------------------------------------------------------------------------
+//  Bytes taken from the system
+
+size_t
+lua_arena_reserved (lua_arena_t *self)
+{
+    if (!self) return 0;
+    return self->pooled + self->large;
+}
+
+//  --------------------------------------------------------------------------
+//  Number of allocations refused because of the limit
+
+uint64_t
+lua_arena_refused (lua_arena_t *self)
+{
+    if (!self) return 0;
+    return self->refused;
+}
+
+//  --------------------------------------------------------------------------
+//  Self test of this class
+
+void
+lua_arena_test (bool verbose)
+{
+    printf (" * lua_arena: ");
+
+    //  @selftest
+    lua_arena_t *self = lua_arena_new (4096);
+    assert (self);
+
+    // small blocks are rounded to their class and reused
+    void *small = lua_arena_alloc (self, NULL, 0, 20);
+    assert (small);
+    assert (((uintptr_t) small % ARENA_GRAIN) == 0);
+    assert (lua_arena_used (self) == 32);
+    memset (small, 'x', 20);
+    assert (lua_arena_alloc (self, small, 20, 30) == small);
+    assert (lua_arena_alloc (self, small, 30, 0) == NULL);
+    assert (lua_arena_used (self) == 0);
+    assert (lua_arena_alloc (self, NULL, 0, 17) == small);
+    size_t reserved = lua_arena_reserved (self);
+    assert (reserved > 0);
+
+    // growing moves data to bigger block
+    memcpy (small, "0123456789abcdef", 17);
+    void *bigger = lua_arena_alloc (self, small, 17, 1000);
+    assert (bigger && bigger != small);
+    assert (memcmp (bigger, "0123456789abcdef", 17) == 0);
+    assert (lua_arena_used (self) == 1000);
+    assert (lua_arena_peak (self) == 1000);
+    void *smaller = lua_arena_alloc (self, bigger, 1000, 10);
+    assert (smaller);
+    assert (memcmp (smaller, "0123456789", 10) == 0);
+    assert (lua_arena_used (self) == 16);
+    assert (lua_arena_peak (self) == 1000);
+    lua_arena_reset_peak (self);
+    assert (lua_arena_peak (self) == 16);
+
+    // limit is hard, shrinking always works
+    assert (lua_arena_alloc (self, NULL, 0, 5000) == NULL);
+    assert (lua_arena_refused (self) == 1);
+    void *large = lua_arena_alloc (self, NULL, 0, 4000);
+    assert (large);
+    assert (lua_arena_alloc (self, large, 4000, 4100) == NULL);
+    large = lua_arena_alloc (self, large, 4000, 300);
+    assert (large);
+    lua_arena_alloc (self, large, 300, 0);
+    lua_arena_alloc (self, smaller, 10, 0);
+    assert (lua_arena_used (self) == 0);
+    lua_arena_destroy (&self);
+    assert (self == NULL);
+
+    // large block shrinking to a class which can't get a chunk becomes
+    // the chunk of that class
+    self = lua_arena_new (0);
+    large = lua_arena_alloc (self, NULL, 0, 1000);
+    assert (large);
+    memcpy (large, "0123456789", 10);
+    reserved = lua_arena_reserved (self);
+    self->classes [3].chunk = SIZE_MAX / 2;
+    small = lua_arena_alloc (self, large, 1000, 60);
+    assert (small);
+    assert (memcmp (small, "0123456789", 10) == 0);
+    assert (lua_arena_used (self) == 64);
+    assert (lua_arena_reserved (self) == reserved);
+    void *next = lua_arena_alloc (self, NULL, 0, 50);
+    assert (next == (char *) small + 64);
+    lua_arena_alloc (self, next, 50, 0);
+    lua_arena_alloc (self, small, 60, 0);
+    assert (lua_arena_used (self) == 0);
+    assert (lua_arena_alloc (self, NULL, 0, 60) == small);
+
+    // block too short for the chunk link grows a bit first
+    large = lua_arena_alloc (self, NULL, 0, 260);
+    assert (large);
+    memcpy (large, "0123456789", 10);
+    self->classes [ARENA_CLASSES - 1].chunk = SIZE_MAX / 2;
+    small = lua_arena_alloc (self, large, 260, 250);
+    assert (small);
+    assert (memcmp (small, "0123456789", 10) == 0);
+    assert (lua_arena_used (self) == 64 + 256);
+    assert (lua_arena_alloc (self, NULL, 0, 250) == NULL);
+    lua_arena_alloc (self, small, 250, 0);
+    assert (lua_arena_alloc (self, NULL, 0, 250) == small);
+    lua_arena_destroy (&self);
+
+    // lua state in the arena, lua 5.1 has no emergency collection, so
+    // garbage counts too
+    self = lua_arena_new (1024 * 1024);
+    lua_State *L = lua_newstate (lua_arena_alloc, self);
+    // 64 bit LuaJIT without GC64 can't use own allocator
+    if (L) {
+        luaL_openlibs (L);
+        assert (luaL_dostring (L, "local t = {} for i = 1, 1000 do t [i] = 'item ' .. i end return #t") == 0);
+        assert (lua_tonumber (L, -1) == 1000);
+        lua_settop (L, 0);
+        assert (lua_arena_used (self) > 0);
+        assert (lua_arena_used (self) <= lua_arena_reserved (self));
+        // table over the limit fails, state stays usable
+        assert (luaL_dostring (L, "local t = {} for i = 1, 1000000 do t [i] = 'item ' .. i end") != 0);
+        assert (lua_arena_refused (self) > 0);
+        lua_settop (L, 0);
+        lua_gc (L, LUA_GCCOLLECT, 0);
+        assert (lua_arena_used (self) < 1024 * 1024);
+        assert (luaL_dostring (L, "return 1 + 1") == 0);
+        assert (lua_tonumber (L, -1) == 2);
+        lua_close (L);
+        assert (lua_arena_used (self) == 0);
+    }
+    lua_arena_destroy (&self);
+    //  @end
+
+    printf ("OK\n");
+}
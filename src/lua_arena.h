@@ -0,0 +1,85 @@
+/*  =========================================================================
+    lua_arena - Size class pool allocator with memory cap for lua states
+
+    Copyright (C) 2016 - 2017 Tomas Halman
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#ifndef LUA_ARENA_H_INCLUDED
+#define LUA_ARENA_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//  @interface
+//  Create a new arena, limit is max bytes allocated by lua, 0 = unlimited
+ZM_METRIC_PRIVATE lua_arena_t *
+    lua_arena_new (size_t limit);
+
+//  Destroy the arena with all its memory. Lua state using it must be
+//  closed first.
+ZM_METRIC_PRIVATE void
+    lua_arena_destroy (lua_arena_t **self_p);
+
+//  Allocation function for lua_newstate, ud is the arena. Blocks up to
+//  256 bytes are taken from pools of their size class, bigger ones from
+//  malloc. Growing over the limit fails, lua raises "not enough memory".
+ZM_METRIC_PRIVATE void *
+    lua_arena_alloc (void *ud, void *ptr, size_t osize, size_t nsize);
+
+//  Set max bytes allocated by lua, 0 = unlimited. Already allocated
+//  memory is kept when it is over the new limit.
+ZM_METRIC_PRIVATE void
+    lua_arena_set_limit (lua_arena_t *self, size_t limit);
+
+//  Max bytes allocated by lua, 0 = unlimited
+ZM_METRIC_PRIVATE size_t
+    lua_arena_limit (lua_arena_t *self);
+
+//  Bytes allocated by lua now (sizes of pooled blocks rounded up to their
+//  size class)
+ZM_METRIC_PRIVATE size_t
+    lua_arena_used (lua_arena_t *self);
+
+//  Max bytes allocated by lua since creation or the last reset
+ZM_METRIC_PRIVATE size_t
+    lua_arena_peak (lua_arena_t *self);
+
+//  Start measuring the peak again from bytes used now
+ZM_METRIC_PRIVATE void
+    lua_arena_reset_peak (lua_arena_t *self);
+
+//  Bytes taken from the system, pools including free blocks
+ZM_METRIC_PRIVATE size_t
+    lua_arena_reserved (lua_arena_t *self);
+
+//  Number of allocations refused because of the limit
+ZM_METRIC_PRIVATE uint64_t
+    lua_arena_refused (lua_arena_t *self);
+
+//  Self test of this class
+ZM_METRIC_PRIVATE void
+    lua_arena_test (bool verbose);
+
+//  @end
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
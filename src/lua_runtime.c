@@ -0,0 +1,1007 @@
+/*  =========================================================================
+    lua_runtime - Lua state of one worker shared by all rules
+
+    Copyright (C) 2016 - 2017 Tomas Halman
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    lua_runtime - Lua state of one worker shared by all rules
+@discuss
+    Every worker thread has one lua state instead of one state per host
+    and rule. Code of a rule is kept once per process (lua_code_t, shared
+    by all hosts with reference counting) and loaded to the state of
+    a worker on first use. Each code gets its own environment table which
+    falls back to standard globals, so rules can't see each other's
+    globals. Standard globals are seen through read-only proxies, so no
+    rule can change string or math for the others. Host specific values
+    (ip, credentials) are passed to main as arguments. Globals of a rule
+    are shared by all its hosts in the worker and host moves between
+    workers, so values kept for the next evaluation of the host belong to
+    ctx.state. Its strings, numbers and booleans are copied out of the lua
+    state after every successful evaluation (to a table the host owns) and
+    back to ctx.state before the next one.
+
+    Every evaluation has a budget of lua instructions and of wall-clock
+    time, counted by a hook called every LUA_RUNTIME_HOOK_PERIOD
+    instructions. Evaluation over the budget is aborted with an error, so
+    a rule with an endless loop can't block its worker. Hook can't run
+    while SNMP functions wait for responses, so they get the time left to
+    the deadline as the timeout of their requests. With LuaJIT the hook is not called from compiled code, only the
+    interpreted parts of rules are counted.
+
+    Lua state allocates from its arena (lua_arena) with a limit of bytes
+    common for all runtimes. Evaluation which needs more fails with "not
+    enough memory" and the state is collected. High-water mark of every
+    evaluation is kept per code and reported by lua_runtime_stats.
+@end
+*/
+
+#include "zm_metric_classes.h"
+
+#include <lualib.h>
+#include <lauxlib.h>
+
+//  Code of one rule
+
+struct _lua_code_t {
+    char *key;                  // name/hash of code
+    char *name;
+    char *code;                 // source or precompiled chunk
+    size_t size;
+    size_t refs;
+    size_t memory_peak;         // bytes, max of all evaluations
+};
+
+//  Default budget of one evaluation
+#define LUA_RUNTIME_MAX_INSTRUCTIONS 100000000
+#define LUA_RUNTIME_MAX_TIME 30000          // ms
+#define LUA_RUNTIME_HOOK_PERIOD 1000        // instructions
+#define LUA_RUNTIME_MEMORY_LIMIT (256 * 1024 * 1024)
+
+//  Why evaluation was aborted
+#define LUA_RUNTIME_WITHIN_BUDGET 0
+#define LUA_RUNTIME_INSTRUCTIONS 1
+#define LUA_RUNTIME_DEADLINE 2
+
+//  Registry key of the runtime
+static const char *RUNTIME_KEY = "zmmetric.runtime";
+
+//  Aborted evaluations of all runtimes
+static pthread_mutex_t s_budget_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t s_budget_instructions = 0;
+static uint64_t s_budget_deadline = 0;
+static uint64_t s_memory_exceeded = 0;
+static size_t s_memory_limit = LUA_RUNTIME_MEMORY_LIMIT;
+
+//  All codes of the process, key -> lua_code_t
+static pthread_mutex_t s_codes_mutex = PTHREAD_MUTEX_INITIALIZER;
+static zhash_t *s_codes = NULL;
+static uint64_t s_codes_generation = 0;    // incremented when code is freed
+
+//  Structure of our class
+
+struct _lua_runtime_t {
+    lua_State *lua;
+    zhash_t *loaded;            // key -> registry reference of environment
+    uint64_t generation;        // of s_codes when loaded were checked
+    uint64_t max_instructions;  // budget of following evaluations
+    unsigned int max_time;      // ms
+    uint64_t instructions;      // used by running evaluation
+    int64_t deadline;           // zclock_mono of running evaluation
+    int exceeded;               // LUA_RUNTIME_INSTRUCTIONS or _DEADLINE
+    zhash_t *state;             // ctx.state of following calls, not owned
+};
+
+//  --------------------------------------------------------------------------
+//  Create a new lua_runtime
+
+lua_runtime_t *
+lua_runtime_new (void)
+{
+    lua_runtime_t *self = (lua_runtime_t *) zmalloc (sizeof (lua_runtime_t));
+    assert (self);
+    self->lua = luasnmp_new ();
+    assert (self->lua);
+    self->loaded = zhash_new ();
+    assert (self->loaded);
+    self->max_instructions = LUA_RUNTIME_MAX_INSTRUCTIONS;
+    self->max_time = LUA_RUNTIME_MAX_TIME;
+    lua_pushlightuserdata (self->lua, self);
+    lua_setfield (self->lua, LUA_REGISTRYINDEX, RUNTIME_KEY);
+    // string methods are shared by all rules, hide their table
+    lua_pushliteral (self->lua, "");
+    lua_getmetatable (self->lua, -1);
+    lua_pushboolean (self->lua, 0);
+    lua_setfield (self->lua, -2, "__metatable");
+    lua_pop (self->lua, 2);
+    return self;
+}
+
+//  --------------------------------------------------------------------------
+//  Destroy the lua_runtime
+
+void
+lua_runtime_destroy (lua_runtime_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        lua_runtime_t *self = *self_p;
+        zhash_destroy (&self->loaded);
+        luasnmp_destroy (&self->lua);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+//  --------------------------------------------------------------------------
+//  Lua state of the runtime
+
+lua_State *
+lua_runtime_state (lua_runtime_t *self)
+{
+    if (!self) return NULL;
+    return self->lua;
+}
+
+//  --------------------------------------------------------------------------
+//  Set budget of following evaluations
+
+void
+lua_runtime_set_budget (lua_runtime_t *self, uint64_t instructions, unsigned int msecs)
+{
+    if (!self) return;
+    self->max_instructions = instructions ? instructions : LUA_RUNTIME_MAX_INSTRUCTIONS;
+    self->max_time = msecs ? msecs : LUA_RUNTIME_MAX_TIME;
+}
+
+//  --------------------------------------------------------------------------
+//  Set table which keeps ctx.state of following calls
+
+void
+lua_runtime_set_state (lua_runtime_t *self, zhash_t *state)
+{
+    if (!self) return;
+    self->state = state;
+}
+
+//  --------------------------------------------------------------------------
+//  Count hook, aborts evaluation over the budget. Then the hook is called
+//  on every instruction and raises the error again, so rule can't catch it
+//  with pcall and continue.
+
+static void
+s_budget_hook (lua_State *L, lua_Debug *ar)
+{
+    lua_getfield (L, LUA_REGISTRYINDEX, RUNTIME_KEY);
+    lua_runtime_t *self = (lua_runtime_t *) lua_touserdata (L, -1);
+    lua_pop (L, 1);
+    if (!self) return;
+
+    if (!self->exceeded) {
+        self->instructions += LUA_RUNTIME_HOOK_PERIOD;
+        if (self->instructions > self->max_instructions)
+            self->exceeded = LUA_RUNTIME_INSTRUCTIONS;
+        else
+        if (zclock_mono () > self->deadline)
+            self->exceeded = LUA_RUNTIME_DEADLINE;
+        else
+            return;
+        lua_sethook (L, s_budget_hook, LUA_MASKCOUNT, 1);
+    }
+    if (self->exceeded == LUA_RUNTIME_INSTRUCTIONS)
+        luaL_error (L, "budget of %llu instructions exceeded", (unsigned long long) self->max_instructions);
+    else
+        luaL_error (L, "budget of %u ms exceeded", self->max_time);
+}
+
+//  --------------------------------------------------------------------------
+//  Set memory limit of lua states of all runtimes
+
+void
+lua_runtime_set_memory_limit (size_t bytes)
+{
+    pthread_mutex_lock (&s_budget_mutex);
+    s_memory_limit = bytes;
+    pthread_mutex_unlock (&s_budget_mutex);
+}
+
+//  --------------------------------------------------------------------------
+//  lua_pcall of the code within the budget and memory limit, aborted
+//  evaluations are counted, high-water mark of memory is kept by code
+
+static int
+s_pcall (lua_runtime_t *self, lua_code_t *code, int nargs, int nresults)
+{
+    lua_State *L = self->lua;
+    lua_arena_t *arena = luasnmp_arena (L);
+    pthread_mutex_lock (&s_budget_mutex);
+    lua_arena_set_limit (arena, s_memory_limit);
+    pthread_mutex_unlock (&s_budget_mutex);
+    size_t base = lua_arena_used (arena);
+    lua_arena_reset_peak (arena);
+    self->instructions = 0;
+    self->deadline = zclock_mono () + self->max_time;
+    self->exceeded = LUA_RUNTIME_WITHIN_BUDGET;
+    lua_sethook (L, s_budget_hook, LUA_MASKCOUNT, LUA_RUNTIME_HOOK_PERIOD);
+    luasnmp_set_deadline (L, self->deadline);
+    int rc = lua_pcall (L, nargs, nresults, 0);
+    luasnmp_set_deadline (L, 0);
+    lua_sethook (L, NULL, 0, 0);
+    if (rc != 0 && self->exceeded) {
+        pthread_mutex_lock (&s_budget_mutex);
+        if (self->exceeded == LUA_RUNTIME_INSTRUCTIONS)
+            ++s_budget_instructions;
+        else
+            ++s_budget_deadline;
+        pthread_mutex_unlock (&s_budget_mutex);
+    }
+    if (arena) {
+        size_t peak = lua_arena_peak (arena) - base;
+        pthread_mutex_lock (&s_codes_mutex);
+        if (peak > code->memory_peak) code->memory_peak = peak;
+        pthread_mutex_unlock (&s_codes_mutex);
+    }
+    if (rc == LUA_ERRMEM) {
+        pthread_mutex_lock (&s_budget_mutex);
+        ++s_memory_exceeded;
+        pthread_mutex_unlock (&s_budget_mutex);
+        // garbage of the failed evaluation must not fail the next one
+        lua_gc (L, LUA_GCCOLLECT, 0);
+    }
+    return rc;
+}
+
+//  --------------------------------------------------------------------------
+//  Write to read-only table
+
+static int
+s_readonly_newindex (lua_State *L)
+{
+    return luaL_error (L, "attempt to modify read-only table");
+}
+
+//  --------------------------------------------------------------------------
+//  Replace table on top of the stack with its read-only proxy: empty table
+//  which refuses writes and reads from shadow table. Shadow holds proxies
+//  of nested tables and falls back to the table for other values, so reads
+//  stay plain table lookups. Proxies are kept in cache (absolute index),
+//  table reachable many ways (_G, package.loaded) gets one proxy.
+
+static void
+s_push_readonly (lua_State *L, int cache)
+{
+    lua_pushvalue (L, -1);
+    lua_rawget (L, cache);
+    if (!lua_isnil (L, -1)) {
+        lua_replace (L, -2);
+        return;
+    }
+    lua_pop (L, 1);
+    lua_checkstack (L, 8);
+    int table = lua_gettop (L);
+    lua_newtable (L);
+    lua_pushvalue (L, table);
+    lua_pushvalue (L, -2);
+    lua_rawset (L, cache);      // before nested tables, they may refer back
+    lua_newtable (L);
+    lua_pushnil (L);
+    while (lua_next (L, table)) {
+        if (lua_istable (L, -1)) {
+            s_push_readonly (L, cache);
+            lua_pushvalue (L, -2);
+            lua_insert (L, -2);
+            lua_rawset (L, table + 2);
+        }
+        else
+            lua_pop (L, 1);
+    }
+    lua_createtable (L, 0, 1);
+    lua_pushvalue (L, table);
+    lua_setfield (L, -2, "__index");
+    lua_setmetatable (L, -2);
+    lua_createtable (L, 0, 3);
+    lua_insert (L, -2);
+    lua_setfield (L, -2, "__index");
+    lua_pushcfunction (L, s_readonly_newindex);
+    lua_setfield (L, -2, "__newindex");
+    lua_pushboolean (L, 0);
+    lua_setfield (L, -2, "__metatable");
+    lua_setmetatable (L, -2);
+    lua_replace (L, table);
+}
+
+//  --------------------------------------------------------------------------
+//  Load code to its own environment and keep reference of the environment.
+//  Returns 0 on success, -1 on error.
+
+static int
+s_load (lua_runtime_t *self, lua_code_t *code)
+{
+    lua_State *L = self->lua;
+    lua_settop (L, 0);
+    if (luaL_loadbuffer (L, code->code, code->size, code->name) != 0) {
+        zsys_error ("rule %s has an error: %s", code->name, lua_tostring (L, -1));
+        lua_settop (L, 0);
+        return -1;
+    }
+    // environment with read access to standard globals
+    lua_newtable (L);
+    lua_newtable (L);
+    lua_newtable (L);
+#if LUA_VERSION_NUM > 501
+    lua_rawgeti (L, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
+#else
+    lua_pushvalue (L, LUA_GLOBALSINDEX);
+#endif
+    s_push_readonly (L, lua_gettop (L) - 1);
+    lua_remove (L, -2);
+    lua_setfield (L, -2, "__index");
+    lua_setmetatable (L, -2);
+    lua_pushvalue (L, -1);
+#if LUA_VERSION_NUM > 501
+    lua_setupvalue (L, 1, 1);
+#else
+    lua_setfenv (L, 1);
+#endif
+    lua_insert (L, 1);
+    if (s_pcall (self, code, 0, 0) != 0) {
+        zsys_error ("rule %s has an error: %s", code->name, lua_tostring (L, -1));
+        lua_settop (L, 0);
+        return -1;
+    }
+    lua_getfield (L, 1, "main");
+    if (!lua_isfunction (L, -1)) {
+        zsys_error ("main function not found in rule %s", code->name);
+        lua_settop (L, 0);
+        return -1;
+    }
+    lua_pop (L, 1);
+    int ref = luaL_ref (L, LUA_REGISTRYINDEX);
+    zhash_insert (self->loaded, code->key, (void *) (intptr_t) ref);
+    lua_settop (L, 0);
+    return 0;
+}
+
+//  --------------------------------------------------------------------------
+//  Forget environments of codes which were freed since the last check
+
+static void
+s_sweep (lua_runtime_t *self)
+{
+    pthread_mutex_lock (&s_codes_mutex);
+    uint64_t generation = s_codes_generation;
+    if (generation == self->generation) {
+        pthread_mutex_unlock (&s_codes_mutex);
+        return;
+    }
+    zlist_t *stale = zlist_new ();
+    void *ref = zhash_first (self->loaded);
+    while (ref) {
+        const char *key = zhash_cursor (self->loaded);
+        if (!s_codes || !zhash_lookup (s_codes, key))
+            zlist_append (stale, (void *) key);
+        ref = zhash_next (self->loaded);
+    }
+    pthread_mutex_unlock (&s_codes_mutex);
+
+    const char *key = (const char *) zlist_first (stale);
+    while (key) {
+        luaL_unref (self->lua, LUA_REGISTRYINDEX, (int) (intptr_t) zhash_lookup (self->loaded, key));
+        zhash_delete (self->loaded, key);
+        key = (const char *) zlist_next (stale);
+    }
+    zlist_destroy (&stale);
+    self->generation = generation;
+}
+
+//  --------------------------------------------------------------------------
+//  Register code of the rule
+
+lua_code_t *
+lua_runtime_add (lua_runtime_t *self, const char *name, const char *code, size_t size)
+{
+    if (!self || !name || !code || !size) return NULL;
+
+    // FNV-1a, equal code of one rule gives equal key
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ (unsigned char) code [i]) * 1099511628211ULL;
+    char *key = zsys_sprintf ("%s/%016" PRIx64 "/%zu", name, hash, size);
+
+    pthread_mutex_lock (&s_codes_mutex);
+    lua_code_t *result = s_codes ? (lua_code_t *) zhash_lookup (s_codes, key) : NULL;
+    if (result) ++result->refs;
+    pthread_mutex_unlock (&s_codes_mutex);
+    if (result) {
+        zstr_free (&key);
+        return result;
+    }
+
+    result = (lua_code_t *) zmalloc (sizeof (lua_code_t));
+    assert (result);
+    result->key = key;
+    result->name = strdup (name);
+    result->code = (char *) malloc (size);
+    assert (result->code);
+    memcpy (result->code, code, size);
+    result->size = size;
+    result->refs = 1;
+    s_sweep (self);
+    if (!zhash_lookup (self->loaded, key) && s_load (self, result) != 0) {
+        zstr_free (&result->key);
+        zstr_free (&result->name);
+        zstr_free (&result->code);
+        free (result);
+        return NULL;
+    }
+
+    pthread_mutex_lock (&s_codes_mutex);
+    if (!s_codes) {
+        s_codes = zhash_new ();
+        assert (s_codes);
+    }
+    // other thread may have added the same code meanwhile
+    lua_code_t *existing = (lua_code_t *) zhash_lookup (s_codes, key);
+    if (existing) {
+        ++existing->refs;
+        zstr_free (&result->key);
+        zstr_free (&result->name);
+        zstr_free (&result->code);
+        free (result);
+        result = existing;
+    }
+    else
+        zhash_insert (s_codes, key, result);
+    pthread_mutex_unlock (&s_codes_mutex);
+    return result;
+}
+
+//  --------------------------------------------------------------------------
+//  Drop one reference of the code
+
+void
+lua_runtime_release (lua_code_t **code_p)
+{
+    if (!code_p || !*code_p) return;
+    lua_code_t *code = *code_p;
+    *code_p = NULL;
+
+    pthread_mutex_lock (&s_codes_mutex);
+    if (--code->refs == 0) {
+        zhash_delete (s_codes, code->key);
+        if (zhash_size (s_codes) == 0)
+            zhash_destroy (&s_codes);
+        ++s_codes_generation;
+        zstr_free (&code->key);
+        zstr_free (&code->name);
+        zstr_free (&code->code);
+        free (code);
+    }
+    pthread_mutex_unlock (&s_codes_mutex);
+}
+
+//  --------------------------------------------------------------------------
+//  Free value of state
+
+static void
+s_state_freefn (void *data)
+{
+    zchunk_t *value = (zchunk_t *) data;
+    zchunk_destroy (&value);
+}
+
+//  --------------------------------------------------------------------------
+//  Push ctx.state table with values of state. Keys are kept as "s<string>"
+//  or "n<number>", values as type byte ('s', 'n' or 'b') and data.
+
+static void
+s_state_push (lua_State *L, zhash_t *state)
+{
+    lua_createtable (L, 0, state ? (int) zhash_size (state) : 0);
+    zchunk_t *value = state ? (zchunk_t *) zhash_first (state) : NULL;
+    while (value) {
+        const char *key = zhash_cursor (state);
+        if (*key == 'n')
+            lua_pushnumber (L, (lua_Number) strtod (key + 1, NULL));
+        else
+            lua_pushstring (L, key + 1);
+        const char *data = (const char *) zchunk_data (value);
+        if (data [0] == 'n') {
+            lua_Number number;
+            memcpy (&number, data + 1, sizeof (number));
+            lua_pushnumber (L, number);
+        }
+        else
+        if (data [0] == 'b')
+            lua_pushboolean (L, data [1]);
+        else
+            lua_pushlstring (L, data + 1, zchunk_size (value) - 1);
+        lua_rawset (L, -3);
+        value = (zchunk_t *) zhash_next (state);
+    }
+}
+
+//  --------------------------------------------------------------------------
+//  Replace content of state with strings, numbers and booleans of the table
+//  at index, other values are dropped
+
+static void
+s_state_save (lua_State *L, int index, zhash_t *state)
+{
+    zhash_purge (state);
+    if (!lua_istable (L, index)) return;
+    lua_pushnil (L);
+    while (lua_next (L, index)) {
+        char key [256];
+        size_t size;
+        if (lua_type (L, -2) == LUA_TNUMBER)
+            snprintf (key, sizeof (key), "n%.17g", (double) lua_tonumber (L, -2));
+        else
+        if (lua_type (L, -2) == LUA_TSTRING) {
+            const char *string = lua_tolstring (L, -2, &size);
+            if (size >= sizeof (key) - 1 || strlen (string) != size) {
+                lua_pop (L, 1);
+                continue;
+            }
+            key [0] = 's';
+            memcpy (key + 1, string, size + 1);
+        }
+        else {
+            lua_pop (L, 1);
+            continue;
+        }
+        zchunk_t *value = NULL;
+        int type = lua_type (L, -1);
+        if (type == LUA_TNUMBER) {
+            lua_Number number = lua_tonumber (L, -1);
+            value = zchunk_new ("n", 1);
+            zchunk_extend (value, &number, sizeof (number));
+        }
+        else
+        if (type == LUA_TBOOLEAN) {
+            char data [2] = { 'b', (char) lua_toboolean (L, -1) };
+            value = zchunk_new (data, 2);
+        }
+        else
+        if (type == LUA_TSTRING) {
+            const char *string = lua_tolstring (L, -1, &size);
+            value = zchunk_new ("s", 1);
+            zchunk_extend (value, string, size);
+        }
+        if (value) {
+            zhash_insert (state, key, value);
+            zhash_freefn (state, key, s_state_freefn);
+        }
+        lua_pop (L, 1);
+    }
+}
+
+//  --------------------------------------------------------------------------
+//  Call main of the code
+
+int
+lua_runtime_call (lua_runtime_t *self, lua_code_t *code, const char *asset, const char *ip, const snmp_credentials_t *credentials)
+{
+    if (!self || !code) return -1;
+
+    lua_State *L = self->lua;
+    s_sweep (self);
+    void *ref = zhash_lookup (self->loaded, code->key);
+    if (!ref) {
+        if (s_load (self, code) != 0) return -1;
+        ref = zhash_lookup (self->loaded, code->key);
+    }
+    lua_settop (L, 0);
+    lua_rawgeti (L, LUA_REGISTRYINDEX, (int) (intptr_t) ref);
+    if (asset)
+        lua_pushstring (L, asset);
+    else
+        lua_pushnil (L);
+    lua_setfield (L, 1, "NAME");
+    lua_getfield (L, 1, "main");
+    lua_remove (L, 1);
+
+    lua_pushstring (L, ip);
+    lua_createtable (L, 0, 5);
+    lua_pushstring (L, asset);
+    lua_setfield (L, -2, "asset");
+    lua_pushstring (L, ip);
+    lua_setfield (L, -2, "ip");
+    if (credentials) {
+        lua_pushinteger (L, credentials->version);
+        lua_setfield (L, -2, "version");
+        lua_pushstring (L, credentials->community);
+        lua_setfield (L, -2, "community");
+    }
+    s_state_push (L, self->state);
+    lua_setfield (L, -2, "state");
+    // context stays below main to save ctx.state after the call
+    lua_pushvalue (L, -1);
+    lua_insert (L, 1);
+    luasnmp_set_credentials (L, credentials);
+    int rc = s_pcall (self, code, 2, 1);
+    luasnmp_set_credentials (L, NULL);
+    if (rc != 0) {
+        zsys_error ("rule %s failed on %s: %s", code->name, asset ? asset : "", lua_tostring (L, -1));
+        lua_settop (L, 0);
+        return -1;
+    }
+    if (self->state) {
+        lua_getfield (L, 1, "state");
+        s_state_save (L, lua_gettop (L), self->state);
+        lua_pop (L, 1);
+    }
+    lua_remove (L, 1);
+    return 0;
+}
+
+//  --------------------------------------------------------------------------
+//  Append counters of aborted evaluations to the message
+
+void
+lua_runtime_stats (zmsg_t *msg)
+{
+    if (!msg) return;
+
+    pthread_mutex_lock (&s_budget_mutex);
+    zmsg_addstr (msg, "budget-instructions");
+    zmsg_addstrf (msg, "%" PRIu64, s_budget_instructions);
+    zmsg_addstr (msg, "budget-deadline");
+    zmsg_addstrf (msg, "%" PRIu64, s_budget_deadline);
+    zmsg_addstr (msg, "memory-exceeded");
+    zmsg_addstrf (msg, "%" PRIu64, s_memory_exceeded);
+    pthread_mutex_unlock (&s_budget_mutex);
+
+    // high-water marks per rule, older codes of the rule included
+    zhash_t *peaks = zhash_new ();
+    pthread_mutex_lock (&s_codes_mutex);
+    lua_code_t *code = s_codes ? (lua_code_t *) zhash_first (s_codes) : NULL;
+    while (code) {
+        size_t peak = (size_t) (uintptr_t) zhash_lookup (peaks, code->name);
+        if (code->memory_peak > peak)
+            zhash_update (peaks, code->name, (void *) (uintptr_t) code->memory_peak);
+        code = (lua_code_t *) zhash_next (s_codes);
+    }
+    pthread_mutex_unlock (&s_codes_mutex);
+    void *peak = zhash_first (peaks);
+    while (peak) {
+        zmsg_addstrf (msg, "memory-peak/%s", zhash_cursor (peaks));
+        zmsg_addstrf (msg, "%zu", (size_t) (uintptr_t) peak);
+        peak = zhash_next (peaks);
+    }
+    zhash_destroy (&peaks);
+}
+
+//  --------------------------------------------------------------------------
+//  High-water mark of memory of evaluations of the code
+
+size_t
+lua_runtime_memory_peak (lua_code_t *code)
+{
+    if (!code) return 0;
+    pthread_mutex_lock (&s_codes_mutex);
+    size_t peak = code->memory_peak;
+    pthread_mutex_unlock (&s_codes_mutex);
+    return peak;
+}
+
+//  --------------------------------------------------------------------------
+//  Number of codes loaded to the runtime
+
+size_t
+lua_runtime_loaded (lua_runtime_t *self)
+{
+    if (!self) return 0;
+    s_sweep (self);
+    return zhash_size (self->loaded);
+}
+
+//  --------------------------------------------------------------------------
+//  Self test of this class
+
+void
+lua_runtime_test (bool verbose)
+{
+    printf (" * lua_runtime: ");
+
+    //  @selftest
+    snmpsim_t *sim = snmpsim_new ();
+    assert (snmpsim_set (sim, ".1.3.6.1.2.1.1.5.0", "STRING", "device") == 0);
+    const char *endpoint = snmpsim_bind (sim, "127.0.0.1", 0);
+    assert (endpoint);
+    zactor_t *agent = zactor_new (snmpsim_actor, sim);
+    assert (agent);
+
+    lua_runtime_t *self = lua_runtime_new ();
+    assert (self);
+    lua_runtime_t *other = lua_runtime_new ();
+    assert (other);
+    lua_State *L = lua_runtime_state (self);
+
+    // invalid code is refused
+    assert (lua_runtime_add (self, "broken", "function main (host", 19) == NULL);
+    assert (lua_runtime_add (self, "nomain", "x = 1", 5) == NULL);
+    assert (lua_runtime_loaded (self) == 0);
+
+    // hosts with the same rule share the code
+    const char *counter =
+        "count = 0 "
+        "function main (host, ctx) count = count + 1 return { 'count', count, '', ctx.asset } end";
+    lua_code_t *first = lua_runtime_add (self, "counter", counter, strlen (counter));
+    assert (first);
+    lua_code_t *second = lua_runtime_add (other, "counter", counter, strlen (counter));
+    assert (second == first);
+
+    // globals of rules are isolated
+    const char *shadowing = "count = 100 function main (host) return { 'shadow', count, '' } end";
+    lua_code_t *shadow = lua_runtime_add (self, "shadow", shadowing, strlen (shadowing));
+    assert (shadow);
+    assert (lua_runtime_loaded (self) == 2);
+    assert (lua_runtime_call (self, first, "asset1", "127.0.0.1", NULL) == 0);
+    assert (lua_istable (L, -1));
+    lua_rawgeti (L, -1, 2);
+    assert (lua_tonumber (L, -1) == 1);
+    lua_rawgeti (L, -2, 4);
+    assert (streq (lua_tostring (L, -1), "asset1"));
+    lua_settop (L, 0);
+    assert (lua_runtime_call (self, shadow, "asset1", "127.0.0.1", NULL) == 0);
+    lua_rawgeti (L, -1, 2);
+    assert (lua_tonumber (L, -1) == 100);
+    lua_settop (L, 0);
+    lua_getglobal (L, "count");
+    assert (lua_isnil (L, -1));
+    lua_settop (L, 0);
+
+    // other runtime loads the code on first use
+    assert (lua_runtime_loaded (other) == 0);
+    assert (lua_runtime_call (other, second, "asset2", "127.0.0.1", NULL) == 0);
+    assert (lua_runtime_loaded (other) == 1);
+    lua_settop (lua_runtime_state (other), 0);
+
+    // credentials come with the call, not from globals
+    const char *getter =
+        "function main (host, ctx) return { 'name', snmp_get (host, '.1.3.6.1.2.1.1.5.0'), '', ctx.community } end";
+    lua_code_t *snmp = lua_runtime_add (self, "snmp", getter, strlen (getter));
+    assert (snmp);
+    snmp_credentials_t credentials = { 2, "public" };
+    assert (lua_runtime_call (self, snmp, "asset1", endpoint, &credentials) == 0);
+    lua_rawgeti (L, -1, 2);
+    assert (streq (lua_tostring (L, -1), "device"));
+    lua_rawgeti (L, -2, 4);
+    assert (streq (lua_tostring (L, -1), "public"));
+    lua_settop (L, 0);
+    assert (lua_runtime_call (self, snmp, "asset1", endpoint, NULL) == 0);
+    lua_rawgeti (L, -1, 2);
+    assert (lua_isnil (L, -1));
+    lua_settop (L, 0);
+
+    // state of the rule is kept per host and follows the host to other
+    // runtimes, globals of the rule are shared by hosts of the runtime
+    const char *stateful =
+        "calls = 0 "
+        "function main (host, ctx) "
+        "    calls = calls + 1 "
+        "    ctx.state.count = (ctx.state.count or 0) + 1 "
+        "    ctx.state [1] = not ctx.state [1] "
+        "    ctx.state.last = ctx.asset "
+        "    ctx.state.skipped = {} "
+        "    return { 'count', ctx.state.count, '', ctx.state.last, 'calls', calls, '' } "
+        "end";
+    lua_code_t *counting = lua_runtime_add (self, "counting", stateful, strlen (stateful));
+    assert (counting);
+    zhash_t *state1 = zhash_new ();
+    zhash_t *state2 = zhash_new ();
+    const char *hosts [] = { "asset1", "asset2", "asset1", "asset1", "asset2" };
+    const int counts [] = { 1, 1, 2, 3, 2 };
+    for (int i = 0; i < 5; i++) {
+        lua_runtime_t *runtime = i % 2 ? other : self;
+        lua_State *state = lua_runtime_state (runtime);
+        lua_runtime_set_state (runtime, streq (hosts [i], "asset1") ? state1 : state2);
+        assert (lua_runtime_call (runtime, counting, hosts [i], "127.0.0.1", NULL) == 0);
+        lua_runtime_set_state (runtime, NULL);
+        lua_rawgeti (state, -1, 2);
+        assert (lua_tonumber (state, -1) == counts [i]);
+        lua_rawgeti (state, -2, 4);
+        assert (streq (lua_tostring (state, -1), hosts [i]));
+        lua_settop (state, 0);
+    }
+    assert (zhash_size (state1) == 3);
+    zchunk_t *saved = (zchunk_t *) zhash_lookup (state1, "slast");
+    assert (saved && zchunk_size (saved) == 7);
+    assert (memcmp (zchunk_data (saved), "sasset1", 7) == 0);
+    saved = (zchunk_t *) zhash_lookup (state1, "n1");
+    assert (saved && zchunk_data (saved) [0] == 'b' && zchunk_data (saved) [1] == 1);
+    assert (zhash_lookup (state1, "sskipped") == NULL);
+    // without state table every call starts empty
+    assert (lua_runtime_call (self, counting, "asset1", "127.0.0.1", NULL) == 0);
+    lua_rawgeti (L, -1, 2);
+    assert (lua_tonumber (L, -1) == 1);
+    lua_rawgeti (L, -2, 6);
+    assert (lua_tonumber (L, -1) == 4);
+    lua_settop (L, 0);
+    zhash_destroy (&state1);
+    zhash_destroy (&state2);
+    lua_runtime_release (&counting);
+
+    // standard tables are read-only, the change would affect other rules
+    const char *vandals [] = {
+        "function main (host) string.upper = string.lower return {} end",
+        "function main (host) _G.count = 1 return {} end",
+        "function main (host) package.loaded.math.pi = 3 return {} end",
+        "function main (host) setmetatable (table, {}) return {} end",
+        "function main (host) getmetatable ('').__index.upper = nil return {} end"
+    };
+    for (int i = 0; i < 5; i++) {
+        lua_code_t *vandal = lua_runtime_add (self, "vandal", vandals [i], strlen (vandals [i]));
+        assert (vandal);
+        assert (lua_runtime_call (self, vandal, "asset1", "127.0.0.1", NULL) == -1);
+        lua_runtime_release (&vandal);
+    }
+    const char *reader =
+        "function main (host) "
+        "    return { 'upper', ('a'):upper () .. string.upper ('b') .. _G.string.upper ('c'), '', math.pi } "
+        "end";
+    lua_code_t *reading = lua_runtime_add (self, "reading", reader, strlen (reader));
+    assert (reading);
+    assert (lua_runtime_call (self, reading, "asset1", "127.0.0.1", NULL) == 0);
+    lua_rawgeti (L, -1, 2);
+    assert (streq (lua_tostring (L, -1), "ABC"));
+    lua_rawgeti (L, -2, 4);
+    assert (lua_tonumber (L, -1) > 3.14 && lua_tonumber (L, -1) < 3.15);
+    lua_settop (L, 0);
+    lua_runtime_release (&reading);
+
+    // runtime error is reported
+    const char *boom = "function main (host) error ('boom') end";
+    lua_code_t *failing = lua_runtime_add (self, "failing", boom, strlen (boom));
+    assert (failing);
+    assert (lua_runtime_call (self, failing, "asset1", "127.0.0.1", NULL) == -1);
+    assert (lua_gettop (L) == 0);
+
+    // precompiled rule is loaded from bytecode
+    rule_t *rule = rule_new ();
+    assert (rule_parse (rule, "{ \"name\" : \"compiled\", \"evaluation\" : \"function main (host) return { 'compiled', 42, '' } end\" }") == 0);
+    size_t size;
+    const char *bytecode = rule_bytecode (rule, &size);
+    assert (bytecode);
+    lua_code_t *compiled = lua_runtime_add (self, "compiled", bytecode, size);
+    assert (compiled);
+    rule_destroy (&rule);
+    assert (lua_runtime_call (self, compiled, "asset1", "127.0.0.1", NULL) == 0);
+    lua_rawgeti (L, -1, 2);
+    assert (lua_tonumber (L, -1) == 42);
+    lua_settop (L, 0);
+    lua_runtime_release (&compiled);
+
+    // endless loops are aborted, even when the rule catches errors
+    const char *endless = "function main (host) while true do end end";
+    lua_code_t *looping = lua_runtime_add (self, "looping", endless, strlen (endless));
+    assert (looping);
+    const char *stubborn =
+        "function main (host) "
+        "    while true do pcall (function () while true do end end) end "
+        "end";
+    lua_code_t *catching = lua_runtime_add (self, "catching", stubborn, strlen (stubborn));
+    assert (catching);
+    lua_runtime_set_budget (self, 100000, 0);
+    int64_t start = zclock_mono ();
+    assert (lua_runtime_call (self, looping, "asset1", "127.0.0.1", NULL) == -1);
+    assert (lua_runtime_call (self, catching, "asset1", "127.0.0.1", NULL) == -1);
+    lua_runtime_set_budget (self, 1000000000000ULL, 50);
+    assert (lua_runtime_call (self, looping, "asset1", "127.0.0.1", NULL) == -1);
+    assert (zclock_mono () - start < 5000);
+    assert (lua_gettop (L) == 0);
+    lua_runtime_set_budget (self, 0, 0);
+    zmsg_t *stats = zmsg_new ();
+    lua_runtime_stats (stats);
+    char *name = zmsg_popstr (stats);
+    assert (streq (name, "budget-instructions"));
+    zstr_free (&name);
+    char *value = zmsg_popstr (stats);
+    assert (atoi (value) >= 2);
+    zstr_free (&value);
+    name = zmsg_popstr (stats);
+    assert (streq (name, "budget-deadline"));
+    zstr_free (&name);
+    value = zmsg_popstr (stats);
+    assert (atoi (value) >= 1);
+    zstr_free (&value);
+    zmsg_destroy (&stats);
+    // the state is still usable
+    assert (lua_runtime_call (self, shadow, "asset1", "127.0.0.1", NULL) == 0);
+    lua_settop (L, 0);
+    lua_runtime_release (&looping);
+    lua_runtime_release (&catching);
+
+    // waiting for silent host ends with the budget
+    snmpsim_t *silent = snmpsim_new ();
+    const char *nowhere = snmpsim_bind (silent, "127.0.0.1", 0);
+    assert (nowhere);
+    lua_runtime_set_budget (self, 0, 300);
+    start = zclock_mono ();
+    assert (lua_runtime_call (self, snmp, "asset1", nowhere, &credentials) == 0);
+    assert (zclock_mono () - start < ZMSNMP_RTO_INITIAL);
+    lua_settop (L, 0);
+    lua_runtime_set_budget (self, 0, 0);
+    snmpsim_destroy (&silent);
+
+    // memory of evaluation is measured and limited
+    const char *hungry =
+        "function main (host) "
+        "    local t = {} for i = 1, 100000 do t [i] = 'item ' .. i end "
+        "    return { 'items', #t, '' } "
+        "end";
+    lua_code_t *table = lua_runtime_add (self, "table", hungry, strlen (hungry));
+    assert (table);
+    assert (lua_runtime_call (self, table, "asset1", "127.0.0.1", NULL) == 0);
+    lua_settop (L, 0);
+    lua_arena_t *arena = luasnmp_arena (L);
+    if (arena) {
+        size_t peak = lua_runtime_memory_peak (table);
+        assert (peak > 100000 * 16);
+        lua_gc (L, LUA_GCCOLLECT, 0);
+        lua_runtime_set_memory_limit (lua_arena_used (arena) + peak / 2);
+        assert (lua_runtime_call (self, table, "asset1", "127.0.0.1", NULL) == -1);
+        assert (lua_runtime_memory_peak (table) == peak);
+        lua_runtime_set_memory_limit (LUA_RUNTIME_MEMORY_LIMIT);
+        assert (lua_runtime_call (self, shadow, "asset1", "127.0.0.1", NULL) == 0);
+        lua_settop (L, 0);
+        stats = zmsg_new ();
+        lua_runtime_stats (stats);
+        bool exceeded = false;
+        bool reported = false;
+        name = zmsg_popstr (stats);
+        while (name) {
+            value = zmsg_popstr (stats);
+            assert (value);
+            if (streq (name, "memory-exceeded"))
+                exceeded = atoi (value) >= 1;
+            if (streq (name, "memory-peak/table"))
+                reported = (size_t) atol (value) == peak;
+            zstr_free (&name);
+            zstr_free (&value);
+            name = zmsg_popstr (stats);
+        }
+        assert (exceeded && reported);
+        zmsg_destroy (&stats);
+    }
+    lua_runtime_release (&table);
+
+    // environment is dropped with the last reference
+    lua_runtime_release (&first);
+    assert (first == NULL);
+    assert (lua_runtime_loaded (other) == 1);
+    lua_runtime_release (&second);
+    assert (lua_runtime_loaded (other) == 0);
+    assert (lua_runtime_loaded (self) == 3);
+    lua_runtime_release (&shadow);
+    lua_runtime_release (&snmp);
+    lua_runtime_release (&failing);
+    assert (lua_runtime_loaded (self) == 0);
+
+    lua_runtime_destroy (&other);
+    lua_runtime_destroy (&self);
+    assert (self == NULL);
+    zactor_destroy (&agent);
+    snmpsim_destroy (&sim);
+    zmsnmp_reset ();
+    //  @end
+
+    printf ("OK\n");
+}
@@ -0,0 +1,117 @@
+/*  =========================================================================
+    lua_runtime - Lua state of one worker shared by all rules
+
+    Copyright (C) 2016 - 2017 Tomas Halman
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#ifndef LUA_RUNTIME_H_INCLUDED
+#define LUA_RUNTIME_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef LUA_RUNTIME_T_DEFINED
+typedef struct _lua_runtime_t lua_runtime_t;
+#define LUA_RUNTIME_T_DEFINED
+#endif
+
+//  Code of one rule, shared by all hosts and runtimes
+typedef struct _lua_code_t lua_code_t;
+
+//  @interface
+//  Create a new runtime with its own lua state with SNMP support. Runtime
+//  must be used from one thread only.
+ZM_METRIC_PRIVATE lua_runtime_t *
+    lua_runtime_new (void);
+
+//  Destroy the runtime
+ZM_METRIC_PRIVATE void
+    lua_runtime_destroy (lua_runtime_t **self_p);
+
+//  Lua state of the runtime
+ZM_METRIC_PRIVATE lua_State *
+    lua_runtime_state (lua_runtime_t *self);
+
+//  Register code of the rule, either lua source or bytecode compiled by
+//  rule_parse. Same name and code give the same object, so thousands of
+//  hosts with the rule keep one copy. Code is loaded to the runtime to
+//  check that it defines function main. Returns the code with one more
+//  reference, NULL if it has an error (error is logged).
+ZM_METRIC_PRIVATE lua_code_t *
+    lua_runtime_add (lua_runtime_t *self, const char *name, const char *code, size_t size);
+
+//  Drop one reference of the code, code is freed with the last one
+ZM_METRIC_PRIVATE void
+    lua_runtime_release (lua_code_t **code_p);
+
+//  Call main (ip, context) of the code. Code runs in its own environment
+//  of the runtime (loaded on first use), its globals are not visible to
+//  other rules and standard tables are read-only. Context is a table
+//  { asset, ip, version, community, state }, global NAME is the asset too.
+//  SNMP functions use the credentials during the call. Result of main is
+//  left on the stack. Returns 0 on success, -1 on error (error is logged
+//  and the stack is empty).
+ZM_METRIC_PRIVATE int
+    lua_runtime_call (lua_runtime_t *self, lua_code_t *code, const char *asset, const char *ip, const snmp_credentials_t *credentials);
+
+//  Set table which keeps ctx.state of following calls, NULL for an empty
+//  ctx.state on every call. Successful call stores strings, numbers and
+//  booleans of ctx.state there and the next call gets them back, in any
+//  runtime. Table is owned by the caller, host keeps one for every rule.
+ZM_METRIC_PRIVATE void
+    lua_runtime_set_state (lua_runtime_t *self, zhash_t *state);
+
+//  Set budget of following evaluations (and loads of codes): max number
+//  of lua instructions and max wall-clock time in ms, 0 for the default
+//  (100 million instructions, 30 s). Evaluation over the budget is aborted
+//  with an error.
+ZM_METRIC_PRIVATE void
+    lua_runtime_set_budget (lua_runtime_t *self, uint64_t instructions, unsigned int msecs);
+
+//  Set max bytes of lua state of every runtime, 0 = unlimited, default is
+//  256 MB. Applies to all runtimes from their next evaluation.
+ZM_METRIC_PRIVATE void
+    lua_runtime_set_memory_limit (size_t bytes);
+
+//  Append counters of evaluations aborted over the budget or memory limit
+//  of all runtimes (budget-instructions, budget-deadline, memory-exceeded)
+//  and memory high-water mark of every rule (memory-peak/<rule>) to the
+//  message
+ZM_METRIC_PRIVATE void
+    lua_runtime_stats (zmsg_t *msg);
+
+//  Max bytes allocated by one evaluation of the code in any runtime
+ZM_METRIC_PRIVATE size_t
+    lua_runtime_memory_peak (lua_code_t *code);
+
+//  Number of codes loaded to the runtime
+ZM_METRIC_PRIVATE size_t
+    lua_runtime_loaded (lua_runtime_t *self);
+
+//  Self test of this class
+ZM_METRIC_PRIVATE void
+    lua_runtime_test (bool verbose);
+
+//  @end
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -27,6 +27,17 @@
 #include <lua.h>
 #include <lauxlib.h>
 #include <lualib.h>
+//  LuaJIT headers are found only when configure got its flags (see
+//  project.xml), define ZM_METRIC_HAVE_LUAJIT for compilers without
+//  __has_include
+#if !defined (ZM_METRIC_HAVE_LUAJIT) && defined (__has_include)
+#   if __has_include (<luajit.h>)
+#       define ZM_METRIC_HAVE_LUAJIT
+#   endif
+#endif
+#ifdef ZM_METRIC_HAVE_LUAJIT
+#include <luajit.h>
+#endif
 #include <net-snmp/net-snmp-config.h>
 #include <net-snmp/net-snmp-includes.h>
 
@@ -34,86 +45,420 @@
 //  --------------------------------------------------------------------------
 //  Init net-snmp library
 
-void luasnmp_init()
+void luasnmp_init (void)
+{
+    zmsnmp_init ();
+}
+
+//  Registry key of response cache
+static const char *CACHE_KEY = "zmsnmp.cache";
+
+//  --------------------------------------------------------------------------
+//  Set response cache of the lua state
+
+void luasnmp_set_cache (lua_State *L, snmp_cache_t *cache)
+{
+    if (!L) return;
+    if (cache)
+        lua_pushlightuserdata (L, cache);
+    else
+        lua_pushnil (L);
+    lua_setfield (L, LUA_REGISTRYINDEX, CACHE_KEY);
+}
+
+//  --------------------------------------------------------------------------
+//  Get response cache of the lua state or NULL
+
+static snmp_cache_t *s_lua_cache (lua_State *L)
 {
-    init_snmp("zm-snmp-client");
+    lua_getfield (L, LUA_REGISTRYINDEX, CACHE_KEY);
+    snmp_cache_t *cache = (snmp_cache_t *) lua_touserdata (L, -1);
+    lua_pop (L, 1);
+    if (cache && snmp_cache_ttl (cache) == 0) return NULL;
+    return cache;
 }
 
+//  Registry keys of response snapshot
+static const char *SNAPSHOT_KEY = "zmsnmp.snapshot";
+static const char *REPLAY_KEY = "zmsnmp.replay";
+
 //  --------------------------------------------------------------------------
-//  SNMP get lua binding
+//  Set response snapshot of the lua state
+
+void luasnmp_set_snapshot (lua_State *L, snmp_snapshot_t *snapshot, bool replay)
+{
+    if (!L) return;
+    if (snapshot)
+        lua_pushlightuserdata (L, snapshot);
+    else
+        lua_pushnil (L);
+    lua_setfield (L, LUA_REGISTRYINDEX, SNAPSHOT_KEY);
+    lua_pushboolean (L, snapshot && replay);
+    lua_setfield (L, LUA_REGISTRYINDEX, REPLAY_KEY);
+}
+
+//  --------------------------------------------------------------------------
+//  Get response snapshot of the lua state or NULL, replay is set when
+//  responses come from the snapshot instead of the network
+
+static snmp_snapshot_t *s_lua_snapshot (lua_State *L, bool *replay)
+{
+    lua_getfield (L, LUA_REGISTRYINDEX, SNAPSHOT_KEY);
+    snmp_snapshot_t *snapshot = (snmp_snapshot_t *) lua_touserdata (L, -1);
+    lua_getfield (L, LUA_REGISTRYINDEX, REPLAY_KEY);
+    *replay = snapshot && lua_toboolean (L, -1);
+    lua_pop (L, 2);
+    return snapshot;
+}
+
+//  Registry key of deadline of the current evaluation
+static const char *DEADLINE_KEY = "zmsnmp.deadline";
+
+//  --------------------------------------------------------------------------
+//  Set deadline of SNMP functions of the lua state
+
+void luasnmp_set_deadline (lua_State *L, int64_t deadline)
+{
+    if (!L) return;
+    if (deadline)
+        lua_pushnumber (L, (lua_Number) deadline);
+    else
+        lua_pushnil (L);
+    lua_setfield (L, LUA_REGISTRYINDEX, DEADLINE_KEY);
+}
+
+//  --------------------------------------------------------------------------
+//  Deadline of the lua state, 0 if not set
+
+static int64_t s_lua_deadline (lua_State *L)
+{
+    lua_getfield (L, LUA_REGISTRYINDEX, DEADLINE_KEY);
+    int64_t deadline = (int64_t) lua_tonumber (L, -1);
+    lua_pop (L, 1);
+    return deadline;
+}
+
+//  Registry key of credentials of the current evaluation
+static const char *CREDENTIALS_KEY = "zmsnmp.credentials";
+
+//  --------------------------------------------------------------------------
+//  Set credentials used by SNMP functions of the lua state
+
+void luasnmp_set_credentials (lua_State *L, const snmp_credentials_t *credentials)
+{
+    if (!L) return;
+    if (credentials)
+        lua_pushlightuserdata (L, (void *) credentials);
+    else
+        lua_pushnil (L);
+    lua_setfield (L, LUA_REGISTRYINDEX, CREDENTIALS_KEY);
+}
+
+//  --------------------------------------------------------------------------
+//  Get credentials/snmpversion for host, set by luasnmp_set_credentials ()
+//  or from lua globals. Values are pushed to the lua stack, so community
+//  string is valid until they are popped. Returns false if credentials
+//  are not set.
+
+static bool s_lua_credentials (lua_State *L, snmp_credentials_t *credentials)
+{
+    lua_getfield (L, LUA_REGISTRYINDEX, CREDENTIALS_KEY);
+    const snmp_credentials_t *context = (const snmp_credentials_t *) lua_touserdata (L, -1);
+    lua_pop (L, 1);
+    if (context) {
+        *credentials = *context;
+        return credentials->community && credentials->version >= 1;
+    }
+    lua_getglobal(L, "SNMP_VERSION");
+    credentials->version = -1;
+    const char *versionstr = lua_tostring (L, -1);
+    if (versionstr)
+        credentials->version = atoi (versionstr);
+    lua_getglobal(L, "SNMP_COMMUNITY_NAME");
+    credentials->community = (char *)lua_tostring (L, -1);
+
+    return credentials->community && credentials->version >= 1;
+}
+
+//  --------------------------------------------------------------------------
+//  Push value to lua stack, numbers as lua numbers, everything else as
+//  string. Counter64 over 2^53 doesn't fit lua number exactly, it is pushed
+//  as decimal string. With typed also the type name is pushed. Returns
+//  number of pushed values.
+
+#define LUASNMP_EXACT_MAX (UINT64_C (1) << 53)
+
+static int s_push_value (lua_State *L, const zmsnmp_value_t *value, bool typed)
+{
+    if (value->type == ZMSNMP_TYPE_COUNTER64 && value->counter64 > LUASNMP_EXACT_MAX) {
+        char buffer [24];
+        snprintf (buffer, sizeof (buffer), "%" PRIu64, value->counter64);
+        lua_pushstring (L, buffer);
+    }
+    else
+    if (zmsnmp_value_is_number (value))
+        lua_pushnumber (L, (lua_Number) zmsnmp_value_number (value));
+    else
+        lua_pushlstring (L, value->string, value->size);
+    if (!typed) return 1;
+    lua_pushstring (L, zmsnmp_value_type_name (value));
+    return 2;
+}
+
+//  --------------------------------------------------------------------------
+//  SNMP get lua binding. With third argument true returns also type of the
+//  value.
 
 static int lua_snmp_get(lua_State *L)
 {
     const char* host = lua_tostring(L, 1);
     const char* oid = lua_tostring(L, 2);
+    bool typed = lua_toboolean (L, 3);
 
     if (!host || !oid ) {
         return 0;
     }
 
-    // get credentials/snmpversion for host
     snmp_credentials_t credentials;
-    lua_getglobal(L, "SNMP_VERSION");
-    credentials.version = -1;
-    const char *versionstr = lua_tostring (L, -1);
-    if (versionstr)
-        credentials.version = atoi (versionstr);
-    lua_getglobal(L, "SNMP_COMMUNITY_NAME");
-    credentials.community = (char *)lua_tostring (L, -1);
-
-    if (! credentials.community || (credentials.version < 1)) {
+    if (!s_lua_credentials (L, &credentials)) {
         return 0;
     }
-    char *result = zmsnmp_get (host, oid, &credentials);
+    bool replay;
+    snmp_snapshot_t *snapshot = s_lua_snapshot (L, &replay);
+    snmp_cache_t *cache = s_lua_cache (L);
+    char *key = cache || snapshot ? zmsnmp_oid_normalize (oid) : NULL;
+    if (replay) {
+        const zmsnmp_value_t *recorded = snmp_snapshot_get (snapshot, key);
+        zstr_free (&key);
+        return recorded ? s_push_value (L, recorded, typed) : 0;
+    }
+    const zmsnmp_value_t *cached = snmp_cache_get (cache, key);
+    if (cached) {
+        zstr_free (&key);
+        return s_push_value (L, cached, typed);
+    }
+    zmsnmp_set_deadline (s_lua_deadline (L));
+    zmsnmp_value_t *result = zmsnmp_get (host, oid, &credentials);
+    zmsnmp_set_deadline (0);
+    snmp_cache_put (cache, key, result);
+    snmp_snapshot_put (snapshot, key, result);
+    zstr_free (&key);
     if (result) {
-        lua_pushstring (L, result);
-        free (result);
-        return 1;
+        int pushed = s_push_value (L, result, typed);
+        zmsnmp_value_destroy (&result);
+        return pushed;
     } else {
         return 0;
     }
 }
 
 //  --------------------------------------------------------------------------
-//  SNMP get-next lua binding
+//  SNMP get-next lua binding. With third argument true returns also type
+//  of the value.
 
 static int lua_snmp_getnext(lua_State *L)
 {
     const char *host = lua_tostring(L, 1);
     const char *oid = lua_tostring(L, 2);
+    bool typed = lua_toboolean (L, 3);
     if (!host || !oid ) {
         return 0;
     }
 
-    // get credentials/snmpversion for host
     snmp_credentials_t credentials;
-    lua_getglobal(L, "SNMP_VERSION");
-    credentials.version = -1;
-    const char *versionstr = lua_tostring (L, -1);
-    if (versionstr)
-        credentials.version = atoi (versionstr);
-
-    lua_getglobal(L, "SNMP_COMMUNITY_NAME");
-    credentials.community = (char *)lua_tostring (L, -1);
-    if (! credentials.community || (credentials.version < 1)) {
+    if (!s_lua_credentials (L, &credentials)) {
         return 0;
     }
 
-    char *nextoid, *nextvalue;
+    bool replay;
+    snmp_snapshot_t *snapshot = s_lua_snapshot (L, &replay);
+    snmp_cache_t *cache = s_lua_cache (L);
+    char *key = cache || replay ? zmsnmp_oid_normalize (oid) : NULL;
+    if (replay) {
+        const zmsnmp_value_t *recordedvalue = NULL;
+        const char *recordedoid = snmp_snapshot_getnext (snapshot, key, &recordedvalue);
+        zstr_free (&key);
+        if (!recordedoid) return 0;
+        lua_pushstring (L, recordedoid);
+        return 1 + s_push_value (L, recordedvalue, typed);
+    }
+    const zmsnmp_value_t *cachedvalue = NULL;
+    const char *cachedoid = snmp_cache_getnext (cache, key, &cachedvalue);
+    if (cachedoid && cachedvalue) {
+        lua_pushstring (L, cachedoid);
+        zstr_free (&key);
+        return 1 + s_push_value (L, cachedvalue, typed);
+    }
+
+    char *nextoid;
+    zmsnmp_value_t *nextvalue;
+    zmsnmp_set_deadline (s_lua_deadline (L));
     zmsnmp_getnext (host, oid, &credentials, &nextoid, &nextvalue);
+    zmsnmp_set_deadline (0);
+    if (nextoid && nextvalue) {
+        snmp_cache_putnext (cache, key, nextoid, nextvalue);
+        snmp_snapshot_put (snapshot, nextoid, nextvalue);
+    }
+    zstr_free (&key);
     if (nextoid && nextvalue) {
         lua_pushstring (L, nextoid);
-        lua_pushstring (L, nextvalue);
+        int pushed = 1 + s_push_value (L, nextvalue, typed);
         free (nextoid);
-        free (nextvalue);
-        return 2;
+        zmsnmp_value_destroy (&nextvalue);
+        return pushed;
     } else {
         if (nextoid) free (nextoid);
-        if (nextvalue) free (nextvalue);
+        zmsnmp_value_destroy (&nextvalue);
         return 0;
     }
 }
 
+//  --------------------------------------------------------------------------
+//  SNMP get of many oids lua binding. Returns table with value of every
+//  requested oid on the same index (nil if agent did not return it) or
+//  nothing if host does not respond.
+
+static int lua_snmp_get_many(lua_State *L)
+{
+    const char *host = lua_tostring(L, 1);
+    if (!host || !lua_istable (L, 2)) {
+        return 0;
+    }
+
+    snmp_credentials_t credentials;
+    if (!s_lua_credentials (L, &credentials)) {
+        return 0;
+    }
+
+    bool replay;
+    snmp_snapshot_t *snapshot = s_lua_snapshot (L, &replay);
+    snmp_cache_t *cache = s_lua_cache (L);
+    int count = (int) lua_objlen (L, 2);
+    zlist_t *oids = zlist_new ();
+    zlist_autofree (oids);
+    char **keys = (char **) zmalloc ((count + 1) * sizeof (char *));
+    // copies, later lookups and puts of duplicate oids may free the entries
+    zmsnmp_value_t **cached = (zmsnmp_value_t **) zmalloc ((count + 1) * sizeof (zmsnmp_value_t *));
+    assert (keys && cached);
+    for (int i = 1; i <= count; i++) {
+        lua_rawgeti (L, 2, i);
+        const char *oid = lua_tostring (L, -1);
+        keys [i - 1] = zmsnmp_oid_normalize (oid);
+        // ask only for oids not in the cache
+        const zmsnmp_value_t *hit = NULL;
+        if (replay)
+            hit = snmp_snapshot_get (snapshot, keys [i - 1]);
+        else
+        if (cache)
+            hit = snmp_cache_get (cache, keys [i - 1]);
+        cached [i - 1] = hit ? zmsnmp_value_dup (hit) : NULL;
+        if (keys [i - 1] && !cached [i - 1] && !replay)
+            zlist_append (oids, keys [i - 1]);
+        lua_pop (L, 1);
+    }
+
+    zmsnmp_set_deadline (s_lua_deadline (L));
+    zhash_t *values = zlist_size (oids) ? zmsnmp_get_many (host, oids, &credentials) : NULL;
+    zmsnmp_set_deadline (0);
+    bool failed = zlist_size (oids) && !values;
+    zlist_destroy (&oids);
+    if (failed) {
+        for (int i = 0; i < count; i++) {
+            zstr_free (&keys [i]);
+            zmsnmp_value_destroy (&cached [i]);
+        }
+        free (keys);
+        free (cached);
+        return 0;
+    }
+    lua_createtable (L, count, 0);
+    for (int i = 0; i < count; i++) {
+        const zmsnmp_value_t *value = cached [i];
+        if (!value && keys [i] && values) {
+            value = (const zmsnmp_value_t *) zhash_lookup (values, keys [i]);
+            snmp_cache_put (cache, keys [i], value);
+            snmp_snapshot_put (snapshot, keys [i], value);
+        }
+        if (value) {
+            s_push_value (L, value, false);
+            lua_rawseti (L, -2, i + 1);
+        }
+        zstr_free (&keys [i]);
+        zmsnmp_value_destroy (&cached [i]);
+    }
+    free (cached);
+    free (keys);
+    zhash_destroy (&values);
+    return 1;
+}
+
+//  --------------------------------------------------------------------------
+//  SNMP walk lua binding. Returns table oid -> value of all rows under
+//  the oid or nothing if host does not respond.
+
+static int lua_snmp_walk(lua_State *L)
+{
+    const char *host = lua_tostring(L, 1);
+    const char *oid = lua_tostring(L, 2);
+    int max_repetitions = (int) luaL_optinteger (L, 3, 0);
+    if (!host || !oid) {
+        return 0;
+    }
+
+    snmp_credentials_t credentials;
+    if (!s_lua_credentials (L, &credentials)) {
+        return 0;
+    }
+
+    bool replay;
+    snmp_snapshot_t *snapshot = s_lua_snapshot (L, &replay);
+    zhash_t *values;
+    if (replay) {
+        char *root = zmsnmp_oid_normalize (oid);
+        values = snmp_snapshot_walk (snapshot, root);
+        zstr_free (&root);
+    }
+    else {
+        zmsnmp_set_deadline (s_lua_deadline (L));
+        values = zmsnmp_walk (host, oid, &credentials, max_repetitions);
+        zmsnmp_set_deadline (0);
+    }
+    if (!values) {
+        return 0;
+    }
+    snmp_cache_t *cache = s_lua_cache (L);
+    lua_createtable (L, 0, (int) zhash_size (values));
+    const zmsnmp_value_t *value = (const zmsnmp_value_t *) zhash_first (values);
+    while (value) {
+        // rows are good for snmp_get of other rules
+        snmp_cache_put (cache, zhash_cursor (values), value);
+        if (!replay) snmp_snapshot_put (snapshot, zhash_cursor (values), value);
+        s_push_value (L, value, false);
+        lua_setfield (L, -2, zhash_cursor (values));
+        value = (const zmsnmp_value_t *) zhash_next (values);
+    }
+    zhash_destroy (&values);
+    return 1;
+}
+
+//  --------------------------------------------------------------------------
+//  String form of value on the stack
+
+const char *luasnmp_tostring (lua_State *L, int index, char *buffer, size_t size)
+{
+    if (lua_type (L, index) == LUA_TNUMBER) {
+        // integral numbers (counters) are printed exactly, not as 1.2e+15
+        lua_Number number = lua_tonumber (L, index);
+        if (number > -1e18 && number < 1e18 && number == (lua_Number) (int64_t) number)
+            snprintf (buffer, size, "%" PRIi64, (int64_t) number);
+        else
+            snprintf (buffer, size, LUA_NUMBER_FMT, number);
+        return buffer;
+    }
+    if (lua_type (L, index) == LUA_TSTRING)
+        return lua_tostring (L, index);
+    return NULL;
+}
 
 //  --------------------------------------------------------------------------
 //  Register SNMP functions in lua
@@ -122,6 +467,20 @@ void extend_lua_of_snmp(lua_State *L)
 {
     lua_register (L, "snmp_get", lua_snmp_get);
     lua_register (L, "snmp_getnext", lua_snmp_getnext);
+    lua_register (L, "snmp_get_many", lua_snmp_get_many);
+    lua_register (L, "snmp_walk", lua_snmp_walk);
+}
+
+//  --------------------------------------------------------------------------
+//  Name and version of lua the agent is built with
+
+const char *luasnmp_backend (void)
+{
+#ifdef ZM_METRIC_HAVE_LUAJIT
+    return LUAJIT_VERSION;
+#else
+    return LUA_RELEASE;
+#endif
 }
 
 //  --------------------------------------------------------------------------
@@ -129,32 +488,134 @@ void extend_lua_of_snmp(lua_State *L)
 
 lua_State *luasnmp_new (void)
 {
+    // state lives in its own arena, unlimited until the owner sets limit
+    lua_arena_t *arena = lua_arena_new (0);
+    lua_State *l = lua_newstate (lua_arena_alloc, arena);
+    if (!l) {
+        // 64 bit LuaJIT without GC64 refuses own allocator
+        lua_arena_destroy (&arena);
 #if LUA_VERSION_NUM > 501
-    lua_State *l = luaL_newstate();
+        l = luaL_newstate();
 #else
-    lua_State *l = lua_open();
+        l = lua_open();
 #endif
+    }
     if (!l) return NULL;
+    luasnmp_init ();
     luaL_openlibs(l); // get functions like print();
     extend_lua_of_snmp (l); //extend of snmp
     return l;
 }
 
+//  --------------------------------------------------------------------------
+//  Arena of the lua state
+
+lua_arena_t *luasnmp_arena (lua_State *L)
+{
+    if (!L) return NULL;
+    void *arena = NULL;
+    lua_Alloc allocator = lua_getallocf (L, &arena);
+    return allocator == lua_arena_alloc ? (lua_arena_t *) arena : NULL;
+}
+
 //  --------------------------------------------------------------------------
 //  Destroy luasnmp
 
 void luasnmp_destroy (lua_State **self_p)
 {
     if (!self_p || !*self_p) return;
+    lua_arena_t *arena = luasnmp_arena (*self_p);
     lua_close (*self_p);
+    lua_arena_destroy (&arena);
     *self_p = NULL;
 }
 
 //  --------------------------------------------------------------------------
-//  Selftest is empty
+//  Self test of this class
 
 void luasnmp_test (bool verbose)
 {
-    //@ test is empty
+    printf (" * luasnmp: ");
+
+    //  @selftest
+    const char *SELFTEST_DIR_RO = "src/selftest-ro";
+    snmpsim_t *sim = snmpsim_new ();
+    char *walk = zsys_sprintf ("%s/walks/linux.walk", SELFTEST_DIR_RO);
+    assert (snmpsim_load (sim, walk) > 0);
+    zstr_free (&walk);
+    assert (snmpsim_set (sim, ".1.3.6.1.2.1.31.1.1.1.6.100", "Counter64", "9007199254740993") == 0);
+    assert (snmpsim_set (sim, ".1.3.6.1.2.1.31.1.1.1.6.101", "Counter64", "18446744073709551615") == 0);
+    const char *endpoint = snmpsim_bind (sim, "127.0.0.1", 0);
+    assert (endpoint);
+    zactor_t *agent = zactor_new (snmpsim_actor, sim);
+    assert (agent);
+
+    assert (luasnmp_backend ());
+    lua_State *L = luasnmp_new ();
+    assert (L);
+    if (luasnmp_arena (L))
+        assert (lua_arena_used (luasnmp_arena (L)) > 0);
+    lua_pushstring (L, endpoint);
+    lua_setglobal (L, "HOST");
+    // no credentials, no SNMP
+    assert (luaL_dostring (L, "return snmp_get (HOST, '.1.3.6.1.2.1.1.5.0')") == 0);
+    assert (lua_gettop (L) == 0);
+    assert (luaL_dostring (L, "SNMP_VERSION = '2'; SNMP_COMMUNITY_NAME = 'public'") == 0);
+
+    // numbers are numbers, strings are strings
+    assert (luaL_dostring (L, "return snmp_get (HOST, '.1.3.6.1.2.1.1.7.0', true)") == 0);
+    assert (lua_type (L, 1) == LUA_TNUMBER && lua_tonumber (L, 1) == 72);
+    assert (streq (lua_tostring (L, 2), "INTEGER"));
+    lua_settop (L, 0);
+    assert (luaL_dostring (L, "return snmp_get (HOST, '.1.3.6.1.2.1.31.1.1.1.6.2')") == 0);
+    char buffer [32];
+    assert (streq (luasnmp_tostring (L, 1, buffer, sizeof (buffer)), "84294967296"));
+    lua_settop (L, 0);
+    // Counter64 over 2^53 keeps all digits
+    assert (luaL_dostring (L, "return snmp_get (HOST, '.1.3.6.1.2.1.31.1.1.1.6.100', true)") == 0);
+    assert (lua_type (L, 1) == LUA_TSTRING && streq (lua_tostring (L, 1), "9007199254740993"));
+    assert (streq (lua_tostring (L, 2), "Counter64"));
+    lua_settop (L, 0);
+    assert (luaL_dostring (L, "return snmp_get_many (HOST, { '.1.3.6.1.2.1.31.1.1.1.6.101' }) [1]") == 0);
+    assert (streq (lua_tostring (L, 1), "18446744073709551615"));
+    lua_settop (L, 0);
+    assert (luaL_dostring (L, "return snmp_get (HOST, '.1.3.6.1.2.1.1.5.0', true)") == 0);
+    assert (lua_type (L, 1) == LUA_TSTRING && streq (lua_tostring (L, 1), "simulated"));
+    assert (streq (lua_tostring (L, 2), "OCTET STRING"));
+    lua_settop (L, 0);
+
+    assert (luaL_dostring (L,
+        "local names = snmp_walk (HOST, '.1.3.6.1.4.1.2021.9.1.2') "
+        "local load = snmp_get_many (HOST, { '.1.3.6.1.4.1.2021.10.1.3.1', '.1.3.6.1.4.1.2021.10.1.3.2', '.1.3.6.1.4.1.2021.10.1.3.3' }) "
+        "return names ['.1.3.6.1.4.1.2021.9.1.2.2'], load [3]") == 0);
+    assert (streq (lua_tostring (L, 1), "/home"));
+    assert (streq (lua_tostring (L, 2), "0.05"));
+    lua_settop (L, 0);
+
+    // duplicate oids in cache expiring meanwhile
+    snmp_cache_t *cache = snmp_cache_new (1);
+    luasnmp_set_cache (L, cache);
+    assert (luaL_dostring (L,
+        "local oids = {} "
+        "for i = 1, 500 do oids [i] = '.1.3.6.1.2.1.1.5.0' end "
+        "for round = 1, 20 do "
+        "  local values = snmp_get_many (HOST, oids) "
+        "  for i = 1, 500 do "
+        "    if values [i] ~= 'simulated' then return false end "
+        "  end "
+        "end "
+        "return true") == 0);
+    assert (lua_toboolean (L, 1));
+    lua_settop (L, 0);
+    luasnmp_set_cache (L, NULL);
+    snmp_cache_destroy (&cache);
+
+    luasnmp_destroy (&L);
+    zactor_destroy (&agent);
+    snmpsim_destroy (&sim);
+    zmsnmp_reset ();
+    //  @end
+
+    printf ("OK\n");
 }
 
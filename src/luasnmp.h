@@ -28,11 +28,62 @@
 extern "C" {
 #endif
 
+//  SNMP credentials, defined in zmsnmp.h
+struct _snmp_credentials_t;
+
 //  @interface
-//  Create a new lua state with SNMP support
+//  Initialize net-snmp library once per process. Output settings of
+//  net-snmp are fixed here and never changed later, so SNMP functions
+//  can run in many threads at once. Called by luasnmp_new ().
+ZM_METRIC_EXPORT void
+    luasnmp_init (void);
+
+//  Create a new lua state with SNMP support. State allocates its memory
+//  from its own arena (see lua_arena), without limit.
 ZM_METRIC_EXPORT lua_State *
     luasnmp_new (void);
 
+//  Arena of the lua state created by luasnmp_new, NULL if the state uses
+//  the default allocator (64 bit LuaJIT without GC64)
+ZM_METRIC_EXPORT lua_arena_t *
+    luasnmp_arena (lua_State *L);
+
+//  Set response cache consulted by SNMP functions of the lua state,
+//  NULL for no cache. Cache must outlive the lua state or be unset.
+ZM_METRIC_EXPORT void
+    luasnmp_set_cache (lua_State *L, snmp_cache_t *cache);
+
+//  Set credentials used by SNMP functions of the lua state, NULL to use
+//  globals SNMP_VERSION and SNMP_COMMUNITY_NAME. Credentials must outlive
+//  the lua state or be unset.
+ZM_METRIC_EXPORT void
+    luasnmp_set_credentials (lua_State *L, const struct _snmp_credentials_t *credentials);
+
+//  Set deadline (zclock_mono, ms) of SNMP functions of the lua state, 0
+//  for none. Time left to the deadline is the timeout of their requests,
+//  waiting for a silent host can't outlast the evaluation budget.
+ZM_METRIC_EXPORT void
+    luasnmp_set_deadline (lua_State *L, int64_t deadline);
+
+//  String form of the value at index: strings as they are, numbers are
+//  formatted to buffer (integral numbers without exponent). Returns NULL
+//  for other types. Unlike lua_tostring it does not convert the stack
+//  slot, so the number stays a number.
+ZM_METRIC_EXPORT const char *
+    luasnmp_tostring (lua_State *L, int index, char *buffer, size_t size);
+
+//  Set snapshot of SNMP responses of the lua state, NULL for none. With
+//  replay SNMP functions are answered from the snapshot and never touch
+//  the network, otherwise every response is recorded to it. Snapshot
+//  must outlive the lua state or be unset.
+ZM_METRIC_EXPORT void
+    luasnmp_set_snapshot (lua_State *L, snmp_snapshot_t *snapshot, bool replay);
+
+//  Name and version of lua the agent is built with, like "Lua 5.1.5" or
+//  "LuaJIT 2.1.0-beta3"
+ZM_METRIC_EXPORT const char *
+    luasnmp_backend (void);
+
 // Destroy luasnmp
 ZM_METRIC_EXPORT void
     luasnmp_destroy (lua_State **self_p);
@@ -28,16 +28,27 @@
 
 #include "zm_metric_classes.h"
 
+#include <lauxlib.h>
+
+#define RULE_INTERVAL_MAX INT_MAX   // seconds, hosts parse it with atoi
+
 //  Structure of our class
 
 struct _rule_t {
     char *name;
     char *description;
     unsigned int polling;
+    unsigned int interval;
+    double snmp_rate;           // requests per second, 0 = unlimited
+    unsigned int snmp_burst;
+    uint64_t max_instructions;  // budget of one evaluation, 0 = default
+    unsigned int max_time;      // ms, 0 = default
     zlist_t *assets;
     zlist_t *groups;
     zlist_t *models;
     char *evaluation;
+    char *bytecode;             // compiled evaluation, NULL if it has an error
+    size_t bytecode_size;
 };
 
 
@@ -62,6 +73,64 @@ rule_new (void)
     return self;
 }
 
+//  --------------------------------------------------------------------------
+//  Parse interval like "10s", "5m", "1h" or number of seconds.
+//  Returns number of seconds, 0 if value is not valid interval, -1 if it
+//  is longer than RULE_INTERVAL_MAX.
+
+static long int
+s_parse_interval (const char *value)
+{
+    if (!value) return 0;
+
+    char *decoded = vsjson_decode_string (value);
+    const char *str = decoded ? decoded : value;
+    char *end = NULL;
+    errno = 0;
+    long int interval = strtol (str, &end, 10);
+    if (errno == ERANGE && interval > 0) {
+        zstr_free (&decoded);
+        return -1;
+    }
+    if (errno || interval <= 0 || end == str) {
+        zstr_free (&decoded);
+        return 0;
+    }
+    while (*end == ' ') ++end;
+    long int unit = 1;
+    if (streq (end, "") || streq (end, "s"))
+        ;
+    else if (streq (end, "m"))
+        unit = 60;
+    else if (streq (end, "h"))
+        unit = 3600;
+    else
+        unit = 0;
+    zstr_free (&decoded);
+    if (unit && interval > RULE_INTERVAL_MAX / unit)
+        return -1;
+    return interval * unit;
+}
+
+//  --------------------------------------------------------------------------
+//  Parse positive number, plain or in string. Returns 0 if value is not valid.
+
+static double
+s_parse_number (const char *value)
+{
+    if (!value) return 0;
+
+    char *decoded = vsjson_decode_string (value);
+    const char *str = decoded ? decoded : value;
+    char *end = NULL;
+    errno = 0;
+    double number = strtod (str, &end);
+    if (errno || number <= 0 || end == str || *end)
+        number = 0;
+    zstr_free (&decoded);
+    return number;
+}
+
 //  --------------------------------------------------------------------------
 //  Parse JSON into rule callback. See vsjson class.
 
@@ -81,6 +150,31 @@ int rule_json_callback (const char *locator, const char *value, void *data)
         self -> polling = atoi (value);
         if (!self -> polling) self -> polling = 1;
     }
+    else if (streq (locator, "interval")) {
+        long int interval = s_parse_interval (value);
+        if (interval < 0) {
+            zsys_error ("interval %s is out of range", value);
+            return 1;
+        }
+        self -> interval = (unsigned int) interval;
+        if (!self -> interval) zsys_error ("invalid interval %s", value);
+    }
+    else if (streq (locator, "snmp_rate")) {
+        self -> snmp_rate = s_parse_number (value);
+        if (self -> snmp_rate == 0) zsys_error ("invalid snmp_rate %s", value);
+    }
+    else if (streq (locator, "snmp_burst")) {
+        self -> snmp_burst = (unsigned int) s_parse_number (value);
+        if (!self -> snmp_burst) zsys_error ("invalid snmp_burst %s", value);
+    }
+    else if (streq (locator, "max_instructions")) {
+        self -> max_instructions = (uint64_t) s_parse_number (value);
+        if (!self -> max_instructions) zsys_error ("invalid max_instructions %s", value);
+    }
+    else if (streq (locator, "max_time")) {
+        self -> max_time = (unsigned int) (s_parse_number (value) * 1000);
+        if (!self -> max_time) zsys_error ("invalid max_time %s", value);
+    }
     else if (strncmp (locator, "assets/", 7) == 0) {
         char *asset = vsjson_decode_string (value);
         zlist_append (self -> assets, asset);
@@ -105,12 +199,63 @@ int rule_json_callback (const char *locator, const char *value, void *data)
     return 0;
 }
 
+//  --------------------------------------------------------------------------
+//  lua_dump writer appending to bytecode of the rule
+
+static int
+s_bytecode_writer (lua_State *L, const void *data, size_t size, void *arg)
+{
+    rule_t *self = (rule_t *) arg;
+    char *bytecode = (char *) realloc (self->bytecode, self->bytecode_size + size);
+    if (!bytecode) return 1;
+    memcpy (bytecode + self->bytecode_size, data, size);
+    self->bytecode = bytecode;
+    self->bytecode_size += size;
+    return 0;
+}
+
+//  --------------------------------------------------------------------------
+//  Compile evaluation to bytecode, so hosts don't parse the same source
+//  again. Errors are logged, bytecode stays NULL then.
+
+static void
+s_compile (rule_t *self)
+{
+    free (self->bytecode);
+    self->bytecode = NULL;
+    self->bytecode_size = 0;
+    if (!self->evaluation) return;
+
+#if LUA_VERSION_NUM > 501
+    lua_State *L = luaL_newstate ();
+#else
+    lua_State *L = lua_open ();
+#endif
+    if (!L) return;
+    const char *name = self->name ? self->name : "rule";
+    if (luaL_loadbuffer (L, self->evaluation, strlen (self->evaluation), name) != 0)
+        zsys_error ("rule %s has an error: %s", name, lua_tostring (L, -1));
+    else
+#if LUA_VERSION_NUM > 502
+    if (lua_dump (L, s_bytecode_writer, self, 0) != 0) {
+#else
+    if (lua_dump (L, s_bytecode_writer, self) != 0) {
+#endif
+        free (self->bytecode);
+        self->bytecode = NULL;
+        self->bytecode_size = 0;
+    }
+    lua_close (L);
+}
+
 //  --------------------------------------------------------------------------
 //  Parse JSON into rule.
 
 int rule_parse (rule_t *self, const char *json)
 {
-    return vsjson_parse (json, rule_json_callback, self);
+    int result = vsjson_parse (json, rule_json_callback, self);
+    if (result == 0) s_compile (self);
+    return result;
 }
 
 //  --------------------------------------------------------------------------
@@ -154,6 +299,7 @@ rule_destroy (rule_t **self_p)
         zstr_free (&self->name);
         zstr_free (&self->description);
         zstr_free (&self->evaluation);
+        free (self->bytecode);
         //  Free object itself
         free (self);
         *self_p = NULL;
@@ -180,6 +326,16 @@ const char *rule_evaluation (rule_t *self)
     return self->evaluation;
 }
 
+//  --------------------------------------------------------------------------
+//  Get compiled evaluation function
+
+const char *rule_bytecode (rule_t *self, size_t *size)
+{
+    if (!self || !self->bytecode) return NULL;
+    if (size) *size = self->bytecode_size;
+    return self->bytecode;
+}
+
 //  --------------------------------------------------------------------------
 //  Get the list of assets for which this rule should be applied
 
@@ -225,6 +381,55 @@ unsigned int rule_polling (rule_t *self)
     return self->polling;
 }
 
+//  --------------------------------------------------------------------------
+//  Get rule interval in seconds, 0 if rule uses polling multiplier
+
+unsigned int rule_interval (rule_t *self)
+{
+    if (!self) return 0;
+    return self->interval;
+}
+
+//  --------------------------------------------------------------------------
+//  Get max SNMP requests per second to the device, 0 if not limited
+
+double rule_snmp_rate (rule_t *self)
+{
+    if (!self) return 0;
+    return self->snmp_rate;
+}
+
+//  --------------------------------------------------------------------------
+//  Get max SNMP requests sent to the device at once, rate rounded up when
+//  not set
+
+unsigned int rule_snmp_burst (rule_t *self)
+{
+    if (!self) return 1;
+    if (self->snmp_burst) return self->snmp_burst;
+    unsigned int burst = (unsigned int) self->snmp_rate;
+    if (burst < self->snmp_rate) ++burst;
+    return burst ? burst : 1;
+}
+
+//  --------------------------------------------------------------------------
+//  Get max lua instructions of one evaluation, 0 for default
+
+uint64_t rule_max_instructions (rule_t *self)
+{
+    if (!self) return 0;
+    return self->max_instructions;
+}
+
+//  --------------------------------------------------------------------------
+//  Get max time of one evaluation in ms, 0 for default
+
+unsigned int rule_max_time (rule_t *self)
+{
+    if (!self) return 0;
+    return self->max_time;
+}
+
 //  --------------------------------------------------------------------------
 //  Self test of this class
 
@@ -252,6 +457,81 @@ rule_test (bool verbose)
     assert (rule_file != NULL);
     rule_load (self, rule_file);
     zstr_free (&rule_file);
+    assert (rule_polling (self) == 1);
+    assert (rule_interval (self) == 0);
+    size_t size = 0;
+    const char *bytecode = rule_bytecode (self, &size);
+    assert (bytecode && size > 0);
+    // binary chunk starts with escape
+    assert (bytecode [0] == 0x1b);
+    rule_destroy (&self);
+
+    //  Rules using batched SNMP functions
+    const char *batched [] = { "linuxload-many.rule", "linuxdisk-walk.rule", NULL };
+    for (int i = 0; batched [i]; i++) {
+        rule_file = zsys_sprintf ("%s/rules/%s", SELFTEST_DIR_RO, batched [i]);
+        self = rule_new ();
+        assert (rule_load (self, rule_file) == 0);
+        assert (rule_bytecode (self, NULL));
+        rule_destroy (&self);
+        zstr_free (&rule_file);
+    }
+
+    //  Source with an error is not compiled
+    self = rule_new ();
+    assert (rule_parse (self, "{ \"name\" : \"broken\", \"evaluation\" : \"function main (host\" }") == 0);
+    assert (rule_evaluation (self));
+    assert (rule_bytecode (self, &size) == NULL);
+    rule_destroy (&self);
+
+    //  Interval parsing
+    const char *intervals [] = { "\"10s\"", "10", "\"10\"", "\"2m\"", "\"1h\"", "\"10x\"", "\"-5s\"", NULL };
+    unsigned int expected [] = { 10, 10, 10, 120, 3600, 0, 0 };
+    for (int i = 0; intervals [i]; i++) {
+        char *json = zsys_sprintf ("{ \"name\" : \"fast\", \"interval\" : %s }", intervals [i]);
+        self = rule_new ();
+        assert (rule_parse (self, json) == 0);
+        assert (rule_interval (self) == expected [i]);
+        rule_destroy (&self);
+        zstr_free (&json);
+    }
+    //  Intervals which would overflow reject the rule
+    const char *overflows [] = { "\"596524h\"", "\"35791395m\"", "\"2147483648\"", "\"99999999999999999999s\"", NULL };
+    for (int i = 0; overflows [i]; i++) {
+        char *json = zsys_sprintf ("{ \"name\" : \"slow\", \"interval\" : %s }", overflows [i]);
+        self = rule_new ();
+        assert (rule_parse (self, json) != 0);
+        rule_destroy (&self);
+        zstr_free (&json);
+    }
+    self = rule_new ();
+    assert (rule_parse (self, "{ \"name\" : \"slow\", \"interval\" : \"596523h\" }") == 0);
+    assert (rule_interval (self) == 596523u * 3600);
+    rule_destroy (&self);
+
+    //  SNMP rate limit
+    self = rule_new ();
+    assert (rule_parse (self, "{ \"name\" : \"ups\", \"snmp_rate\" : 2.5 }") == 0);
+    assert (rule_snmp_rate (self) == 2.5);
+    assert (rule_snmp_burst (self) == 3);
+    rule_destroy (&self);
+    self = rule_new ();
+    assert (rule_parse (self, "{ \"name\" : \"ups\", \"snmp_rate\" : \"0.5\", \"snmp_burst\" : 4 }") == 0);
+    assert (rule_snmp_rate (self) == 0.5);
+    assert (rule_snmp_burst (self) == 4);
+    rule_destroy (&self);
+    self = rule_new ();
+    assert (rule_parse (self, "{ \"name\" : \"ups\", \"snmp_rate\" : \"fast\" }") == 0);
+    assert (rule_snmp_rate (self) == 0);
+    assert (rule_max_instructions (self) == 0);
+    assert (rule_max_time (self) == 0);
+    rule_destroy (&self);
+
+    //  Evaluation budget
+    self = rule_new ();
+    assert (rule_parse (self, "{ \"name\" : \"walk\", \"max_instructions\" : 1000000, \"max_time\" : \"2.5\" }") == 0);
+    assert (rule_max_instructions (self) == 1000000);
+    assert (rule_max_time (self) == 2500);
     rule_destroy (&self);
     //  @end
     printf ("OK\n");
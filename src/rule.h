@@ -44,7 +44,8 @@ ZM_METRIC_PRIVATE void
 ZM_METRIC_PRIVATE void
     rule_test (bool verbose);
 
-//  Parse JSON into rule.
+//  Parse JSON into rule. Returns 0 on success, nonzero if JSON is not valid
+//  or interval is out of range.
 ZM_METRIC_PRIVATE int
     rule_parse (rule_t *self, const char *json);
 
@@ -72,10 +73,40 @@ ZM_METRIC_PRIVATE const char *
 ZM_METRIC_PRIVATE const char *
     rule_evaluation (rule_t *self);
 
+//  Get the evaluation function compiled to lua bytecode (with debug info)
+//  and its size. Returns NULL if the evaluation has an error or is missing.
+ZM_METRIC_PRIVATE const char *
+    rule_bytecode (rule_t *self, size_t *size);
+
 // rulle polling multiplicator
 ZM_METRIC_PRIVATE unsigned int
     rule_polling (rule_t *self);
 
+//  Rule polling interval in seconds ("interval" : "10s"), 0 if not set.
+//  When set, it takes precedence over polling multiplicator.
+ZM_METRIC_PRIVATE unsigned int
+    rule_interval (rule_t *self);
+
+//  Max SNMP requests per second to the device ("snmp_rate" : 5), 0 if not
+//  limited
+ZM_METRIC_PRIVATE double
+    rule_snmp_rate (rule_t *self);
+
+//  Max SNMP requests sent to the device at once ("snmp_burst" : 10),
+//  defaults to the rate rounded up
+ZM_METRIC_PRIVATE unsigned int
+    rule_snmp_burst (rule_t *self);
+
+//  Max lua instructions of one evaluation ("max_instructions" : 1000000),
+//  0 if the agent default is used
+ZM_METRIC_PRIVATE uint64_t
+    rule_max_instructions (rule_t *self);
+
+//  Max wall-clock time of one evaluation in ms ("max_time" : 2.5, in
+//  seconds), 0 if the agent default is used
+ZM_METRIC_PRIVATE unsigned int
+    rule_max_time (rule_t *self);
+
 //  freefn for zhash/zlist
 ZM_METRIC_PRIVATE void
     rule_freefn (void *self);
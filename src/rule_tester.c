@@ -40,6 +40,21 @@ rule_tester (
     int snmpversion,
     const char *community,
     const char *addr)
+{
+    return rule_tester_snapshot (file, snmpversion, community, addr, NULL, NULL);
+}
+
+//  --------------------------------------------------------------------------
+//  rule tester recording or replaying SNMP responses
+
+int
+rule_tester_snapshot (
+    const char *file,
+    int snmpversion,
+    const char *community,
+    const char *addr,
+    const char *record,
+    const char *replay)
 {
     if (!file) {
         puts ("Rule not specified!");
@@ -48,34 +63,39 @@ rule_tester (
 
     int result = 0;
     int returnedvalues = 0;
+    size_t memory = 0;
     rule_t *rule = rule_new ();
-    lua_State *lua = luasnmp_new();
+    lua_runtime_t *runtime = lua_runtime_new ();
+    lua_State *lua = lua_runtime_state (runtime);
+    lua_code_t *code = NULL;
+    snmp_snapshot_t *snapshot = NULL;
+    snmp_credentials_t credentials = { snmpversion, (char *) community };
     if (rule_load (rule, file)) {
         puts ("Error: can't parse rule file!");
         result = 2;
         goto cleanup;
     }
-    if (luaL_dostring (lua, rule_evaluation (rule)) != 0) {
-        puts ("Error: lua syntax error");
-        lua_error (lua);
-        result = 3;
-        goto cleanup;
+    if (record || replay) {
+        snapshot = snmp_snapshot_new ();
+        if (replay && snmp_snapshot_load (snapshot, replay) < 0) {
+            printf ("Error: can't read snapshot %s\n", replay);
+            result = 6;
+            goto cleanup;
+        }
+        luasnmp_set_snapshot (lua, snapshot, replay != NULL);
     }
-    lua_pushstring(lua, addr);
-    lua_setglobal(lua, "NAME");
-    lua_getglobal (lua, "main");
-    if (!lua_isfunction (lua, -1)) {
-        puts ("Error: main function not found");
-        result = 4;
+    // evaluated the same way as by the agent, from bytecode
+    size_t size = 0;
+    const char *bytecode = rule_bytecode (rule, &size);
+    if (bytecode)
+        code = lua_runtime_add (runtime, rule_name (rule) ? rule_name (rule) : file, bytecode, size);
+    if (!code) {
+        puts ("Error: lua syntax error or main function not found");
+        result = 3;
         goto cleanup;
     }
-    lua_settop (lua, 0);
-
-    // TODO: set credentials to lua
-
-    lua_getglobal (lua, "main");
-    lua_pushstring (lua, addr);
-    if (lua_pcall(lua, 1, 1, 0) == 0) {
+    lua_runtime_set_budget (runtime, rule_max_instructions (rule), rule_max_time (rule));
+    if (lua_runtime_call (runtime, code, addr, addr, &credentials) == 0) {
         // check if result is an array
         if (! lua_istable (lua, -1)) {
             zsys_error ("function did not returned array");
@@ -88,6 +108,7 @@ rule_tester (
             const char *value = NULL;
             const char *units = NULL;
             const char *desc = NULL;
+            char number [64];
 
             lua_pushnumber(lua, i++);
             lua_gettable(lua, -2);
@@ -96,7 +117,7 @@ rule_tester (
 
             lua_pushnumber(lua, i++);
             lua_gettable(lua, -2);
-            if (lua_isstring (lua, -1)) value = lua_tostring(lua,-1);
+            value = luasnmp_tostring (lua, -1, number, sizeof (number));
             lua_pop (lua, 1);
 
             lua_pushnumber(lua, i++);
@@ -122,13 +143,26 @@ rule_tester (
             }
         }
     } else {
-        lua_error (lua);
+        puts ("Error: evaluation failed");
+        result = 4;
+        goto cleanup;
+    }
+    if (record && !replay) {
+        if (snmp_snapshot_save (snapshot, record) == 0)
+            printf ("Recorded %zu values to %s\n", snmp_snapshot_size (snapshot), record);
+        else {
+            printf ("Error: can't write snapshot %s\n", record);
+            result = 7;
+        }
     }
  cleanup:
-    luasnmp_destroy (&lua);
+    memory = lua_runtime_memory_peak (code);
+    lua_runtime_release (&code);
+    lua_runtime_destroy (&runtime);
+    snmp_snapshot_destroy (&snapshot);
     rule_destroy (&rule);
     if (result == 0) {
-        printf ("Seems OK, %i values returned.\n", returnedvalues);
+        printf ("Seems OK, %i values returned, lua memory peak %zu bytes.\n", returnedvalues, memory);
     }
     return result;
 }
@@ -141,6 +175,36 @@ rule_tester_test (bool verbose)
 {
     printf (" * rule_tester: ");
     //  @selftest
+    const char *SELFTEST_DIR_RO = "src/selftest-ro";
+    const char *SELFTEST_DIR_RW = "src/selftest-rw";
+    char *rulefile = zsys_sprintf ("%s/rules/linuxdisk-walk.rule", SELFTEST_DIR_RO);
+    char *walk = zsys_sprintf ("%s/walks/linux.walk", SELFTEST_DIR_RO);
+    zsys_dir_create (SELFTEST_DIR_RW);
+    char *recorded = zsys_sprintf ("%s/linuxdisk.walk", SELFTEST_DIR_RW);
+
+    // record what the rule gets from simulated agent
+    snmpsim_t *sim = snmpsim_new ();
+    assert (snmpsim_load (sim, walk) > 0);
+    char *endpoint = strdup (snmpsim_bind (sim, "127.0.0.1", 0));
+    zactor_t *agent = zactor_new (snmpsim_actor, sim);
+    assert (rule_tester_snapshot (rulefile, 2, "public", endpoint, recorded, NULL) == 0);
+    zactor_destroy (&agent);
+    snmpsim_destroy (&sim);
+
+    snmp_snapshot_t *snapshot = snmp_snapshot_new ();
+    assert (snmp_snapshot_load (snapshot, recorded) == 4);
+    snmp_snapshot_destroy (&snapshot);
+
+    // replay needs no agent
+    assert (rule_tester_snapshot (rulefile, 2, "public", endpoint, NULL, recorded) == 0);
+    assert (rule_tester_snapshot (rulefile, 2, "public", endpoint, NULL, "nonexistent.walk") == 6);
+
+    zsys_file_delete (recorded);
+    zstr_free (&recorded);
+    zstr_free (&endpoint);
+    zstr_free (&walk);
+    zstr_free (&rulefile);
+    zmsnmp_reset ();
     //  @end
     printf ("OK\n");
 }
@@ -0,0 +1,617 @@
+/*  =========================================================================
+    scheduler - timing wheel scheduling rule evaluations
+
+    Copyright (C) 2016 - 2017 Tomas Halman
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    scheduler - timing wheel scheduling rule evaluations
+@discuss
+    Every (asset, rule) pair is evaluated periodically. Instead of waking
+    up all pairs at once, each pair gets phase offset within its period
+    (hash of asset and rule name), so the load is spread over the whole
+    period. Offset is relative to wall clock, so it stays the same after
+    restart.
+
+    Pairs are kept in hierarchical timing wheel: root wheel has 256 slots
+    of one tick, every next level has 64 slots, each covering the whole
+    lower level. Adding, removing and expiring is O(1), entries are moved
+    to lower level when the lower wheel wraps around.
+
+    Dispatched pair is in flight until scheduler_done () is called. When
+    the pair is due again while still in flight, the evaluation is skipped
+    and counted as overrun, so a slow host never queues more than one
+    evaluation per rule.
+@end
+*/
+
+#include "zm_metric_classes.h"
+
+#define WHEEL_LEVELS    4
+#define WHEEL_ROOT_BITS 8
+#define WHEEL_BITS      6
+#define WHEEL_ROOT_SIZE (1 << WHEEL_ROOT_BITS)
+#define WHEEL_SIZE      (1 << WHEEL_BITS)
+
+typedef struct _entry_t entry_t;
+
+struct _entry_t {
+    char *asset;
+    char *rule;
+    int64_t period;     // ms
+    int64_t due;        // zclock_mono time of next evaluation
+    entry_t *prev;
+    entry_t *next;
+    entry_t **slot;     // wheel slot the entry is linked in
+    bool inflight;      // dispatched, waiting for scheduler_done
+    uint64_t overruns;  // skipped evaluations
+};
+
+//  Structure of our class
+
+struct _scheduler_t {
+    int64_t tick;                   // ms per tick
+    int64_t origin;                 // zclock_mono time of tick 0
+    uint64_t current;               // next tick to process
+    entry_t *root [WHEEL_ROOT_SIZE];
+    entry_t *levels [WHEEL_LEVELS - 1][WHEEL_SIZE];
+    zhash_t *assets;                // asset -> zhash (rule -> entry_t)
+    size_t size;
+    size_t inflight;                // pairs being evaluated
+    uint64_t dispatched;            // evaluations started
+    uint64_t overruns;              // evaluations skipped
+};
+
+//  --------------------------------------------------------------------------
+//  Entry constructor/destructor
+
+static entry_t *
+s_entry_new (const char *asset, const char *rule)
+{
+    entry_t *self = (entry_t *) zmalloc (sizeof (entry_t));
+    assert (self);
+    self->asset = strdup (asset);
+    self->rule = strdup (rule);
+    return self;
+}
+
+static void
+s_entry_destroy (entry_t **self_p)
+{
+    if (!self_p || !*self_p) return;
+    entry_t *self = *self_p;
+    zstr_free (&self->asset);
+    zstr_free (&self->rule);
+    free (self);
+    *self_p = NULL;
+}
+
+//  --------------------------------------------------------------------------
+//  Wheel slot list manipulation
+
+static void
+s_link (entry_t **slot, entry_t *entry)
+{
+    entry->prev = NULL;
+    entry->next = *slot;
+    if (*slot) (*slot)->prev = entry;
+    *slot = entry;
+    entry->slot = slot;
+}
+
+static void
+s_unlink (entry_t *entry)
+{
+    if (!entry->slot) return;
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        *entry->slot = entry->next;
+    if (entry->next) entry->next->prev = entry->prev;
+    entry->prev = NULL;
+    entry->next = NULL;
+    entry->slot = NULL;
+}
+
+//  --------------------------------------------------------------------------
+//  Put entry into wheel according its due time. Tick is rounded up, so
+//  nothing expires before its time.
+
+static void
+s_wheel_add (scheduler_t *self, entry_t *entry)
+{
+    uint64_t expires = 0;
+    if (entry->due > self->origin)
+        expires = (uint64_t) ((entry->due - self->origin + self->tick - 1) / self->tick);
+    if (expires < self->current) expires = self->current;
+
+    uint64_t ticks = expires - self->current;
+    if (ticks < WHEEL_ROOT_SIZE) {
+        s_link (&self->root [expires & (WHEEL_ROOT_SIZE - 1)], entry);
+        return;
+    }
+    int level = 0;
+    uint64_t span = (uint64_t) WHEEL_ROOT_SIZE << WHEEL_BITS;
+    while (level < WHEEL_LEVELS - 2 && ticks >= span) {
+        ++level;
+        span <<= WHEEL_BITS;
+    }
+    if (ticks >= span) {
+        // beyond the wheel, park it in the last slot, it is placed
+        // again with real due time once the slot is cascaded
+        expires = self->current + span - 1;
+    }
+    int shift = WHEEL_ROOT_BITS + level * WHEEL_BITS;
+    s_link (&self->levels [level][(expires >> shift) & (WHEEL_SIZE - 1)], entry);
+}
+
+//  --------------------------------------------------------------------------
+//  Move entries from higher level slot to lower levels
+
+static void
+s_cascade (scheduler_t *self, int level, size_t index)
+{
+    entry_t *entry = self->levels [level][index];
+    self->levels [level][index] = NULL;
+    while (entry) {
+        entry_t *next = entry->next;
+        entry->prev = NULL;
+        entry->next = NULL;
+        entry->slot = NULL;
+        s_wheel_add (self, entry);
+        entry = next;
+    }
+}
+
+//  --------------------------------------------------------------------------
+//  Find entry of the pair
+
+static entry_t *
+s_lookup (scheduler_t *self, const char *asset, const char *rule)
+{
+    zhash_t *rules = (zhash_t *) zhash_lookup (self->assets, asset);
+    if (!rules) return NULL;
+    return (entry_t *) zhash_lookup (rules, rule);
+}
+
+//  --------------------------------------------------------------------------
+//  Time of the first evaluation, aligned to the phase of the pair
+
+static int64_t
+s_first_due (const char *asset, const char *rule, int64_t period)
+{
+    int64_t phase = scheduler_phase (asset, rule, period);
+    int64_t delay = (phase - zclock_time () % period + period) % period;
+    return zclock_mono () + delay;
+}
+
+//  --------------------------------------------------------------------------
+//  Create a new scheduler
+
+scheduler_t *
+scheduler_new (int64_t tick)
+{
+    scheduler_t *self = (scheduler_t *) zmalloc (sizeof (scheduler_t));
+    assert (self);
+    self->tick = tick > 0 ? tick : 1;
+    self->origin = zclock_mono ();
+    self->assets = zhash_new ();
+    assert (self->assets);
+    return self;
+}
+
+//  --------------------------------------------------------------------------
+//  Destroy the scheduler
+
+void
+scheduler_destroy (scheduler_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        scheduler_t *self = *self_p;
+        zlist_t *assets = zhash_keys (self->assets);
+        const char *asset = (const char *) zlist_first (assets);
+        while (asset) {
+            scheduler_remove (self, asset);
+            asset = (const char *) zlist_next (assets);
+        }
+        zlist_destroy (&assets);
+        zhash_destroy (&self->assets);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+//  --------------------------------------------------------------------------
+//  Phase offset of the pair within the period (FNV-1a hash)
+
+int64_t
+scheduler_phase (const char *asset, const char *rule, int64_t period)
+{
+    if (!asset || !rule || period <= 0) return 0;
+
+    uint64_t hash = 14695981039346656037ULL;
+    const char *p;
+    for (p = asset; *p; p++) {
+        hash ^= (unsigned char) *p;
+        hash *= 1099511628211ULL;
+    }
+    hash ^= '/';
+    hash *= 1099511628211ULL;
+    for (p = rule; *p; p++) {
+        hash ^= (unsigned char) *p;
+        hash *= 1099511628211ULL;
+    }
+    return (int64_t) (hash % (uint64_t) period);
+}
+
+//  --------------------------------------------------------------------------
+//  Schedule evaluation of rule on asset every period ms
+
+void
+scheduler_add (scheduler_t *self, const char *asset, const char *rule, int64_t period)
+{
+    if (!self || !asset || !rule) return;
+    if (period < self->tick) period = self->tick;
+
+    zhash_t *rules = (zhash_t *) zhash_lookup (self->assets, asset);
+    if (!rules) {
+        rules = zhash_new ();
+        zhash_insert (self->assets, asset, rules);
+    }
+    entry_t *entry = (entry_t *) zhash_lookup (rules, rule);
+    if (entry) {
+        if (entry->period == period) return;
+        s_unlink (entry);
+    }
+    else {
+        entry = s_entry_new (asset, rule);
+        zhash_insert (rules, rule, entry);
+        ++self->size;
+    }
+    entry->period = period;
+    entry->due = s_first_due (asset, rule, period);
+    s_wheel_add (self, entry);
+}
+
+//  --------------------------------------------------------------------------
+//  Remove one rule of the asset
+
+void
+scheduler_remove_rule (scheduler_t *self, const char *asset, const char *rule)
+{
+    if (!self || !asset || !rule) return;
+
+    zhash_t *rules = (zhash_t *) zhash_lookup (self->assets, asset);
+    if (!rules) return;
+    entry_t *entry = (entry_t *) zhash_lookup (rules, rule);
+    if (!entry) return;
+    zhash_delete (rules, rule);
+    s_unlink (entry);
+    if (entry->inflight) --self->inflight;
+    s_entry_destroy (&entry);
+    --self->size;
+    if (zhash_size (rules) == 0) {
+        zhash_delete (self->assets, asset);
+        zhash_destroy (&rules);
+    }
+}
+
+//  --------------------------------------------------------------------------
+//  Remove all rules of the asset
+
+void
+scheduler_remove (scheduler_t *self, const char *asset)
+{
+    if (!self || !asset) return;
+
+    zhash_t *rules = (zhash_t *) zhash_lookup (self->assets, asset);
+    if (!rules) return;
+    zhash_delete (self->assets, asset);
+    entry_t *entry = (entry_t *) zhash_first (rules);
+    while (entry) {
+        s_unlink (entry);
+        if (entry->inflight) --self->inflight;
+        s_entry_destroy (&entry);
+        --self->size;
+        entry = (entry_t *) zhash_next (rules);
+    }
+    zhash_destroy (&rules);
+}
+
+//  --------------------------------------------------------------------------
+//  Number of scheduled (asset, rule) pairs
+
+size_t
+scheduler_size (scheduler_t *self)
+{
+    if (!self) return 0;
+    return self->size;
+}
+
+//  --------------------------------------------------------------------------
+//  Mark evaluation of the pair as finished
+
+void
+scheduler_done (scheduler_t *self, const char *asset, const char *rule)
+{
+    if (!self || !asset || !rule) return;
+
+    entry_t *entry = s_lookup (self, asset, rule);
+    if (!entry || !entry->inflight) return;
+    entry->inflight = false;
+    --self->inflight;
+}
+
+//  --------------------------------------------------------------------------
+//  Number of skipped evaluations of the pair
+
+uint64_t
+scheduler_overruns (scheduler_t *self, const char *asset, const char *rule)
+{
+    if (!self || !asset || !rule) return 0;
+
+    entry_t *entry = s_lookup (self, asset, rule);
+    return entry ? entry->overruns : 0;
+}
+
+//  --------------------------------------------------------------------------
+//  Add scheduler counters to the message as name/value frame pairs
+
+void
+scheduler_stats (scheduler_t *self, zmsg_t *msg)
+{
+    if (!self || !msg) return;
+
+    zmsg_addstr (msg, "scheduled");
+    zmsg_addstrf (msg, "%zu", self->size);
+    zmsg_addstr (msg, "inflight");
+    zmsg_addstrf (msg, "%zu", self->inflight);
+    zmsg_addstr (msg, "dispatched");
+    zmsg_addstrf (msg, "%" PRIu64, self->dispatched);
+    zmsg_addstr (msg, "overruns");
+    zmsg_addstrf (msg, "%" PRIu64, self->overruns);
+}
+
+//  --------------------------------------------------------------------------
+//  Call fn for every pair due at time now and schedule its next evaluation.
+//  Pairs still in flight are skipped. Callback must not add or remove pairs.
+
+size_t
+scheduler_dispatch (scheduler_t *self, int64_t now, scheduler_fn *fn, void *arg)
+{
+    if (!self || now < self->origin) return 0;
+
+    uint64_t target = (uint64_t) ((now - self->origin) / self->tick);
+    if (self->size == 0) {
+        if (self->current <= target) self->current = target + 1;
+        return 0;
+    }
+
+    size_t count = 0;
+    while (self->current <= target) {
+        uint64_t tick = self->current;
+        size_t index = tick & (WHEEL_ROOT_SIZE - 1);
+        if (index == 0 && tick) {
+            for (int level = 0; level < WHEEL_LEVELS - 1; level++) {
+                size_t li = (tick >> (WHEEL_ROOT_BITS + level * WHEEL_BITS)) & (WHEEL_SIZE - 1);
+                s_cascade (self, level, li);
+                if (li) break;
+            }
+        }
+        entry_t *entry = self->root [index];
+        self->root [index] = NULL;
+        self->current = tick + 1;
+        while (entry) {
+            entry_t *next = entry->next;
+            entry->prev = NULL;
+            entry->next = NULL;
+            entry->slot = NULL;
+            entry->due += entry->period;
+            if (entry->due <= now) {
+                // we are late, skip missed periods but keep the phase
+                entry->due += ((now - entry->due) / entry->period + 1) * entry->period;
+            }
+            s_wheel_add (self, entry);
+            if (entry->inflight) {
+                ++entry->overruns;
+                ++self->overruns;
+                zsys_debug ("%s/%s still running, evaluation skipped", entry->asset, entry->rule);
+            }
+            else {
+                entry->inflight = true;
+                ++self->inflight;
+                ++self->dispatched;
+                if (fn) fn (entry->asset, entry->rule, arg);
+                ++count;
+            }
+            entry = next;
+        }
+    }
+    return count;
+}
+
+//  --------------------------------------------------------------------------
+//  Make all pairs not in flight due at the next dispatch. Their following
+//  evaluation keeps the phase.
+
+size_t
+scheduler_wakeup (scheduler_t *self)
+{
+    if (!self) return 0;
+
+    size_t count = 0;
+    zhash_t *rules = (zhash_t *) zhash_first (self->assets);
+    while (rules) {
+        entry_t *entry = (entry_t *) zhash_first (rules);
+        while (entry) {
+            if (!entry->inflight) {
+                // previous phase point is in the past, so the entry lands
+                // in the current tick and dispatch moves it back to due
+                s_unlink (entry);
+                entry->due -= entry->period;
+                s_wheel_add (self, entry);
+                ++count;
+            }
+            entry = (entry_t *) zhash_next (rules);
+        }
+        rules = (zhash_t *) zhash_next (self->assets);
+    }
+    return count;
+}
+
+//  --------------------------------------------------------------------------
+//  Milliseconds from now to the next tick which has something to do
+
+int
+scheduler_timeout (scheduler_t *self, int64_t now)
+{
+    if (!self || self->size == 0) return -1;
+
+    // look for work in root wheel up to the next cascade
+    uint64_t tick = self->current;
+    uint64_t limit = (tick | (WHEEL_ROOT_SIZE - 1)) + 1;
+    while (tick < limit && !self->root [tick & (WHEEL_ROOT_SIZE - 1)])
+        ++tick;
+
+    int64_t when = self->origin + (int64_t) tick * self->tick;
+    if (when <= now) return 0;
+    if (when - now > INT_MAX) return INT_MAX;
+    return (int) (when - now);
+}
+
+//  --------------------------------------------------------------------------
+//  Self test of this class
+
+typedef struct {
+    scheduler_t *scheduler;
+    zhash_t *counts;
+} test_ctx_t;
+
+static void
+s_test_count (const char *asset, const char *rule, void *arg)
+{
+    test_ctx_t *ctx = (test_ctx_t *) arg;
+    char *key = zsys_sprintf ("%s/%s", asset, rule);
+    size_t count = (size_t) zhash_lookup (ctx->counts, key);
+    zhash_update (ctx->counts, key, (void *) (count + 1));
+    zstr_free (&key);
+    scheduler_done (ctx->scheduler, asset, rule);
+}
+
+void
+scheduler_test (bool verbose)
+{
+    printf (" * scheduler: ");
+
+    //  @selftest
+    scheduler_t *self = scheduler_new (100);
+    assert (self);
+    assert (scheduler_timeout (self, zclock_mono ()) == -1);
+    assert (scheduler_dispatch (self, zclock_mono (), NULL, NULL) == 0);
+
+    // phase is deterministic and within the period
+    assert (scheduler_phase ("a", "b", 60000) == scheduler_phase ("a", "b", 60000));
+    for (int i = 0; i < 100; i++) {
+        char *asset = zsys_sprintf ("host%i", i);
+        int64_t phase = scheduler_phase (asset, "load", 10000);
+        assert (phase >= 0 && phase < 10000);
+        scheduler_add (self, asset, "load", 10000);
+        zstr_free (&asset);
+    }
+    assert (scheduler_size (self) == 100);
+    int64_t now = zclock_mono ();
+    assert (scheduler_timeout (self, now) >= 0);
+
+    // every pair is dispatched once per period, spread over the period
+    zhash_t *counts = zhash_new ();
+    test_ctx_t ctx = { self, counts };
+    size_t busiest = 0;
+    int64_t t;
+    for (t = now; t < now + 100000; t += 1000) {
+        size_t dispatched = scheduler_dispatch (self, t, s_test_count, &ctx);
+        if (dispatched > busiest) busiest = dispatched;
+    }
+    if (verbose) zsys_debug ("busiest second dispatched %zu of 100", busiest);
+    assert (busiest < 40);
+    assert (zhash_size (counts) == 100);
+    size_t count = (size_t) zhash_first (counts);
+    while (count) {
+        assert (count >= 9 && count <= 11);
+        count = (size_t) zhash_next (counts);
+    }
+    zhash_destroy (&counts);
+
+    scheduler_remove_rule (self, "host0", "load");
+    scheduler_remove_rule (self, "host0", "load");
+    assert (scheduler_size (self) == 99);
+    for (int i = 1; i < 100; i++) {
+        char *asset = zsys_sprintf ("host%i", i);
+        scheduler_remove (self, asset);
+        zstr_free (&asset);
+    }
+    assert (scheduler_size (self) == 0);
+
+    // long period goes through higher levels of the wheel
+    int64_t day = 24 * 3600 * 1000;
+    scheduler_add (self, "host", "daily", day);
+    assert (scheduler_dispatch (self, t + day, NULL, NULL) == 1);
+    assert (scheduler_timeout (self, t + day) > 0);
+    scheduler_done (self, "host", "daily");
+    assert (scheduler_dispatch (self, t + 2 * day, NULL, NULL) == 1);
+    scheduler_remove (self, "host");
+
+    // evaluation still in flight is skipped and counted, not queued
+    t += 3 * day;
+    scheduler_add (self, "slow", "walk", 1000);
+    size_t started = 0;
+    int64_t end = t + 10000;
+    for (; t <= end; t += 100)
+        started += scheduler_dispatch (self, t, NULL, NULL);
+    assert (started == 1);
+    uint64_t overruns = scheduler_overruns (self, "slow", "walk");
+    assert (overruns >= 9 && overruns <= 11);
+    scheduler_done (self, "slow", "walk");
+    scheduler_done (self, "slow", "walk");
+    for (end = t + 1000; t <= end; t += 100)
+        started += scheduler_dispatch (self, t, NULL, NULL);
+    assert (started == 2);
+
+    // wakeup makes pairs due at the next dispatch, except those in flight
+    scheduler_t *wheel = scheduler_new (100);
+    now = zclock_mono ();
+    scheduler_add (wheel, "host", "load", 3600000);
+    scheduler_add (wheel, "host", "walk", 3600000);
+    assert (scheduler_wakeup (wheel) == 2);
+    assert (scheduler_dispatch (wheel, now + 100, NULL, NULL) == 2);
+    scheduler_done (wheel, "host", "load");
+    assert (scheduler_wakeup (wheel) == 1);
+    assert (scheduler_dispatch (wheel, now + 200, NULL, NULL) == 1);
+    assert (scheduler_overruns (wheel, "host", "walk") == 0);
+    scheduler_destroy (&wheel);
+
+    zmsg_t *stats = zmsg_new ();
+    scheduler_stats (self, stats);
+    assert (zmsg_size (stats) == 8);
+    zmsg_destroy (&stats);
+    scheduler_destroy (&self);
+    //  @end
+
+    printf ("OK\n");
+}
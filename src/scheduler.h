@@ -0,0 +1,108 @@
+/*  =========================================================================
+    scheduler - timing wheel scheduling rule evaluations
+
+    Copyright (C) 2016 - 2017 Tomas Halman
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#ifndef SCHEDULER_H_INCLUDED
+#define SCHEDULER_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef SCHEDULER_T_DEFINED
+typedef struct _scheduler_t scheduler_t;
+#define SCHEDULER_T_DEFINED
+#endif
+
+//  Callback called for every (asset, rule) pair which is due
+typedef void (scheduler_fn) (const char *asset, const char *rule, void *arg);
+
+//  @interface
+//  Create a new scheduler, tick is the resolution of the wheel in ms
+ZM_METRIC_PRIVATE scheduler_t *
+    scheduler_new (int64_t tick);
+
+//  Destroy the scheduler
+ZM_METRIC_PRIVATE void
+    scheduler_destroy (scheduler_t **self_p);
+
+//  Schedule evaluation of rule on asset every period ms. First evaluation
+//  is at deterministic phase offset within the period derived from asset
+//  and rule name. Adding existing pair just updates the period.
+ZM_METRIC_PRIVATE void
+    scheduler_add (scheduler_t *self, const char *asset, const char *rule, int64_t period);
+
+//  Remove one rule of the asset
+ZM_METRIC_PRIVATE void
+    scheduler_remove_rule (scheduler_t *self, const char *asset, const char *rule);
+
+//  Remove all rules of the asset
+ZM_METRIC_PRIVATE void
+    scheduler_remove (scheduler_t *self, const char *asset);
+
+//  Number of scheduled (asset, rule) pairs
+ZM_METRIC_PRIVATE size_t
+    scheduler_size (scheduler_t *self);
+
+//  Call fn for every pair due at time now (zclock_mono) and schedule its
+//  next evaluation. Dispatched pair stays in flight until scheduler_done (),
+//  pairs due while in flight are skipped. Returns number of dispatched pairs.
+ZM_METRIC_PRIVATE size_t
+    scheduler_dispatch (scheduler_t *self, int64_t now, scheduler_fn *fn, void *arg);
+
+//  Make all pairs not in flight due at the next dispatch, their following
+//  evaluation stays at its phase. Returns number of such pairs.
+ZM_METRIC_PRIVATE size_t
+    scheduler_wakeup (scheduler_t *self);
+
+//  Mark evaluation of the pair as finished, so it can be dispatched again
+ZM_METRIC_PRIVATE void
+    scheduler_done (scheduler_t *self, const char *asset, const char *rule);
+
+//  Number of evaluations of the pair skipped because the previous one
+//  was still in flight
+ZM_METRIC_PRIVATE uint64_t
+    scheduler_overruns (scheduler_t *self, const char *asset, const char *rule);
+
+//  Append counters (scheduled, inflight, dispatched, overruns) to the
+//  message as name/value frame pairs
+ZM_METRIC_PRIVATE void
+    scheduler_stats (scheduler_t *self, zmsg_t *msg);
+
+//  Milliseconds from now to the next tick which has something to do,
+//  -1 if nothing is scheduled. Suitable for zpoller_wait.
+ZM_METRIC_PRIVATE int
+    scheduler_timeout (scheduler_t *self, int64_t now);
+
+//  Phase offset of the pair within the period in ms
+ZM_METRIC_PRIVATE int64_t
+    scheduler_phase (const char *asset, const char *rule, int64_t period);
+
+//  Self test of this class
+ZM_METRIC_PRIVATE void
+    scheduler_test (bool verbose);
+
+//  @end
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,586 @@
+/*  =========================================================================
+    snmp_bench - SNMP request throughput benchmark
+
+    Copyright (C) 2016 - 2017 Tomas Halman                                 
+                                                                           
+    This program is free software; you can redistribute it and/or modify   
+    it under the terms of the GNU General Public License as published by   
+    the Free Software Foundation; either version 2 of the License, or      
+    (at your option) any later version.                                    
+                                                                           
+    This program is distributed in the hope that it will be useful,        
+    but WITHOUT ANY WARRANTY; without even the implied warranty of         
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          
+    GNU General Public License for more details.                           
+                                                                           
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.            
+    =========================================================================
+*/
+
+/*
+@header
+    snmp_bench - SNMP request throughput benchmark
+@discuss
+    Measures how many SNMP requests per second the agent can do against
+    one host, from one thread and from many threads sharing the sockets of
+    synchronous requests.
+    snmp_bench_oid measures oid parsing and formatting offline,
+    snmp_bench_value conversion of received values, snmp_bench_memory
+    resident memory needed per monitored host and snmp_bench_startup
+    deployment of rules to many assets, from source and from bytecode.
+    snmp_bench_eval measures evaluation of a rule post processing walk
+    tables, run it with agent built against lua and LuaJIT to compare
+    backends.
+@end
+*/
+
+#include "zm_metric_classes.h"
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <lauxlib.h>
+
+static const char *s_bench_oids [] = {
+    ".1.3.6.1.2.1.1.3.0",
+    ".1.3.6.1.4.1.2021.10.1.3.1",
+    ".1.3.6.1.4.1.2021.10.1.3.2",
+    ".1.3.6.1.4.1.2021.10.1.3.3",
+    ".1.3.6.1.2.1.25.2.3.1.6.31",
+    ".1.3.6.1.2.1.31.1.1.1.6.10001",
+    NULL
+};
+
+//  Typical rule, hosts without credentials don't touch network with it
+static const char *s_bench_rule =
+    "function main (host)\n"
+    "    local load = snmp_get_many (host, {\n"
+    "        '.1.3.6.1.4.1.2021.10.1.3.1',\n"
+    "        '.1.3.6.1.4.1.2021.10.1.3.2',\n"
+    "        '.1.3.6.1.4.1.2021.10.1.3.3' })\n"
+    "    if not load then return {} end\n"
+    "    return {\n"
+    "        'load1m', load [1], '%', 'one minute average load',\n"
+    "        'load5m', load [2], '%', 'five minutes average load',\n"
+    "        'load15m', load [3], '%', 'fifteen minutes average load' }\n"
+    "end\n";
+
+//  --------------------------------------------------------------------------
+//  Run count get requests, returns number of successful ones and time in us
+
+static int
+s_bench_get (const char *host, const snmp_credentials_t *credentials, const char *oid, int count, int64_t *usecs)
+{
+    int ok = 0;
+    int64_t start = zclock_usecs ();
+    for (int i = 0; i < count; i++) {
+        zmsnmp_value_t *value = zmsnmp_get (host, oid, credentials);
+        if (value) ++ok;
+        zmsnmp_value_destroy (&value);
+    }
+    *usecs = zclock_usecs () - start;
+    return ok;
+}
+
+//  --------------------------------------------------------------------------
+//  Thread doing its share of get requests, reports number of successful
+//  ones
+
+#define BENCH_THREADS 16
+
+typedef struct {
+    const char *host;
+    const snmp_credentials_t *credentials;
+    const char *oid;
+    int count;
+} bench_get_t;
+
+static void
+s_bench_get_actor (zsock_t *pipe, void *args)
+{
+    bench_get_t *get = (bench_get_t *) args;
+    zsock_signal (pipe, 0);
+    int64_t usecs;
+    int ok = s_bench_get (get->host, get->credentials, get->oid, get->count, &usecs);
+    zstr_sendf (pipe, "%i", ok);
+    char *command = zstr_recv (pipe);
+    zstr_free (&command);
+}
+
+//  --------------------------------------------------------------------------
+//  Print one line of results
+
+static void
+s_bench_report (const char *name, int count, int ok, int64_t usecs)
+{
+    double rate = usecs > 0 ? (double) count * 1000000.0 / usecs : 0;
+    printf ("%-24s %8i requests %8i failed %12.1f req/s\n", name, count, count - ok, rate);
+}
+
+//  --------------------------------------------------------------------------
+//  SNMP benchmark
+
+int
+snmp_bench (
+    const char *host,
+    int snmpversion,
+    const char *community,
+    const char *oid,
+    int count)
+{
+    if (!host || !community || !oid || count <= 0) return 1;
+
+    snmp_credentials_t credentials = { snmpversion, (char *) community };
+    int64_t usecs;
+    int ok;
+
+    // one request in flight
+    ok = s_bench_get (host, &credentials, oid, count, &usecs);
+    s_bench_report ("get, 1 thread", count, ok, usecs);
+    if (ok == 0) {
+        printf ("Error: %s does not respond, check host, credentials and oid\n", host);
+        zmsnmp_reset ();
+        return 2;
+    }
+
+    // requests of all threads go through the same sockets
+    bench_get_t get = { host, &credentials, oid, count > BENCH_THREADS ? count / BENCH_THREADS : 1 };
+    zactor_t *threads [BENCH_THREADS];
+    int64_t start = zclock_usecs ();
+    for (int i = 0; i < BENCH_THREADS; i++)
+        threads [i] = zactor_new (s_bench_get_actor, &get);
+    ok = 0;
+    for (int i = 0; i < BENCH_THREADS; i++) {
+        char *result = zstr_recv (threads [i]);
+        ok += result ? atoi (result) : 0;
+        zstr_free (&result);
+        zactor_destroy (&threads [i]);
+    }
+    usecs = zclock_usecs () - start;
+    s_bench_report ("get, 16 threads", get.count * BENCH_THREADS, ok, usecs);
+
+    zmsnmp_reset ();
+    return 0;
+}
+
+//  --------------------------------------------------------------------------
+//  OID parse/format microbenchmark
+
+int
+snmp_bench_oid (int count)
+{
+    if (count <= 0) return 1;
+
+    oid name [MAX_OID_LEN];
+    size_t len;
+    char buffer [256];
+    int noids = 0;
+    while (s_bench_oids [noids]) ++noids;
+
+    int64_t start = zclock_usecs ();
+    for (int i = 0; i < count; i++) {
+        len = MAX_OID_LEN;
+        if (!read_objid (s_bench_oids [i % noids], name, &len)) return 2;
+    }
+    s_bench_report ("parse, read_objid", count, count, zclock_usecs () - start);
+
+    start = zclock_usecs ();
+    for (int i = 0; i < count; i++) {
+        if (!zmsnmp_oid_parse (s_bench_oids [i % noids], name, MAX_OID_LEN)) return 2;
+    }
+    s_bench_report ("parse, interned", count, count, zclock_usecs () - start);
+
+    len = zmsnmp_oid_parse (s_bench_oids [noids - 1], name, MAX_OID_LEN);
+    start = zclock_usecs ();
+    for (int i = 0; i < count; i++) {
+        netsnmp_ds_set_int (NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_OID_OUTPUT_FORMAT, NETSNMP_OID_OUTPUT_NUMERIC);
+        snprint_objid (buffer, sizeof (buffer), name, len);
+    }
+    s_bench_report ("format, snprint_objid", count, count, zclock_usecs () - start);
+
+    start = zclock_usecs ();
+    for (int i = 0; i < count; i++) {
+        zmsnmp_oid_format (name, len, buffer, sizeof (buffer));
+    }
+    s_bench_report ("format, numeric", count, count, zclock_usecs () - start);
+
+    zmsnmp_reset ();
+    return 0;
+}
+
+//  --------------------------------------------------------------------------
+//  Value conversion microbenchmark
+
+int
+snmp_bench_value (int count)
+{
+    if (count <= 0) return 1;
+
+    // typical varbinds of a poll: counters, gauge, uptime, description
+    netsnmp_variable_list *vars = NULL;
+    oid name [MAX_OID_LEN];
+    size_t len = zmsnmp_oid_parse (s_bench_oids [0], name, MAX_OID_LEN);
+    long counter = 3735928559L;
+    long gauge = 42;
+    long ticks = 123456789;
+    struct counter64 octets = { 12, 3456789 };
+    const char *descr = "Linux server 4.9.0-3-amd64 #1 SMP Debian 4.9.30-2 x86_64";
+    snmp_varlist_add_variable (&vars, name, len, ASN_COUNTER, &counter, sizeof (counter));
+    snmp_varlist_add_variable (&vars, name, len, ASN_GAUGE, &gauge, sizeof (gauge));
+    snmp_varlist_add_variable (&vars, name, len, ASN_TIMETICKS, &ticks, sizeof (ticks));
+    snmp_varlist_add_variable (&vars, name, len, ASN_COUNTER64, &octets, sizeof (octets));
+    snmp_varlist_add_variable (&vars, name, len, ASN_OCTET_STR, descr, strlen (descr));
+    if (!vars) return 2;
+    int nvars = 0;
+    for (netsnmp_variable_list *var = vars; var; var = var->next_variable) ++nvars;
+
+    // printed to string and parsed back by lua tonumber
+    char buffer [1024];
+    double sum = 0;
+    int64_t start = zclock_usecs ();
+    for (int i = 0; i < count; i += nvars) {
+        for (netsnmp_variable_list *var = vars; var; var = var->next_variable) {
+            netsnmp_ds_set_boolean (NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT, true);
+            snprint_value (buffer, sizeof (buffer), var->name, var->name_length, var);
+            char *value = strdup (buffer);
+            sum += strtod (value, NULL);
+            free (value);
+        }
+    }
+    s_bench_report ("value, snprint_value", count, count, zclock_usecs () - start);
+
+    // typed values
+    start = zclock_usecs ();
+    for (int i = 0; i < count; i += nvars) {
+        for (netsnmp_variable_list *var = vars; var; var = var->next_variable) {
+            zmsnmp_value_t *value = zmsnmp_value_from_varbind (var);
+            sum += zmsnmp_value_number (value);
+            zmsnmp_value_destroy (&value);
+        }
+    }
+    s_bench_report ("value, typed", count, count, zclock_usecs () - start);
+
+    snmp_free_varbind (vars);
+    return sum >= 0 ? 0 : 2;
+}
+
+//  --------------------------------------------------------------------------
+//  Resident memory of the process in bytes, 0 if unknown
+
+static size_t
+s_bench_rss (void)
+{
+    size_t rss = 0;
+#if defined (ZM_METRIC_HAVE_LINUX)
+    FILE *file = fopen ("/proc/self/statm", "r");
+    if (file) {
+        unsigned long size, resident;
+        if (fscanf (file, "%lu %lu", &size, &resident) == 2)
+            rss = (size_t) resident * (size_t) sysconf (_SC_PAGESIZE);
+        fclose (file);
+    }
+#endif
+    return rss;
+}
+
+//  --------------------------------------------------------------------------
+//  Print one line of memory results
+
+static void
+s_bench_memory_report (const char *name, int hosts, int rules, size_t before, size_t after)
+{
+    double used = after > before ? (double) (after - before) : 0;
+    printf ("%-24s %8i hosts %8i rules %12.1f KiB/host\n", name, hosts, rules, used / 1024.0 / hosts);
+}
+
+//  --------------------------------------------------------------------------
+//  Memory needed by rules of monitored hosts
+
+int
+snmp_bench_memory (int hosts, int rules)
+{
+    if (hosts <= 0 || rules <= 0) return 1;
+    if (s_bench_rss () == 0) {
+        printf ("Error: resident memory can't be measured on this system\n");
+        return 2;
+    }
+
+    const char *code = s_bench_rule;
+    luasnmp_init ();
+
+    // shared lua states of workers, measured first, freed memory of the
+    // other variant would be reused
+    size_t before = s_bench_rss ();
+    worker_pool_t *pool = worker_pool_new (0);
+    for (int h = 0; h < hosts; h++) {
+        char asset [32];
+        snprintf (asset, sizeof (asset), "host-%i", h);
+        worker_pool_add_host (pool, asset);
+        zmsg_t *msg = zmsg_new ();
+        zmsg_addstr (msg, "IP");
+        zmsg_addstr (msg, "127.0.0.1");
+        worker_pool_post (pool, asset, &msg);
+        for (int r = 0; r < rules; r++) {
+            char name [32];
+            snprintf (name, sizeof (name), "rule-%i", r);
+            msg = zmsg_new ();
+            zmsg_addstr (msg, "LUA");
+            zmsg_addstr (msg, name);
+            zmsg_addstr (msg, code);
+            zmsg_addstr (msg, "60");
+            worker_pool_post (pool, asset, &msg);
+            msg = zmsg_new ();
+            zmsg_addstr (msg, "EVALUATE");
+            zmsg_addstr (msg, name);
+            worker_pool_post (pool, asset, &msg);
+        }
+    }
+    // every evaluation confirms itself
+    int done = 0;
+    while (done < hosts * rules) {
+        zmsg_t *msg = zmsg_recv (worker_pool_socket (pool));
+        if (!msg) break;
+        char *command = zmsg_popstr (msg);
+        if (command && streq (command, "DONE")) ++done;
+        zstr_free (&command);
+        zmsg_destroy (&msg);
+    }
+    s_bench_memory_report ("lua state per worker", hosts, rules, before, s_bench_rss ());
+    worker_pool_destroy (&pool);
+
+    // lua state per host and rule
+    before = s_bench_rss ();
+    size_t count = (size_t) hosts * rules;
+    lua_State **states = (lua_State **) zmalloc (count * sizeof (lua_State *));
+    assert (states);
+    for (size_t i = 0; i < count; i++) {
+        states [i] = luasnmp_new ();
+        if (states [i] && luaL_dostring (states [i], code) != 0)
+            luasnmp_destroy (&states [i]);
+    }
+    s_bench_memory_report ("lua state per rule", hosts, rules, before, s_bench_rss ());
+    for (size_t i = 0; i < count; i++)
+        luasnmp_destroy (&states [i]);
+    free (states);
+    return done == hosts * rules ? 0 : 2;
+}
+
+//  --------------------------------------------------------------------------
+//  Deploy rules to assets in worker pool the way server does it, source or
+//  bytecode, and wait until every rule is evaluated once. Returns time in
+//  us, -1 if some evaluation was not confirmed.
+
+static int64_t
+s_bench_deploy (rule_t **list, int assets, int rules, bool bytecode)
+{
+    int64_t start = zclock_usecs ();
+    worker_pool_t *pool = worker_pool_new (0);
+    for (int a = 0; a < assets; a++) {
+        char asset [32];
+        snprintf (asset, sizeof (asset), "asset-%i", a);
+        worker_pool_add_host (pool, asset);
+        for (int r = 0; r < rules; r++) {
+            size_t size = 0;
+            const char *code = bytecode ? rule_bytecode (list [r], &size) : rule_evaluation (list [r]);
+            if (!bytecode) size = strlen (code);
+            zmsg_t *msg = zmsg_new ();
+            zmsg_addstr (msg, "LUA");
+            zmsg_addstr (msg, rule_name (list [r]));
+            zmsg_addmem (msg, code, size);
+            zmsg_addstr (msg, "60");
+            worker_pool_post (pool, asset, &msg);
+            msg = zmsg_new ();
+            zmsg_addstr (msg, "EVALUATE");
+            zmsg_addstr (msg, rule_name (list [r]));
+            worker_pool_post (pool, asset, &msg);
+        }
+    }
+    int done = 0;
+    while (done < assets * rules) {
+        zmsg_t *msg = zmsg_recv (worker_pool_socket (pool));
+        if (!msg) break;
+        char *command = zmsg_popstr (msg);
+        if (command && streq (command, "DONE")) ++done;
+        zstr_free (&command);
+        zmsg_destroy (&msg);
+    }
+    int64_t usecs = zclock_usecs () - start;
+    worker_pool_destroy (&pool);
+    return done == assets * rules ? usecs : -1;
+}
+
+//  --------------------------------------------------------------------------
+//  Print one line of startup results
+
+static void
+s_bench_startup_report (const char *name, int count, int64_t usecs)
+{
+    double rate = usecs > 0 ? (double) count * 1000000.0 / usecs : 0;
+    printf ("%-24s %8i rules %12.1f ms %12.1f rules/s\n", name, count, usecs / 1000.0, rate);
+}
+
+//  --------------------------------------------------------------------------
+//  Startup with many assets, rules loaded from source and from bytecode
+
+int
+snmp_bench_startup (int assets, int rules)
+{
+    if (assets <= 0 || rules <= 0) return 1;
+
+    luasnmp_init ();
+    // rules compiled by rule_parse as the server does it
+    rule_t **list = (rule_t **) zmalloc (rules * sizeof (rule_t *));
+    assert (list);
+    int result = 0;
+    for (int r = 0; r < rules && result == 0; r++) {
+        char *escaped = (char *) zmalloc (2 * strlen (s_bench_rule) + 1);
+        char *e = escaped;
+        for (const char *c = s_bench_rule; *c; c++) {
+            if (*c == '\n') { *e++ = '\\'; *e++ = 'n'; }
+            else *e++ = *c;
+        }
+        char *text = zsys_sprintf ("{ \"name\" : \"rule-%i\", \"evaluation\" : \"%s\" }", r, escaped);
+        list [r] = rule_new ();
+        if (rule_parse (list [r], text) != 0 || !rule_bytecode (list [r], NULL))
+            result = 2;
+        zstr_free (&text);
+        free (escaped);
+    }
+
+    // load of one chunk, this is what every lua state pays for every rule
+    if (result == 0) {
+        int count = assets * rules;
+        lua_State *L = luasnmp_new ();
+        size_t size = 0;
+        const char *bytecode = rule_bytecode (list [0], &size);
+        int64_t start = zclock_usecs ();
+        for (int i = 0; i < count && result == 0; i++) {
+            if (luaL_loadbuffer (L, s_bench_rule, strlen (s_bench_rule), "rule-0") != 0) result = 3;
+            lua_settop (L, 0);
+        }
+        s_bench_startup_report ("load, source", count, zclock_usecs () - start);
+        start = zclock_usecs ();
+        for (int i = 0; i < count && result == 0; i++) {
+            if (luaL_loadbuffer (L, bytecode, size, "rule-0") != 0) result = 3;
+            lua_settop (L, 0);
+        }
+        s_bench_startup_report ("load, bytecode", count, zclock_usecs () - start);
+        luasnmp_destroy (&L);
+    }
+
+    // whole deployment through worker pool
+    if (result == 0) {
+        int64_t usecs = s_bench_deploy (list, assets, rules, false);
+        if (usecs < 0) result = 4;
+        else s_bench_startup_report ("deploy, source", assets * rules, usecs);
+    }
+    if (result == 0) {
+        int64_t usecs = s_bench_deploy (list, assets, rules, true);
+        if (usecs < 0) result = 4;
+        else s_bench_startup_report ("deploy, bytecode", assets * rules, usecs);
+    }
+    for (int r = 0; r < rules; r++)
+        rule_destroy (&list [r]);
+    free (list);
+    return result;
+}
+
+//  --------------------------------------------------------------------------
+//  Rule evaluation throughput
+
+int
+snmp_bench_eval (int count)
+{
+    if (count <= 0) return 1;
+
+    // heavy rule, walk tables are post processed in lua
+    const char *code =
+        "function main (host)\n"
+        "    local octets = snmp_walk (host, '.1.3.6.1.2.1.31.1.1.1.6')\n"
+        "    local speeds = snmp_walk (host, '.1.3.6.1.2.1.31.1.1.1.15')\n"
+        "    if not octets or not speeds then return {} end\n"
+        "    local speed = {}\n"
+        "    for oid, value in pairs (speeds) do\n"
+        "        speed [tonumber (oid:match ('(%d+)$'))] = value\n"
+        "    end\n"
+        "    local total, busiest, up = 0, 0, 0\n"
+        "    for oid, value in pairs (octets) do\n"
+        "        local index = tonumber (oid:match ('(%d+)$'))\n"
+        "        total = total + value\n"
+        "        local mbps = speed [index] or 0\n"
+        "        if mbps > 0 then\n"
+        "            up = up + 1\n"
+        "            local load = value * 8 / (mbps * 1000000)\n"
+        "            if load > busiest then busiest = load end\n"
+        "        end\n"
+        "    end\n"
+        "    return { 'octets', total, 'B', 'up', up, '', 'busiest', busiest, '' }\n"
+        "end\n";
+
+    // interface table of a switch, answered from snapshot
+    luasnmp_init ();
+    snmp_snapshot_t *snapshot = snmp_snapshot_new ();
+    for (int i = 1; i <= 256; i++) {
+        char oid [64];
+        zmsnmp_value_t *value = zmsnmp_value_new_counter64 ((uint64_t) i * 1234567);
+        snprintf (oid, sizeof (oid), ".1.3.6.1.2.1.31.1.1.1.6.%i", i);
+        snmp_snapshot_put (snapshot, oid, value);
+        zmsnmp_value_destroy (&value);
+        value = zmsnmp_value_new_integer (ZMSNMP_TYPE_GAUGE32, i % 4 ? 1000 : 0);
+        snprintf (oid, sizeof (oid), ".1.3.6.1.2.1.31.1.1.1.15.%i", i);
+        snmp_snapshot_put (snapshot, oid, value);
+        zmsnmp_value_destroy (&value);
+    }
+
+    int result = 0;
+    lua_runtime_t *runtime = lua_runtime_new ();
+    lua_State *L = lua_runtime_state (runtime);
+    luasnmp_set_snapshot (L, snapshot, true);
+    lua_code_t *rule = lua_runtime_add (runtime, "interfaces", code, strlen (code));
+    snmp_credentials_t credentials = { 2, "public" };
+    if (!rule)
+        result = 2;
+    int ok = 0;
+    int64_t start = zclock_usecs ();
+    for (int i = 0; i < count && result == 0; i++) {
+        if (lua_runtime_call (runtime, rule, "switch", "127.0.0.1", &credentials) == 0
+        &&  lua_istable (L, -1)) {
+            // busiest interface is the last value
+            lua_rawgeti (L, -1, 8);
+            if (lua_tonumber (L, -1) > 0) ++ok;
+        }
+        lua_settop (L, 0);
+    }
+    if (result == 0) {
+        int64_t usecs = zclock_usecs () - start;
+        double rate = usecs > 0 ? (double) count * 1000000.0 / usecs : 0;
+        printf ("%-24s %8i evaluations %8i failed %12.1f eval/s\n", luasnmp_backend (), count, count - ok, rate);
+        if (ok != count) result = 3;
+    }
+    luasnmp_set_snapshot (L, NULL, false);
+    lua_runtime_release (&rule);
+    lua_runtime_destroy (&runtime);
+    snmp_snapshot_destroy (&snapshot);
+    return result;
+}
+
+//  --------------------------------------------------------------------------
+//  Self test of this class
+
+void
+snmp_bench_test (bool verbose)
+{
+    printf (" * snmp_bench: ");
+    //  @selftest
+    assert (snmp_bench (NULL, 1, "public", ".1.3.6.1.2.1.1.1.0", 10) != 0);
+    assert (snmp_bench ("localhost", 1, "public", ".1.3.6.1.2.1.1.1.0", 0) != 0);
+    assert (snmp_bench_oid (0) != 0);
+    assert (snmp_bench_value (0) != 0);
+    assert (snmp_bench_memory (0, 8) != 0);
+    assert (snmp_bench_startup (0, 8) != 0);
+    assert (snmp_bench_eval (0) != 0);
+    assert (snmp_bench_eval (10) == 0);
+    //  @end
+    printf ("OK\n");
+}
@@ -0,0 +1,361 @@
+/*  =========================================================================
+    snmp_ber - BER encoding and decoding of SNMP v1/v2c messages
+
+    Copyright (C) 2016 - 2017 Tomas Halman
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    snmp_ber - BER encoding and decoding of SNMP v1/v2c messages
+@discuss
+    The subset of BER SNMP messages need: definite lengths of up to three
+    bytes, integers of up to 8 bytes and oids of 32 bit sub-identifiers.
+    Shared by snmp_transport, which encodes requests and decodes
+    responses, and snmpsim, which does the opposite. Encoding functions
+    write to caller's buffer and return false when out of space, decoding
+    ones never read past the end of data.
+@end
+*/
+
+#include "zm_metric_classes.h"
+
+//  --------------------------------------------------------------------------
+//  Append tag and length of content
+
+bool
+snmp_ber_put_header (byte *data, size_t *pos, size_t size, byte tag, size_t length)
+{
+    size_t needed = length < 0x80 ? 2 : (length < 0x100 ? 3 : 4);
+    if (length > SNMP_BER_LENGTH_MAX || *pos + needed + length > size) return false;
+    data [(*pos)++] = tag;
+    if (length < 0x80)
+        data [(*pos)++] = (byte) length;
+    else
+    if (length < 0x100) {
+        data [(*pos)++] = 0x81;
+        data [(*pos)++] = (byte) length;
+    }
+    else {
+        data [(*pos)++] = 0x82;
+        data [(*pos)++] = (byte) (length >> 8);
+        data [(*pos)++] = (byte) length;
+    }
+    return true;
+}
+
+//  --------------------------------------------------------------------------
+//  Append tag, length and value
+
+bool
+snmp_ber_put (byte *data, size_t *pos, size_t size, byte tag, const byte *value, size_t length)
+{
+    if (!snmp_ber_put_header (data, pos, size, tag, length)) return false;
+    if (length) memcpy (data + *pos, value, length);
+    *pos += length;
+    return true;
+}
+
+//  --------------------------------------------------------------------------
+//  Append already encoded bytes
+
+bool
+snmp_ber_put_raw (byte *data, size_t *pos, size_t size, const byte *value, size_t length)
+{
+    if (*pos + length > size) return false;
+    memcpy (data + *pos, value, length);
+    *pos += length;
+    return true;
+}
+
+//  --------------------------------------------------------------------------
+//  Append INTEGER
+
+bool
+snmp_ber_put_integer (byte *data, size_t *pos, size_t size, int64_t value)
+{
+    byte bytes [8];
+    return snmp_ber_put (data, pos, size, BER_INTEGER, bytes, snmp_ber_encode_integer (value, bytes));
+}
+
+//  --------------------------------------------------------------------------
+//  Two's complement integer in as few bytes as possible
+
+size_t
+snmp_ber_encode_integer (int64_t value, byte *buffer)
+{
+    byte bytes [8];
+    for (int i = 7; i >= 0; i--) {
+        bytes [i] = (byte) value;
+        value >>= 8;
+    }
+    int start = 0;
+    while (start < 7
+    && ((bytes [start] == 0x00 && !(bytes [start + 1] & 0x80))
+    ||  (bytes [start] == 0xFF && (bytes [start + 1] & 0x80))))
+        ++start;
+    memcpy (buffer, bytes + start, 8 - start);
+    return 8 - start;
+}
+
+//  --------------------------------------------------------------------------
+//  Unsigned integer, leading zero keeps it positive
+
+size_t
+snmp_ber_encode_unsigned (uint64_t value, byte *buffer)
+{
+    byte bytes [9];
+    bytes [0] = 0;
+    for (int i = 8; i >= 1; i--) {
+        bytes [i] = (byte) value;
+        value >>= 8;
+    }
+    int start = 0;
+    while (start < 8 && bytes [start] == 0 && !(bytes [start + 1] & 0x80))
+        ++start;
+    memcpy (buffer, bytes + start, 9 - start);
+    return 9 - start;
+}
+
+//  --------------------------------------------------------------------------
+//  Content of oid, the first two arcs share one sub-identifier which can
+//  be over 32 bits for arc 2
+
+size_t
+snmp_ber_encode_oid (const uint32_t *oid, size_t len, byte *buffer)
+{
+    size_t pos = 0;
+    for (size_t i = 0; i < len; i++) {
+        uint64_t value;
+        if (i == 0) {
+            value = (uint64_t) oid [0] * 40 + (len > 1 ? oid [1] : 0);
+            ++i;
+        }
+        else
+            value = oid [i];
+        byte digits [5];
+        int n = 0;
+        do {
+            digits [n++] = value & 0x7f;
+            value >>= 7;
+        } while (value);
+        while (n > 1) buffer [pos++] = digits [--n] | 0x80;
+        buffer [pos++] = digits [0];
+    }
+    return pos;
+}
+
+//  --------------------------------------------------------------------------
+//  Read tag and length of the next element
+
+bool
+snmp_ber_get_header (snmp_ber_reader_t *ber, byte *tag, size_t *length)
+{
+    if (ber->pos + 2 > ber->size) return false;
+    *tag = ber->data [ber->pos++];
+    size_t len = ber->data [ber->pos++];
+    if (len & 0x80) {
+        size_t bytes = len & 0x7f;
+        if (bytes == 0 || bytes > 3 || ber->pos + bytes > ber->size) return false;
+        len = 0;
+        while (bytes--) len = (len << 8) | ber->data [ber->pos++];
+    }
+    if (ber->pos + len > ber->size) return false;
+    *length = len;
+    return true;
+}
+
+//  --------------------------------------------------------------------------
+//  Read INTEGER
+
+bool
+snmp_ber_get_integer (snmp_ber_reader_t *ber, int64_t *value)
+{
+    byte tag;
+    size_t length;
+    if (!snmp_ber_get_header (ber, &tag, &length) || tag != BER_INTEGER || length < 1 || length > 8) return false;
+    int64_t result = (ber->data [ber->pos] & 0x80) ? -1 : 0;
+    for (size_t i = 0; i < length; i++)
+        result = (int64_t) (((uint64_t) result << 8) | ber->data [ber->pos++]);
+    *value = result;
+    return true;
+}
+
+//  --------------------------------------------------------------------------
+//  Decode content of oid
+
+size_t
+snmp_ber_decode_oid (const byte *data, size_t size, uint32_t *oid, size_t max)
+{
+    if (max < 2) return 0;
+    size_t n = 0;
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; i++) {
+        value = (value << 7) | (data [i] & 0x7f);
+        // the first sub-identifier carries 80 more for arc 2
+        if (value > 0xFFFFFFFFULL + (n == 0 ? 80 : 0)) return 0;
+        if (data [i] & 0x80) continue;
+        if (n == 0) {
+            uint32_t first = value < 80 ? (uint32_t) value / 40 : 2;
+            oid [n++] = first;
+            oid [n++] = (uint32_t) (value - first * 40);
+        }
+        else {
+            if (n >= max) return 0;
+            oid [n++] = (uint32_t) value;
+        }
+        value = 0;
+    }
+    // data ending inside of sub-identifier
+    if (size && (data [size - 1] & 0x80)) return 0;
+    return n;
+}
+
+//  --------------------------------------------------------------------------
+//  Self test of this class
+
+void
+snmp_ber_test (bool verbose)
+{
+    printf (" * snmp_ber: ");
+
+    //  @selftest
+    // lengths take 1, 2 or 3 bytes and read back
+    {
+        const size_t lengths [] = { 0, 0x7F, 0x80, 0xFF, 0x100, 0xFFFF };
+        const size_t headers [] = { 2, 2, 3, 3, 4, 4 };
+        size_t size = SNMP_BER_LENGTH_MAX + 4;
+        byte *data = (byte *) zmalloc (size);
+        assert (data);
+        for (size_t i = 0; i < sizeof (lengths) / sizeof (lengths [0]); i++) {
+            size_t pos = 0;
+            assert (snmp_ber_put_header (data, &pos, size, BER_OCTET_STRING, lengths [i]));
+            assert (pos == headers [i]);
+            snmp_ber_reader_t ber = { data, 0, pos + lengths [i] };
+            byte tag;
+            size_t length;
+            assert (snmp_ber_get_header (&ber, &tag, &length));
+            assert (tag == BER_OCTET_STRING && length == lengths [i] && ber.pos == headers [i]);
+            // content must be there
+            ber.pos = 0;
+            ber.size = pos + lengths [i] - (lengths [i] ? 1 : 0);
+            assert (snmp_ber_get_header (&ber, &tag, &length) == (lengths [i] == 0));
+        }
+        size_t pos = 0;
+        assert (!snmp_ber_put_header (data, &pos, size + 1, BER_SEQUENCE, SNMP_BER_LENGTH_MAX + 1));
+        assert (pos == 0);
+        assert (!snmp_ber_put_header (data, &pos, 0x82, BER_SEQUENCE, 0x80));
+        assert (snmp_ber_put_header (data, &pos, 0x83, BER_SEQUENCE, 0x80));
+        free (data);
+
+        // three length bytes are read, indefinite and longer ones are not
+        const byte three [] = { BER_OCTET_STRING, 0x83, 0x00, 0x00, 0x01, 'x' };
+        snmp_ber_reader_t ber = { three, 0, sizeof (three) };
+        byte tag;
+        size_t length;
+        assert (snmp_ber_get_header (&ber, &tag, &length) && length == 1 && ber.pos == 5);
+        const byte four [] = { BER_OCTET_STRING, 0x84, 0x00, 0x00, 0x00, 0x01, 'x' };
+        ber = (snmp_ber_reader_t) { four, 0, sizeof (four) };
+        assert (!snmp_ber_get_header (&ber, &tag, &length));
+        const byte indefinite [] = { BER_SEQUENCE, 0x80, 0x00, 0x00 };
+        ber = (snmp_ber_reader_t) { indefinite, 0, sizeof (indefinite) };
+        assert (!snmp_ber_get_header (&ber, &tag, &length));
+        ber = (snmp_ber_reader_t) { three, 0, 3 };
+        assert (!snmp_ber_get_header (&ber, &tag, &length));
+        ber = (snmp_ber_reader_t) { three, 0, 1 };
+        assert (!snmp_ber_get_header (&ber, &tag, &length));
+    }
+
+    // integers are minimal two's complement
+    {
+        const int64_t values [] = { 0, 127, 128, -1, -128, -129, 0xFFFFFFFFLL, INT64_MAX, INT64_MIN };
+        const size_t sizes [] = { 1, 1, 2, 1, 1, 2, 5, 8, 8 };
+        for (size_t i = 0; i < sizeof (values) / sizeof (values [0]); i++) {
+            byte data [10];
+            size_t pos = 0;
+            assert (snmp_ber_put_integer (data, &pos, sizeof (data), values [i]));
+            assert (pos == 2 + sizes [i]);
+            snmp_ber_reader_t ber = { data, 0, pos };
+            int64_t value;
+            assert (snmp_ber_get_integer (&ber, &value) && value == values [i]);
+            assert (ber.pos == pos);
+        }
+        byte buffer [9];
+        assert (snmp_ber_encode_integer (128, buffer) == 2 && buffer [0] == 0x00 && buffer [1] == 0x80);
+        assert (snmp_ber_encode_integer (-129, buffer) == 2 && buffer [0] == 0xFF && buffer [1] == 0x7F);
+        assert (snmp_ber_encode_unsigned (0, buffer) == 1 && buffer [0] == 0);
+        assert (snmp_ber_encode_unsigned (0xFFFFFFFF, buffer) == 5 && buffer [0] == 0 && buffer [1] == 0xFF);
+        assert (snmp_ber_encode_unsigned (UINT64_MAX, buffer) == 9 && buffer [0] == 0);
+
+        byte small [3];
+        size_t pos = 0;
+        assert (!snmp_ber_put_integer (small, &pos, sizeof (small), 128));
+        assert (pos == 0);
+        const byte nine [] = { BER_INTEGER, 9, 0, 0, 0, 0, 0, 0, 0, 0, 1 };
+        snmp_ber_reader_t ber = { nine, 0, sizeof (nine) };
+        int64_t value;
+        assert (!snmp_ber_get_integer (&ber, &value));
+        const byte string [] = { BER_OCTET_STRING, 1, 1 };
+        ber = (snmp_ber_reader_t) { string, 0, sizeof (string) };
+        assert (!snmp_ber_get_integer (&ber, &value));
+    }
+
+    // sub-identifiers of up to 32 bits take up to 5 bytes
+    {
+        const uint32_t oid [] = { 1, 3, 127, 128, 16383, 16384, 4294967295U };
+        const byte expected [] = {
+            0x2B, 0x7F, 0x81, 0x00, 0xFF, 0x7F, 0x81, 0x80, 0x00,
+            0x8F, 0xFF, 0xFF, 0xFF, 0x7F
+        };
+        size_t len = sizeof (oid) / sizeof (oid [0]);
+        byte buffer [sizeof (oid) / sizeof (oid [0]) * 5];
+        size_t size = snmp_ber_encode_oid (oid, len, buffer);
+        assert (size == sizeof (expected));
+        assert (memcmp (buffer, expected, size) == 0);
+        uint32_t decoded [16];
+        assert (snmp_ber_decode_oid (buffer, size, decoded, 16) == len);
+        assert (memcmp (decoded, oid, sizeof (oid)) == 0);
+        // too many of them
+        assert (snmp_ber_decode_oid (buffer, size, decoded, len - 1) == 0);
+        assert (snmp_ber_decode_oid (buffer, size, decoded, 1) == 0);
+
+        // arc 2 can have the second arc over 39, up to 32 bits too
+        const uint32_t arc2 [] = { 2, 999, 3 };
+        size = snmp_ber_encode_oid (arc2, 3, buffer);
+        assert (size == 3 && buffer [0] == 0x88 && buffer [1] == 0x37 && buffer [2] == 0x03);
+        assert (snmp_ber_decode_oid (buffer, size, decoded, 16) == 3);
+        assert (memcmp (decoded, arc2, sizeof (arc2)) == 0);
+        const uint32_t arc2max [] = { 2, 4294967295U };
+        size = snmp_ber_encode_oid (arc2max, 2, buffer);
+        assert (size == 5);
+        assert (snmp_ber_decode_oid (buffer, size, decoded, 16) == 2);
+        assert (decoded [0] == 2 && decoded [1] == 4294967295U);
+
+        // values over 32 bits and data ending inside of a value are refused
+        const byte overlong [] = { 0x2B, 0x90, 0x80, 0x80, 0x80, 0x00 };
+        assert (snmp_ber_decode_oid (overlong, sizeof (overlong), decoded, 16) == 0);
+        const byte padded [] = { 0x2B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x01 };
+        assert (snmp_ber_decode_oid (padded, sizeof (padded), decoded, 16) == 3);
+        assert (decoded [2] == 1);
+        const byte truncated [] = { 0x2B, 0x06, 0x81 };
+        assert (snmp_ber_decode_oid (truncated, sizeof (truncated), decoded, 16) == 0);
+        assert (snmp_ber_decode_oid (truncated, 0, decoded, 16) == 0);
+    }
+    //  @end
+
+    printf ("OK\n");
+}
@@ -0,0 +1,119 @@
+/*  =========================================================================
+    snmp_ber - BER encoding and decoding of SNMP v1/v2c messages
+
+    Copyright (C) 2016 - 2017 Tomas Halman
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#ifndef SNMP_BER_H_INCLUDED
+#define SNMP_BER_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//  BER tags used by SNMP v1/v2c
+#define BER_INTEGER         0x02
+#define BER_OCTET_STRING    0x04
+#define BER_NULL            0x05
+#define BER_OID             0x06
+#define BER_SEQUENCE        0x30
+#define BER_IPADDRESS       0x40
+#define BER_COUNTER32       0x41
+#define BER_GAUGE32         0x42
+#define BER_TIMETICKS       0x43
+#define BER_COUNTER64       0x46
+#define BER_NOSUCHOBJECT    0x80
+#define BER_NOSUCHINSTANCE  0x81
+#define BER_ENDOFMIBVIEW    0x82
+#define PDU_GET             0xA0
+#define PDU_GETNEXT         0xA1
+#define PDU_RESPONSE        0xA2
+#define PDU_GETBULK         0xA5
+
+#define SNMP_BER_LENGTH_MAX 0xFFFF      // longest content put_header writes
+
+//  Read position in BER data
+typedef struct {
+    const byte *data;
+    size_t pos;
+    size_t size;
+} snmp_ber_reader_t;
+
+//  @interface
+//  Append tag and length of content to data at pos, data has size bytes.
+//  Length takes 1 byte below 0x80, otherwise 0x81 or 0x82 and 1 or 2
+//  bytes. Returns false when the header and the content would not fit or
+//  length is over SNMP_BER_LENGTH_MAX.
+ZM_METRIC_PRIVATE bool
+    snmp_ber_put_header (byte *data, size_t *pos, size_t size, byte tag, size_t length);
+
+//  Append tag, length and value. Returns false when out of space.
+ZM_METRIC_PRIVATE bool
+    snmp_ber_put (byte *data, size_t *pos, size_t size, byte tag, const byte *value, size_t length);
+
+//  Append already encoded bytes. Returns false when out of space.
+ZM_METRIC_PRIVATE bool
+    snmp_ber_put_raw (byte *data, size_t *pos, size_t size, const byte *value, size_t length);
+
+//  Append INTEGER. Returns false when out of space.
+ZM_METRIC_PRIVATE bool
+    snmp_ber_put_integer (byte *data, size_t *pos, size_t size, int64_t value);
+
+//  Encode content of two's complement integer in as few bytes as possible
+//  to buffer of 8 bytes. Returns number of bytes.
+ZM_METRIC_PRIVATE size_t
+    snmp_ber_encode_integer (int64_t value, byte *buffer);
+
+//  Encode content of unsigned integer (Counter, Gauge, Counter64) to
+//  buffer of 9 bytes, leading zero keeps it positive. Returns number of
+//  bytes.
+ZM_METRIC_PRIVATE size_t
+    snmp_ber_encode_unsigned (uint64_t value, byte *buffer);
+
+//  Encode content of oid of len sub-identifiers (at least 2) to buffer of
+//  5 * len bytes. Returns number of bytes.
+ZM_METRIC_PRIVATE size_t
+    snmp_ber_encode_oid (const uint32_t *oid, size_t len, byte *buffer);
+
+//  Read tag and length of the next element, the reader moves to its
+//  content. Returns false if data is truncated or length is indefinite
+//  or longer than 3 bytes.
+ZM_METRIC_PRIVATE bool
+    snmp_ber_get_header (snmp_ber_reader_t *ber, byte *tag, size_t *length);
+
+//  Read INTEGER of at most 8 bytes. Returns false on other element.
+ZM_METRIC_PRIVATE bool
+    snmp_ber_get_integer (snmp_ber_reader_t *ber, int64_t *value);
+
+//  Decode content of oid to at most max sub-identifiers. Returns number
+//  of sub-identifiers, 0 if data is not valid (sub-identifier over 32
+//  bits, truncated one or too many of them).
+ZM_METRIC_PRIVATE size_t
+    snmp_ber_decode_oid (const byte *data, size_t size, uint32_t *oid, size_t max);
+
+//  Self test of this class
+ZM_METRIC_PRIVATE void
+    snmp_ber_test (bool verbose);
+
+//  @end
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,335 @@
+/*  =========================================================================
+    snmp_cache - short lived cache of SNMP responses of one host
+
+    Copyright (C) 2016 - 2017 Tomas Halman
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    snmp_cache - short lived cache of SNMP responses of one host
+@discuss
+    Several rules evaluated on one host often ask for the same oids
+    (sysUpTime, ifTable, ...). Responses are kept for a short time, so
+    the second rule gets them without talking to the device. Cache is
+    owned by host, so it is used by one thread at a time. Only hit/miss
+    counters of all caches are global.
+@end
+*/
+
+#include "zm_metric_classes.h"
+
+typedef struct {
+    zmsnmp_value_t *value;
+    char *next;         // next oid for getnext responses
+    int64_t expires;    // zclock_mono
+} cache_entry_t;
+
+//  Structure of our class
+
+struct _snmp_cache_t {
+    int64_t ttl;        // ms
+    zhash_t *entries;   // "g" or "n" + oid -> cache_entry_t
+    uint64_t hits;
+    uint64_t misses;
+};
+
+static pthread_mutex_t s_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t s_hits = 0;
+static uint64_t s_misses = 0;
+
+//  --------------------------------------------------------------------------
+//  Entry destructor
+
+static void
+s_entry_freefn (void *data)
+{
+    cache_entry_t *entry = (cache_entry_t *) data;
+    if (!entry) return;
+    zmsnmp_value_destroy (&entry->value);
+    zstr_free (&entry->next);
+    free (entry);
+}
+
+//  --------------------------------------------------------------------------
+//  Create a new snmp_cache
+
+snmp_cache_t *
+snmp_cache_new (int64_t ttl)
+{
+    snmp_cache_t *self = (snmp_cache_t *) zmalloc (sizeof (snmp_cache_t));
+    assert (self);
+    self->ttl = ttl > 0 ? ttl : 0;
+    self->entries = zhash_new ();
+    assert (self->entries);
+    return self;
+}
+
+//  --------------------------------------------------------------------------
+//  Destroy the snmp_cache
+
+void
+snmp_cache_destroy (snmp_cache_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        snmp_cache_t *self = *self_p;
+        zhash_destroy (&self->entries);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+//  --------------------------------------------------------------------------
+//  Set lifetime of responses
+
+void
+snmp_cache_set_ttl (snmp_cache_t *self, int64_t ttl)
+{
+    if (!self) return;
+    self->ttl = ttl > 0 ? ttl : 0;
+    if (self->ttl == 0) snmp_cache_clear (self);
+}
+
+//  --------------------------------------------------------------------------
+//  Get lifetime of responses
+
+int64_t
+snmp_cache_ttl (snmp_cache_t *self)
+{
+    if (!self) return 0;
+    return self->ttl;
+}
+
+//  --------------------------------------------------------------------------
+//  Find valid entry, count hit or miss
+
+static cache_entry_t *
+s_lookup (snmp_cache_t *self, char type, const char *oid)
+{
+    if (!self || !oid || !self->ttl) return NULL;
+
+    char *key = zsys_sprintf ("%c%s", type, oid);
+    cache_entry_t *entry = (cache_entry_t *) zhash_lookup (self->entries, key);
+    if (entry && entry->expires <= zclock_mono ()) {
+        zhash_delete (self->entries, key);
+        entry = NULL;
+    }
+    zstr_free (&key);
+
+    pthread_mutex_lock (&s_stats_mutex);
+    if (entry) {
+        ++self->hits;
+        ++s_hits;
+    }
+    else {
+        ++self->misses;
+        ++s_misses;
+    }
+    pthread_mutex_unlock (&s_stats_mutex);
+    return entry;
+}
+
+//  --------------------------------------------------------------------------
+//  Store entry
+
+static void
+s_store (snmp_cache_t *self, char type, const char *oid, const zmsnmp_value_t *value, const char *next)
+{
+    if (!self || !oid || !value || !self->ttl) return;
+
+    cache_entry_t *entry = (cache_entry_t *) zmalloc (sizeof (cache_entry_t));
+    assert (entry);
+    entry->value = zmsnmp_value_dup (value);
+    if (next) entry->next = strdup (next);
+    entry->expires = zclock_mono () + self->ttl;
+
+    char *key = zsys_sprintf ("%c%s", type, oid);
+    zhash_update (self->entries, key, entry);
+    zhash_freefn (self->entries, key, s_entry_freefn);
+    zstr_free (&key);
+}
+
+//  --------------------------------------------------------------------------
+//  Look up value of get request
+
+const zmsnmp_value_t *
+snmp_cache_get (snmp_cache_t *self, const char *oid)
+{
+    cache_entry_t *entry = s_lookup (self, 'g', oid);
+    return entry ? entry->value : NULL;
+}
+
+//  --------------------------------------------------------------------------
+//  Store value of get request
+
+void
+snmp_cache_put (snmp_cache_t *self, const char *oid, const zmsnmp_value_t *value)
+{
+    s_store (self, 'g', oid, value, NULL);
+}
+
+//  --------------------------------------------------------------------------
+//  Look up result of getnext request
+
+const char *
+snmp_cache_getnext (snmp_cache_t *self, const char *oid, const zmsnmp_value_t **value)
+{
+    cache_entry_t *entry = s_lookup (self, 'n', oid);
+    if (value) *value = entry ? entry->value : NULL;
+    return entry ? entry->next : NULL;
+}
+
+//  --------------------------------------------------------------------------
+//  Store result of getnext request
+
+void
+snmp_cache_putnext (snmp_cache_t *self, const char *oid, const char *nextoid, const zmsnmp_value_t *value)
+{
+    if (!nextoid) return;
+    s_store (self, 'n', oid, value, nextoid);
+    s_store (self, 'g', nextoid, value, NULL);
+}
+
+//  --------------------------------------------------------------------------
+//  Drop all cached responses
+
+void
+snmp_cache_clear (snmp_cache_t *self)
+{
+    if (!self) return;
+    zhash_destroy (&self->entries);
+    self->entries = zhash_new ();
+    assert (self->entries);
+}
+
+//  --------------------------------------------------------------------------
+//  Drop expired responses
+
+void
+snmp_cache_purge (snmp_cache_t *self)
+{
+    if (!self || zhash_size (self->entries) == 0) return;
+
+    int64_t now = zclock_mono ();
+    zlist_t *expired = zlist_new ();
+    zlist_autofree (expired);
+    cache_entry_t *entry = (cache_entry_t *) zhash_first (self->entries);
+    while (entry) {
+        if (entry->expires <= now)
+            zlist_append (expired, (void *) zhash_cursor (self->entries));
+        entry = (cache_entry_t *) zhash_next (self->entries);
+    }
+    const char *key = (const char *) zlist_first (expired);
+    while (key) {
+        zhash_delete (self->entries, key);
+        key = (const char *) zlist_next (expired);
+    }
+    zlist_destroy (&expired);
+}
+
+//  --------------------------------------------------------------------------
+//  Number of hits
+
+uint64_t
+snmp_cache_hits (snmp_cache_t *self)
+{
+    if (!self) return 0;
+    return self->hits;
+}
+
+//  --------------------------------------------------------------------------
+//  Number of misses
+
+uint64_t
+snmp_cache_misses (snmp_cache_t *self)
+{
+    if (!self) return 0;
+    return self->misses;
+}
+
+//  --------------------------------------------------------------------------
+//  Append counters of all caches to the message
+
+void
+snmp_cache_stats (zmsg_t *msg)
+{
+    if (!msg) return;
+
+    pthread_mutex_lock (&s_stats_mutex);
+    zmsg_addstr (msg, "response-cache-hits");
+    zmsg_addstrf (msg, "%" PRIu64, s_hits);
+    zmsg_addstr (msg, "response-cache-misses");
+    zmsg_addstrf (msg, "%" PRIu64, s_misses);
+    pthread_mutex_unlock (&s_stats_mutex);
+}
+
+//  --------------------------------------------------------------------------
+//  Self test of this class
+
+void
+snmp_cache_test (bool verbose)
+{
+    printf (" * snmp_cache: ");
+
+    //  @selftest
+    snmp_cache_t *self = snmp_cache_new (200);
+    assert (self);
+    assert (snmp_cache_ttl (self) == 200);
+
+    zmsnmp_value_t *uptime = zmsnmp_value_new_integer (ZMSNMP_TYPE_TIMETICKS, 12345);
+    zmsnmp_value_t *sysdescr = zmsnmp_value_new_string (ZMSNMP_TYPE_OCTETSTRING, "Linux", 5);
+    assert (snmp_cache_get (self, ".1.3.6.1.2.1.1.3.0") == NULL);
+    snmp_cache_put (self, ".1.3.6.1.2.1.1.3.0", uptime);
+    const zmsnmp_value_t *cached = snmp_cache_get (self, ".1.3.6.1.2.1.1.3.0");
+    assert (cached && cached != uptime);
+    assert (cached->type == ZMSNMP_TYPE_TIMETICKS && cached->integer == 12345);
+    assert (snmp_cache_hits (self) == 1);
+    assert (snmp_cache_misses (self) == 1);
+
+    // getnext result is also result of get
+    const zmsnmp_value_t *value = NULL;
+    assert (snmp_cache_getnext (self, ".1.3.6.1.2.1.1", &value) == NULL);
+    assert (value == NULL);
+    snmp_cache_putnext (self, ".1.3.6.1.2.1.1", ".1.3.6.1.2.1.1.1.0", sysdescr);
+    assert (streq (snmp_cache_getnext (self, ".1.3.6.1.2.1.1", &value), ".1.3.6.1.2.1.1.1.0"));
+    assert (value && streq (value->string, "Linux"));
+    cached = snmp_cache_get (self, ".1.3.6.1.2.1.1.1.0");
+    assert (cached && cached->type == ZMSNMP_TYPE_OCTETSTRING && streq (cached->string, "Linux"));
+
+    // responses expire
+    zclock_sleep (300);
+    assert (snmp_cache_get (self, ".1.3.6.1.2.1.1.1.0") == NULL);
+    snmp_cache_purge (self);
+    assert (snmp_cache_getnext (self, ".1.3.6.1.2.1.1", &value) == NULL);
+
+    // zero ttl disables the cache
+    snmp_cache_set_ttl (self, 0);
+    snmp_cache_put (self, ".1.3.6.1.2.1.1.3.0", uptime);
+    assert (snmp_cache_get (self, ".1.3.6.1.2.1.1.3.0") == NULL);
+    zmsnmp_value_destroy (&uptime);
+    zmsnmp_value_destroy (&sysdescr);
+
+    zmsg_t *stats = zmsg_new ();
+    snmp_cache_stats (stats);
+    assert (zmsg_size (stats) == 4);
+    zmsg_destroy (&stats);
+    snmp_cache_destroy (&self);
+    //  @end
+
+    printf ("OK\n");
+}
@@ -0,0 +1,101 @@
+/*  =========================================================================
+    snmp_cache - short lived cache of SNMP responses of one host
+
+    Copyright (C) 2016 - 2017 Tomas Halman
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#ifndef SNMP_CACHE_H_INCLUDED
+#define SNMP_CACHE_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef SNMP_CACHE_T_DEFINED
+typedef struct _snmp_cache_t snmp_cache_t;
+#define SNMP_CACHE_T_DEFINED
+#endif
+
+//  @interface
+//  Create a new cache, responses are valid for ttl ms
+ZM_METRIC_PRIVATE snmp_cache_t *
+    snmp_cache_new (int64_t ttl);
+
+//  Destroy the cache
+ZM_METRIC_PRIVATE void
+    snmp_cache_destroy (snmp_cache_t **self_p);
+
+//  Set lifetime of responses in ms, 0 disables the cache
+ZM_METRIC_PRIVATE void
+    snmp_cache_set_ttl (snmp_cache_t *self, int64_t ttl);
+
+//  Get lifetime of responses in ms
+ZM_METRIC_PRIVATE int64_t
+    snmp_cache_ttl (snmp_cache_t *self);
+
+//  Look up value of get request of the oid. Oid must be in numeric form
+//  (see zmsnmp_oid_normalize). Returns NULL if not cached or expired.
+ZM_METRIC_PRIVATE const zmsnmp_value_t *
+    snmp_cache_get (snmp_cache_t *self, const char *oid);
+
+//  Store copy of value of get request of the oid
+ZM_METRIC_PRIVATE void
+    snmp_cache_put (snmp_cache_t *self, const char *oid, const zmsnmp_value_t *value);
+
+//  Look up result of getnext request of the oid. Returns the next oid and
+//  sets value, NULL if not cached or expired.
+ZM_METRIC_PRIVATE const char *
+    snmp_cache_getnext (snmp_cache_t *self, const char *oid, const zmsnmp_value_t **value);
+
+//  Store result of getnext request of the oid, value is also stored as
+//  result of get of the next oid
+ZM_METRIC_PRIVATE void
+    snmp_cache_putnext (snmp_cache_t *self, const char *oid, const char *nextoid, const zmsnmp_value_t *value);
+
+//  Drop all cached responses
+ZM_METRIC_PRIVATE void
+    snmp_cache_clear (snmp_cache_t *self);
+
+//  Drop expired responses
+ZM_METRIC_PRIVATE void
+    snmp_cache_purge (snmp_cache_t *self);
+
+//  Number of lookups answered from this cache
+ZM_METRIC_PRIVATE uint64_t
+    snmp_cache_hits (snmp_cache_t *self);
+
+//  Number of lookups not answered from this cache
+ZM_METRIC_PRIVATE uint64_t
+    snmp_cache_misses (snmp_cache_t *self);
+
+//  Append hit/miss counters of all caches to the message as name/value
+//  frame pairs
+ZM_METRIC_PRIVATE void
+    snmp_cache_stats (zmsg_t *msg);
+
+//  Self test of this class
+ZM_METRIC_PRIVATE void
+    snmp_cache_test (bool verbose);
+
+//  @end
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
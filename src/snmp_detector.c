@@ -0,0 +1,722 @@
+/*  =========================================================================
+    snmp_detector - asynchronous detection of SNMP credentials
+
+    Copyright (C) 2016 - 2017 Tomas Halman
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    snmp_detector - asynchronous detection of SNMP credentials
+@discuss
+    New host is probed with every configured community at once through
+    the asynchronous SNMP engine, so unreachable devices cost one timeout
+    instead of one timeout per community and the server loop never waits
+    for SNMP. Results are cached per ip address and can be kept in a file,
+    so after restart known devices are polled at once and their credentials
+    are just confirmed in the background.
+@end
+*/
+
+#include "zm_metric_classes.h"
+
+//  Detection of one address in progress
+typedef struct {
+    char *ip;
+    uint64_t id;                        // distinguishes detections of the same ip
+    zlist_t *assets;                    // assets waiting for the result
+    snmp_credentials_t *candidates;
+    int *status;                        // per candidate: -1 pending, 0 failed, 1 works
+    char **sysobjectids;                // per candidate, NULL if not returned
+    size_t count;
+    bool revalidate;                    // assets already got known credentials
+} detection_t;
+
+//  Detected credentials of one address
+typedef struct {
+    int version;                        // 0 = nothing works
+    char *community;
+    char *sysobjectid;                  // "" if unknown
+    int64_t success;                    // zclock_time of last working probe
+    int64_t expires;                    // zclock_mono
+    bool stale;                         // loaded or credentials changed, confirm
+} detected_t;
+
+//  Argument of probe callback
+typedef struct {
+    snmp_detector_t *detector;
+    char *ip;
+    uint64_t id;
+    size_t index;
+} probe_t;
+
+//  Structure of our class
+
+struct _snmp_detector_t {
+    zsock_t *pipe;                      // results are sent here
+    zmsnmp_engine_t *engine;
+    credentials_t *credentials;
+    zhash_t *detections;                // ip -> detection_t
+    zhash_t *cache;                     // ip -> detected_t
+    int64_t ttl;
+    uint64_t id;
+    char *filename;                     // cache is saved here, NULL = not saved
+    int64_t save_at;                    // zclock_mono of next save, 0 = no change
+};
+
+//  --------------------------------------------------------------------------
+//  Destructors
+
+static void
+s_detection_freefn (void *data)
+{
+    detection_t *detection = (detection_t *) data;
+    if (!detection) return;
+    zstr_free (&detection->ip);
+    zlist_destroy (&detection->assets);
+    for (size_t i = 0; i < detection->count; i++) {
+        zstr_free (&detection->candidates [i].community);
+        zstr_free (&detection->sysobjectids [i]);
+    }
+    free (detection->candidates);
+    free (detection->status);
+    free (detection->sysobjectids);
+    free (detection);
+}
+
+static void
+s_detected_freefn (void *data)
+{
+    detected_t *detected = (detected_t *) data;
+    if (!detected) return;
+    zstr_free (&detected->community);
+    zstr_free (&detected->sysobjectid);
+    free (detected);
+}
+
+//  --------------------------------------------------------------------------
+//  Create a new snmp_detector
+
+snmp_detector_t *
+snmp_detector_new (void)
+{
+    snmp_detector_t *self = (snmp_detector_t *) zmalloc (sizeof (snmp_detector_t));
+    assert (self);
+    self->engine = zmsnmp_engine_new ();
+    assert (self->engine);
+    zmsnmp_engine_set_timeout (self->engine, SNMP_DETECTOR_TIMEOUT, SNMP_DETECTOR_RETRIES);
+    self->credentials = credentials_new ();
+    self->detections = zhash_new ();
+    self->cache = zhash_new ();
+    assert (self->credentials && self->detections && self->cache);
+    self->ttl = SNMP_DETECTOR_TTL;
+    return self;
+}
+
+//  --------------------------------------------------------------------------
+//  Destroy the snmp_detector
+
+void
+snmp_detector_destroy (snmp_detector_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        snmp_detector_t *self = *self_p;
+        // callbacks of probes in flight find no detection
+        zhash_destroy (&self->detections);
+        zmsnmp_engine_destroy (&self->engine);
+        zhash_destroy (&self->cache);
+        credentials_destroy (&self->credentials);
+        zstr_free (&self->filename);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+//  --------------------------------------------------------------------------
+//  Send result to the asset
+
+static void
+s_reply (snmp_detector_t *self, const char *asset, const char *ip, const detected_t *detected)
+{
+    if (!self->pipe) return;
+    char *version = zsys_sprintf ("%i", detected->version);
+    zstr_sendx (self->pipe, "DETECTED", asset, ip, version, detected->community, detected->sysobjectid, NULL);
+    zstr_free (&version);
+}
+
+//  --------------------------------------------------------------------------
+//  Cache changed, save it a bit later so one burst of results is one write
+
+static void
+s_changed (snmp_detector_t *self)
+{
+    if (self->filename && !self->save_at)
+        self->save_at = zclock_mono () + SNMP_DETECTOR_SAVE_DELAY;
+}
+
+//  --------------------------------------------------------------------------
+//  Remember result of the ip
+
+static detected_t *
+s_cache_store (snmp_detector_t *self, const char *ip, int version, const char *community, const char *sysobjectid)
+{
+    if (zhash_size (self->cache) >= SNMP_DETECTOR_CACHE_MAX && !zhash_lookup (self->cache, ip)) {
+        // drop everything rather than scanning for the oldest
+        zhash_destroy (&self->cache);
+        self->cache = zhash_new ();
+        assert (self->cache);
+    }
+    detected_t *detected = (detected_t *) zmalloc (sizeof (detected_t));
+    assert (detected);
+    detected->version = version;
+    detected->community = strdup (community ? community : "");
+    detected->sysobjectid = strdup (sysobjectid ? sysobjectid : "");
+    detected->success = version ? zclock_time () : 0;
+    detected->expires = zclock_mono () + (version ? self->ttl : SNMP_DETECTOR_FAILED_TTL);
+    zhash_update (self->cache, ip, detected);
+    zhash_freefn (self->cache, ip, s_detected_freefn);
+    s_changed (self);
+    return detected;
+}
+
+//  --------------------------------------------------------------------------
+//  Return true if known credentials are still configured
+
+static bool
+s_configured (snmp_detector_t *self, const detected_t *detected)
+{
+    const snmp_credentials_t *cr = credentials_first (self->credentials);
+    while (cr) {
+        if (cr->version == detected->version && streq (cr->community, detected->community))
+            return true;
+        cr = credentials_next (self->credentials);
+    }
+    return false;
+}
+
+//  --------------------------------------------------------------------------
+//  Finish detection once the best candidate is known
+
+static void
+s_resolve (snmp_detector_t *self, detection_t *detection)
+{
+    const snmp_credentials_t *found = NULL;
+    const char *sysobjectid = NULL;
+    for (size_t i = 0; i < detection->count; i++) {
+        if (detection->status [i] < 0) return;     // better one may still answer
+        if (detection->status [i] > 0) {
+            found = &detection->candidates [i];
+            sysobjectid = detection->sysobjectids [i];
+            break;
+        }
+    }
+    detected_t *known = (detected_t *) zhash_lookup (self->cache, detection->ip);
+    if (detection->revalidate && known) {
+        if (!found) {
+            // device may be just down, keep polling with known credentials
+            zsys_warning ("SNMP credentials of %s not confirmed", detection->ip);
+            known->expires = zclock_mono () + SNMP_DETECTOR_FAILED_TTL;
+            zhash_delete (self->detections, detection->ip);
+            return;
+        }
+        if (found->version == known->version && streq (found->community, known->community)) {
+            // assets already use them
+            zstr_free (&known->sysobjectid);
+            known->sysobjectid = strdup (sysobjectid ? sysobjectid : "");
+            known->success = zclock_time ();
+            known->expires = zclock_mono () + self->ttl;
+            known->stale = false;
+            s_changed (self);
+            zhash_delete (self->detections, detection->ip);
+            return;
+        }
+    }
+    if (!found)
+        zsys_warning ("no SNMP credentials work for %s", detection->ip);
+    detected_t *detected = s_cache_store (self, detection->ip,
+        found ? found->version : 0, found ? found->community : NULL, sysobjectid);
+    const char *asset = (const char *) zlist_first (detection->assets);
+    while (asset) {
+        s_reply (self, asset, detection->ip, detected);
+        asset = (const char *) zlist_next (detection->assets);
+    }
+    zhash_delete (self->detections, detection->ip);
+}
+
+//  --------------------------------------------------------------------------
+//  Probe completed
+
+static void
+s_probe_done (int status, zlist_t *oids, zlist_t *values, void *arg)
+{
+    probe_t *probe = (probe_t *) arg;
+    snmp_detector_t *self = probe->detector;
+    detection_t *detection = self->detections ? (detection_t *) zhash_lookup (self->detections, probe->ip) : NULL;
+    if (detection && detection->id == probe->id) {
+        detection->status [probe->index] = status == ZMSNMP_OK ? 1 : 0;
+        if (status == ZMSNMP_OK) {
+            const char *oid = (const char *) zlist_first (oids);
+            zmsnmp_value_t *value = (zmsnmp_value_t *) zlist_first (values);
+            if (oid && value && streq (oid, SNMP_DETECTOR_PROBE ".0") && value->type == ZMSNMP_TYPE_OID)
+                detection->sysobjectids [probe->index] = strdup (value->string);
+        }
+        s_resolve (self, detection);
+    }
+    zstr_free (&probe->ip);
+    free (probe);
+}
+
+//  --------------------------------------------------------------------------
+//  Start detection of credentials of the asset
+
+static void
+s_detect (snmp_detector_t *self, const char *asset, const char *ip)
+{
+    detected_t *detected = (detected_t *) zhash_lookup (self->cache, ip);
+    if (detected && !detected->stale && detected->expires > zclock_mono ()) {
+        s_reply (self, asset, ip, detected);
+        return;
+    }
+    // credentials which worked are used until the device says otherwise
+    bool usable = detected && detected->version && s_configured (self, detected);
+    if (usable) {
+        s_reply (self, asset, ip, detected);
+        if (detected->expires > zclock_mono ())
+            return;                             // confirmation failed recently
+    }
+    detection_t *detection = (detection_t *) zhash_lookup (self->detections, ip);
+    if (detection) {
+        zlist_append (detection->assets, (void *) asset);
+        if (!usable) detection->revalidate = false;
+        return;
+    }
+
+    detection = (detection_t *) zmalloc (sizeof (detection_t));
+    assert (detection);
+    detection->ip = strdup (ip);
+    detection->id = ++self->id;
+    detection->revalidate = usable;
+    detection->assets = zlist_new ();
+    zlist_autofree (detection->assets);
+    zlist_append (detection->assets, (void *) asset);
+    const snmp_credentials_t *cr = credentials_first (self->credentials);
+    while (cr) {
+        ++detection->count;
+        cr = credentials_next (self->credentials);
+    }
+    detection->candidates = (snmp_credentials_t *) zmalloc ((detection->count + 1) * sizeof (snmp_credentials_t));
+    detection->status = (int *) zmalloc ((detection->count + 1) * sizeof (int));
+    detection->sysobjectids = (char **) zmalloc ((detection->count + 1) * sizeof (char *));
+    assert (detection->candidates && detection->status && detection->sysobjectids);
+    cr = credentials_first (self->credentials);
+    for (size_t i = 0; cr; i++) {
+        detection->candidates [i].version = cr->version;
+        detection->candidates [i].community = strdup (cr->community);
+        detection->status [i] = -1;
+        cr = credentials_next (self->credentials);
+    }
+    zhash_insert (self->detections, ip, detection);
+    zhash_freefn (self->detections, ip, s_detection_freefn);
+
+    for (size_t i = 0; i < detection->count; i++) {
+        probe_t *probe = (probe_t *) zmalloc (sizeof (probe_t));
+        assert (probe);
+        probe->detector = self;
+        probe->ip = strdup (ip);
+        probe->id = detection->id;
+        probe->index = i;
+        if (zmsnmp_engine_getnext (self->engine, ip, SNMP_DETECTOR_PROBE, &detection->candidates [i], s_probe_done, probe) != 0) {
+            detection->status [i] = 0;
+            zstr_free (&probe->ip);
+            free (probe);
+        }
+    }
+    s_resolve (self, detection);
+}
+
+//  --------------------------------------------------------------------------
+//  Load detected credentials saved by snmp_detector_save (). Loaded
+//  credentials are used at once and confirmed by the next detection of
+//  the address. Returns number of loaded addresses, -1 if the file can't
+//  be read.
+
+int
+snmp_detector_load (snmp_detector_t *self, const char *filename)
+{
+    assert (self);
+    assert (filename);
+    FILE *file = fopen (filename, "r");
+    if (!file) return -1;
+    int count = 0;
+    int64_t oldest = zclock_time () - SNMP_DETECTOR_KEEP;
+    char line [1024];
+    while (fgets (line, sizeof (line), file)) {
+        line [strcspn (line, "\r\n")] = 0;
+        if (line [0] == '#' || line [0] == 0) continue;
+        // ip version last-success sysObjectID community
+        char ip [256], sysobjectid [256];
+        int version, offset = 0;
+        int64_t success;
+        if (sscanf (line, "%255s %d %" SCNd64 " %255s %n", ip, &version, &success, sysobjectid, &offset) != 4
+        ||  offset == 0 || version <= 0) {
+            zsys_warning ("%s: invalid line '%s'", filename, line);
+            continue;
+        }
+        if (success < oldest) continue;
+        detected_t *detected = s_cache_store (self, ip, version, line + offset,
+            streq (sysobjectid, "-") ? NULL : sysobjectid);
+        detected->success = success;
+        detected->expires = 0;
+        detected->stale = true;
+        ++count;
+    }
+    fclose (file);
+    return count;
+}
+
+//  --------------------------------------------------------------------------
+//  Save working credentials of all addresses to file (readable just by the
+//  owner, it contains communities). File is replaced atomically. Returns 0
+//  on success, -1 on error.
+
+int
+snmp_detector_save (snmp_detector_t *self, const char *filename)
+{
+    assert (self);
+    assert (filename);
+    char *temporary = zsys_sprintf ("%s.tmp", filename);
+    int fd = open (temporary, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    FILE *file = fd >= 0 ? fdopen (fd, "w") : NULL;
+    if (!file) {
+        if (fd >= 0) close (fd);
+        zstr_free (&temporary);
+        return -1;
+    }
+    fprintf (file, "# ip version last-success sysObjectID community\n");
+    detected_t *detected = (detected_t *) zhash_first (self->cache);
+    while (detected) {
+        if (detected->version && !strchr (detected->community, '\n'))
+            fprintf (file, "%s %i %" PRIi64 " %s %s\n",
+                (const char *) zhash_cursor (self->cache), detected->version, detected->success,
+                *detected->sysobjectid ? detected->sysobjectid : "-", detected->community);
+        detected = (detected_t *) zhash_next (self->cache);
+    }
+    int rc = ferror (file) ? -1 : 0;
+    if (fclose (file) != 0) rc = -1;
+    if (rc == 0 && rename (temporary, filename) != 0) rc = -1;
+    if (rc != 0) unlink (temporary);
+    zstr_free (&temporary);
+    return rc;
+}
+
+//  --------------------------------------------------------------------------
+//  Save the cache if it changed
+
+static void
+s_save (snmp_detector_t *self)
+{
+    if (!self->filename || !self->save_at) return;
+    self->save_at = 0;
+    if (snmp_detector_save (self, self->filename) != 0)
+        zsys_error ("can't save detected SNMP credentials to %s", self->filename);
+}
+
+//  --------------------------------------------------------------------------
+//  Handle command from the pipe, returns false on $TERM
+
+static bool
+s_handle (snmp_detector_t *self, zmsg_t *msg)
+{
+    char *cmd = zmsg_popstr (msg);
+    bool running = cmd && !streq (cmd, "$TERM");
+    if (!cmd || !running) {
+        zstr_free (&cmd);
+        return false;
+    }
+    if (streq (cmd, "CREDENTIALS")) {
+        credentials_destroy (&self->credentials);
+        self->credentials = credentials_new ();
+        char *version = zmsg_popstr (msg);
+        char *community = zmsg_popstr (msg);
+        while (version && community) {
+            credentials_set (self->credentials, atoi (version), community);
+            zstr_free (&version);
+            zstr_free (&community);
+            version = zmsg_popstr (msg);
+            community = zmsg_popstr (msg);
+        }
+        zstr_free (&version);
+        zstr_free (&community);
+        // failures are tried again, working credentials confirmed
+        zlist_t *ips = zhash_keys (self->cache);
+        const char *ip = (const char *) zlist_first (ips);
+        while (ip) {
+            detected_t *detected = (detected_t *) zhash_lookup (self->cache, ip);
+            if (detected->version) {
+                detected->stale = true;
+                detected->expires = 0;
+            }
+            else
+                zhash_delete (self->cache, ip);
+            ip = (const char *) zlist_next (ips);
+        }
+        zlist_destroy (&ips);
+    }
+    else
+    if (streq (cmd, "TTL")) {
+        char *ttl = zmsg_popstr (msg);
+        if (ttl) self->ttl = atoll (ttl);
+        zstr_free (&ttl);
+    }
+    else
+    if (streq (cmd, "TIMEOUT")) {
+        char *timeout = zmsg_popstr (msg);
+        char *retries = zmsg_popstr (msg);
+        if (timeout && retries)
+            zmsnmp_engine_set_timeout (self->engine, atoi (timeout), atoi (retries));
+        zstr_free (&timeout);
+        zstr_free (&retries);
+    }
+    else
+    if (streq (cmd, "LOAD")) {
+        char *filename = zmsg_popstr (msg);
+        if (filename) {
+            int count = snmp_detector_load (self, filename);
+            if (count >= 0)
+                zsys_info ("loaded SNMP credentials of %i addresses from %s", count, filename);
+            zstr_free (&self->filename);
+            self->filename = filename;
+        }
+    }
+    else
+    if (streq (cmd, "DETECT")) {
+        char *asset = zmsg_popstr (msg);
+        char *ip = zmsg_popstr (msg);
+        if (asset && ip) s_detect (self, asset, ip);
+        zstr_free (&asset);
+        zstr_free (&ip);
+    }
+    else
+        zsys_warning ("snmp_detector: unknown command %s", cmd);
+    zstr_free (&cmd);
+    return true;
+}
+
+//  --------------------------------------------------------------------------
+//  Zactor interface
+
+void
+snmp_detector_actor (zsock_t *pipe, void *args)
+{
+    snmp_detector_t *self = snmp_detector_new ();
+    self->pipe = pipe;
+    zpoller_t *poller = zpoller_new (pipe, NULL);
+    assert (poller);
+    zsock_signal (pipe, 0);
+    while (!zsys_interrupted) {
+        // with probes in flight just look at the pipe, engine does the waiting
+        bool pending = zmsnmp_engine_pending (self->engine) > 0;
+        int timeout = -1;
+        if (self->save_at) {
+            int64_t wait = self->save_at - zclock_mono ();
+            timeout = wait > 0 ? (int) wait : 0;
+        }
+        zsock_t *which = (zsock_t *) zpoller_wait (poller, pending ? 0 : timeout);
+        if (which == pipe) {
+            zmsg_t *msg = zmsg_recv (pipe);
+            bool running = msg && s_handle (self, msg);
+            zmsg_destroy (&msg);
+            if (!running) break;
+        }
+        else
+        if (!which && zpoller_terminated (poller))
+            break;
+        if (zmsnmp_engine_pending (self->engine))
+            zmsnmp_engine_run (self->engine, 50);
+        if (self->save_at && self->save_at <= zclock_mono ())
+            s_save (self);
+    }
+    s_save (self);
+    zpoller_destroy (&poller);
+    self->pipe = NULL;
+    snmp_detector_destroy (&self);
+}
+
+//  --------------------------------------------------------------------------
+//  Self test of this class
+
+//  Receive DETECTED message, return "asset version community sysObjectID"
+static char *
+s_test_recv (zactor_t *detector)
+{
+    char *cmd, *asset, *ip, *version, *community, *sysobjectid;
+    if (zstr_recvx (detector, &cmd, &asset, &ip, &version, &community, &sysobjectid, NULL) != 6)
+        return NULL;
+    assert (streq (cmd, "DETECTED"));
+    char *result = zsys_sprintf ("%s %s %s %s", asset, version, community, sysobjectid);
+    zstr_free (&cmd);
+    zstr_free (&asset);
+    zstr_free (&ip);
+    zstr_free (&version);
+    zstr_free (&community);
+    zstr_free (&sysobjectid);
+    return result;
+}
+
+//  Number of requests held by rate limits so far
+static uint64_t
+s_test_rate_delayed (void)
+{
+    uint64_t delayed = 0;
+    zmsg_t *stats = zmsg_new ();
+    zmsnmp_limit_stats (stats);
+    char *name = zmsg_popstr (stats);
+    while (name) {
+        char *value = zmsg_popstr (stats);
+        if (streq (name, "rate-delayed"))
+            delayed = strtoull (value, NULL, 10);
+        zstr_free (&name);
+        zstr_free (&value);
+        name = zmsg_popstr (stats);
+    }
+    zmsg_destroy (&stats);
+    return delayed;
+}
+
+void
+snmp_detector_test (bool verbose)
+{
+    printf (" * snmp_detector: ");
+
+    //  @selftest
+    const char *SELFTEST_DIR_RW = "src/selftest-rw";
+    zsys_dir_create (SELFTEST_DIR_RW);
+    char *filename = zsys_sprintf ("%s/detector.cache", SELFTEST_DIR_RW);
+    zsys_file_delete (filename);
+
+    snmpsim_t *sim = snmpsim_new ();
+    assert (snmpsim_set (sim, ".1.3.6.1.2.1.1.2.0", "OID", ".1.3.6.1.4.1.8072.3.2.10") == 0);
+    assert (snmpsim_set (sim, ".1.3.6.1.2.1.1.5.0", "STRING", "device") == 0);
+    snmpsim_set_community (sim, "secret");
+    char *endpoint = strdup (snmpsim_bind (sim, "127.0.0.1", 0));
+    assert (endpoint);
+    zactor_t *agent = zactor_new (snmpsim_actor, sim);
+
+    zactor_t *detector = zactor_new (snmp_detector_actor, NULL);
+    assert (detector);
+    zstr_sendx (detector, "TIMEOUT", "200", "0", NULL);
+    zstr_sendx (detector, "LOAD", filename, NULL);
+    zstr_sendx (detector, "CREDENTIALS", "1", "public", "2", "secret", "1", "secret", NULL);
+
+    // both assets on the same address get the first working credentials
+    zstr_sendx (detector, "DETECT", "first", endpoint, NULL);
+    zstr_sendx (detector, "DETECT", "second", endpoint, NULL);
+    char *result = s_test_recv (detector);
+    assert (result && streq (result, "first 2 secret .1.3.6.1.4.1.8072.3.2.10"));
+    zstr_free (&result);
+    result = s_test_recv (detector);
+    assert (result && streq (result, "second 2 secret .1.3.6.1.4.1.8072.3.2.10"));
+    zstr_free (&result);
+
+    // known address is answered without asking the device
+    zactor_destroy (&agent);
+    int64_t start = zclock_mono ();
+    zstr_sendx (detector, "DETECT", "third", endpoint, NULL);
+    result = s_test_recv (detector);
+    assert (result && streq (result, "third 2 secret .1.3.6.1.4.1.8072.3.2.10"));
+    assert (zclock_mono () - start < 200);
+    zstr_free (&result);
+
+    // working credentials are saved on exit and used at once after restart,
+    // silent device does not take them away
+    zactor_destroy (&detector);
+    snmp_detector_t *saved = snmp_detector_new ();
+    assert (snmp_detector_load (saved, filename) == 1);
+    snmp_detector_destroy (&saved);
+    detector = zactor_new (snmp_detector_actor, NULL);
+    zstr_sendx (detector, "TIMEOUT", "200", "0", NULL);
+    zstr_sendx (detector, "LOAD", filename, NULL);
+    zstr_sendx (detector, "CREDENTIALS", "1", "public", "2", "secret", NULL);
+    start = zclock_mono ();
+    zstr_sendx (detector, "DETECT", "fourth", endpoint, NULL);
+    result = s_test_recv (detector);
+    assert (result && streq (result, "fourth 2 secret .1.3.6.1.4.1.8072.3.2.10"));
+    assert (zclock_mono () - start < 200);
+    zstr_free (&result);
+    zclock_sleep (300);
+    zpoller_t *poller = zpoller_new (detector, NULL);
+    assert (zpoller_wait (poller, 100) == NULL);
+    zpoller_destroy (&poller);
+
+    // device answering different credentials gets them from confirmation
+    snmpsim_set_community (sim, "public");
+    agent = zactor_new (snmpsim_actor, sim);
+    zstr_sendx (detector, "CREDENTIALS", "1", "public", "2", "secret", NULL);
+    zstr_sendx (detector, "DETECT", "fifth", endpoint, NULL);
+    result = s_test_recv (detector);
+    assert (result && streq (result, "fifth 2 secret .1.3.6.1.4.1.8072.3.2.10"));
+    zstr_free (&result);
+    result = s_test_recv (detector);
+    assert (result && streq (result, "fifth 1 public .1.3.6.1.4.1.8072.3.2.10"));
+    zstr_free (&result);
+    zactor_destroy (&agent);
+
+    // credentials which are not configured any more are not used
+    zstr_sendx (detector, "CREDENTIALS", "2", "public", NULL);
+    zstr_sendx (detector, "DETECT", "sixth", endpoint, NULL);
+    result = s_test_recv (detector);
+    assert (result && streq (result, "sixth 0  "));
+    zstr_free (&result);
+    zstr_sendx (detector, "CREDENTIALS", NULL);
+    zstr_sendx (detector, "DETECT", "seventh", endpoint, NULL);
+    result = s_test_recv (detector);
+    assert (result && streq (result, "seventh 0  "));
+    zstr_free (&result);
+
+    // probes to rate limited device go out one by one, waiting in the
+    // queue does not count to their timeout
+    snmpsim_t *limited = snmpsim_new ();
+    assert (snmpsim_set (limited, ".1.3.6.1.2.1.1.2.0", "OID", ".1.3.6.1.4.1.8072.3.2.10") == 0);
+    char *slow = strdup (snmpsim_bind (limited, "127.0.0.1", 0));
+    assert (slow);
+    agent = zactor_new (snmpsim_actor, limited);
+    zmsnmp_set_rate (slow, 10, 1);
+    uint64_t delayed = s_test_rate_delayed ();
+    zstr_sendx (detector, "CREDENTIALS", "1", "wrong", "2", "wrong", "1", "other", "2", "public", NULL);
+    start = zclock_mono ();
+    zstr_sendx (detector, "DETECT", "eighth", slow, NULL);
+    result = s_test_recv (detector);
+    assert (result && streq (result, "eighth 2 public .1.3.6.1.4.1.8072.3.2.10"));
+    assert (zclock_mono () - start >= 250);
+    assert (s_test_rate_delayed () - delayed == 3);
+    zstr_free (&result);
+    zmsnmp_set_rate (slow, 0, 0);
+    zactor_destroy (&agent);
+    snmpsim_destroy (&limited);
+    zstr_free (&slow);
+
+    zactor_destroy (&detector);
+    snmpsim_destroy (&sim);
+    zmsnmp_reset ();
+    zsys_file_delete (filename);
+    zstr_free (&filename);
+    zstr_free (&endpoint);
+    //  @end
+
+    printf ("OK\n");
+}
@@ -0,0 +1,94 @@
+/*  =========================================================================
+    snmp_detector - asynchronous detection of SNMP credentials
+
+    Copyright (C) 2016 - 2017 Tomas Halman
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#ifndef SNMP_DETECTOR_H_INCLUDED
+#define SNMP_DETECTOR_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SNMP_DETECTOR_TTL           3600000 // ms, lifetime of detected credentials
+#define SNMP_DETECTOR_FAILED_TTL    60000   // ms, lifetime of failed detection
+#define SNMP_DETECTOR_TIMEOUT       1000    // ms, timeout of one probe
+#define SNMP_DETECTOR_RETRIES       2       // retries of one probe
+#define SNMP_DETECTOR_CACHE_MAX     65536   // cached addresses
+#define SNMP_DETECTOR_SAVE_DELAY    10000   // ms, changes are saved after
+#define SNMP_DETECTOR_KEEP          2592000000LL    // ms, saved credentials older
+                                                    // than 30 days are not loaded
+#define SNMP_DETECTOR_PROBE         ".1.3.6.1.2.1.1.2"  // getnext gives sysObjectID
+
+#ifndef SNMP_DETECTOR_T_DEFINED
+typedef struct _snmp_detector_t snmp_detector_t;
+#define SNMP_DETECTOR_T_DEFINED
+#endif
+
+//  @interface
+//  Create a new detector without credentials
+ZM_METRIC_PRIVATE snmp_detector_t *
+    snmp_detector_new (void);
+
+//  Destroy the detector, detections in progress are dropped
+ZM_METRIC_PRIVATE void
+    snmp_detector_destroy (snmp_detector_t **self_p);
+
+//  Load working credentials saved by snmp_detector_save (). They are used
+//  at once and confirmed by the next detection of the address. Returns
+//  number of loaded addresses, -1 if the file can't be read.
+ZM_METRIC_PRIVATE int
+    snmp_detector_load (snmp_detector_t *self, const char *filename);
+
+//  Save working credentials of all addresses, one per line as
+//    ip version last-success sysObjectID community
+//  File is readable just by the owner and replaced atomically. Returns 0
+//  on success, -1 on error.
+ZM_METRIC_PRIVATE int
+    snmp_detector_save (snmp_detector_t *self, const char *filename);
+
+//  Zactor detecting credentials, args are not used. Commands:
+//    CREDENTIALS [version community ...]  candidates in order of preference,
+//                                         failed detections are forgotten
+//    TTL ms                               lifetime of detected credentials
+//    LOAD file                            load saved credentials, save them
+//                                         to the file on change and $TERM
+//    DETECT asset ip                      start detection
+//  All candidates are probed at once with getnext, the first one in order
+//  of preference which is answered wins. Result is sent back as
+//    DETECTED asset ip version community sysObjectID
+//  with version 0 and empty community if no candidate works. Results are
+//  kept per ip, so next DETECT of the same ip is answered immediately.
+//  Credentials which worked before (expired, loaded or detected before
+//  CREDENTIALS and still configured) are sent at once and confirmed in the
+//  background, DETECTED is sent again only if other credentials work now.
+ZM_METRIC_PRIVATE void
+    snmp_detector_actor (zsock_t *pipe, void *args);
+
+//  Self test of this class
+ZM_METRIC_PRIVATE void
+    snmp_detector_test (bool verbose);
+
+//  @end
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
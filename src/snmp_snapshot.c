@@ -0,0 +1,487 @@
+/*  =========================================================================
+    snmp_snapshot - recorded SNMP responses for offline rule evaluation
+
+    Copyright (C) 2016 - 2017 Tomas Halman
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    snmp_snapshot - recorded SNMP responses for offline rule evaluation
+@discuss
+    Values seen while a rule talks to a device are stored under their oids
+    and saved in snmpwalk -On format. Loaded snapshot answers get, getnext
+    and walk from memory, so the rule can be evaluated again without the
+    device. Getnext and walk are answered from the sorted index of oids,
+    which gives the same answers as the device as long as the recording
+    contains what the rule asked for.
+@end
+*/
+
+#include "zm_metric_classes.h"
+
+#define SNAPSHOT_OID_MAX    128     // sub-identifiers of one oid
+
+typedef struct {
+    char *oid;
+    unsigned long name [SNAPSHOT_OID_MAX];
+    size_t len;
+    zmsnmp_value_t *value;
+} snapshot_entry_t;
+
+//  Structure of our class
+
+struct _snmp_snapshot_t {
+    zhash_t *entries;           // oid -> snapshot_entry_t
+    snapshot_entry_t **index;   // entries sorted by oid
+    size_t indexsize;
+    bool dirty;                 // index must be rebuilt
+};
+
+//  --------------------------------------------------------------------------
+//  Entry destructor
+
+static void
+s_entry_freefn (void *data)
+{
+    snapshot_entry_t *entry = (snapshot_entry_t *) data;
+    if (!entry) return;
+    zstr_free (&entry->oid);
+    zmsnmp_value_destroy (&entry->value);
+    free (entry);
+}
+
+//  --------------------------------------------------------------------------
+//  Create a new snmp_snapshot
+
+snmp_snapshot_t *
+snmp_snapshot_new (void)
+{
+    snmp_snapshot_t *self = (snmp_snapshot_t *) zmalloc (sizeof (snmp_snapshot_t));
+    assert (self);
+    self->entries = zhash_new ();
+    assert (self->entries);
+    return self;
+}
+
+//  --------------------------------------------------------------------------
+//  Destroy the snmp_snapshot
+
+void
+snmp_snapshot_destroy (snmp_snapshot_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        snmp_snapshot_t *self = *self_p;
+        zhash_destroy (&self->entries);
+        free (self->index);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+//  --------------------------------------------------------------------------
+//  Compare parsed oids
+
+static int
+s_oid_compare (const unsigned long *a, size_t alen, const unsigned long *b, size_t blen)
+{
+    size_t len = alen < blen ? alen : blen;
+    for (size_t i = 0; i < len; i++) {
+        if (a [i] != b [i]) return a [i] < b [i] ? -1 : 1;
+    }
+    if (alen == blen) return 0;
+    return alen < blen ? -1 : 1;
+}
+
+static int
+s_entry_compare (const void *a, const void *b)
+{
+    const snapshot_entry_t *ea = *(const snapshot_entry_t **) a;
+    const snapshot_entry_t *eb = *(const snapshot_entry_t **) b;
+    return s_oid_compare (ea->name, ea->len, eb->name, eb->len);
+}
+
+//  --------------------------------------------------------------------------
+//  Rebuild sorted index of entries if needed
+
+static void
+s_index (snmp_snapshot_t *self)
+{
+    if (!self->dirty) return;
+    free (self->index);
+    self->indexsize = zhash_size (self->entries);
+    self->index = (snapshot_entry_t **) zmalloc ((self->indexsize + 1) * sizeof (snapshot_entry_t *));
+    assert (self->index);
+    size_t i = 0;
+    snapshot_entry_t *entry = (snapshot_entry_t *) zhash_first (self->entries);
+    while (entry) {
+        self->index [i++] = entry;
+        entry = (snapshot_entry_t *) zhash_next (self->entries);
+    }
+    qsort (self->index, self->indexsize, sizeof (snapshot_entry_t *), s_entry_compare);
+    self->dirty = false;
+}
+
+//  --------------------------------------------------------------------------
+//  Index of first entry after oid
+
+static size_t
+s_upper_bound (snmp_snapshot_t *self, const unsigned long *name, size_t len)
+{
+    size_t low = 0;
+    size_t high = self->indexsize;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        snapshot_entry_t *entry = self->index [middle];
+        if (s_oid_compare (entry->name, entry->len, name, len) <= 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+//  --------------------------------------------------------------------------
+//  Store copy of value of the oid
+
+void
+snmp_snapshot_put (snmp_snapshot_t *self, const char *oid, const zmsnmp_value_t *value)
+{
+    if (!self || !oid || !value) return;
+
+    snapshot_entry_t *entry = (snapshot_entry_t *) zmalloc (sizeof (snapshot_entry_t));
+    assert (entry);
+    entry->len = zmsnmp_oid_parse (oid, entry->name, SNAPSHOT_OID_MAX);
+    if (entry->len == 0) {
+        free (entry);
+        return;
+    }
+    entry->oid = strdup (oid);
+    entry->value = zmsnmp_value_dup (value);
+    zhash_update (self->entries, oid, entry);
+    zhash_freefn (self->entries, oid, s_entry_freefn);
+    self->dirty = true;
+}
+
+//  --------------------------------------------------------------------------
+//  Value of the oid
+
+const zmsnmp_value_t *
+snmp_snapshot_get (snmp_snapshot_t *self, const char *oid)
+{
+    if (!self || !oid) return NULL;
+    snapshot_entry_t *entry = (snapshot_entry_t *) zhash_lookup (self->entries, oid);
+    return entry ? entry->value : NULL;
+}
+
+//  --------------------------------------------------------------------------
+//  First oid after the given one
+
+const char *
+snmp_snapshot_getnext (snmp_snapshot_t *self, const char *oid, const zmsnmp_value_t **value)
+{
+    if (value) *value = NULL;
+    if (!self || !oid) return NULL;
+
+    unsigned long name [SNAPSHOT_OID_MAX];
+    size_t len = zmsnmp_oid_parse (oid, name, SNAPSHOT_OID_MAX);
+    if (len == 0) return NULL;
+    s_index (self);
+    size_t i = s_upper_bound (self, name, len);
+    if (i == self->indexsize) return NULL;
+    if (value) *value = self->index [i]->value;
+    return self->index [i]->oid;
+}
+
+//  --------------------------------------------------------------------------
+//  All values under the oid
+
+zhash_t *
+snmp_snapshot_walk (snmp_snapshot_t *self, const char *oid)
+{
+    if (!self || !oid) return NULL;
+
+    unsigned long name [SNAPSHOT_OID_MAX];
+    size_t len = zmsnmp_oid_parse (oid, name, SNAPSHOT_OID_MAX);
+    if (len == 0) return NULL;
+    s_index (self);
+    zhash_t *result = zhash_new ();
+    assert (result);
+    for (size_t i = s_upper_bound (self, name, len); i < self->indexsize; i++) {
+        snapshot_entry_t *entry = self->index [i];
+        if (entry->len <= len || s_oid_compare (entry->name, len, name, len) != 0) break;
+        zhash_insert (result, entry->oid, zmsnmp_value_dup (entry->value));
+        zhash_freefn (result, entry->oid, zmsnmp_value_freefn);
+    }
+    return result;
+}
+
+//  --------------------------------------------------------------------------
+//  Number of values
+
+size_t
+snmp_snapshot_size (snmp_snapshot_t *self)
+{
+    if (!self) return 0;
+    return zhash_size (self->entries);
+}
+
+//  --------------------------------------------------------------------------
+//  Parse value of one snmpwalk line, NULL if type is not supported
+
+static zmsnmp_value_t *
+s_parse_value (const char *type, const char *text)
+{
+    // numbers of INTEGER: up(1) and Timeticks: (123) 0:00:01.23
+    const char *number = strchr (text, '(');
+    number = number ? number + 1 : text;
+
+    if (streq (type, "INTEGER"))
+        return zmsnmp_value_new_integer (ZMSNMP_TYPE_INTEGER, strtoll (number, NULL, 10));
+    if (streq (type, "Counter32"))
+        return zmsnmp_value_new_integer (ZMSNMP_TYPE_COUNTER32, strtoll (number, NULL, 10));
+    if (streq (type, "Gauge32") || streq (type, "Unsigned32"))
+        return zmsnmp_value_new_integer (ZMSNMP_TYPE_GAUGE32, strtoll (number, NULL, 10));
+    if (streq (type, "Timeticks"))
+        return zmsnmp_value_new_integer (ZMSNMP_TYPE_TIMETICKS, strtoll (number, NULL, 10));
+    if (streq (type, "Counter64"))
+        return zmsnmp_value_new_counter64 (strtoull (text, NULL, 10));
+    if (streq (type, "OID"))
+        return zmsnmp_value_new_string (ZMSNMP_TYPE_OID, text, strlen (text));
+    if (streq (type, "IpAddress"))
+        return zmsnmp_value_new_string (ZMSNMP_TYPE_IPADDRESS, text, strlen (text));
+
+    size_t textlen = strlen (text);
+    char *data = (char *) zmalloc (textlen + 1);
+    assert (data);
+    size_t size = 0;
+    if (streq (type, "STRING")) {
+        const char *p = text;
+        const char *end = text + textlen;
+        if (textlen >= 2 && text [0] == '"' && text [textlen - 1] == '"') {
+            ++p;
+            --end;
+        }
+        while (p < end) {
+            if (*p == '\\' && p + 1 < end) ++p;
+            data [size++] = *p++;
+        }
+    }
+    else
+    if (streq (type, "Hex-STRING")) {
+        const char *p = text;
+        while (*p) {
+            char *end;
+            unsigned long byte = strtoul (p, &end, 16);
+            if (end == p) break;
+            data [size++] = (char) byte;
+            p = end;
+        }
+    }
+    else {
+        free (data);
+        return NULL;
+    }
+    zmsnmp_value_t *value = zmsnmp_value_new_string (ZMSNMP_TYPE_OCTETSTRING, data, size);
+    free (data);
+    return value;
+}
+
+//  --------------------------------------------------------------------------
+//  Load snapshot from file
+
+int
+snmp_snapshot_load (snmp_snapshot_t *self, const char *filename)
+{
+    if (!self || !filename) return -1;
+    FILE *file = fopen (filename, "r");
+    if (!file) return -1;
+
+    int loaded = 0;
+    char *line = NULL;
+    size_t linesize = 0;
+    while (getline (&line, &linesize, file) != -1) {
+        line [strcspn (line, "\r\n")] = 0;
+        // .1.3.6.1.2.1.1.5.0 = STRING: "name"
+        char *separator = strstr (line, " = ");
+        if (line [0] != '.' || !separator) continue;
+        *separator = 0;
+        char *type = separator + 3;
+        char *text;
+        if (streq (type, "\"\"")) {
+            // empty string is printed without type
+            type = "STRING";
+            text = "";
+        }
+        else {
+            char *colon = strstr (type, ": ");
+            if (!colon) continue;
+            *colon = 0;
+            text = colon + 2;
+        }
+        zmsnmp_value_t *value = s_parse_value (type, text);
+        if (!value) continue;
+        snmp_snapshot_put (self, line, value);
+        zmsnmp_value_destroy (&value);
+        ++loaded;
+    }
+    free (line);
+    fclose (file);
+    return loaded;
+}
+
+//  --------------------------------------------------------------------------
+//  Write one value in snmpwalk format
+
+static void
+s_write_value (FILE *file, const zmsnmp_value_t *value)
+{
+    switch (value->type) {
+        case ZMSNMP_TYPE_INTEGER:
+        case ZMSNMP_TYPE_COUNTER32:
+        case ZMSNMP_TYPE_GAUGE32:
+            fprintf (file, "%s: %" PRIi64 "\n", zmsnmp_value_type_name (value), value->integer);
+            return;
+        case ZMSNMP_TYPE_TIMETICKS:
+            fprintf (file, "Timeticks: (%" PRIi64 ")\n", value->integer);
+            return;
+        case ZMSNMP_TYPE_COUNTER64:
+            fprintf (file, "Counter64: %" PRIu64 "\n", value->counter64);
+            return;
+        case ZMSNMP_TYPE_OID:
+        case ZMSNMP_TYPE_IPADDRESS:
+            fprintf (file, "%s: %s\n", zmsnmp_value_type_name (value), value->string);
+            return;
+        default:
+            break;
+    }
+    // strings, other types are already printed as strings
+    bool printable = true;
+    for (size_t i = 0; i < value->size && printable; i++)
+        printable = value->string [i] >= 0x20 && value->string [i] < 0x7f;
+    if (printable) {
+        fputs ("STRING: \"", file);
+        for (size_t i = 0; i < value->size; i++) {
+            if (value->string [i] == '"' || value->string [i] == '\\') fputc ('\\', file);
+            fputc (value->string [i], file);
+        }
+        fputs ("\"\n", file);
+    }
+    else {
+        fputs ("Hex-STRING:", file);
+        for (size_t i = 0; i < value->size; i++)
+            fprintf (file, " %02X", (byte) value->string [i]);
+        fputc ('\n', file);
+    }
+}
+
+//  --------------------------------------------------------------------------
+//  Save snapshot to file
+
+int
+snmp_snapshot_save (snmp_snapshot_t *self, const char *filename)
+{
+    if (!self || !filename) return -1;
+    FILE *file = fopen (filename, "w");
+    if (!file) return -1;
+
+    s_index (self);
+    for (size_t i = 0; i < self->indexsize; i++) {
+        fprintf (file, "%s = ", self->index [i]->oid);
+        s_write_value (file, self->index [i]->value);
+    }
+    return fclose (file) == 0 ? 0 : -1;
+}
+
+//  --------------------------------------------------------------------------
+//  Self test of this class
+
+void
+snmp_snapshot_test (bool verbose)
+{
+    printf (" * snmp_snapshot: ");
+
+    //  @selftest
+    const char *SELFTEST_DIR_RO = "src/selftest-ro";
+    const char *SELFTEST_DIR_RW = "src/selftest-rw";
+    snmp_snapshot_t *self = snmp_snapshot_new ();
+    assert (self);
+    char *walk = zsys_sprintf ("%s/walks/linux.walk", SELFTEST_DIR_RO);
+    int loaded = snmp_snapshot_load (self, walk);
+    zstr_free (&walk);
+    assert (loaded > 0 && snmp_snapshot_size (self) == (size_t) loaded);
+
+    const zmsnmp_value_t *value = snmp_snapshot_get (self, ".1.3.6.1.2.1.1.5.0");
+    assert (value && value->type == ZMSNMP_TYPE_OCTETSTRING && streq (value->string, "simulated"));
+    value = snmp_snapshot_get (self, ".1.3.6.1.2.1.2.2.1.8.2");
+    assert (value && value->type == ZMSNMP_TYPE_INTEGER && value->integer == 1);
+    value = snmp_snapshot_get (self, ".1.3.6.1.2.1.1.3.0");
+    assert (value && value->type == ZMSNMP_TYPE_TIMETICKS && value->integer == 123456);
+    value = snmp_snapshot_get (self, ".1.3.6.1.2.1.2.2.1.6.2");
+    assert (value && value->size == 6 && memcmp (value->string, "\x52\x54\x00\x12\x34\x56", 6) == 0);
+    assert (snmp_snapshot_get (self, ".1.3.6.1.2.1.1.5") == NULL);
+
+    // getnext and walk follow oid order, not string order
+    assert (streq (snmp_snapshot_getnext (self, ".1.3.6.1.4.1.2021.9.1.9.2", &value), ".1.3.6.1.4.1.2021.10.1.3.1"));
+    assert (value && streq (value->string, "0.12"));
+    assert (snmp_snapshot_getnext (self, ".1.3.6.1.4.1.2021.11.11.0", &value) == NULL);
+    assert (value == NULL);
+    zhash_t *rows = snmp_snapshot_walk (self, ".1.3.6.1.4.1.2021.9.1.2");
+    assert (rows && zhash_size (rows) == 2);
+    value = (const zmsnmp_value_t *) zhash_lookup (rows, ".1.3.6.1.4.1.2021.9.1.2.2");
+    assert (value && streq (value->string, "/home"));
+    zhash_destroy (&rows);
+    rows = snmp_snapshot_walk (self, ".1.3.6.1.4.1.2021.9.1.2.2");
+    assert (rows && zhash_size (rows) == 0);
+    zhash_destroy (&rows);
+
+    // saved snapshot loads back the same
+    zmsnmp_value_t *quoted = zmsnmp_value_new_string (ZMSNMP_TYPE_OCTETSTRING, "say \"hi\\\"", 9);
+    zmsnmp_value_t *binary = zmsnmp_value_new_string (ZMSNMP_TYPE_OCTETSTRING, "a\nb\0", 4);
+    zmsnmp_value_t *counter = zmsnmp_value_new_counter64 (18446744073709551615ULL);
+    snmp_snapshot_put (self, ".1.3.6.1.4.1.99999.1", quoted);
+    snmp_snapshot_put (self, ".1.3.6.1.4.1.99999.2", binary);
+    snmp_snapshot_put (self, ".1.3.6.1.4.1.99999.3", counter);
+    snmp_snapshot_put (self, ".1.3.6.1.4.1.99999.3", counter);
+    assert (snmp_snapshot_size (self) == (size_t) loaded + 3);
+    zsys_dir_create (SELFTEST_DIR_RW);
+    char *saved = zsys_sprintf ("%s/snapshot.walk", SELFTEST_DIR_RW);
+    assert (snmp_snapshot_save (self, saved) == 0);
+    snmp_snapshot_t *copy = snmp_snapshot_new ();
+    assert (snmp_snapshot_load (copy, saved) == loaded + 3);
+    value = snmp_snapshot_get (copy, ".1.3.6.1.4.1.99999.1");
+    assert (value && value->size == 9 && memcmp (value->string, "say \"hi\\\"", 9) == 0);
+    value = snmp_snapshot_get (copy, ".1.3.6.1.4.1.99999.2");
+    assert (value && value->size == 4 && memcmp (value->string, "a\nb\0", 4) == 0);
+    value = snmp_snapshot_get (copy, ".1.3.6.1.4.1.99999.3");
+    assert (value && value->type == ZMSNMP_TYPE_COUNTER64 && value->counter64 == 18446744073709551615ULL);
+    value = snmp_snapshot_get (copy, ".1.3.6.1.2.1.1.2.0");
+    assert (value && value->type == ZMSNMP_TYPE_OID && streq (value->string, ".1.3.6.1.4.1.8072.3.2.10"));
+    snmp_snapshot_destroy (&copy);
+    zsys_file_delete (saved);
+    zstr_free (&saved);
+    zmsnmp_value_destroy (&quoted);
+    zmsnmp_value_destroy (&binary);
+    zmsnmp_value_destroy (&counter);
+
+    snmp_snapshot_destroy (&self);
+    assert (self == NULL);
+    //  @end
+
+    printf ("OK\n");
+}
@@ -0,0 +1,86 @@
+/*  =========================================================================
+    snmp_snapshot - recorded SNMP responses for offline rule evaluation
+
+    Copyright (C) 2016 - 2017 Tomas Halman
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#ifndef SNMP_SNAPSHOT_H_INCLUDED
+#define SNMP_SNAPSHOT_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef SNMP_SNAPSHOT_T_DEFINED
+typedef struct _snmp_snapshot_t snmp_snapshot_t;
+#define SNMP_SNAPSHOT_T_DEFINED
+#endif
+
+//  @interface
+//  Create a new empty snapshot
+ZM_METRIC_PRIVATE snmp_snapshot_t *
+    snmp_snapshot_new (void);
+
+//  Destroy the snapshot
+ZM_METRIC_PRIVATE void
+    snmp_snapshot_destroy (snmp_snapshot_t **self_p);
+
+//  Load snapshot from file in snmpwalk -On format (the same as snmpsim
+//  reads). Values are added to the already loaded ones. Returns number
+//  of loaded values, -1 if file can't be read.
+ZM_METRIC_PRIVATE int
+    snmp_snapshot_load (snmp_snapshot_t *self, const char *filename);
+
+//  Save snapshot to file in snmpwalk -On format, sorted by oid. Returns
+//  0 on success, -1 if file can't be written.
+ZM_METRIC_PRIVATE int
+    snmp_snapshot_save (snmp_snapshot_t *self, const char *filename);
+
+//  Store copy of value of the oid. Oid must be in numeric form (see
+//  zmsnmp_oid_normalize). Value stored later wins.
+ZM_METRIC_PRIVATE void
+    snmp_snapshot_put (snmp_snapshot_t *self, const char *oid, const zmsnmp_value_t *value);
+
+//  Value of the oid, NULL if there is none
+ZM_METRIC_PRIVATE const zmsnmp_value_t *
+    snmp_snapshot_get (snmp_snapshot_t *self, const char *oid);
+
+//  First oid after the given one, sets value. Returns NULL at the end.
+ZM_METRIC_PRIVATE const char *
+    snmp_snapshot_getnext (snmp_snapshot_t *self, const char *oid, const zmsnmp_value_t **value);
+
+//  All values under the oid as oid -> zmsnmp_value_t hash, the same
+//  zmsnmp_walk returns. Caller destroys the hash.
+ZM_METRIC_PRIVATE zhash_t *
+    snmp_snapshot_walk (snmp_snapshot_t *self, const char *oid);
+
+//  Number of values in the snapshot
+ZM_METRIC_PRIVATE size_t
+    snmp_snapshot_size (snmp_snapshot_t *self);
+
+//  Self test of this class
+ZM_METRIC_PRIVATE void
+    snmp_snapshot_test (bool verbose);
+
+//  @end
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1086 @@
+/*  =========================================================================
+    snmp_transport - SNMP requests multiplexed over shared UDP sockets
+
+    Copyright (C) 2016 - 2017 Tomas Halman
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    snmp_transport - SNMP requests multiplexed over shared UDP sockets
+@discuss
+    net-snmp opens one socket per session, so thousands of hosts mean
+    thousands of sockets and ephemeral ports. Transport encodes v1/v2c
+    requests itself and sends all of them through a few sockets, responses
+    are matched to requests by request id and address of the agent.
+    Queued requests are sent and responses received in batches (sendmmsg
+    and recvmmsg on Linux). Request leaves the queue only when zmsnmp
+    admits it (rate limit of its host and requests in flight of the whole
+    process), so the limits hold for every user of any transport. Held
+    requests wait in the queue while the others go out.
+
+    Transport is used by one thread at a time. Only snmp_transport_wake
+    can be called from other threads, it interrupts waiting in
+    snmp_transport_run, e.g. when another thread has queued requests for
+    the running one.
+@end
+*/
+
+#include "zm_metric_classes.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+
+#define TRANSPORT_OID_MAX   128     // sub-identifiers of one oid
+#define TRANSPORT_READS     16      // batches read from one socket per run
+
+//  One UDP socket and requests waiting to be sent through it
+typedef struct {
+    int fd;
+    zlist_t *queue;                     // transport_request_t
+} transport_socket_t;
+
+//  Request queued or in flight
+typedef struct {
+    uint32_t id;
+    char *host;                         // as given, key of the rate limit
+    struct sockaddr_storage addr;       // agent
+    socklen_t addrlen;
+    transport_socket_t *socket;
+    byte *packet;                       // encoded message, sent again on retry
+    size_t size;
+    int version;                        // 1 or 2
+    int timeout;                        // ms
+    int retries;                        // left
+    int64_t deadline;                   // zclock_mono, 0 while queued
+    int64_t sent;                       // zclock_mono of the first send
+    int64_t held;                       // zclock_mono when limits held it
+    bool admitted;                      // holds slot in flight
+    bool queued;
+    zmsnmp_fn *fn;
+    void *arg;
+} transport_request_t;
+
+//  Structure of our class
+
+struct _snmp_transport_t {
+    size_t count;                       // sockets per address family
+    transport_socket_t *sockets [2];    // IPv4 and IPv6, opened on first use
+    struct pollfd *pollfds;
+    transport_socket_t **polled;        // socket of every pollfd, NULL for wakeup
+    int wakeup [2];                     // pipe interrupting poll
+    zhash_t *requests;                  // "%08x" request id -> transport_request_t
+    uint32_t id;                        // last used request id
+    int64_t next_tick;                  // zclock_mono of next timeout check
+    size_t completed;                   // callbacks called during current run
+    int errstat;                        // error of the response being completed
+    int errindex;
+    int64_t elapsed;                    // ms since it was sent
+    int64_t hold;                       // ms until held requests are tried again
+    byte *varbinds;                     // encoding buffers
+    byte *pdu;
+    byte *received;                     // SNMP_TRANSPORT_BATCH datagrams
+    uint64_t sent;
+    uint64_t retransmitted;
+    uint64_t received_count;
+    uint64_t unmatched;
+    uint64_t syscalls;
+};
+
+//  --------------------------------------------------------------------------
+//  Create a new snmp_transport
+
+snmp_transport_t *
+snmp_transport_new (size_t sockets)
+{
+    snmp_transport_t *self = (snmp_transport_t *) zmalloc (sizeof (snmp_transport_t));
+    assert (self);
+    self->count = sockets ? sockets : SNMP_TRANSPORT_SOCKETS;
+    self->pollfds = (struct pollfd *) zmalloc ((2 * self->count + 1) * sizeof (struct pollfd));
+    self->polled = (transport_socket_t **) zmalloc ((2 * self->count + 1) * sizeof (transport_socket_t *));
+    self->requests = zhash_new ();
+    self->varbinds = (byte *) malloc (SNMP_TRANSPORT_MESSAGE_MAX);
+    self->pdu = (byte *) malloc (SNMP_TRANSPORT_MESSAGE_MAX);
+    assert (self->pollfds && self->polled && self->requests && self->varbinds && self->pdu);
+    int rc = pipe (self->wakeup);
+    assert (rc == 0);
+    for (int i = 0; i < 2; i++) {
+        fcntl (self->wakeup [i], F_SETFL, fcntl (self->wakeup [i], F_GETFL) | O_NONBLOCK);
+        fcntl (self->wakeup [i], F_SETFD, FD_CLOEXEC);
+    }
+    // ids of previous run of the process should not match
+    self->id = (uint32_t) ((zclock_time () ^ (getpid () << 16)) & 0x7fffffff);
+    return self;
+}
+
+//  --------------------------------------------------------------------------
+//  Remove request and call its callback
+
+static void
+s_complete (snmp_transport_t *self, transport_request_t *request, int status, zlist_t *oids, zlist_t *values)
+{
+    char key [16];
+    snprintf (key, sizeof (key), "%08x", request->id);
+    zhash_delete (self->requests, key);
+    if (request->queued)
+        zlist_remove (request->socket->queue, request);
+    if (request->admitted)
+        zmsnmp_limit_release ();
+    zmsnmp_fn *fn = request->fn;
+    void *arg = request->arg;
+    self->elapsed = request->sent ? zclock_mono () - request->sent : 0;
+    free (request->host);
+    free (request->packet);
+    free (request);
+    ++self->completed;
+    if (fn) fn (status, oids, values, arg);
+    self->elapsed = 0;
+}
+
+//  --------------------------------------------------------------------------
+//  Destroy the snmp_transport
+
+void
+snmp_transport_destroy (snmp_transport_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        snmp_transport_t *self = *self_p;
+        zlist_t *requests = zlist_new ();
+        transport_request_t *request = (transport_request_t *) zhash_first (self->requests);
+        while (request) {
+            zlist_append (requests, request);
+            request = (transport_request_t *) zhash_next (self->requests);
+        }
+        request = (transport_request_t *) zlist_first (requests);
+        while (request) {
+            s_complete (self, request, ZMSNMP_ERROR, NULL, NULL);
+            request = (transport_request_t *) zlist_next (requests);
+        }
+        zlist_destroy (&requests);
+        zhash_destroy (&self->requests);
+        for (int family = 0; family < 2; family++) {
+            if (!self->sockets [family]) continue;
+            for (size_t i = 0; i < self->count; i++) {
+                if (self->sockets [family][i].fd >= 0)
+                    close (self->sockets [family][i].fd);
+                zlist_destroy (&self->sockets [family][i].queue);
+            }
+            free (self->sockets [family]);
+        }
+        close (self->wakeup [0]);
+        close (self->wakeup [1]);
+        free (self->pollfds);
+        free (self->polled);
+        free (self->varbinds);
+        free (self->pdu);
+        free (self->received);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+//  --------------------------------------------------------------------------
+//  Resolve "host", "host:port", "[ipv6]:port" or plain ipv6 address,
+//  optionally prefixed by udp: or udp6: like net-snmp peername. Returns 0
+//  on success, -1 on error.
+
+static int
+s_resolve (const char *host, struct sockaddr_storage *addr, socklen_t *addrlen)
+{
+    if (strncmp (host, "udp:", 4) == 0) host += 4;
+    else
+    if (strncmp (host, "udp6:", 5) == 0) host += 5;
+    char name [256];
+    if (strlen (host) >= sizeof (name)) return -1;
+    strcpy (name, host);
+
+    char *address = name;
+    const char *port = "161";
+    if (name [0] == '[') {
+        char *end = strchr (name, ']');
+        if (!end) return -1;
+        *end = 0;
+        address = name + 1;
+        if (end [1] == ':')
+            port = end + 2;
+        else
+        if (end [1])
+            return -1;
+    }
+    else {
+        char *colon = strchr (name, ':');
+        // more colons are ipv6 address without port
+        if (colon && colon == strrchr (name, ':')) {
+            *colon = 0;
+            port = colon + 1;
+        }
+    }
+    struct addrinfo hints, *result = NULL;
+    memset (&hints, 0, sizeof (hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_NUMERICSERV;
+    if (getaddrinfo (address, port, &hints, &result) != 0 || !result)
+        return -1;
+    int rc = -1;
+    if ((result->ai_family == AF_INET || result->ai_family == AF_INET6)
+    &&  result->ai_addrlen <= sizeof (*addr)) {
+        memcpy (addr, result->ai_addr, result->ai_addrlen);
+        *addrlen = result->ai_addrlen;
+        rc = 0;
+    }
+    freeaddrinfo (result);
+    return rc;
+}
+
+//  --------------------------------------------------------------------------
+//  Return true if both addresses are the same agent
+
+static bool
+s_same_address (const struct sockaddr_storage *a, const struct sockaddr *b)
+{
+    if (a->ss_family != b->sa_family) return false;
+    if (a->ss_family == AF_INET) {
+        const struct sockaddr_in *a4 = (const struct sockaddr_in *) a;
+        const struct sockaddr_in *b4 = (const struct sockaddr_in *) b;
+        return a4->sin_port == b4->sin_port && a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+    }
+    const struct sockaddr_in6 *a6 = (const struct sockaddr_in6 *) a;
+    const struct sockaddr_in6 *b6 = (const struct sockaddr_in6 *) b;
+    return a6->sin6_port == b6->sin6_port
+        && memcmp (&a6->sin6_addr, &b6->sin6_addr, sizeof (a6->sin6_addr)) == 0;
+}
+
+//  --------------------------------------------------------------------------
+//  Sockets of the address family, opened on first use. Returns NULL if
+//  they can't be opened.
+
+static transport_socket_t *
+s_sockets (snmp_transport_t *self, int family)
+{
+    int index = family == AF_INET6 ? 1 : 0;
+    if (self->sockets [index]) return self->sockets [index];
+
+    transport_socket_t *sockets = (transport_socket_t *) zmalloc (self->count * sizeof (transport_socket_t));
+    assert (sockets);
+    for (size_t i = 0; i < self->count; i++) {
+        sockets [i].fd = socket (family, SOCK_DGRAM, 0);
+        if (sockets [i].fd < 0
+        ||  fcntl (sockets [i].fd, F_SETFL, fcntl (sockets [i].fd, F_GETFL) | O_NONBLOCK) < 0
+        ||  fcntl (sockets [i].fd, F_SETFD, FD_CLOEXEC) < 0) {
+            zsys_error ("snmp_transport: can't open socket: %s", strerror (errno));
+            for (size_t j = 0; j <= i; j++)
+                if (sockets [j].fd >= 0) close (sockets [j].fd);
+            free (sockets);
+            return NULL;
+        }
+        sockets [i].queue = zlist_new ();
+        assert (sockets [i].queue);
+    }
+    self->sockets [index] = sockets;
+    return sockets;
+}
+
+//  --------------------------------------------------------------------------
+//  Encode request message, returns newly allocated packet or NULL if oid
+//  is not valid or message is too big
+
+static byte *
+s_encode_request (snmp_transport_t *self, int version, const char *community, byte type, uint32_t id, int max_repetitions, zlist_t *oids, size_t *size)
+{
+    size_t vbpos = 0;
+    const char *oid = (const char *) zlist_first (oids);
+    while (oid) {
+        unsigned long name [TRANSPORT_OID_MAX];
+        size_t len = zmsnmp_oid_parse (oid, name, TRANSPORT_OID_MAX);
+        if (!len) return NULL;
+        uint32_t sub [TRANSPORT_OID_MAX];   // SNMP sub-identifiers are 32 bit
+        for (size_t i = 0; i < len; i++) {
+            if (name [i] > 0xFFFFFFFF) return NULL;
+            sub [i] = (uint32_t) name [i];
+        }
+        byte encoded [TRANSPORT_OID_MAX * 5];
+        size_t encodedlen = snmp_ber_encode_oid (sub, len, encoded);
+        size_t length = 2 + encodedlen + (encodedlen < 0x80 ? 0 : (encodedlen < 0x100 ? 1 : 2)) + 2;
+        if (!snmp_ber_put_header (self->varbinds, &vbpos, SNMP_TRANSPORT_MESSAGE_MAX, BER_SEQUENCE, length)
+        ||  !snmp_ber_put (self->varbinds, &vbpos, SNMP_TRANSPORT_MESSAGE_MAX, BER_OID, encoded, encodedlen)
+        ||  !snmp_ber_put (self->varbinds, &vbpos, SNMP_TRANSPORT_MESSAGE_MAX, BER_NULL, NULL, 0))
+            return NULL;
+        oid = (const char *) zlist_next (oids);
+    }
+    // error status and index are non-repeaters and max-repetitions of GETBULK
+    size_t pdupos = 0;
+    if (!snmp_ber_put_integer (self->pdu, &pdupos, SNMP_TRANSPORT_MESSAGE_MAX, id)
+    ||  !snmp_ber_put_integer (self->pdu, &pdupos, SNMP_TRANSPORT_MESSAGE_MAX, 0)
+    ||  !snmp_ber_put_integer (self->pdu, &pdupos, SNMP_TRANSPORT_MESSAGE_MAX, type == PDU_GETBULK ? max_repetitions : 0)
+    ||  !snmp_ber_put (self->pdu, &pdupos, SNMP_TRANSPORT_MESSAGE_MAX, BER_SEQUENCE, self->varbinds, vbpos))
+        return NULL;
+
+    // header of the message is encoded to find out its length first
+    byte head [300];
+    size_t headpos = 0;
+    size_t communitylen = strlen (community);
+    if (communitylen > 255
+    ||  !snmp_ber_put_integer (head, &headpos, sizeof (head), version == 1 ? 0 : 1)
+    ||  !snmp_ber_put (head, &headpos, sizeof (head), BER_OCTET_STRING, (const byte *) community, communitylen))
+        return NULL;
+    size_t pduheader = 2 + (pdupos < 0x80 ? 0 : (pdupos < 0x100 ? 1 : 2));
+    size_t content = headpos + pduheader + pdupos;
+    byte *packet = (byte *) malloc (content + 4);
+    assert (packet);
+    size_t pos = 0;
+    if (!snmp_ber_put_header (packet, &pos, content + 4, BER_SEQUENCE, content)
+    ||  content + pos > SNMP_TRANSPORT_MESSAGE_MAX) {
+        free (packet);
+        return NULL;
+    }
+    memcpy (packet + pos, head, headpos);
+    pos += headpos;
+    snmp_ber_put (packet, &pos, content + 4, type, self->pdu, pdupos);
+    *size = pos;
+    return packet;
+}
+
+//  --------------------------------------------------------------------------
+//  Queue request of PDU type
+
+static int
+s_send (snmp_transport_t *self, const char *host, const snmp_credentials_t *credentials, byte type, int max_repetitions, zlist_t *oids, int timeout, int retries, zmsnmp_fn *fn, void *arg)
+{
+    transport_request_t *request = (transport_request_t *) zmalloc (sizeof (transport_request_t));
+    assert (request);
+    if (s_resolve (host, &request->addr, &request->addrlen) != 0) {
+        free (request);
+        return -1;
+    }
+    transport_socket_t *sockets = s_sockets (self, request->addr.ss_family);
+    if (!sockets) {
+        free (request);
+        return -1;
+    }
+    // next free id, 0 is never used
+    char key [16];
+    do {
+        self->id = (self->id + 1) & 0x7fffffff;
+        snprintf (key, sizeof (key), "%08x", self->id);
+    } while (self->id == 0 || zhash_lookup (self->requests, key));
+    request->id = self->id;
+    request->packet = s_encode_request (self, credentials->version, credentials->community, type, request->id, max_repetitions, oids, &request->size);
+    if (!request->packet) {
+        free (request);
+        return -1;
+    }
+    request->host = strdup (host);
+    assert (request->host);
+    request->socket = &sockets [request->id % self->count];
+    request->version = credentials->version;
+    request->timeout = timeout > 0 ? timeout : SNMP_TRANSPORT_TIMEOUT;
+    request->retries = retries >= 0 ? retries : SNMP_TRANSPORT_RETRIES;
+    request->fn = fn;
+    request->arg = arg;
+    request->queued = true;
+    zhash_insert (self->requests, key, request);
+    zlist_append (request->socket->queue, request);
+    return 0;
+}
+
+//  --------------------------------------------------------------------------
+//  Queue request
+
+int
+snmp_transport_send (snmp_transport_t *self, const char *host, const snmp_credentials_t *credentials, int command, zlist_t *oids, int timeout, int retries, zmsnmp_fn *fn, void *arg)
+{
+    if (!self || !host || !credentials || !credentials->community || !oids || !zlist_size (oids)) return -1;
+    if (credentials->version != 1 && credentials->version != 2) return -1;
+    byte type;
+    if (command == ZMSNMP_GET)
+        type = PDU_GET;
+    else
+    if (command == ZMSNMP_GETNEXT)
+        type = PDU_GETNEXT;
+    else
+        return -1;
+    return s_send (self, host, credentials, type, 0, oids, timeout, retries, fn, arg);
+}
+
+//  --------------------------------------------------------------------------
+//  Queue GETBULK request
+
+int
+snmp_transport_send_bulk (snmp_transport_t *self, const char *host, const snmp_credentials_t *credentials, zlist_t *oids, int max_repetitions, int timeout, int retries, zmsnmp_fn *fn, void *arg)
+{
+    if (!self || !host || !credentials || !credentials->community || !oids || !zlist_size (oids)) return -1;
+    if (credentials->version != 2 || max_repetitions <= 0) return -1;
+    return s_send (self, host, credentials, PDU_GETBULK, max_repetitions, oids, timeout, retries, fn, arg);
+}
+
+//  --------------------------------------------------------------------------
+//  Error of the response being completed
+
+int
+snmp_transport_error (snmp_transport_t *self, int *errindex)
+{
+    if (errindex) *errindex = self ? self->errindex : 0;
+    if (!self) return 0;
+    return self->errstat;
+}
+
+//  --------------------------------------------------------------------------
+//  Round trip of the response being completed
+
+int64_t
+snmp_transport_elapsed (snmp_transport_t *self)
+{
+    if (!self) return 0;
+    return self->elapsed;
+}
+
+//  --------------------------------------------------------------------------
+//  Interrupt waiting in snmp_transport_run, can be called from any thread
+
+void
+snmp_transport_wake (snmp_transport_t *self)
+{
+    if (!self) return;
+    byte signal = 0;
+    // full pipe wakes the poll as well
+    if (write (self->wakeup [1], &signal, 1) < 0 && errno != EAGAIN)
+        zsys_error ("snmp_transport: can't wake: %s", strerror (errno));
+}
+
+//  --------------------------------------------------------------------------
+//  Number of requests queued or in flight
+
+size_t
+snmp_transport_pending (snmp_transport_t *self)
+{
+    if (!self) return 0;
+    return zhash_size (self->requests);
+}
+
+//  --------------------------------------------------------------------------
+//  Number of open sockets
+
+size_t
+snmp_transport_sockets (snmp_transport_t *self)
+{
+    if (!self) return 0;
+    return (self->sockets [0] ? self->count : 0) + (self->sockets [1] ? self->count : 0);
+}
+
+//  --------------------------------------------------------------------------
+//  Queued request went out
+
+static void
+s_sent (snmp_transport_t *self, transport_request_t *request, int64_t now)
+{
+    zlist_remove (request->socket->queue, request);
+    request->queued = false;
+    request->deadline = now + request->timeout;
+    if (!request->sent) request->sent = now;
+    ++self->sent;
+}
+
+//  --------------------------------------------------------------------------
+//  Returns true if queued request can go out now: it was admitted before
+//  (retransmission) or zmsnmp admits it now. Held request sets when the
+//  transport should try again.
+
+static bool
+s_admit (snmp_transport_t *self, transport_request_t *request)
+{
+    if (request->admitted) return true;
+    int64_t wait = zmsnmp_limit_acquire (request->host, &request->held);
+    if (wait == 0) {
+        request->admitted = true;
+        return true;
+    }
+    // slot is freed by completion of any transport, check on next tick
+    if (wait < 0) wait = SNMP_TRANSPORT_TICK;
+    if (!self->hold || wait < self->hold) self->hold = wait;
+    return false;
+}
+
+//  --------------------------------------------------------------------------
+//  Send admitted requests of the socket, in batches where possible
+
+static void
+s_flush (snmp_transport_t *self, transport_socket_t *socket)
+{
+    int64_t now = zclock_mono ();
+#if defined (ZM_METRIC_HAVE_LINUX)
+    struct mmsghdr messages [SNMP_TRANSPORT_BATCH];
+    struct iovec iovecs [SNMP_TRANSPORT_BATCH];
+    transport_request_t *batch [SNMP_TRANSPORT_BATCH];
+    transport_request_t *request = (transport_request_t *) zlist_first (socket->queue);
+    while (request) {
+        unsigned int count = 0;
+        while (request && count < SNMP_TRANSPORT_BATCH) {
+            if (!s_admit (self, request)) {
+                request = (transport_request_t *) zlist_next (socket->queue);
+                continue;
+            }
+            batch [count] = request;
+            iovecs [count].iov_base = request->packet;
+            iovecs [count].iov_len = request->size;
+            memset (&messages [count], 0, sizeof (messages [count]));
+            messages [count].msg_hdr.msg_name = &request->addr;
+            messages [count].msg_hdr.msg_namelen = request->addrlen;
+            messages [count].msg_hdr.msg_iov = &iovecs [count];
+            messages [count].msg_hdr.msg_iovlen = 1;
+            ++count;
+            request = (transport_request_t *) zlist_next (socket->queue);
+        }
+        if (count == 0)
+            break;
+        int sent = sendmmsg (socket->fd, messages, count, 0);
+        ++self->syscalls;
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                break;                  // socket buffer is full, next run
+            sent = 1;                   // this one can't be sent, it times out
+        }
+        // cursor of the queue is past the batch, removing batch keeps it
+        for (int i = 0; i < sent; i++)
+            s_sent (self, batch [i], now);
+        if ((unsigned int) sent < count)
+            break;                      // rest of the batch goes next run
+    }
+#else
+    transport_request_t *request = (transport_request_t *) zlist_first (socket->queue);
+    while (request) {
+        transport_request_t *next = (transport_request_t *) zlist_next (socket->queue);
+        if (s_admit (self, request)) {
+            ssize_t rc = sendto (socket->fd, request->packet, request->size, 0,
+                (struct sockaddr *) &request->addr, request->addrlen);
+            ++self->syscalls;
+            if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+                break;
+            s_sent (self, request, now);
+        }
+        request = next;
+    }
+#endif
+}
+
+//  --------------------------------------------------------------------------
+//  Decode oid to numeric string, returns length or -1
+
+static int
+s_decode_oid (const byte *data, size_t size, char *buffer, size_t buffersize)
+{
+    uint32_t oid [TRANSPORT_OID_MAX];
+    size_t len = snmp_ber_decode_oid (data, size, oid, TRANSPORT_OID_MAX);
+    if (!len) return -1;
+    unsigned long name [TRANSPORT_OID_MAX];
+    for (size_t i = 0; i < len; i++)
+        name [i] = oid [i];
+    return zmsnmp_oid_format (name, len, buffer, buffersize);
+}
+
+//  Decode value of varbind, same representation as zmsnmp_value_from_varbind
+static zmsnmp_value_t *
+s_decode_value (byte tag, const byte *data, size_t length)
+{
+    switch (tag) {
+        case BER_INTEGER: {
+            if (length < 1 || length > 8) return NULL;
+            int64_t result = (data [0] & 0x80) ? -1 : 0;
+            for (size_t i = 0; i < length; i++)
+                result = (int64_t) (((uint64_t) result << 8) | data [i]);
+            return zmsnmp_value_new_integer (ZMSNMP_TYPE_INTEGER, result);
+        }
+        case BER_COUNTER32:
+        case BER_GAUGE32:
+        case BER_TIMETICKS:
+        case BER_COUNTER64: {
+            if (length < 1 || length > 9) return NULL;
+            uint64_t result = 0;
+            for (size_t i = 0; i < length; i++)
+                result = (result << 8) | data [i];
+            if (tag == BER_COUNTER64)
+                return zmsnmp_value_new_counter64 (result);
+            zmsnmp_type_t type = tag == BER_COUNTER32 ? ZMSNMP_TYPE_COUNTER32 :
+                (tag == BER_GAUGE32 ? ZMSNMP_TYPE_GAUGE32 : ZMSNMP_TYPE_TIMETICKS);
+            return zmsnmp_value_new_integer (type, (uint32_t) result);
+        }
+        case BER_OCTET_STRING:
+            return zmsnmp_value_new_string (ZMSNMP_TYPE_OCTETSTRING, (const char *) data, length);
+        case BER_OID: {
+            char buffer [1024];
+            int len = s_decode_oid (data, length, buffer, sizeof (buffer));
+            if (len < 0) return NULL;
+            return zmsnmp_value_new_string (ZMSNMP_TYPE_OID, buffer, len);
+        }
+        case BER_IPADDRESS: {
+            if (length != 4) break;
+            char buffer [16];
+            int len = snprintf (buffer, sizeof (buffer), "%u.%u.%u.%u", data [0], data [1], data [2], data [3]);
+            return zmsnmp_value_new_string (ZMSNMP_TYPE_IPADDRESS, buffer, len);
+        }
+        default:
+            break;
+    }
+    // the same text net-snmp prints
+    const char *text = NULL;
+    if (tag == BER_NULL)
+        text = "NULL";
+    else
+    if (tag == BER_NOSUCHOBJECT)
+        text = ZMSNMP_NOSUCHOBJECT;
+    else
+    if (tag == BER_NOSUCHINSTANCE)
+        text = ZMSNMP_NOSUCHINSTANCE;
+    else
+    if (tag == BER_ENDOFMIBVIEW)
+        text = ZMSNMP_ENDOFMIBVIEW;
+    if (text)
+        return zmsnmp_value_new_string (ZMSNMP_TYPE_OTHER, text, strlen (text));
+    char *hex = (char *) zmalloc (length * 3 + 1);
+    assert (hex);
+    for (size_t i = 0; i < length; i++)
+        sprintf (hex + 3 * i, i + 1 < length ? "%02X " : "%02X", data [i]);
+    zmsnmp_value_t *value = zmsnmp_value_new_string (ZMSNMP_TYPE_OTHER, hex, strlen (hex));
+    free (hex);
+    return value;
+}
+
+//  --------------------------------------------------------------------------
+//  Process one received datagram
+
+static void
+s_receive (snmp_transport_t *self, const byte *data, size_t size, const struct sockaddr *from)
+{
+    snmp_ber_reader_t ber = { data, 0, size };
+    byte tag;
+    size_t length;
+    int64_t version, id, errstat, errindex;
+    if (!snmp_ber_get_header (&ber, &tag, &length) || tag != BER_SEQUENCE
+    ||  !snmp_ber_get_integer (&ber, &version)
+    ||  !snmp_ber_get_header (&ber, &tag, &length) || tag != BER_OCTET_STRING) {
+        ++self->unmatched;
+        return;
+    }
+    ber.pos += length;                  // community
+    if (!snmp_ber_get_header (&ber, &tag, &length) || tag != PDU_RESPONSE
+    ||  !snmp_ber_get_integer (&ber, &id)
+    ||  !snmp_ber_get_integer (&ber, &errstat)
+    ||  !snmp_ber_get_integer (&ber, &errindex)
+    ||  !snmp_ber_get_header (&ber, &tag, &length) || tag != BER_SEQUENCE) {
+        ++self->unmatched;
+        return;
+    }
+    char key [16];
+    snprintf (key, sizeof (key), "%08x", (uint32_t) id);
+    transport_request_t *request = (transport_request_t *) zhash_lookup (self->requests, key);
+    if (!request || request->id != (uint32_t) id || !s_same_address (&request->addr, from)
+    ||  version != (request->version == 1 ? 0 : 1)) {
+        // late response of completed request or somebody else's datagram
+        ++self->unmatched;
+        return;
+    }
+    ++self->received_count;
+    if (errstat) {
+        self->errstat = (int) errstat;
+        self->errindex = (int) errindex;
+        s_complete (self, request, ZMSNMP_ERROR, NULL, NULL);
+        self->errstat = 0;
+        self->errindex = 0;
+        return;
+    }
+    zlist_t *oids = zlist_new ();
+    zlist_t *values = zlist_new ();
+    zlist_autofree (oids);
+    bool valid = true;
+    size_t end = ber.pos + length;
+    while (valid && ber.pos < end) {
+        size_t vblength, oidlength, valuelength;
+        byte valuetag;
+        valid = snmp_ber_get_header (&ber, &tag, &vblength) && tag == BER_SEQUENCE
+            &&  snmp_ber_get_header (&ber, &tag, &oidlength) && tag == BER_OID;
+        if (!valid) break;
+        char oid [1024];
+        valid = s_decode_oid (ber.data + ber.pos, oidlength, oid, sizeof (oid)) > 0;
+        ber.pos += oidlength;
+        valid = valid && snmp_ber_get_header (&ber, &valuetag, &valuelength);
+        if (!valid) break;
+        zmsnmp_value_t *value = s_decode_value (valuetag, ber.data + ber.pos, valuelength);
+        ber.pos += valuelength;
+        if (value) {
+            zlist_append (oids, oid);
+            zlist_append (values, value);
+            zlist_freefn (values, value, zmsnmp_value_freefn, true);
+        }
+    }
+    if (valid)
+        s_complete (self, request, ZMSNMP_OK, oids, values);
+    else
+        s_complete (self, request, ZMSNMP_ERROR, NULL, NULL);
+    zlist_destroy (&oids);
+    zlist_destroy (&values);
+}
+
+//  --------------------------------------------------------------------------
+//  Read available datagrams of the socket, in batches where possible
+
+static void
+s_read (snmp_transport_t *self, transport_socket_t *socket)
+{
+    if (!self->received) {
+        self->received = (byte *) malloc ((size_t) SNMP_TRANSPORT_BATCH * SNMP_TRANSPORT_MESSAGE_MAX);
+        assert (self->received);
+    }
+    struct sockaddr_storage addrs [SNMP_TRANSPORT_BATCH];
+#if defined (ZM_METRIC_HAVE_LINUX)
+    struct mmsghdr messages [SNMP_TRANSPORT_BATCH];
+    struct iovec iovecs [SNMP_TRANSPORT_BATCH];
+    for (int round = 0; round < TRANSPORT_READS; round++) {
+        for (int i = 0; i < SNMP_TRANSPORT_BATCH; i++) {
+            iovecs [i].iov_base = self->received + (size_t) i * SNMP_TRANSPORT_MESSAGE_MAX;
+            iovecs [i].iov_len = SNMP_TRANSPORT_MESSAGE_MAX;
+            memset (&messages [i], 0, sizeof (messages [i]));
+            messages [i].msg_hdr.msg_name = &addrs [i];
+            messages [i].msg_hdr.msg_namelen = sizeof (addrs [i]);
+            messages [i].msg_hdr.msg_iov = &iovecs [i];
+            messages [i].msg_hdr.msg_iovlen = 1;
+        }
+        int count = recvmmsg (socket->fd, messages, SNMP_TRANSPORT_BATCH, MSG_DONTWAIT, NULL);
+        ++self->syscalls;
+        if (count <= 0) break;
+        for (int i = 0; i < count; i++) {
+            if (messages [i].msg_hdr.msg_flags & MSG_TRUNC) {
+                ++self->unmatched;
+                continue;
+            }
+            s_receive (self, (const byte *) iovecs [i].iov_base, messages [i].msg_len,
+                (const struct sockaddr *) &addrs [i]);
+        }
+        if (count < SNMP_TRANSPORT_BATCH) break;
+    }
+#else
+    for (int round = 0; round < TRANSPORT_READS * SNMP_TRANSPORT_BATCH; round++) {
+        socklen_t addrlen = sizeof (addrs [0]);
+        ssize_t size = recvfrom (socket->fd, self->received, SNMP_TRANSPORT_MESSAGE_MAX, MSG_DONTWAIT,
+            (struct sockaddr *) &addrs [0], &addrlen);
+        ++self->syscalls;
+        if (size < 0) break;
+        s_receive (self, self->received, (size_t) size, (const struct sockaddr *) &addrs [0]);
+    }
+#endif
+}
+
+//  --------------------------------------------------------------------------
+//  Retransmit or fail requests without response
+
+static void
+s_expire (snmp_transport_t *self, int64_t now)
+{
+    zlist_t *expired = NULL;
+    transport_request_t *request = (transport_request_t *) zhash_first (self->requests);
+    while (request) {
+        if (!request->queued && request->deadline <= now) {
+            if (!expired) expired = zlist_new ();
+            zlist_append (expired, request);
+        }
+        request = (transport_request_t *) zhash_next (self->requests);
+    }
+    if (!expired) return;
+    request = (transport_request_t *) zlist_first (expired);
+    while (request) {
+        if (request->retries > 0) {
+            --request->retries;
+            request->queued = true;
+            zlist_append (request->socket->queue, request);
+            ++self->retransmitted;
+        }
+        else
+            s_complete (self, request, ZMSNMP_TIMEOUT, NULL, NULL);
+        request = (transport_request_t *) zlist_next (expired);
+    }
+    zlist_destroy (&expired);
+}
+
+//  --------------------------------------------------------------------------
+//  Send queued requests of all sockets, returns number of polled sockets
+
+static size_t
+s_flush_all (snmp_transport_t *self)
+{
+    size_t nfds = 0;
+    self->hold = 0;
+    for (int family = 0; family < 2; family++) {
+        transport_socket_t *sockets = self->sockets [family];
+        if (!sockets) continue;
+        for (size_t i = 0; i < self->count; i++) {
+            if (zlist_size (sockets [i].queue))
+                s_flush (self, &sockets [i]);
+            self->pollfds [nfds].fd = sockets [i].fd;
+            self->pollfds [nfds].events = POLLIN;
+            self->pollfds [nfds].revents = 0;
+            self->polled [nfds] = &sockets [i];
+            ++nfds;
+        }
+    }
+    self->pollfds [nfds].fd = self->wakeup [0];
+    self->pollfds [nfds].events = POLLIN;
+    self->pollfds [nfds].revents = 0;
+    self->polled [nfds] = NULL;
+    return nfds + 1;
+}
+
+//  --------------------------------------------------------------------------
+//  Send queued requests, wait for responses and handle timeouts
+
+size_t
+snmp_transport_run (snmp_transport_t *self, int timeout)
+{
+    if (!self) return 0;
+
+    self->completed = 0;
+    size_t nfds = s_flush_all (self);
+    if (!zhash_size (self->requests)) return 0;
+
+    int64_t now = zclock_mono ();
+    if (self->next_tick == 0) self->next_tick = now + SNMP_TRANSPORT_TICK;
+    int wait = (int) (self->next_tick > now ? self->next_tick - now : 0);
+    if (timeout >= 0 && timeout < wait) wait = timeout;
+    if (self->hold && self->hold < wait) wait = (int) self->hold;
+
+    if (poll (self->pollfds, nfds, wait) > 0) {
+        for (size_t i = 0; i < nfds; i++) {
+            if (!self->pollfds [i].revents)
+                continue;
+            if (self->polled [i])
+                s_read (self, self->polled [i]);
+            else {
+                byte signals [64];
+                while (read (self->wakeup [0], signals, sizeof (signals)) > 0) ;
+            }
+        }
+    }
+    now = zclock_mono ();
+    if (now >= self->next_tick) {
+        s_expire (self, now);
+        s_flush_all (self);
+        self->next_tick = now + SNMP_TRANSPORT_TICK;
+    }
+    return self->completed;
+}
+
+//  --------------------------------------------------------------------------
+//  Append counters to the message
+
+void
+snmp_transport_stats (snmp_transport_t *self, zmsg_t *msg)
+{
+    if (!self || !msg) return;
+    zmsg_addstr (msg, "transport-sent");
+    zmsg_addstrf (msg, "%" PRIu64, self->sent);
+    zmsg_addstr (msg, "transport-retransmitted");
+    zmsg_addstrf (msg, "%" PRIu64, self->retransmitted);
+    zmsg_addstr (msg, "transport-received");
+    zmsg_addstrf (msg, "%" PRIu64, self->received_count);
+    zmsg_addstr (msg, "transport-unmatched");
+    zmsg_addstrf (msg, "%" PRIu64, self->unmatched);
+    zmsg_addstr (msg, "transport-syscalls");
+    zmsg_addstrf (msg, "%" PRIu64, self->syscalls);
+}
+
+//  --------------------------------------------------------------------------
+//  Self test of this class
+
+typedef struct {
+    int status [ZMSNMP_ERROR + 1];
+    char *oid;                          // of the last OK response
+    char *value;
+    snmp_transport_t *transport;
+    int errstat;                        // of the last error response
+    int errindex;
+} test_result_t;
+
+static void
+s_test_result (int status, zlist_t *oids, zlist_t *values, void *arg)
+{
+    test_result_t *result = (test_result_t *) arg;
+    ++result->status [status];
+    if (status == ZMSNMP_ERROR)
+        result->errstat = snmp_transport_error (result->transport, &result->errindex);
+    if (status != ZMSNMP_OK) return;
+    zstr_free (&result->oid);
+    zstr_free (&result->value);
+    const char *oid = (const char *) zlist_last (oids);
+    zmsnmp_value_t *value = (zmsnmp_value_t *) zlist_last (values);
+    if (oid) result->oid = strdup (oid);
+    if (value) result->value = zmsnmp_value_str (value);
+}
+
+static void
+s_test_wait (snmp_transport_t *transport)
+{
+    int64_t start = zclock_mono ();
+    while (snmp_transport_pending (transport) && zclock_mono () - start < 5000)
+        snmp_transport_run (transport, 100);
+}
+
+void
+snmp_transport_test (bool verbose)
+{
+    printf (" * snmp_transport: ");
+
+    //  @selftest
+    snmpsim_t *sim = snmpsim_new ();
+    assert (snmpsim_set (sim, ".1.3.6.1.2.1.1.3.0", "Timeticks", "123456") == 0);
+    assert (snmpsim_set (sim, ".1.3.6.1.2.1.1.5.0", "STRING", "device") == 0);
+    assert (snmpsim_set (sim, ".1.3.6.1.2.1.2.2.1.10.1", "Counter32", "4294967295") == 0);
+    assert (snmpsim_set (sim, ".1.3.6.1.2.1.31.1.1.1.6.1", "Counter64", "84294967296") == 0);
+    for (int i = 0; i < 10; i++)
+        assert (snmpsim_bind (sim, "127.0.0.1", 0));
+    zactor_t *agent = zactor_new (snmpsim_actor, sim);
+    assert (agent);
+    const char *host = snmpsim_endpoint (sim, 0);
+
+    snmp_transport_t *transport = snmp_transport_new (2);
+    assert (transport);
+    snmp_credentials_t public = { 2, "public" };
+    snmp_credentials_t v1 = { 1, "public" };
+    snmp_credentials_t wrong = { 2, "wrong" };
+    test_result_t result;
+    memset (&result, 0, sizeof (result));
+    result.transport = transport;
+
+    // get of several oids in one request, numbers are decoded as numbers
+    zlist_t *oids = zlist_new ();
+    zlist_append (oids, ".1.3.6.1.2.1.1.5.0");
+    zlist_append (oids, ".1.3.6.1.2.1.2.2.1.10.1");
+    zlist_append (oids, ".1.3.6.1.2.1.31.1.1.1.6.1");
+    assert (snmp_transport_send (transport, host, &public, ZMSNMP_GET, oids, 500, 1, s_test_result, &result) == 0);
+    assert (snmp_transport_pending (transport) == 1);
+    s_test_wait (transport);
+    assert (result.status [ZMSNMP_OK] == 1);
+    assert (streq (result.oid, ".1.3.6.1.2.1.31.1.1.1.6.1"));
+    assert (streq (result.value, "84294967296"));
+    zlist_destroy (&oids);
+
+    // getnext, version 1
+    oids = zlist_new ();
+    zlist_append (oids, ".1.3.6.1.2.1.1.3");
+    assert (snmp_transport_send (transport, host, &v1, ZMSNMP_GETNEXT, oids, 500, 1, s_test_result, &result) == 0);
+    s_test_wait (transport);
+    assert (result.status [ZMSNMP_OK] == 2);
+    assert (streq (result.oid, ".1.3.6.1.2.1.1.3.0"));
+    assert (streq (result.value, "123456"));
+    zlist_destroy (&oids);
+
+    // getbulk, version 2c only
+    oids = zlist_new ();
+    zlist_append (oids, ".1.3.6.1.2.1.1");
+    assert (snmp_transport_send_bulk (transport, host, &v1, oids, 2, 500, 1, s_test_result, &result) == -1);
+    assert (snmp_transport_send_bulk (transport, host, &public, oids, 2, 500, 1, s_test_result, &result) == 0);
+    s_test_wait (transport);
+    assert (result.status [ZMSNMP_OK] == 3);
+    assert (streq (result.oid, ".1.3.6.1.2.1.1.5.0"));
+    assert (streq (result.value, "device"));
+    zlist_destroy (&oids);
+
+    // error status of the response is available in the callback
+    oids = zlist_new ();
+    zlist_append (oids, ".1.3.6.1.2.1.1.5.0");
+    zlist_append (oids, ".1.3.6.1.2.1.1.9.0");
+    assert (snmp_transport_send (transport, host, &v1, ZMSNMP_GET, oids, 500, 1, s_test_result, &result) == 0);
+    s_test_wait (transport);
+    assert (result.status [ZMSNMP_ERROR] == 1);
+    assert (result.errstat == 2 && result.errindex == 2);      // noSuchName
+    assert (snmp_transport_error (transport, NULL) == 0);
+    zlist_destroy (&oids);
+    oids = zlist_new ();
+    zlist_append (oids, ".1.3.6.1.2.1.1.3");
+
+    // wrong community is not answered, request is retried and times out
+    int64_t start = zclock_mono ();
+    assert (snmp_transport_send (transport, host, &wrong, ZMSNMP_GET, oids, 100, 1, s_test_result, &result) == 0);
+    s_test_wait (transport);
+    assert (result.status [ZMSNMP_TIMEOUT] == 1);
+    assert (zclock_mono () - start >= 200);
+
+    // invalid requests are refused
+    assert (snmp_transport_send (transport, "no.such.host.invalid", &public, ZMSNMP_GET, oids, 100, 0, s_test_result, &result) == -1);
+    assert (snmp_transport_send (transport, host, &public, 0, oids, 100, 0, s_test_result, &result) == -1);
+    zlist_destroy (&oids);
+    oids = zlist_new ();
+    assert (snmp_transport_send (transport, host, &public, ZMSNMP_GET, oids, 100, 0, s_test_result, &result) == -1);
+    zlist_append (oids, "not an oid");
+    assert (snmp_transport_send (transport, host, &public, ZMSNMP_GET, oids, 100, 0, s_test_result, &result) == -1);
+    zlist_destroy (&oids);
+
+    // thousand requests to ten agents share two sockets
+    oids = zlist_new ();
+    zlist_append (oids, ".1.3.6.1.2.1.1.5.0");
+    memset (&result.status, 0, sizeof (result.status));
+    result.errstat = 0;
+    start = zclock_mono ();
+    for (int i = 0; i < 1000; i++)
+        assert (snmp_transport_send (transport, snmpsim_endpoint (sim, i % 10), &public, ZMSNMP_GET, oids, 1000, 2, s_test_result, &result) == 0);
+    s_test_wait (transport);
+    zlist_destroy (&oids);
+    if (verbose)
+        zsys_debug ("1000 requests in %" PRIi64 " ms", zclock_mono () - start);
+    assert (result.status [ZMSNMP_OK] == 1000);
+    assert (streq (result.value, "device"));
+    assert (snmp_transport_sockets (transport) == 2);
+
+    zmsg_t *stats = zmsg_new ();
+    snmp_transport_stats (transport, stats);
+    assert (zmsg_size (stats) == 10);
+    char *name = zmsg_popstr (stats);
+    while (name) {
+        char *value = zmsg_popstr (stats);
+        if (verbose)
+            zsys_debug ("%s: %s", name, value);
+#if defined (ZM_METRIC_HAVE_LINUX)
+        if (streq (name, "transport-syscalls"))
+            assert (atoi (value) < 1000);       // sent and received in batches
+#endif
+        zstr_free (&name);
+        zstr_free (&value);
+        name = zmsg_popstr (stats);
+    }
+    zmsg_destroy (&stats);
+
+    // destroy completes requests in flight
+    oids = zlist_new ();
+    zlist_append (oids, ".1.3.6.1.2.1.1.5.0");
+    memset (&result.status, 0, sizeof (result.status));
+    assert (snmp_transport_send (transport, host, &wrong, ZMSNMP_GET, oids, 1000, 0, s_test_result, &result) == 0);
+    zlist_destroy (&oids);
+    snmp_transport_run (transport, 0);
+    snmp_transport_destroy (&transport);
+    assert (transport == NULL);
+    assert (result.status [ZMSNMP_ERROR] == 1);
+
+    zstr_free (&result.oid);
+    zstr_free (&result.value);
+    zactor_destroy (&agent);
+    snmpsim_destroy (&sim);
+    zmsnmp_reset ();
+    //  @end
+
+    printf ("OK\n");
+}
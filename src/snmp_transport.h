@@ -0,0 +1,115 @@
+/*  =========================================================================
+    snmp_transport - SNMP requests multiplexed over shared UDP sockets
+
+    Copyright (C) 2016 - 2017 Tomas Halman
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#ifndef SNMP_TRANSPORT_H_INCLUDED
+#define SNMP_TRANSPORT_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SNMP_TRANSPORT_SOCKETS      4       // default sockets per address family
+#define SNMP_TRANSPORT_BATCH        64      // datagrams per sendmmsg/recvmmsg
+#define SNMP_TRANSPORT_TICK         50      // ms, how often timeouts are checked
+#define SNMP_TRANSPORT_TIMEOUT      1000    // ms, default timeout (net-snmp default)
+#define SNMP_TRANSPORT_RETRIES      5       // default retries (net-snmp default)
+#define SNMP_TRANSPORT_MESSAGE_MAX  65507   // max UDP payload
+
+#ifndef SNMP_TRANSPORT_T_DEFINED
+typedef struct _snmp_transport_t snmp_transport_t;
+#define SNMP_TRANSPORT_T_DEFINED
+#endif
+
+//  @interface
+//  Create a new transport with given number of UDP sockets per address
+//  family (0 = SNMP_TRANSPORT_SOCKETS). Sockets are opened on first use.
+ZM_METRIC_PRIVATE snmp_transport_t *
+    snmp_transport_new (size_t sockets);
+
+//  Destroy the transport. Callbacks of requests in flight are called with
+//  ZMSNMP_ERROR status.
+ZM_METRIC_PRIVATE void
+    snmp_transport_destroy (snmp_transport_t **self_p);
+
+//  Queue SNMP v1/v2c request (ZMSNMP_GET or ZMSNMP_GETNEXT) of all oids to
+//  the host ("10.0.0.1", "10.0.0.1:1161", "[::1]:161" or host name).
+//  Request is sent by the next snmp_transport_run () together with other
+//  queued requests, unless rate or in flight limit of zmsnmp holds it in
+//  the queue for a later run. Response is matched by request id and
+//  address of the host. fn is called from snmp_transport_run () once the request completes,
+//  timeout is in ms. Returns 0 if the request was queued, -1 otherwise (fn
+//  is not called then).
+ZM_METRIC_PRIVATE int
+    snmp_transport_send (snmp_transport_t *self, const char *host, const snmp_credentials_t *credentials, int command, zlist_t *oids, int timeout, int retries, zmsnmp_fn *fn, void *arg);
+
+//  Queue SNMP v2c GETBULK request of all oids with no non-repeaters and
+//  max_repetitions. Otherwise the same as snmp_transport_send.
+ZM_METRIC_PRIVATE int
+    snmp_transport_send_bulk (snmp_transport_t *self, const char *host, const snmp_credentials_t *credentials, zlist_t *oids, int max_repetitions, int timeout, int retries, zmsnmp_fn *fn, void *arg);
+
+//  Error status (like tooBig or noSuchName) of the response whose request
+//  is being completed with ZMSNMP_ERROR, errindex gets index of the failed
+//  varbind. Valid only inside the callback, returns 0 when the request
+//  failed without response from the agent.
+ZM_METRIC_PRIVATE int
+    snmp_transport_error (snmp_transport_t *self, int *errindex);
+
+//  Round trip of the request being completed, ms since it was first sent
+//  (0 if it was never sent). Valid only inside the callback.
+ZM_METRIC_PRIVATE int64_t
+    snmp_transport_elapsed (snmp_transport_t *self);
+
+//  Interrupt waiting of snmp_transport_run (). The only function which can
+//  be called from another thread than the one using the transport.
+ZM_METRIC_PRIVATE void
+    snmp_transport_wake (snmp_transport_t *self);
+
+//  Number of requests queued or in flight
+ZM_METRIC_PRIVATE size_t
+    snmp_transport_pending (snmp_transport_t *self);
+
+//  Send queued requests, wait up to timeout ms (-1 for one tick) for
+//  responses, call callbacks of completed requests. Returns number of
+//  completed requests.
+ZM_METRIC_PRIVATE size_t
+    snmp_transport_run (snmp_transport_t *self, int timeout);
+
+//  Number of open sockets
+ZM_METRIC_PRIVATE size_t
+    snmp_transport_sockets (snmp_transport_t *self);
+
+//  Append counters (transport-sent, transport-retransmitted,
+//  transport-received, transport-unmatched, transport-syscalls) to the
+//  message as name/value frame pairs
+ZM_METRIC_PRIVATE void
+    snmp_transport_stats (snmp_transport_t *self, zmsg_t *msg);
+
+//  Self test of this class
+ZM_METRIC_PRIVATE void
+    snmp_transport_test (bool verbose);
+
+//  @end
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,935 @@
+/*  =========================================================================
+    snmpsim - simulated SNMP agents serving recorded walks
+
+    Copyright (C) 2016 - 2017 Tomas Halman
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    snmpsim - simulated SNMP agents serving recorded walks
+@discuss
+    Serves SNMP v1 and v2c GET, GETNEXT and GETBULK requests from data
+    loaded from snmpwalk output. Every bound UDP socket looks like one
+    device, all of them serve the same data. Responses can be delayed,
+    dropped or refused with tooBig, so timeouts, retries and PDU splitting
+    can be tested and benchmarked without real devices. Requests are
+    decoded and responses encoded here, net-snmp is not involved.
+@end
+*/
+
+#include "zm_metric_classes.h"
+
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define SNMPSIM_OID_MAX         128     // sub-identifiers of one oid
+#define SNMPSIM_VARBINDS_MAX    128     // varbinds of one request
+#define SNMPSIM_MESSAGE_MAX     65507   // max UDP payload
+
+//  Error status
+#define ERR_TOOBIG          1
+#define ERR_NOSUCHNAME      2
+
+typedef struct {
+    uint32_t *oid;
+    size_t len;
+    byte *name;         // BER encoded oid
+    size_t namesize;
+    byte *value;        // BER encoded value
+    size_t valuesize;
+    size_t seq;         // order of setting, the last one wins
+} sim_entry_t;
+
+typedef struct {
+    int fd;
+    char *endpoint;
+} sim_agent_t;
+
+typedef struct {
+    int fd;
+    struct sockaddr_in peer;
+    int64_t due;        // zclock_mono
+    size_t size;
+    byte data [];
+} sim_response_t;
+
+//  One varbind of request
+typedef struct {
+    uint32_t oid [SNMPSIM_OID_MAX];
+    size_t len;
+    const byte *name;   // BER encoded oid in request
+    size_t namesize;
+} sim_varbind_t;
+
+//  Structure of our class
+
+struct _snmpsim_t {
+    sim_entry_t *entries;
+    size_t size;
+    size_t capacity;
+    bool sorted;
+    size_t seq;
+    sim_agent_t *agents;
+    struct pollfd *pollfds;
+    size_t nagents;
+    char *community;
+    int latency;        // ms
+    int loss;           // percent
+    int max_varbinds;
+    uint64_t random;    // xorshift state
+    zlist_t *delayed;   // sim_response_t, in order of due time
+    uint64_t requests;
+    uint64_t dropped;
+    sim_varbind_t *varbinds;
+    byte *varbindsbuf;
+};
+
+
+//  --------------------------------------------------------------------------
+//  Create a new snmpsim
+
+snmpsim_t *
+snmpsim_new (void)
+{
+    snmpsim_t *self = (snmpsim_t *) zmalloc (sizeof (snmpsim_t));
+    assert (self);
+    self->community = strdup ("public");
+    self->random = 0x2545F4914F6CDD1DULL;
+    self->sorted = true;
+    self->delayed = zlist_new ();
+    assert (self->delayed);
+    self->varbinds = (sim_varbind_t *) zmalloc (SNMPSIM_VARBINDS_MAX * sizeof (sim_varbind_t));
+    self->varbindsbuf = (byte *) zmalloc (SNMPSIM_MESSAGE_MAX);
+    assert (self->varbinds && self->varbindsbuf);
+    return self;
+}
+
+//  --------------------------------------------------------------------------
+//  Destroy the snmpsim
+
+void
+snmpsim_destroy (snmpsim_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        snmpsim_t *self = *self_p;
+        for (size_t i = 0; i < self->size; i++) {
+            free (self->entries [i].oid);
+            free (self->entries [i].name);
+            free (self->entries [i].value);
+        }
+        free (self->entries);
+        for (size_t i = 0; i < self->nagents; i++) {
+            close (self->agents [i].fd);
+            zstr_free (&self->agents [i].endpoint);
+        }
+        free (self->agents);
+        free (self->pollfds);
+        zstr_free (&self->community);
+        sim_response_t *delayed = (sim_response_t *) zlist_pop (self->delayed);
+        while (delayed) {
+            free (delayed);
+            delayed = (sim_response_t *) zlist_pop (self->delayed);
+        }
+        zlist_destroy (&self->delayed);
+        free (self->varbinds);
+        free (self->varbindsbuf);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+//  --------------------------------------------------------------------------
+//  Parse numeric oid string
+
+static bool
+s_parse_oid (const char *str, uint32_t *oid, size_t *len)
+{
+    size_t n = 0;
+    const char *p = str;
+    if (*p == '.') ++p;
+    while (*p) {
+        if (*p < '0' || *p > '9' || n >= SNMPSIM_OID_MAX) return false;
+        char *end;
+        unsigned long value = strtoul (p, &end, 10);
+        if (value > 0xFFFFFFFF) return false;
+        oid [n++] = (uint32_t) value;
+        p = end;
+        if (*p == '.') ++p;
+        else
+        if (*p) return false;
+    }
+    *len = n;
+    return n >= 2;
+}
+
+static int
+s_oid_compare (const uint32_t *a, size_t alen, const uint32_t *b, size_t blen)
+{
+    size_t len = alen < blen ? alen : blen;
+    for (size_t i = 0; i < len; i++) {
+        if (a [i] != b [i]) return a [i] < b [i] ? -1 : 1;
+    }
+    if (alen == blen) return 0;
+    return alen < blen ? -1 : 1;
+}
+
+//  --------------------------------------------------------------------------
+//  Encode value given as snmpwalk type and text. Returns size of encoded
+//  value in buffer, 0 if value is not valid.
+
+static size_t
+s_encode_value (const char *type, const char *text, byte *buffer, size_t size)
+{
+    byte content [1024];
+    size_t length = 0;
+    byte tag;
+    // numbers of INTEGER: up(1) and Timeticks: (123) 0:00:01.23
+    const char *number = strchr (text, '(');
+    number = number ? number + 1 : text;
+
+    if (streq (type, "INTEGER")) {
+        tag = BER_INTEGER;
+        length = snmp_ber_encode_integer (strtoll (number, NULL, 10), content);
+    }
+    else
+    if (streq (type, "Counter32") || streq (type, "Gauge32") || streq (type, "Unsigned32") || streq (type, "Timeticks")) {
+        tag = streq (type, "Counter32") ? BER_COUNTER32 : streq (type, "Timeticks") ? BER_TIMETICKS : BER_GAUGE32;
+        length = snmp_ber_encode_unsigned (strtoull (number, NULL, 10) & 0xFFFFFFFF, content);
+    }
+    else
+    if (streq (type, "Counter64")) {
+        tag = BER_COUNTER64;
+        length = snmp_ber_encode_unsigned (strtoull (text, NULL, 10), content);
+    }
+    else
+    if (streq (type, "STRING")) {
+        tag = BER_OCTET_STRING;
+        size_t textlen = strlen (text);
+        const char *p = text;
+        const char *end = text + textlen;
+        if (textlen >= 2 && text [0] == '"' && text [textlen - 1] == '"') {
+            ++p;
+            --end;
+        }
+        while (p < end && length < sizeof (content)) {
+            if (*p == '\\' && p + 1 < end) ++p;
+            content [length++] = (byte) *p++;
+        }
+    }
+    else
+    if (streq (type, "Hex-STRING")) {
+        tag = BER_OCTET_STRING;
+        const char *p = text;
+        while (*p && length < sizeof (content)) {
+            while (*p == ' ') ++p;
+            if (!*p) break;
+            char *end;
+            unsigned long value = strtoul (p, &end, 16);
+            if (end == p || value > 0xFF) return 0;
+            content [length++] = (byte) value;
+            p = end;
+        }
+    }
+    else
+    if (streq (type, "OID")) {
+        tag = BER_OID;
+        uint32_t oid [SNMPSIM_OID_MAX];
+        size_t len;
+        if (!s_parse_oid (text, oid, &len)) return 0;
+        length = snmp_ber_encode_oid (oid, len, content);
+    }
+    else
+    if (streq (type, "IpAddress")) {
+        tag = BER_IPADDRESS;
+        struct in_addr addr;
+        if (inet_pton (AF_INET, text, &addr) != 1) return 0;
+        memcpy (content, &addr, 4);
+        length = 4;
+    }
+    else
+        return 0;
+
+    size_t pos = 0;
+    if (!snmp_ber_put (buffer, &pos, size, tag, content, length)) return 0;
+    return pos;
+}
+
+//  --------------------------------------------------------------------------
+//  Set value of the oid
+
+int
+snmpsim_set (snmpsim_t *self, const char *oid, const char *type, const char *value)
+{
+    if (!self || !oid || !type || !value) return -1;
+
+    uint32_t parsed [SNMPSIM_OID_MAX];
+    size_t len;
+    if (!s_parse_oid (oid, parsed, &len)) return -1;
+    byte encoded [1100];
+    size_t valuesize = s_encode_value (type, value, encoded, sizeof (encoded));
+    if (!valuesize) return -1;
+
+    if (self->size == self->capacity) {
+        self->capacity = self->capacity ? self->capacity * 2 : 256;
+        self->entries = (sim_entry_t *) realloc (self->entries, self->capacity * sizeof (sim_entry_t));
+        assert (self->entries);
+    }
+    sim_entry_t *entry = &self->entries [self->size++];
+    entry->oid = (uint32_t *) zmalloc (len * sizeof (uint32_t));
+    assert (entry->oid);
+    memcpy (entry->oid, parsed, len * sizeof (uint32_t));
+    entry->len = len;
+    byte name [SNMPSIM_OID_MAX * 5 + 4];
+    size_t namelen = snmp_ber_encode_oid (parsed, len, name + 4);
+    entry->namesize = 0;
+    entry->name = (byte *) zmalloc (namelen + 4);
+    assert (entry->name);
+    snmp_ber_put (entry->name, &entry->namesize, namelen + 4, BER_OID, name + 4, namelen);
+    entry->value = (byte *) zmalloc (valuesize);
+    assert (entry->value);
+    memcpy (entry->value, encoded, valuesize);
+    entry->valuesize = valuesize;
+    entry->seq = self->seq++;
+    self->sorted = false;
+    return 0;
+}
+
+//  --------------------------------------------------------------------------
+//  Load snmpwalk output
+
+int
+snmpsim_load (snmpsim_t *self, const char *filename)
+{
+    if (!self || !filename) return -1;
+    FILE *file = fopen (filename, "r");
+    if (!file) return -1;
+
+    int loaded = 0;
+    char *line = NULL;
+    size_t linesize = 0;
+    while (getline (&line, &linesize, file) != -1) {
+        line [strcspn (line, "\r\n")] = 0;
+        // .1.3.6.1.2.1.1.5.0 = STRING: "name"
+        char *separator = strstr (line, " = ");
+        if (line [0] != '.' || !separator) continue;
+        *separator = 0;
+        char *type = separator + 3;
+        char *value;
+        if (streq (type, "\"\"")) {
+            // empty string is printed without type
+            type = "STRING";
+            value = "";
+        }
+        else {
+            char *colon = strstr (type, ": ");
+            if (!colon) continue;
+            *colon = 0;
+            value = colon + 2;
+        }
+        if (snmpsim_set (self, line, type, value) == 0) ++loaded;
+    }
+    free (line);
+    fclose (file);
+    return loaded;
+}
+
+//  --------------------------------------------------------------------------
+//  Sort entries, for duplicate oids keep the one set last
+
+static int
+s_entry_compare (const void *a, const void *b)
+{
+    const sim_entry_t *ea = (const sim_entry_t *) a;
+    const sim_entry_t *eb = (const sim_entry_t *) b;
+    int result = s_oid_compare (ea->oid, ea->len, eb->oid, eb->len);
+    if (result) return result;
+    return ea->seq < eb->seq ? -1 : 1;
+}
+
+static void
+s_sort (snmpsim_t *self)
+{
+    if (self->sorted) return;
+    qsort (self->entries, self->size, sizeof (sim_entry_t), s_entry_compare);
+    size_t n = 0;
+    for (size_t i = 0; i < self->size; i++) {
+        if (i + 1 < self->size
+        &&  s_oid_compare (self->entries [i].oid, self->entries [i].len, self->entries [i + 1].oid, self->entries [i + 1].len) == 0) {
+            free (self->entries [i].oid);
+            free (self->entries [i].name);
+            free (self->entries [i].value);
+            continue;
+        }
+        self->entries [n++] = self->entries [i];
+    }
+    self->size = n;
+    self->sorted = true;
+}
+
+//  --------------------------------------------------------------------------
+//  Number of values
+
+size_t
+snmpsim_size (snmpsim_t *self)
+{
+    if (!self) return 0;
+    s_sort (self);
+    return self->size;
+}
+
+//  --------------------------------------------------------------------------
+//  Index of first entry greater or equal (or just greater) than oid
+
+static size_t
+s_lower_bound (snmpsim_t *self, const uint32_t *oid, size_t len, bool greater)
+{
+    size_t low = 0;
+    size_t high = self->size;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        int result = s_oid_compare (self->entries [middle].oid, self->entries [middle].len, oid, len);
+        if (result < 0 || (greater && result == 0))
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+//  --------------------------------------------------------------------------
+//  Settings
+
+void
+snmpsim_set_community (snmpsim_t *self, const char *community)
+{
+    if (!self) return;
+    zstr_free (&self->community);
+    if (community) self->community = strdup (community);
+}
+
+void
+snmpsim_set_latency (snmpsim_t *self, int latency)
+{
+    if (!self) return;
+    self->latency = latency > 0 ? latency : 0;
+}
+
+void
+snmpsim_set_loss (snmpsim_t *self, int percent)
+{
+    if (!self) return;
+    self->loss = percent < 0 ? 0 : (percent > 100 ? 100 : percent);
+}
+
+void
+snmpsim_set_max_varbinds (snmpsim_t *self, int max)
+{
+    if (!self) return;
+    self->max_varbinds = max > 0 ? max : 0;
+}
+
+//  --------------------------------------------------------------------------
+//  Bind new agent
+
+const char *
+snmpsim_bind (snmpsim_t *self, const char *address, int port)
+{
+    if (!self || !address) return NULL;
+
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof (addr);
+    memset (&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons ((uint16_t) port);
+    if (inet_pton (AF_INET, address, &addr.sin_addr) != 1) return NULL;
+
+    int fd = socket (AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) return NULL;
+    if (bind (fd, (struct sockaddr *) &addr, sizeof (addr)) != 0
+    ||  getsockname (fd, (struct sockaddr *) &addr, &addrlen) != 0) {
+        close (fd);
+        return NULL;
+    }
+    fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK);
+
+    self->agents = (sim_agent_t *) realloc (self->agents, (self->nagents + 1) * sizeof (sim_agent_t));
+    self->pollfds = (struct pollfd *) realloc (self->pollfds, (self->nagents + 1) * sizeof (struct pollfd));
+    assert (self->agents && self->pollfds);
+    sim_agent_t *agent = &self->agents [self->nagents];
+    agent->fd = fd;
+    agent->endpoint = zsys_sprintf ("%s:%i", address, ntohs (addr.sin_port));
+    self->pollfds [self->nagents].fd = fd;
+    self->pollfds [self->nagents].events = POLLIN;
+    ++self->nagents;
+    return agent->endpoint;
+}
+
+//  --------------------------------------------------------------------------
+//  Number of agents
+
+size_t
+snmpsim_agents (snmpsim_t *self)
+{
+    if (!self) return 0;
+    return self->nagents;
+}
+
+//  --------------------------------------------------------------------------
+//  Endpoint of the agent
+
+const char *
+snmpsim_endpoint (snmpsim_t *self, size_t index)
+{
+    if (!self || index >= self->nagents) return NULL;
+    return self->agents [index].endpoint;
+}
+
+//  --------------------------------------------------------------------------
+//  Pseudorandom number, xorshift64*
+
+static uint64_t
+s_random (snmpsim_t *self)
+{
+    self->random ^= self->random >> 12;
+    self->random ^= self->random << 25;
+    self->random ^= self->random >> 27;
+    return self->random * 0x2545F4914F6CDD1DULL;
+}
+
+//  --------------------------------------------------------------------------
+//  Append varbind of entry (or of request oid with exception value)
+
+static bool
+s_put_varbind (byte *data, size_t *pos, size_t size, const byte *name, size_t namesize, const byte *value, size_t valuesize)
+{
+    return snmp_ber_put_header (data, pos, size, BER_SEQUENCE, namesize + valuesize)
+        && snmp_ber_put_raw (data, pos, size, name, namesize)
+        && snmp_ber_put_raw (data, pos, size, value, valuesize);
+}
+
+//  --------------------------------------------------------------------------
+//  Process one request, returns size of the response in buffer, 0 if
+//  request is dropped
+
+static size_t
+s_process (snmpsim_t *self, const byte *request, size_t size, byte *response)
+{
+    snmp_ber_reader_t ber = { request, 0, size };
+    byte tag;
+    size_t length;
+
+    // message: version, community, PDU
+    if (!snmp_ber_get_header (&ber, &tag, &length) || tag != BER_SEQUENCE) return 0;
+    size_t header = ber.pos;
+    int64_t version;
+    if (!snmp_ber_get_integer (&ber, &version) || (version != 0 && version != 1)) return 0;
+    if (!snmp_ber_get_header (&ber, &tag, &length) || tag != BER_OCTET_STRING) return 0;
+    if (self->community
+    && (length != strlen (self->community) || memcmp (request + ber.pos, self->community, length) != 0))
+        return 0;
+    ber.pos += length;
+    size_t headersize = ber.pos - header;
+
+    byte command;
+    if (!snmp_ber_get_header (&ber, &command, &length)) return 0;
+    if (command != PDU_GET && command != PDU_GETNEXT && !(command == PDU_GETBULK && version == 1)) return 0;
+    size_t reqid = ber.pos;
+    int64_t ignored, nonrepeaters, repetitions;
+    if (!snmp_ber_get_integer (&ber, &ignored)) return 0;
+    size_t reqidsize = ber.pos - reqid;
+    if (!snmp_ber_get_integer (&ber, &nonrepeaters) || !snmp_ber_get_integer (&ber, &repetitions)) return 0;
+
+    // request varbinds
+    if (!snmp_ber_get_header (&ber, &tag, &length) || tag != BER_SEQUENCE) return 0;
+    const byte *reqvarbinds = request + ber.pos;
+    size_t reqvarbindssize = length;
+    size_t end = ber.pos + length;
+    size_t count = 0;
+    while (ber.pos < end) {
+        if (count == SNMPSIM_VARBINDS_MAX) return 0;
+        if (!snmp_ber_get_header (&ber, &tag, &length) || tag != BER_SEQUENCE) return 0;
+        size_t next = ber.pos + length;
+        sim_varbind_t *varbind = &self->varbinds [count];
+        varbind->name = request + ber.pos;
+        if (!snmp_ber_get_header (&ber, &tag, &length) || tag != BER_OID) return 0;
+        varbind->len = snmp_ber_decode_oid (request + ber.pos, length, varbind->oid, SNMPSIM_OID_MAX);
+        if (!varbind->len) return 0;
+        varbind->namesize = ber.pos + length - (varbind->name - request);
+        ber.pos = next;
+        ++count;
+    }
+
+    if (self->loss && (int) (s_random (self) % 100) < self->loss) return 0;
+    s_sort (self);
+
+    // response varbinds
+    byte *varbinds = self->varbindsbuf;
+    size_t vsize = SNMPSIM_MESSAGE_MAX - 64;
+    size_t vpos = 0;
+    int errstat = 0;
+    size_t errindex = 0;
+    size_t returned = 0;
+    static const byte nosuchobject [] = { BER_NOSUCHOBJECT, 0 };
+    static const byte endofmibview [] = { BER_ENDOFMIBVIEW, 0 };
+
+    if (command == PDU_GET || command == PDU_GETNEXT) {
+        for (size_t i = 0; i < count && !errstat; i++) {
+            sim_varbind_t *varbind = &self->varbinds [i];
+            size_t index = s_lower_bound (self, varbind->oid, varbind->len, command == PDU_GETNEXT);
+            bool found = index < self->size
+                && (command == PDU_GETNEXT || s_oid_compare (self->entries [index].oid, self->entries [index].len, varbind->oid, varbind->len) == 0);
+            bool ok;
+            if (found) {
+                sim_entry_t *entry = &self->entries [index];
+                ok = s_put_varbind (varbinds, &vpos, vsize, entry->name, entry->namesize, entry->value, entry->valuesize);
+            }
+            else
+            if (version == 0) {
+                errstat = ERR_NOSUCHNAME;
+                errindex = i + 1;
+                ok = true;
+            }
+            else
+                ok = s_put_varbind (varbinds, &vpos, vsize, varbind->name, varbind->namesize,
+                    command == PDU_GET ? nosuchobject : endofmibview, 2);
+            if (!ok) errstat = ERR_TOOBIG;
+            ++returned;
+        }
+        if (!errstat && self->max_varbinds && returned > (size_t) self->max_varbinds)
+            errstat = ERR_TOOBIG;
+    }
+    else {
+        // GETBULK: non-repeaters get one next, the rest max-repetitions
+        size_t limit = self->max_varbinds ? (size_t) self->max_varbinds : SIZE_MAX;
+        if (nonrepeaters < 0) nonrepeaters = 0;
+        if ((size_t) nonrepeaters > count) nonrepeaters = count;
+        if (repetitions < 0) repetitions = 0;
+        size_t current [SNMPSIM_VARBINDS_MAX];
+        bool full = false;
+        for (size_t i = 0; i < count && !full; i++) {
+            sim_varbind_t *varbind = &self->varbinds [i];
+            current [i] = s_lower_bound (self, varbind->oid, varbind->len, true);
+            if (i >= (size_t) nonrepeaters) continue;
+            if (returned == limit) full = true;
+            else
+            if (current [i] < self->size) {
+                sim_entry_t *entry = &self->entries [current [i]];
+                full = !s_put_varbind (varbinds, &vpos, vsize, entry->name, entry->namesize, entry->value, entry->valuesize);
+            }
+            else
+                full = !s_put_varbind (varbinds, &vpos, vsize, varbind->name, varbind->namesize, endofmibview, 2);
+            if (!full) ++returned;
+        }
+        for (int64_t r = 0; r < repetitions && !full; r++) {
+            bool moved = false;
+            for (size_t i = nonrepeaters; i < count && !full; i++) {
+                sim_varbind_t *varbind = &self->varbinds [i];
+                size_t before = vpos;
+                if (returned == limit) full = true;
+                else
+                if (current [i] < self->size) {
+                    sim_entry_t *entry = &self->entries [current [i]];
+                    full = !s_put_varbind (varbinds, &vpos, vsize, entry->name, entry->namesize, entry->value, entry->valuesize);
+                    if (!full) {
+                        ++current [i];
+                        moved = true;
+                    }
+                }
+                else
+                    full = !s_put_varbind (varbinds, &vpos, vsize, varbind->name, varbind->namesize, endofmibview, 2);
+                if (full) vpos = before;
+                else ++returned;
+            }
+            if (!moved) break;
+        }
+    }
+
+    // errors: v1 echoes request varbinds, v2c tooBig has none
+    if (errstat) {
+        vpos = 0;
+        if (version == 0 && !snmp_ber_put_raw (varbinds, &vpos, vsize, reqvarbinds, reqvarbindssize))
+            return 0;
+    }
+    byte status [8];
+    size_t statussize = 0;
+    byte number [9];
+    snmp_ber_put (status, &statussize, sizeof (status), BER_INTEGER, number, snmp_ber_encode_integer (errstat, number));
+    size_t indexpos = statussize;
+    snmp_ber_put (status, &indexpos, sizeof (status), BER_INTEGER, number, snmp_ber_encode_integer (errindex, number));
+    statussize = indexpos;
+
+    // varbinds sequence header
+    byte seqheader [4];
+    size_t seqheadersize = 0;
+    if (!snmp_ber_put_header (seqheader, &seqheadersize, sizeof (seqheader) + vpos, BER_SEQUENCE, vpos)) return 0;
+    size_t pdusize = reqidsize + statussize + seqheadersize + vpos;
+    byte pduheader [4];
+    size_t pduheadersize = 0;
+    if (!snmp_ber_put_header (pduheader, &pduheadersize, sizeof (pduheader) + pdusize, PDU_RESPONSE, pdusize)) return 0;
+    size_t messagesize = headersize + pduheadersize + pdusize;
+
+    size_t pos = 0;
+    if (!snmp_ber_put_header (response, &pos, SNMPSIM_MESSAGE_MAX, BER_SEQUENCE, messagesize)) return 0;
+    snmp_ber_put_raw (response, &pos, SNMPSIM_MESSAGE_MAX, request + header, headersize);
+    snmp_ber_put_raw (response, &pos, SNMPSIM_MESSAGE_MAX, pduheader, pduheadersize);
+    snmp_ber_put_raw (response, &pos, SNMPSIM_MESSAGE_MAX, request + reqid, reqidsize);
+    snmp_ber_put_raw (response, &pos, SNMPSIM_MESSAGE_MAX, status, statussize);
+    snmp_ber_put_raw (response, &pos, SNMPSIM_MESSAGE_MAX, seqheader, seqheadersize);
+    snmp_ber_put_raw (response, &pos, SNMPSIM_MESSAGE_MAX, varbinds, vpos);
+    return pos;
+}
+
+//  --------------------------------------------------------------------------
+//  Read all waiting requests of the agent
+
+static void
+s_receive (snmpsim_t *self, int fd, byte *request, byte *response)
+{
+    while (true) {
+        struct sockaddr_in peer;
+        socklen_t peerlen = sizeof (peer);
+        ssize_t size = recvfrom (fd, request, SNMPSIM_MESSAGE_MAX, 0, (struct sockaddr *) &peer, &peerlen);
+        if (size <= 0) break;
+        ++self->requests;
+        size_t responsesize = s_process (self, request, size, response);
+        if (!responsesize) {
+            ++self->dropped;
+            continue;
+        }
+        if (self->latency == 0) {
+            sendto (fd, response, responsesize, 0, (struct sockaddr *) &peer, peerlen);
+            continue;
+        }
+        sim_response_t *delayed = (sim_response_t *) zmalloc (sizeof (sim_response_t) + responsesize);
+        assert (delayed);
+        delayed->fd = fd;
+        delayed->peer = peer;
+        delayed->due = zclock_mono () + self->latency;
+        delayed->size = responsesize;
+        memcpy (delayed->data, response, responsesize);
+        zlist_append (self->delayed, delayed);
+    }
+}
+
+//  --------------------------------------------------------------------------
+//  Send delayed responses which are due, returns ms to the next one or -1
+
+static int
+s_send_delayed (snmpsim_t *self)
+{
+    int64_t now = zclock_mono ();
+    sim_response_t *delayed = (sim_response_t *) zlist_first (self->delayed);
+    while (delayed && delayed->due <= now) {
+        delayed = (sim_response_t *) zlist_pop (self->delayed);
+        sendto (delayed->fd, delayed->data, delayed->size, 0, (struct sockaddr *) &delayed->peer, sizeof (delayed->peer));
+        free (delayed);
+        delayed = (sim_response_t *) zlist_first (self->delayed);
+    }
+    return delayed ? (int) (delayed->due - now) : -1;
+}
+
+//  --------------------------------------------------------------------------
+//  Serve requests for timeout ms
+
+size_t
+snmpsim_run (snmpsim_t *self, int timeout)
+{
+    if (!self) return 0;
+    s_sort (self);
+
+    byte *request = (byte *) zmalloc (SNMPSIM_MESSAGE_MAX);
+    byte *response = (byte *) zmalloc (SNMPSIM_MESSAGE_MAX);
+    assert (request && response);
+    uint64_t before = self->requests;
+    int64_t deadline = zclock_mono () + (timeout > 0 ? timeout : 0);
+    while (!zsys_interrupted) {
+        int wait = (int) (deadline - zclock_mono ());
+        if (wait < 0) wait = 0;
+        int next = s_send_delayed (self);
+        if (next >= 0 && next < wait) wait = next;
+        int rc = self->nagents ? poll (self->pollfds, self->nagents, wait) : (zclock_sleep (wait), 0);
+        if (rc < 0) break;
+        for (size_t i = 0; rc > 0 && i < self->nagents; i++) {
+            if (!(self->pollfds [i].revents & POLLIN)) continue;
+            --rc;
+            s_receive (self, self->pollfds [i].fd, request, response);
+        }
+        s_send_delayed (self);
+        if (zclock_mono () >= deadline) break;
+    }
+    free (request);
+    free (response);
+    return (size_t) (self->requests - before);
+}
+
+//  --------------------------------------------------------------------------
+//  Actor serving the simulator until $TERM
+
+void
+snmpsim_actor (zsock_t *pipe, void *args)
+{
+    snmpsim_t *self = (snmpsim_t *) args;
+    zpoller_t *poller = zpoller_new (pipe, NULL);
+    assert (poller);
+    zsock_signal (pipe, 0);
+    while (!zsys_interrupted) {
+        snmpsim_run (self, 20);
+        if (zpoller_wait (poller, 0) == pipe) {
+            char *cmd = zstr_recv (pipe);
+            bool term = !cmd || streq (cmd, "$TERM");
+            zstr_free (&cmd);
+            if (term) break;
+        }
+    }
+    zpoller_destroy (&poller);
+}
+
+//  --------------------------------------------------------------------------
+//  Counters
+
+uint64_t
+snmpsim_requests (snmpsim_t *self)
+{
+    if (!self) return 0;
+    return self->requests;
+}
+
+uint64_t
+snmpsim_dropped (snmpsim_t *self)
+{
+    if (!self) return 0;
+    return self->dropped;
+}
+
+//  --------------------------------------------------------------------------
+//  Self test of this class
+
+void
+snmpsim_test (bool verbose)
+{
+    printf (" * snmpsim: ");
+
+    // Note: If your selftest reads SCMed fixture data, please keep it in
+    // src/selftest-ro; if your test creates filesystem objects, please
+    // do so under src/selftest-rw. They are defined below along with a
+    // usecase (asert) to make compilers happy.
+    const char *SELFTEST_DIR_RO = "src/selftest-ro";
+    const char *SELFTEST_DIR_RW = "src/selftest-rw";
+    assert (SELFTEST_DIR_RO);
+    assert (SELFTEST_DIR_RW);
+
+    //  @selftest
+    snmpsim_t *self = snmpsim_new ();
+    assert (self);
+    char *walk = zsys_sprintf ("%s/walks/linux.walk", SELFTEST_DIR_RO);
+    int loaded = snmpsim_load (self, walk);
+    zstr_free (&walk);
+    assert (loaded > 0);
+    assert (snmpsim_size (self) == (size_t) loaded);
+    assert (snmpsim_set (self, ".1.3.6.1.4.1.99999.1", "INTEGER", "-5") == 0);
+    assert (snmpsim_set (self, ".1.3.6.1.4.1.99999.1", "INTEGER", "7") == 0);
+    assert (snmpsim_set (self, ".1.3.6.1.4.1.99999.2", "Counter64", "18446744073709551615") == 0);
+    assert (snmpsim_set (self, ".1.3.6.1.4.1.99999.3", "Hex-STRING", "00 1A 2B") == 0);
+    assert (snmpsim_set (self, "not-an-oid", "INTEGER", "1") == -1);
+    assert (snmpsim_set (self, ".1.3.6.1.4.1.99999.4", "Bits", "1") == -1);
+    assert (snmpsim_size (self) == (size_t) loaded + 3);
+    const char *endpoint = snmpsim_bind (self, "127.0.0.1", 0);
+    assert (endpoint);
+    assert (snmpsim_agents (self) == 1);
+    assert (streq (snmpsim_endpoint (self, 0), endpoint));
+
+    zactor_t *sim = zactor_new (snmpsim_actor, self);
+    assert (sim);
+    snmp_credentials_t v1 = { 1, "public" };
+    snmp_credentials_t v2 = { 2, "public" };
+    snmp_credentials_t wrong = { 2, "private" };
+
+    zmsnmp_value_t *value = zmsnmp_get (endpoint, ".1.3.6.1.2.1.1.5.0", &v2);
+    assert (value && value->type == ZMSNMP_TYPE_OCTETSTRING && streq (value->string, "simulated"));
+    zmsnmp_value_destroy (&value);
+    value = zmsnmp_get (endpoint, ".1.3.6.1.4.1.99999.1", &v1);
+    assert (value && value->type == ZMSNMP_TYPE_INTEGER && value->integer == 7);
+    zmsnmp_value_destroy (&value);
+    value = zmsnmp_get (endpoint, ".1.3.6.1.4.1.99999.2", &v2);
+    assert (value && value->type == ZMSNMP_TYPE_COUNTER64 && value->counter64 == 18446744073709551615ULL);
+    zmsnmp_value_destroy (&value);
+    value = zmsnmp_get (endpoint, ".1.3.6.1.2.1.1.3.0", &v2);
+    assert (value && value->type == ZMSNMP_TYPE_TIMETICKS && value->integer == 123456);
+    zmsnmp_value_destroy (&value);
+    value = zmsnmp_get (endpoint, ".1.3.6.1.4.1.99999.9", &v1);
+    assert (value == NULL);
+
+    char *oid;
+    zmsnmp_getnext (endpoint, ".1.3.6.1.4.1.99999", &v1, &oid, &value);
+    assert (oid && streq (oid, ".1.3.6.1.4.1.99999.1"));
+    zstr_free (&oid);
+    zmsnmp_value_destroy (&value);
+
+    // walk over GETBULK and GETNEXT returns the same
+    zhash_t *bulk = zmsnmp_walk (endpoint, ".1.3.6.1.4.1.2021.9.1", &v2, 0);
+    zhash_t *next = zmsnmp_walk (endpoint, ".1.3.6.1.4.1.2021.9.1", &v1, 0);
+    assert (bulk && next);
+    assert (zhash_size (bulk) > 0 && zhash_size (bulk) == zhash_size (next));
+    zhash_destroy (&bulk);
+    zhash_destroy (&next);
+
+    // wrong community is not answered
+    uint64_t dropped = snmpsim_dropped (self);
+    value = zmsnmp_get (endpoint, ".1.3.6.1.2.1.1.5.0", &wrong);
+    assert (value == NULL);
+    zactor_destroy (&sim);
+    assert (snmpsim_dropped (self) > dropped);
+    zmsnmp_reset ();
+
+    // tooBig splits get_many requests
+    snmpsim_set_max_varbinds (self, 2);
+    sim = zactor_new (snmpsim_actor, self);
+    zlist_t *oids = zlist_new ();
+    zlist_append (oids, ".1.3.6.1.4.1.2021.10.1.3.1");
+    zlist_append (oids, ".1.3.6.1.4.1.2021.10.1.3.2");
+    zlist_append (oids, ".1.3.6.1.4.1.2021.10.1.3.3");
+    zlist_append (oids, ".1.3.6.1.2.1.1.5.0");
+    zhash_t *many = zmsnmp_get_many (endpoint, oids, &v2);
+    assert (many && zhash_size (many) == 4);
+    zhash_destroy (&many);
+    zlist_destroy (&oids);
+    bulk = zmsnmp_walk (endpoint, ".1.3.6.1.4.1.2021.9.1", &v2, 0);
+    assert (bulk && zhash_size (bulk) > 2);
+    zhash_destroy (&bulk);
+    zactor_destroy (&sim);
+
+    // latency delays responses
+    snmpsim_set_max_varbinds (self, 0);
+    snmpsim_set_latency (self, 100);
+    sim = zactor_new (snmpsim_actor, self);
+    int64_t start = zclock_mono ();
+    value = zmsnmp_get (endpoint, ".1.3.6.1.2.1.1.5.0", &v2);
+    assert (value);
+    assert (zclock_mono () - start >= 100);
+    zmsnmp_value_destroy (&value);
+    zactor_destroy (&sim);
+
+    snmpsim_destroy (&self);
+    zmsnmp_reset ();
+    //  @end
+    printf ("OK\n");
+}
@@ -0,0 +1,540 @@
+/*  =========================================================================
+    worker_pool - fixed pool of threads evaluating hosts
+
+    Copyright (C) 2016 - 2017 Tomas Halman
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    worker_pool - fixed pool of threads evaluating hosts
+@discuss
+    Pool owns all host records. Every host has a mailbox with command
+    messages. When something is posted to an idle host, the host is put
+    to the queue of one worker (round robin). Worker takes hosts from its
+    own queue and when it is empty, it steals from the longest queue of
+    other workers, so one worker stuck on slow SNMP device does not hold
+    back the hosts queued behind it. One host is never handled by two
+    workers at the same time, so host_t needs no locking. Every worker has
+    its own lua state (lua_runtime) in which it evaluates rules of all
+    hosts.
+
+    Messages produced by hosts are pushed by workers to one PULL socket,
+    see worker_pool_socket ().
+@end
+*/
+
+#include "zm_metric_classes.h"
+
+//  Max number of messages processed for one host before it is requeued
+#define WORKER_POOL_BATCH 32
+
+//  Host with its queue of commands
+
+typedef struct {
+    host_t *host;
+    zlist_t *mailbox;
+    bool scheduled;     // host is in some worker queue or being handled
+    bool removed;       // host was removed from pool while scheduled
+} pool_host_t;
+
+//  One worker thread
+
+typedef struct {
+    worker_pool_t *pool;
+    zactor_t *actor;
+    zlist_t *queue;
+} worker_t;
+
+//  Structure of our class
+
+struct _worker_pool_t {
+    pthread_mutex_t mutex;
+    pthread_cond_t ready;
+    bool terminated;
+    size_t nworkers;
+    worker_t *workers;
+    size_t next;
+    zhash_t *hosts;
+    zsock_t *output;
+    char *endpoint;
+};
+
+//  --------------------------------------------------------------------------
+//  pool_host_t constructor/destructor
+
+static pool_host_t *
+s_pool_host_new (const char *asset)
+{
+    pool_host_t *self = (pool_host_t *) zmalloc (sizeof (pool_host_t));
+    assert (self);
+    self->host = host_new (asset);
+    self->mailbox = zlist_new ();
+    return self;
+}
+
+static void
+s_pool_host_destroy (pool_host_t **self_p)
+{
+    if (!self_p || !*self_p) return;
+    pool_host_t *self = *self_p;
+    zmsg_t *msg = (zmsg_t *) zlist_pop (self->mailbox);
+    while (msg) {
+        zmsg_destroy (&msg);
+        msg = (zmsg_t *) zlist_pop (self->mailbox);
+    }
+    zlist_destroy (&self->mailbox);
+    host_destroy (&self->host);
+    free (self);
+    *self_p = NULL;
+}
+
+static void
+s_pool_host_freefn (void *self)
+{
+    if (!self) return;
+    pool_host_t *ph = (pool_host_t *) self;
+    s_pool_host_destroy (&ph);
+}
+
+//  --------------------------------------------------------------------------
+//  Put host to some worker queue. Must be called with mutex locked.
+
+static void
+s_schedule (worker_pool_t *self, pool_host_t *ph)
+{
+    if (ph->scheduled) return;
+    ph->scheduled = true;
+    worker_t *worker = &self->workers [self->next++ % self->nworkers];
+    zlist_append (worker->queue, ph);
+    pthread_cond_signal (&self->ready);
+}
+
+//  --------------------------------------------------------------------------
+//  Get next host for the worker, steal from the longest queue if own queue
+//  is empty. Victim's oldest host is taken, it waits for the longest time.
+//  Must be called with mutex locked.
+
+static pool_host_t *
+s_take (worker_pool_t *self, worker_t *worker)
+{
+    pool_host_t *ph = (pool_host_t *) zlist_pop (worker->queue);
+    if (ph) return ph;
+
+    worker_t *victim = NULL;
+    size_t longest = 0;
+    for (size_t i = 0; i < self->nworkers; i++) {
+        worker_t *w = &self->workers [i];
+        if (w != worker && zlist_size (w->queue) > longest) {
+            victim = w;
+            longest = zlist_size (w->queue);
+        }
+    }
+    if (!victim) return NULL;
+    return (pool_host_t *) zlist_pop (victim->queue);
+}
+
+//  --------------------------------------------------------------------------
+//  Worker thread
+
+static void
+s_worker_actor (zsock_t *pipe, void *args)
+{
+    worker_t *worker = (worker_t *) args;
+    worker_pool_t *pool = worker->pool;
+
+    zsock_t *output = zsock_new_push (pool->endpoint);
+    assert (output);
+    // one lua state per worker, shared by all hosts it handles
+    lua_runtime_t *runtime = lua_runtime_new ();
+    assert (runtime);
+    zsock_signal (pipe, 0);
+
+    pthread_mutex_lock (&pool->mutex);
+    while (true) {
+        pool_host_t *ph = NULL;
+        while (!pool->terminated && (ph = s_take (pool, worker)) == NULL)
+            pthread_cond_wait (&pool->ready, &pool->mutex);
+        if (!ph) break;
+
+        int processed = 0;
+        while (!ph->removed && processed < WORKER_POOL_BATCH) {
+            zmsg_t *msg = (zmsg_t *) zlist_pop (ph->mailbox);
+            if (!msg) break;
+            pthread_mutex_unlock (&pool->mutex);
+            host_handle (ph->host, &msg, output, runtime);
+            ++processed;
+            pthread_mutex_lock (&pool->mutex);
+        }
+        if (ph->removed) {
+            pthread_mutex_unlock (&pool->mutex);
+            s_pool_host_destroy (&ph);
+            pthread_mutex_lock (&pool->mutex);
+        }
+        else
+        if (zlist_size (ph->mailbox)) {
+            // host has more work, let the others go first
+            zlist_append (worker->queue, ph);
+            pthread_cond_signal (&pool->ready);
+        }
+        else
+            ph->scheduled = false;
+    }
+    pthread_mutex_unlock (&pool->mutex);
+    lua_runtime_destroy (&runtime);
+    zsock_destroy (&output);
+}
+
+//  --------------------------------------------------------------------------
+//  Create a new worker_pool
+
+worker_pool_t *
+worker_pool_new (size_t workers)
+{
+    worker_pool_t *self = (worker_pool_t *) zmalloc (sizeof (worker_pool_t));
+    assert (self);
+
+    if (workers == 0) {
+        long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? (size_t) cpus : 1;
+    }
+    pthread_mutex_init (&self->mutex, NULL);
+    pthread_cond_init (&self->ready, NULL);
+
+    self->hosts = zhash_new ();
+    assert (self->hosts);
+    self->endpoint = zsys_sprintf ("inproc://worker-pool-%p", (void *) self);
+    assert (self->endpoint);
+    self->output = zsock_new_pull (self->endpoint);
+    assert (self->output);
+
+    self->nworkers = workers;
+    self->workers = (worker_t *) zmalloc (workers * sizeof (worker_t));
+    assert (self->workers);
+    for (size_t i = 0; i < workers; i++) {
+        worker_t *worker = &self->workers [i];
+        worker->pool = self;
+        worker->queue = zlist_new ();
+        worker->actor = zactor_new (s_worker_actor, worker);
+        assert (worker->actor);
+    }
+    return self;
+}
+
+//  --------------------------------------------------------------------------
+//  Destroy the worker_pool
+
+void
+worker_pool_destroy (worker_pool_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        worker_pool_t *self = *self_p;
+        pthread_mutex_lock (&self->mutex);
+        self->terminated = true;
+        pthread_cond_broadcast (&self->ready);
+        pthread_mutex_unlock (&self->mutex);
+
+        for (size_t i = 0; i < self->nworkers; i++) {
+            worker_t *worker = &self->workers [i];
+            zactor_destroy (&worker->actor);
+        }
+        for (size_t i = 0; i < self->nworkers; i++) {
+            worker_t *worker = &self->workers [i];
+            // removed hosts are only in queues, others are freed with hash
+            pool_host_t *ph = (pool_host_t *) zlist_pop (worker->queue);
+            while (ph) {
+                if (ph->removed) s_pool_host_destroy (&ph);
+                ph = (pool_host_t *) zlist_pop (worker->queue);
+            }
+            zlist_destroy (&worker->queue);
+        }
+        free (self->workers);
+        zhash_destroy (&self->hosts);
+        zsock_destroy (&self->output);
+        zstr_free (&self->endpoint);
+        pthread_cond_destroy (&self->ready);
+        pthread_mutex_destroy (&self->mutex);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+//  --------------------------------------------------------------------------
+//  Number of worker threads
+
+size_t
+worker_pool_workers (worker_pool_t *self)
+{
+    if (!self) return 0;
+    return self->nworkers;
+}
+
+//  --------------------------------------------------------------------------
+//  Number of hosts owned by pool
+
+size_t
+worker_pool_hosts (worker_pool_t *self)
+{
+    if (!self) return 0;
+    pthread_mutex_lock (&self->mutex);
+    size_t size = zhash_size (self->hosts);
+    pthread_mutex_unlock (&self->mutex);
+    return size;
+}
+
+//  --------------------------------------------------------------------------
+//  Socket delivering messages produced by hosts
+
+zsock_t *
+worker_pool_socket (worker_pool_t *self)
+{
+    if (!self) return NULL;
+    return self->output;
+}
+
+//  --------------------------------------------------------------------------
+//  Create host record for the asset
+
+bool
+worker_pool_add_host (worker_pool_t *self, const char *asset)
+{
+    if (!self || !asset) return false;
+
+    bool created = false;
+    pthread_mutex_lock (&self->mutex);
+    if (!zhash_lookup (self->hosts, asset)) {
+        pool_host_t *ph = s_pool_host_new (asset);
+        zhash_insert (self->hosts, asset, ph);
+        zhash_freefn (self->hosts, asset, s_pool_host_freefn);
+        created = true;
+    }
+    pthread_mutex_unlock (&self->mutex);
+    return created;
+}
+
+//  --------------------------------------------------------------------------
+//  Returns true if pool has host for the asset
+
+bool
+worker_pool_has_host (worker_pool_t *self, const char *asset)
+{
+    if (!self || !asset) return false;
+    pthread_mutex_lock (&self->mutex);
+    bool exists = zhash_lookup (self->hosts, asset) != NULL;
+    pthread_mutex_unlock (&self->mutex);
+    return exists;
+}
+
+//  --------------------------------------------------------------------------
+//  Remove the host
+
+void
+worker_pool_remove_host (worker_pool_t *self, const char *asset)
+{
+    if (!self || !asset) return;
+
+    pthread_mutex_lock (&self->mutex);
+    pool_host_t *ph = (pool_host_t *) zhash_lookup (self->hosts, asset);
+    if (ph) {
+        zhash_freefn (self->hosts, asset, NULL);
+        zhash_delete (self->hosts, asset);
+        if (ph->scheduled) {
+            // worker will free it
+            ph->removed = true;
+            ph = NULL;
+        }
+    }
+    pthread_mutex_unlock (&self->mutex);
+    s_pool_host_destroy (&ph);
+}
+
+//  --------------------------------------------------------------------------
+//  Queue command message for the host
+
+int
+worker_pool_post (worker_pool_t *self, const char *asset, zmsg_t **msg_p)
+{
+    if (!self || !asset || !msg_p || !*msg_p) return -1;
+
+    int result = -1;
+    pthread_mutex_lock (&self->mutex);
+    pool_host_t *ph = (pool_host_t *) zhash_lookup (self->hosts, asset);
+    if (ph) {
+        zlist_append (ph->mailbox, *msg_p);
+        *msg_p = NULL;
+        s_schedule (self, ph);
+        result = 0;
+    }
+    pthread_mutex_unlock (&self->mutex);
+    if (*msg_p) zmsg_destroy (msg_p);
+    return result;
+}
+
+//  --------------------------------------------------------------------------
+//  Queue copy of the message for every host
+
+void
+worker_pool_broadcast (worker_pool_t *self, zmsg_t *msg)
+{
+    if (!self || !msg) return;
+
+    pthread_mutex_lock (&self->mutex);
+    pool_host_t *ph = (pool_host_t *) zhash_first (self->hosts);
+    while (ph) {
+        zlist_append (ph->mailbox, zmsg_dup (msg));
+        s_schedule (self, ph);
+        ph = (pool_host_t *) zhash_next (self->hosts);
+    }
+    pthread_mutex_unlock (&self->mutex);
+}
+
+//  --------------------------------------------------------------------------
+//  Self test of this class
+
+static void
+s_post_strings (worker_pool_t *self, const char *asset, const char *cmd, ...)
+{
+    zmsg_t *msg = zmsg_new ();
+    va_list args;
+    va_start (args, cmd);
+    const char *frame = cmd;
+    while (frame) {
+        zmsg_addstr (msg, frame);
+        frame = va_arg (args, const char *);
+    }
+    va_end (args);
+    int rv = worker_pool_post (self, asset, &msg);
+    assert (rv == 0);
+}
+
+//  Receive one message of the pool, NULL if nothing comes in 10 s
+
+static zmsg_t *
+s_recv (zpoller_t *poller)
+{
+    zsock_t *which = (zsock_t *) zpoller_wait (poller, 10000);
+    return which ? zmsg_recv (which) : NULL;
+}
+
+void
+worker_pool_test (bool verbose)
+{
+    printf (" * worker_pool: ");
+
+    // Note: If your selftest reads SCMed fixture data, please keep it in
+    // src/selftest-ro; if your test creates filesystem objects, please
+    // do so under src/selftest-rw. They are defined below along with a
+    // usecase (asert) to make compilers happy.
+    const char *SELFTEST_DIR_RO = "src/selftest-ro";
+    const char *SELFTEST_DIR_RW = "src/selftest-rw";
+    assert (SELFTEST_DIR_RO);
+    assert (SELFTEST_DIR_RW);
+
+    //  @selftest
+    worker_pool_t *self = worker_pool_new (2);
+    assert (self);
+    assert (worker_pool_workers (self) == 2);
+    zpoller_t *poller = zpoller_new (worker_pool_socket (self), NULL);
+    assert (poller);
+
+    // simple evaluation
+    assert (worker_pool_add_host (self, "fast0"));
+    assert (!worker_pool_add_host (self, "fast0"));
+    assert (worker_pool_has_host (self, "fast0"));
+    s_post_strings (self, "fast0", "IP", "127.0.0.1", NULL);
+    s_post_strings (self, "fast0", "LUA", "load", "function main(host) return { 'load', 15, '%' } end", "1", NULL);
+    s_post_strings (self, "fast0", "WAKEUP", NULL);
+    zmsg_t *msg = s_recv (poller);
+    assert (msg);
+    char *cmd = zmsg_popstr (msg);
+    char *asset = zmsg_popstr (msg);
+    assert (streq (cmd, "METRIC"));
+    assert (streq (asset, "fast0"));
+    zstr_free (&cmd);
+    zstr_free (&asset);
+    zmsg_destroy (&msg);
+
+    // host stuck on slow evaluation must not hold back the others, slow
+    // one blocks reading a fifo until the test writes to it
+    zsys_dir_create (SELFTEST_DIR_RW);
+    char *release = zsys_sprintf ("%s/worker_pool.fifo", SELFTEST_DIR_RW);
+    zsys_file_delete (release);
+    assert (mkfifo (release, 0600) == 0);
+    // kept open for writing, so the rule doesn't block in open
+    int fifo = open (release, O_RDWR);
+    assert (fifo >= 0);
+    char *slow = zsys_sprintf (
+        "function main(host)"
+        "  local f = io.open ('%s')"
+        "  f:read ('*l')"
+        "  f:close ()"
+        "  return { 'slow', 1, '' }"
+        "end", release);
+    worker_pool_add_host (self, "slow");
+    s_post_strings (self, "slow", "IP", "127.0.0.1", NULL);
+    s_post_strings (self, "slow", "LUA", "slow", slow, "1", NULL);
+    zstr_free (&slow);
+    for (int i = 1; i < 5; i++) {
+        char *name = zsys_sprintf ("fast%i", i);
+        worker_pool_add_host (self, name);
+        s_post_strings (self, name, "IP", "127.0.0.1", NULL);
+        s_post_strings (self, name, "LUA", "load", "function main(host) return { 'load', 15, '%' } end", "1", NULL);
+        zstr_free (&name);
+    }
+    assert (worker_pool_hosts (self) == 6);
+    zclock_sleep (100);
+
+    zmsg_t *wakeup = zmsg_new ();
+    zmsg_addstr (wakeup, "WAKEUP");
+    worker_pool_broadcast (self, wakeup);
+    zmsg_destroy (&wakeup);
+
+    // five fast hosts come while the slow one waits
+    for (int i = 0; i < 6; i++) {
+        if (i == 5)
+            assert (write (fifo, "go\n", 3) == 3);
+        msg = s_recv (poller);
+        assert (msg);
+        cmd = zmsg_popstr (msg);
+        asset = zmsg_popstr (msg);
+        assert (streq (cmd, "METRIC"));
+        if (verbose) zsys_debug ("received metric from %s", asset);
+        if (i < 5)
+            assert (strneq (asset, "slow"));
+        else
+            assert (streq (asset, "slow"));
+        zstr_free (&cmd);
+        zstr_free (&asset);
+        zmsg_destroy (&msg);
+    }
+    close (fifo);
+    zsys_file_delete (release);
+    zstr_free (&release);
+
+    worker_pool_remove_host (self, "fast1");
+    assert (!worker_pool_has_host (self, "fast1"));
+    msg = zmsg_new ();
+    zmsg_addstr (msg, "WAKEUP");
+    assert (worker_pool_post (self, "fast1", &msg) == -1);
+    assert (msg == NULL);
+
+    zpoller_destroy (&poller);
+    worker_pool_destroy (&self);
+    //  @end
+    printf ("OK\n");
+}
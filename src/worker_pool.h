@@ -0,0 +1,90 @@
+/*  =========================================================================
+    worker_pool - fixed pool of threads evaluating hosts
+
+    Copyright (C) 2016 - 2017 Tomas Halman
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#ifndef WORKER_POOL_H_INCLUDED
+#define WORKER_POOL_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef WORKER_POOL_T_DEFINED
+typedef struct _worker_pool_t worker_pool_t;
+#define WORKER_POOL_T_DEFINED
+#endif
+
+//  @interface
+//  Create a new worker pool with given number of threads. Zero means
+//  one thread per online CPU.
+ZM_METRIC_PRIVATE worker_pool_t *
+    worker_pool_new (size_t workers);
+
+//  Destroy the worker pool, stop all threads and free all hosts
+ZM_METRIC_PRIVATE void
+    worker_pool_destroy (worker_pool_t **self_p);
+
+//  Number of worker threads
+ZM_METRIC_PRIVATE size_t
+    worker_pool_workers (worker_pool_t *self);
+
+//  Number of hosts owned by pool
+ZM_METRIC_PRIVATE size_t
+    worker_pool_hosts (worker_pool_t *self);
+
+//  Socket delivering messages produced by hosts (METRIC, ...). Poll it
+//  and read it from the thread owning the pool.
+ZM_METRIC_PRIVATE zsock_t *
+    worker_pool_socket (worker_pool_t *self);
+
+//  Create host record for the asset. Returns true if the host was created,
+//  false if it already exists.
+ZM_METRIC_PRIVATE bool
+    worker_pool_add_host (worker_pool_t *self, const char *asset);
+
+//  Returns true if pool has host for the asset
+ZM_METRIC_PRIVATE bool
+    worker_pool_has_host (worker_pool_t *self, const char *asset);
+
+//  Remove the host. If the host is being evaluated right now, it is freed
+//  by the worker once it is done.
+ZM_METRIC_PRIVATE void
+    worker_pool_remove_host (worker_pool_t *self, const char *asset);
+
+//  Queue command message for the host, see host_handle () for commands.
+//  Message is consumed. Returns -1 if there is no such host.
+ZM_METRIC_PRIVATE int
+    worker_pool_post (worker_pool_t *self, const char *asset, zmsg_t **msg_p);
+
+//  Queue copy of the message for every host
+ZM_METRIC_PRIVATE void
+    worker_pool_broadcast (worker_pool_t *self, zmsg_t *msg);
+
+//  Self test of this class
+ZM_METRIC_PRIVATE void
+    worker_pool_test (bool verbose);
+
+//  @end
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -33,13 +33,12 @@ static const char *ENDPOINT = "ipc://@/malamute";
 static const char *RULES_DIR = "./rules";
 static const char *SNMP_CONFIG_FILE = "/etc/sysconfig/zm.cfg";
 static int POLLING = 60;
-
-static int
-s_wakeup_event (zloop_t *loop, int timer_id, void *output)
-{
-    zstr_send (output, "WAKEUP");
-    return 0;
-}
+static int WORKERS = 0;
+static const char *CACHE_TTL = NULL;
+static const char *DETECT_TTL = NULL;
+static const char *DETECT_CACHE = NULL;
+static const char *INFLIGHT = NULL;
+static const char *LUA_MEMORY = NULL;
 
 int main (int argc, char *argv [])
 {
@@ -57,6 +56,13 @@ int main (int argc, char *argv [])
             puts ("  --snmpconfig / -c      config file with SNMP communities [/etc/sysconfig/zm.cfg]");
             puts ("  --rules / -r           directory with rules [./rules]");
             puts ("  --polling / -p         polling interval in seconds [60]");
+            puts ("  --workers / -w         number of polling threads [number of CPUs]");
+            puts ("  --cache-ttl / -t       lifetime of cached SNMP responses in ms, 0 disables");
+            puts ("                         [shortest rule interval of the host]");
+            puts ("  --detect-ttl / -d      lifetime of detected SNMP credentials in ms [3600000]");
+            puts ("  --detect-cache / -D    file keeping detected SNMP credentials over restarts");
+            puts ("  --max-inflight / -m    max SNMP requests waiting for response, 0 = unlimited [0]");
+            puts ("  --lua-memory / -l      max MB of lua state of one worker, 0 = unlimited [256]");
             return 0;
         }
         else if (streq (argv [argn], "--verbose") ||  streq (argv [argn], "-v")) {
@@ -82,6 +88,70 @@ int main (int argc, char *argv [])
             }
             ++argn;
         }
+        else if (streq (argv [argn], "--workers") || streq (argv [argn], "-w")) {
+            if (param) {
+                errno = 0;
+                long int i = strtol (param, NULL, 10);
+                if (errno || i < 0) {
+                    zsys_error ("Invalid number of workers %s", param);
+                } else {
+                    WORKERS = i;
+                }
+            }
+            ++argn;
+        }
+        else if (streq (argv [argn], "--cache-ttl") || streq (argv [argn], "-t")) {
+            if (param) {
+                errno = 0;
+                long int i = strtol (param, NULL, 10);
+                if (errno || i < 0) {
+                    zsys_error ("Invalid cache ttl %s", param);
+                } else {
+                    CACHE_TTL = param;
+                }
+            }
+            ++argn;
+        }
+        else if (streq (argv [argn], "--detect-ttl") || streq (argv [argn], "-d")) {
+            if (param) {
+                errno = 0;
+                long int i = strtol (param, NULL, 10);
+                if (errno || i < 0) {
+                    zsys_error ("Invalid detect ttl %s", param);
+                } else {
+                    DETECT_TTL = param;
+                }
+            }
+            ++argn;
+        }
+        else if (streq (argv [argn], "--detect-cache") || streq (argv [argn], "-D")) {
+            if (param) DETECT_CACHE = param;
+            ++argn;
+        }
+        else if (streq (argv [argn], "--max-inflight") || streq (argv [argn], "-m")) {
+            if (param) {
+                errno = 0;
+                long int i = strtol (param, NULL, 10);
+                if (errno || i < 0) {
+                    zsys_error ("Invalid max inflight %s", param);
+                } else {
+                    INFLIGHT = param;
+                }
+            }
+            ++argn;
+        }
+        else if (streq (argv [argn], "--lua-memory") || streq (argv [argn], "-l")) {
+            if (param) {
+                errno = 0;
+                long int i = strtol (param, NULL, 10);
+                if (errno || i < 0) {
+                    zsys_error ("Invalid lua memory %s", param);
+                } else {
+                    LUA_MEMORY = param;
+                }
+            }
+            ++argn;
+        }
         else if (streq (argv [argn], "--rules") || streq (argv [argn], "-r")) {
             if (param) RULES_DIR = param;
             ++argn;
@@ -95,6 +165,24 @@ int main (int argc, char *argv [])
         zsys_info ("zm-metric - started");
     zactor_t *server = zactor_new (zm_metric_server_actor, NULL);
     assert (server);
+    if (WORKERS) {
+        char *workers = zsys_sprintf ("%i", WORKERS);
+        zstr_sendx (server, "WORKERS", workers, NULL);
+        zstr_free (&workers);
+    }
+    if (CACHE_TTL)
+        zstr_sendx (server, "CACHETTL", CACHE_TTL, NULL);
+    if (DETECT_TTL)
+        zstr_sendx (server, "DETECTTTL", DETECT_TTL, NULL);
+    if (DETECT_CACHE)
+        zstr_sendx (server, "DETECTCACHE", DETECT_CACHE, NULL);
+    if (INFLIGHT)
+        zstr_sendx (server, "INFLIGHT", INFLIGHT, NULL);
+    if (LUA_MEMORY)
+        zstr_sendx (server, "LUAMEMORY", LUA_MEMORY, NULL);
+    char *polling = zsys_sprintf ("%i", POLLING);
+    zstr_sendx (server, "POLLING", polling, NULL);
+    zstr_free (&polling);
     zstr_sendx (server, "BIND", ENDPOINT, ACTOR_NAME, NULL);
     zstr_sendx (server, "PRODUCER", ZM_PROTO_METRIC_STREAM, NULL);
     zstr_sendx (server, "CONSUMER", ZM_PROTO_DEVICE_STREAM, ".*", NULL);
@@ -107,16 +195,11 @@ int main (int argc, char *argv [])
         zstr_free (&ttl);
     }
 
-    zloop_t *wakeup = zloop_new();
-    zloop_timer (wakeup, POLLING * 1000, 0, s_wakeup_event, server);
-    zloop_start (wakeup);
-
     while (!zsys_interrupted) {
         zmsg_t *msg = zactor_recv (server);
         zmsg_destroy (&msg);
     }
 
-    zloop_destroy (&wakeup);
     zactor_destroy (&server);
     if (verbose)
         zsys_info ("zm-metric - exited");
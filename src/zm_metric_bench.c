@@ -0,0 +1,121 @@
+/*  =========================================================================
+    zm_metric_bench - SNMP request throughput benchmark
+
+    Copyright (C) 2016 - 2017 Tomas Halman
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    zm_metric_bench - SNMP request throughput benchmark
+@discuss
+@end
+*/
+
+#include "zm_metric_classes.h"
+
+int main (int argc, char *argv [])
+{
+    int argn;
+    int snmpversion = 1;
+    const char *community = "public";
+    const char *host = "localhost";
+    const char *oid = ".1.3.6.1.2.1.1.1.0";
+    int count = 1000;
+    bool micro = false;
+    bool memory = false;
+    bool startup = false;
+    bool eval = false;
+
+    for (argn = 1; argn < argc; argn++) {
+        char *param = NULL;
+        if (argn < argc - 1) param = argv [argn + 1];
+        if (streq (argv [argn], "--help") ||  streq (argv [argn], "-h")) {
+            puts ("zm-metric-bench [options] ...");
+            puts ("  --help / -h            this information");
+            puts ("  --snmp-version / -s    snmp version [1], (1 or 2)");
+            puts ("  --community / -c       snmp community name [public]");
+            puts ("  --host / -H            server to test with [localhost]");
+            puts ("  --oid / -o             oid to get [.1.3.6.1.2.1.1.1.0]");
+            puts ("  --count / -n           number of requests [1000]");
+            puts ("  --micro / -m           benchmark oid and value conversions, no agent needed");
+            puts ("  --memory / -M          memory of count hosts with 8 rules, no agent needed");
+            puts ("  --startup / -S         startup of count assets with 8 rules, no agent needed");
+            puts ("  --eval / -e            count evaluations of rule processing walk, no agent needed");
+            return 0;
+        }
+        else if (streq (argv [argn], "--snmp-version") ||  streq (argv [argn], "-s")) {
+            if (param) {
+                errno = 0;
+                snmpversion = strtol (param, NULL, 10);
+                if (errno || snmpversion < 1 || snmpversion > 2) {
+                    printf ("Invalid SNMP version '%s'\n", param);
+                    return 1;
+                }
+            }
+            ++argn;
+        }
+        else if (streq (argv [argn], "--community") ||  streq (argv [argn], "-c")) {
+            if (param) community = param;
+            ++argn;
+        }
+        else if (streq (argv [argn], "--host") ||  streq (argv [argn], "-H")) {
+            if (param) host = param;
+            ++argn;
+        }
+        else if (streq (argv [argn], "--oid") ||  streq (argv [argn], "-o")) {
+            if (param) oid = param;
+            ++argn;
+        }
+        else if (streq (argv [argn], "--count") ||  streq (argv [argn], "-n")) {
+            if (param) {
+                errno = 0;
+                count = strtol (param, NULL, 10);
+                if (errno || count <= 0) {
+                    printf ("Invalid count '%s'\n", param);
+                    return 1;
+                }
+            }
+            ++argn;
+        }
+        else if (streq (argv [argn], "--micro") ||  streq (argv [argn], "-m")) {
+            micro = true;
+        }
+        else if (streq (argv [argn], "--memory") ||  streq (argv [argn], "-M")) {
+            memory = true;
+        }
+        else if (streq (argv [argn], "--startup") ||  streq (argv [argn], "-S")) {
+            startup = true;
+        }
+        else if (streq (argv [argn], "--eval") ||  streq (argv [argn], "-e")) {
+            eval = true;
+        }
+        else {
+            printf ("Unknown option: %s\n", argv [argn]);
+            return 1;
+        }
+    }
+    if (eval)
+        return snmp_bench_eval (count);
+    if (startup)
+        return snmp_bench_startup (count, 8);
+    if (memory)
+        return snmp_bench_memory (count, 8);
+    if (micro)
+        return snmp_bench_oid (count * 1000) || snmp_bench_value (count * 1000);
+    return snmp_bench (host, snmpversion, community, oid, count);
+}
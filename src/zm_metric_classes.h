@@ -47,9 +47,13 @@ typedef struct _rule_t rule_t;
 typedef struct _vsjson_t vsjson_t;
 #define VSJSON_T_DEFINED
 #endif
-#ifndef HOST_ACTOR_T_DEFINED
-typedef struct _host_actor_t host_actor_t;
-#define HOST_ACTOR_T_DEFINED
+#ifndef HOST_T_DEFINED
+typedef struct _host_t host_t;
+#define HOST_T_DEFINED
+#endif
+#ifndef WORKER_POOL_T_DEFINED
+typedef struct _worker_pool_t worker_pool_t;
+#define WORKER_POOL_T_DEFINED
 #endif
 #ifndef ZMSNMP_T_DEFINED
 typedef struct _zmsnmp_t zmsnmp_t;
@@ -59,18 +63,67 @@ typedef struct _zmsnmp_t zmsnmp_t;
 typedef struct _credentials_t credentials_t;
 #define CREDENTIALS_T_DEFINED
 #endif
+#ifndef SCHEDULER_T_DEFINED
+typedef struct _scheduler_t scheduler_t;
+#define SCHEDULER_T_DEFINED
+#endif
+#ifndef SNMP_CACHE_T_DEFINED
+typedef struct _snmp_cache_t snmp_cache_t;
+#define SNMP_CACHE_T_DEFINED
+#endif
+#ifndef SNMP_SNAPSHOT_T_DEFINED
+typedef struct _snmp_snapshot_t snmp_snapshot_t;
+#define SNMP_SNAPSHOT_T_DEFINED
+#endif
+#ifndef SNMP_DETECTOR_T_DEFINED
+typedef struct _snmp_detector_t snmp_detector_t;
+#define SNMP_DETECTOR_T_DEFINED
+#endif
+#ifndef SNMP_TRANSPORT_T_DEFINED
+typedef struct _snmp_transport_t snmp_transport_t;
+#define SNMP_TRANSPORT_T_DEFINED
+#endif
+#ifndef LUA_RUNTIME_T_DEFINED
+typedef struct _lua_runtime_t lua_runtime_t;
+#define LUA_RUNTIME_T_DEFINED
+#endif
+#ifndef LUA_ARENA_T_DEFINED
+typedef struct _lua_arena_t lua_arena_t;
+#define LUA_ARENA_T_DEFINED
+#endif
 
 //  Internal API
 #include "luasnmp.h"
 #include "rule.h"
 #include "vsjson.h"
-#include "host_actor.h"
+#include "host.h"
+#include "worker_pool.h"
 #include "zmsnmp.h"
 #include "credentials.h"
+#include "scheduler.h"
+#include "snmp_cache.h"
+#include "snmp_snapshot.h"
+#include "snmp_detector.h"
+#include "snmp_ber.h"
+#include "snmp_transport.h"
+#include "lua_runtime.h"
+#include "lua_arena.h"
 
 //  *** To avoid double-definitions, only define if building without draft ***
 #ifndef ZM_METRIC_BUILD_DRAFT_API
 
+//  Draft classes are used internally also in stable releases
+#ifndef SNMP_BENCH_T_DEFINED
+typedef struct _snmp_bench_t snmp_bench_t;
+#define SNMP_BENCH_T_DEFINED
+#endif
+#include "../include/snmp_bench.h"
+#ifndef SNMPSIM_T_DEFINED
+typedef struct _snmpsim_t snmpsim_t;
+#define SNMPSIM_T_DEFINED
+#endif
+#include "../include/snmpsim.h"
+
 //  *** Draft method, defined for internal use only ***
 //  Self test of this class.
 ZM_METRIC_PRIVATE void
@@ -89,7 +142,12 @@ ZM_METRIC_PRIVATE void
 //  *** Draft method, defined for internal use only ***
 //  Self test of this class.
 ZM_METRIC_PRIVATE void
-    host_actor_test (bool verbose);
+    host_test (bool verbose);
+
+//  *** Draft method, defined for internal use only ***
+//  Self test of this class.
+ZM_METRIC_PRIVATE void
+    worker_pool_test (bool verbose);
 
 //  *** Draft method, defined for internal use only ***
 //  Self test of this class.
@@ -101,6 +159,58 @@ ZM_METRIC_PRIVATE void
 ZM_METRIC_PRIVATE void
     credentials_test (bool verbose);
 
+//  *** Draft method, defined for internal use only ***
+//  Self test of this class.
+ZM_METRIC_PRIVATE void
+    scheduler_test (bool verbose);
+
+//  *** Draft method, defined for internal use only ***
+//  Self test of this class.
+ZM_METRIC_PRIVATE void
+    snmp_cache_test (bool verbose);
+
+//  *** Draft method, defined for internal use only ***
+//  Self test of this class.
+ZM_METRIC_PRIVATE void
+    snmp_snapshot_test (bool verbose);
+
+//  *** Draft method, defined for internal use only ***
+//  Self test of this class.
+ZM_METRIC_PRIVATE void
+    snmp_detector_test (bool verbose);
+
+//  *** Draft method, defined for internal use only ***
+//  Self test of this class.
+ZM_METRIC_PRIVATE void
+    snmp_ber_test (bool verbose);
+
+//  *** Draft method, defined for internal use only ***
+//  Self test of this class.
+ZM_METRIC_PRIVATE void
+    snmp_transport_test (bool verbose);
+
+//  *** Draft method, defined for internal use only ***
+//  Self test of this class.
+ZM_METRIC_PRIVATE void
+    lua_runtime_test (bool verbose);
+
+//  *** Draft method, defined for internal use only ***
+//  Self test of this class.
+ZM_METRIC_PRIVATE void
+    lua_arena_test (bool verbose);
+
+//  *** Draft method, defined for internal use only ***
+//  Evaluate rule file like rule_tester, recording or replaying SNMP
+//  responses.
+ZM_METRIC_PRIVATE int
+    rule_tester_snapshot (
+        const char *file,
+        int snmpversion,
+        const char *community,
+        const char *addr,
+        const char *record,
+        const char *replay);
+
 //  Self test for private classes
 ZM_METRIC_PRIVATE void
     zm_metric_private_selftest (bool verbose);
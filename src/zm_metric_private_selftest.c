@@ -41,9 +41,18 @@ zm_metric_private_selftest (bool verbose)
     luasnmp_test (verbose);
     rule_test (verbose);
     vsjson_test (verbose);
-    host_actor_test (verbose);
+    host_test (verbose);
+    worker_pool_test (verbose);
     zmsnmp_test (verbose);
     credentials_test (verbose);
+    scheduler_test (verbose);
+    snmp_cache_test (verbose);
+    snmp_snapshot_test (verbose);
+    snmp_detector_test (verbose);
+    snmp_ber_test (verbose);
+    snmp_transport_test (verbose);
+    lua_runtime_test (verbose);
+    lua_arena_test (verbose);
 }
 /*
 ################################################################################
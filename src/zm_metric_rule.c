@@ -35,6 +35,8 @@ int main (int argc, char *argv [])
     int snmpversion = 1;
     const char *community = "public";
     const char *host = "localhost";
+    const char *record = NULL;
+    const char *replay = NULL;
 
     for (argn = 1; argn < argc; argn++) {
         char *param = NULL;
@@ -46,6 +48,9 @@ int main (int argc, char *argv [])
             puts ("  --snmp-version / -s    snmp version [1], (1 or 2)");
             puts ("  --community / -c       snmp community name [public]");
             puts ("  --host / -H            server to test with [localhost]");
+            puts ("  --record / -R          save SNMP responses to file");
+            puts ("  --replay / -P          take SNMP responses from file recorded");
+            puts ("                         by --record, the server is not contacted");
             return 0;
         }
         else if (streq (argv [argn], "--rule") ||  streq (argv [argn], "-r")) {
@@ -71,15 +76,42 @@ int main (int argc, char *argv [])
             if (param) host = param;
             ++argn;
         }
+        else if (streq (argv [argn], "--record") ||  streq (argv [argn], "-R")) {
+            if (param) record = param;
+            ++argn;
+        }
+        else if (streq (argv [argn], "--replay") ||  streq (argv [argn], "-P")) {
+            if (param) replay = param;
+            ++argn;
+        }
         else {
             printf ("Unknown option: %s\n", argv [argn]);
             return 1;
         }
     }
+    if (record && replay) {
+        puts ("Use either --record or --replay");
+        return 1;
+    }
+#ifdef ZM_METRIC_BUILD_DRAFT_API
+    return rule_tester_snapshot (
+        file,
+        snmpversion,
+        community,
+        host,
+        record,
+        replay
+    );
+#else
+    if (record || replay) {
+        puts ("--record and --replay need zm-metric built with --enable-drafts");
+        return 1;
+    }
     return rule_tester (
         file,
-        1,
+        snmpversion,
         community,
         host
     );
+#endif // ZM_METRIC_BUILD_DRAFT_API
 }
@@ -39,6 +39,11 @@ all_tests [] = {
 // Tests for stable public classes:
     { "zm_metric_server", zm_metric_server_test },
     { "rule_tester", rule_tester_test },
+#ifdef ZM_METRIC_BUILD_DRAFT_API
+// Tests for draft public classes:
+    { "snmp_bench", snmp_bench_test },
+    { "snmpsim", snmpsim_test },
+#endif // ZM_METRIC_BUILD_DRAFT_API
 #ifdef ZM_METRIC_BUILD_DRAFT_API
     { "private_classes", zm_metric_private_selftest },
 #endif // ZM_METRIC_BUILD_DRAFT_API
@@ -99,7 +104,7 @@ main (int argc, char **argv)
         else
         if (streq (argv [argn], "--number")
         ||  streq (argv [argn], "-n")) {
-            puts ("8");
+            puts ("10");
             return 0;
         }
         else
@@ -108,6 +113,8 @@ main (int argc, char **argv)
             puts ("Available tests:");
             puts ("    zm_metric_server\t\t- stable");
             puts ("    rule_tester\t\t- stable");
+            puts ("    snmp_bench\t\t- draft");
+            puts ("    snmpsim\t\t- draft");
             puts ("    private_classes\t- draft");
             return 0;
         }
@@ -28,14 +28,35 @@
 
 #include "zm_metric_classes.h"
 
+//  Address and rate limit of one monitored asset
+
+typedef struct {
+    char *ip;
+    double rate;                // the most strict limit of its rules, 0 = none
+    unsigned int burst;
+} monitored_t;
+
+static void
+s_monitored_destroy (void *item)
+{
+    monitored_t *monitored = (monitored_t *) item;
+    zstr_free (&monitored->ip);
+    free (monitored);
+}
+
 //  Structure of our class
 
 struct _zm_metric_server_t {
     mlm_client_t *mlm;
     zlist_t *rules;
-    zhash_t *host_actors;
+    worker_pool_t *pool;
+    scheduler_t *scheduler;
     zpoller_t *poller;
     credentials_t *credentials;
+    zactor_t *detector;     // snmp_detector_actor
+    zhash_t *addresses;     // asset -> monitored_t
+    int polling;
+    char *cachettl;     // lifetime of cached SNMP responses in ms, NULL = default
 };
 
 
@@ -54,11 +75,20 @@ zm_metric_server_new (void)
     self->rules = zlist_new();
     assert (self->rules);
 
-    self->host_actors = zhash_new();
-    assert (self->host_actors);
+    self->pool = worker_pool_new (0);
+    assert (self->pool);
+
+    self->scheduler = scheduler_new (100);
+    assert (self->scheduler);
+    self->polling = 60;
 
     self->credentials = credentials_new();
     assert (self->credentials);
+
+    self->detector = zactor_new (snmp_detector_actor, NULL);
+    assert (self->detector);
+    self->addresses = zhash_new ();
+    assert (self->addresses);
     return self;
 }
 
@@ -75,9 +105,15 @@ zm_metric_server_destroy (zm_metric_server_t **self_p)
         //  Free class properties here
         mlm_client_destroy (&self->mlm);
         zlist_destroy (&self->rules);
-        zhash_destroy (&self->host_actors);
         zpoller_destroy (&self->poller);
+        scheduler_destroy (&self->scheduler);
+        worker_pool_destroy (&self->pool);
         credentials_destroy (&self->credentials);
+        zactor_destroy (&self->detector);
+        zhash_destroy (&self->addresses);
+        // sockets, interned oids, round trip estimations and rate limits
+        zmsnmp_reset ();
+        zstr_free (&self->cachettl);
         //  Free object itself
         free (self);
         *self_p = NULL;
@@ -171,115 +207,225 @@ is_rule_for_this_asset (rule_t *rule, zm_proto_t *zmmsg)
 }
 
 //  --------------------------------------------------------------------------
-//  Try SNMP credentials with this host and return first working.
+//  Polling interval of the rule in seconds
 
-const snmp_credentials_t *
-zm_metric_server_detect_credentials (zm_metric_server_t *self, const char *ip)
+static unsigned int
+s_rule_interval (zm_metric_server_t *self, rule_t *rule)
 {
-    const snmp_credentials_t *cr = credentials_first (self->credentials);
-    const char *startoid = ".1";
-    char *oid, *value;
+    if (rule_interval (rule)) return rule_interval (rule);
+    return rule_polling (rule) * self->polling;
+}
 
+//  --------------------------------------------------------------------------
+//  Pass credentials loaded from file to the detector
+
+static void
+s_detector_credentials (zm_metric_server_t *self)
+{
+    zmsg_t *msg = zmsg_new ();
+    zmsg_addstr (msg, "CREDENTIALS");
+    const snmp_credentials_t *cr = credentials_first (self->credentials);
     while (cr) {
-        zmsnmp_getnext (
-            ip,
-            startoid,
-            cr,
-            &oid,
-            &value
-        );
-        if (oid && value) {
-            free (oid);
-            free (value);
-            return cr;
-        }
+        zmsg_addstrf (msg, "%i", cr->version);
+        zmsg_addstr (msg, cr->community);
         cr = credentials_next (self->credentials);
     }
-    return NULL;
+    zmsg_send (&msg, self->detector);
 }
 
 //  --------------------------------------------------------------------------
-//  Update poller to have all existing sockets, pipes and actors
+//  Update poller to have all existing sockets and pipes
 
 void
 zm_metric_server_update_poller (zm_metric_server_t *self, zsock_t *pipe)
 {
     if (!self || !pipe ) return;
     zpoller_destroy (&self -> poller);
-    self -> poller = zpoller_new (pipe, mlm_client_msgpipe (self -> mlm), NULL);
-    zactor_t *a = (zactor_t *) zhash_first (self -> host_actors);
-    while (a) {
-        zpoller_add (self -> poller, a);
-        a = (zactor_t *) zhash_next (self -> host_actors);
+    self -> poller = zpoller_new (pipe, mlm_client_msgpipe (self -> mlm), worker_pool_socket (self -> pool), self -> detector, NULL);
+}
+
+//  --------------------------------------------------------------------------
+//  Send command to the host in worker pool
+
+static int
+s_host_sendx (zm_metric_server_t *self, const char *assetname, const char *cmd, ...)
+{
+    zmsg_t *msg = zmsg_new ();
+    va_list args;
+    va_start (args, cmd);
+    const char *frame = cmd;
+    while (frame) {
+        zmsg_addstr (msg, frame);
+        frame = va_arg (args, const char *);
     }
+    va_end (args);
+    return worker_pool_post (self -> pool, assetname, &msg);
 }
 
+//  --------------------------------------------------------------------------
+//  Send rule to the host in worker pool. Bytecode compiled by rule_parse
+//  is sent, so thousands of hosts don't parse the same source again. Rule
+//  with an error goes as source, host reports the error. Budget of the
+//  evaluation follows the interval.
+
+static int
+s_host_send_rule (zm_metric_server_t *self, const char *assetname, rule_t *rule, unsigned int interval)
+{
+    zmsg_t *msg = zmsg_new ();
+    zmsg_addstr (msg, "LUA");
+    zmsg_addstr (msg, rule_name (rule));
+    size_t size;
+    const char *bytecode = rule_bytecode (rule, &size);
+    if (bytecode)
+        zmsg_addmem (msg, bytecode, size);
+    else
+        zmsg_addstr (msg, rule_evaluation (rule) ? rule_evaluation (rule) : "");
+    zmsg_addstrf (msg, "%u", interval);
+    zmsg_addstrf (msg, "%" PRIu64, rule_max_instructions (rule));
+    zmsg_addstrf (msg, "%u", rule_max_time (rule));
+    return worker_pool_post (self -> pool, assetname, &msg);
+}
+
+//  --------------------------------------------------------------------------
+//  Limit rate of requests to the ip. Limit is kept per ip, so the most
+//  strict one of all assets with that ip wins, it is removed with the
+//  last of them.
+
+static void
+s_update_rate (zm_metric_server_t *self, const char *ip)
+{
+    double rate = 0;
+    unsigned int burst = 0;
+    monitored_t *monitored = (monitored_t *) zhash_first (self->addresses);
+    while (monitored) {
+        if (streq (monitored->ip, ip) && monitored->rate > 0 && (rate == 0 || monitored->rate < rate)) {
+            rate = monitored->rate;
+            burst = monitored->burst;
+        }
+        monitored = (monitored_t *) zhash_next (self->addresses);
+    }
+    zmsnmp_set_rate (ip, rate, (int) burst);
+}
 
 //  --------------------------------------------------------------------------
-//  When asset message comes, function creates new host_actor if not exists.
+//  When asset message comes, function creates new host in worker pool if
+//  not exists. Returns true if the asset is monitored.
 
-zactor_t *
-zm_metric_server_asset (zm_metric_server_t *self, zm_proto_t *zmmsg, zsock_t *pipe)
+bool
+zm_metric_server_asset (zm_metric_server_t *self, zm_proto_t *zmmsg)
 {
-    if (!self || !zmmsg) return NULL;
+    if (!self || !zmmsg) return false;
 
     const char *assetname = zm_proto_device (zmmsg);
 
     // TODO: clean it using device TTL
     /*
     if (streq (operation, "delete")) {
-        if (zhash_lookup (self->host_actors, assetname)) {
-            zhash_delete (self->host_actors, assetname);
-            zm_metric_server_update_poller (self, pipe);
-        }
-        return NULL;
+        scheduler_remove (self->scheduler, assetname);
+        worker_pool_remove_host (self->pool, assetname);
+        return false;
     }
     */
 
     zhash_t *ext = zm_proto_ext (zmmsg);
     const char *ip = (char *)zhash_lookup (ext, "ip.1");
-    if (!ip) return NULL;
-    zactor_t *host = (zactor_t *) zhash_lookup (self->host_actors, assetname);
-    if (host) zstr_send (host, "DROPLUA");
+    if (!ip) return false;
+    bool host = worker_pool_has_host (self->pool, assetname);
+    if (host) s_host_sendx (self, assetname, "DROPLUA", NULL);
 
     rule_t *rule = (rule_t *)zlist_first (self->rules);
     bool haverule = false;
+    double rate = 0;            // the most strict limit of the rules wins
+    unsigned int burst = 0;
     while (rule) {
         if (is_rule_for_this_asset (rule, zmmsg)) {
             haverule = true;
+            if (rule_snmp_rate (rule) > 0 && (rate == 0 || rule_snmp_rate (rule) < rate)) {
+                rate = rule_snmp_rate (rule);
+                burst = rule_snmp_burst (rule);
+            }
             if (!host) {
-                zsys_debug ("deploying actor for %s", assetname);
-                host = zactor_new(host_actor, NULL);
-                assert (host);
-                zhash_insert (self->host_actors, assetname, host);
-                zhash_freefn (self->host_actors, assetname, host_actor_freefn);
-                zstr_sendx (host, "ASSETNAME", assetname, NULL);
-                zm_metric_server_update_poller (self, pipe);
+                zsys_debug ("deploying host %s", assetname);
+                host = worker_pool_add_host (self->pool, assetname);
+                if (self->cachettl)
+                    s_host_sendx (self, assetname, "CACHETTL", self->cachettl, NULL);
             }
-            zsys_debug ("function '%s' send to '%s' actor", rule_name (rule), assetname);
-            zstr_sendx (host, "LUA", rule_name (rule), rule_evaluation (rule), NULL);
+            zsys_debug ("function '%s' send to '%s' host", rule_name (rule), assetname);
+            unsigned int interval = s_rule_interval (self, rule);
+            s_host_send_rule (self, assetname, rule, interval);
+            scheduler_add (self->scheduler, assetname, rule_name (rule), (int64_t) interval * 1000);
+        }
+        else {
+            scheduler_remove_rule (self->scheduler, assetname, rule_name (rule));
         }
         rule = (rule_t *)zlist_next (self->rules);
     }
+    // asset could move from other ip, which may get less strict limit
+    monitored_t *previous = (monitored_t *) zhash_lookup (self->addresses, assetname);
+    char *previp = previous && !streq (previous->ip, ip) ? strdup (previous->ip) : NULL;
     if (!haverule) {
         zsys_debug ("no rule for %s", assetname);
-        if (host) {
-            zactor_destroy (&host);
-            zm_metric_server_update_poller (self, pipe);
-        }
-        return NULL;
+        scheduler_remove (self->scheduler, assetname);
+        if (host) worker_pool_remove_host (self->pool, assetname);
+        zhash_delete (self->addresses, assetname);
+        s_update_rate (self, ip);
+        if (previp) s_update_rate (self, previp);
+        zstr_free (&previp);
+        return false;
     }
-    zstr_sendx (host, "IP", ip, NULL);
-    const snmp_credentials_t *cr = zm_metric_server_detect_credentials (self, ip);
-    if (cr) {
-        char *versionstr = zsys_sprintf ("%i", cr->version);
-        zstr_sendx (host, "CREDENTIALS", versionstr, cr->community, NULL);
-        zstr_free (&versionstr);
-    } else {
-        zsys_error ("Can't detect SNMP credentials for %s", assetname);
-        zstr_sendx (host, "CREDENTIALS", "0", "", NULL);
+    monitored_t *monitored = (monitored_t *) zmalloc (sizeof (monitored_t));
+    assert (monitored);
+    monitored->ip = strdup (ip);
+    monitored->rate = rate;
+    monitored->burst = burst;
+    zhash_update (self->addresses, assetname, monitored);
+    zhash_freefn (self->addresses, assetname, s_monitored_destroy);
+    s_update_rate (self, ip);
+    if (previp) s_update_rate (self, previp);
+    zstr_free (&previp);
+    s_host_sendx (self, assetname, "IP", ip, NULL);
+    // credentials come later as DETECTED from the detector
+    zstr_sendx (self->detector, "DETECT", assetname, ip, NULL);
+    return true;
+}
+
+//  --------------------------------------------------------------------------
+//  Detector found credentials of the asset, pass them to the host unless
+//  its address changed meanwhile. Known credentials may come first and the
+//  confirmed ones later.
+
+static void
+s_detected (zm_metric_server_t *self, zmsg_t *msg)
+{
+    char *cmd = zmsg_popstr (msg);
+    char *asset = zmsg_popstr (msg);
+    char *ip = zmsg_popstr (msg);
+    char *version = zmsg_popstr (msg);
+    char *community = zmsg_popstr (msg);
+    if (cmd && streq (cmd, "DETECTED") && asset && ip && version && community) {
+        monitored_t *current = (monitored_t *) zhash_lookup (self->addresses, asset);
+        if (current && streq (current->ip, ip)) {
+            if (streq (version, "0"))
+                zsys_error ("Can't detect SNMP credentials for %s", asset);
+            s_host_sendx (self, asset, "CREDENTIALS", version, community, NULL);
+        }
     }
-    return host;
+    zstr_free (&cmd);
+    zstr_free (&asset);
+    zstr_free (&ip);
+    zstr_free (&version);
+    zstr_free (&community);
+}
+
+//  --------------------------------------------------------------------------
+//  Scheduler callback, ask the host to evaluate one rule
+
+static void
+s_evaluate (const char *asset, const char *rule, void *arg)
+{
+    zm_metric_server_t *self = (zm_metric_server_t *) arg;
+    if (s_host_sendx (self, asset, "EVALUATE", rule, NULL) != 0)
+        scheduler_done (self->scheduler, asset, rule);
 }
 
 //  --------------------------------------------------------------------------
@@ -293,7 +439,12 @@ zm_metric_server_actor_main_loop (zm_metric_server_t *self, zsock_t *pipe)
     zm_metric_server_update_poller (self, pipe);
     zsock_signal (pipe, 0);
     while (!zsys_interrupted) {
-        zsock_t *which = (zsock_t *) zpoller_wait (self -> poller, -1);
+        int timeout = scheduler_timeout (self -> scheduler, zclock_mono ());
+        zsock_t *which = (zsock_t *) zpoller_wait (self -> poller, timeout);
+        scheduler_dispatch (self -> scheduler, zclock_mono (), s_evaluate, self);
+        if (which == NULL && zpoller_terminated (self -> poller)) {
+            break;
+        }
         if (which == pipe) {
             zmsg_t *msg = zmsg_recv (pipe);
             if (msg) {
@@ -337,8 +488,16 @@ zm_metric_server_actor_main_loop (zm_metric_server_t *self, zsock_t *pipe)
                         char *path = zmsg_popstr (msg);
                         assert (path);
                         credentials_load (self->credentials, path);
+                        s_detector_credentials (self);
                         zstr_free (&path);
                     }
+                    else if (streq (cmd, "POLLING")) {
+                        char *polling = zmsg_popstr (msg);
+                        assert (polling);
+                        self->polling = atoi (polling);
+                        if (self->polling <= 0) self->polling = 60;
+                        zstr_free (&polling);
+                    }
                     else if (streq (cmd, "TTL")) {
                         char *ttlstr = zmsg_popstr (msg);
                         assert (ttlstr);
@@ -351,12 +510,75 @@ zm_metric_server_actor_main_loop (zm_metric_server_t *self, zsock_t *pipe)
                         zm_metric_server_add_rule (self, json);
                         zstr_free (&json);
                     }
-                    else if (streq (cmd, "WAKEUP")) {
-                        zactor_t *a = (zactor_t *) zhash_first (self -> host_actors);
-                        while (a) {
-                            zstr_send (a, "WAKEUP");
-                            a = (zactor_t *) zhash_next (self -> host_actors);
+                    else if (streq (cmd, "WORKERS")) {
+                        char *workers = zmsg_popstr (msg);
+                        assert (workers);
+                        if (worker_pool_hosts (self->pool) == 0) {
+                            worker_pool_destroy (&self->pool);
+                            self->pool = worker_pool_new (atoi (workers));
+                            assert (self->pool);
+                            zm_metric_server_update_poller (self, pipe);
+                        } else {
+                            zsys_error ("Can't change number of workers, hosts are already deployed");
                         }
+                        zstr_free (&workers);
+                    }
+                    else if (streq (cmd, "WAKEUP")) {
+                        // evaluate everything now, in flight pairs are skipped
+                        scheduler_wakeup (self -> scheduler);
+                    }
+                    else if (streq (cmd, "CACHETTL")) {
+                        char *cachettl = zmsg_popstr (msg);
+                        assert (cachettl);
+                        zstr_free (&self->cachettl);
+                        self->cachettl = cachettl;
+                        zmsg_t *update = zmsg_new ();
+                        zmsg_addstr (update, "CACHETTL");
+                        zmsg_addstr (update, cachettl);
+                        worker_pool_broadcast (self -> pool, update);
+                        zmsg_destroy (&update);
+                    }
+                    else if (streq (cmd, "DETECTCACHE")) {
+                        char *path = zmsg_popstr (msg);
+                        assert (path);
+                        zstr_sendx (self->detector, "LOAD", path, NULL);
+                        zstr_free (&path);
+                    }
+                    else if (streq (cmd, "INFLIGHT")) {
+                        char *inflight = zmsg_popstr (msg);
+                        assert (inflight);
+                        zmsnmp_set_inflight ((size_t) atoi (inflight));
+                        zstr_free (&inflight);
+                    }
+                    else if (streq (cmd, "LUAMEMORY")) {
+                        // MB of lua state of one worker
+                        char *memory = zmsg_popstr (msg);
+                        assert (memory);
+                        lua_runtime_set_memory_limit ((size_t) atol (memory) * 1024 * 1024);
+                        zstr_free (&memory);
+                    }
+                    else if (streq (cmd, "DETECTTTL")) {
+                        char *detectttl = zmsg_popstr (msg);
+                        assert (detectttl);
+                        zstr_sendx (self->detector, "TTL", detectttl, NULL);
+                        zstr_free (&detectttl);
+                    }
+                    else if (streq (cmd, "STATS")) {
+                        // optional ip address asks for stats of one host
+                        char *ip = zmsg_popstr (msg);
+                        zmsg_t *reply = zmsg_new ();
+                        zmsg_addstr (reply, "hosts");
+                        zmsg_addstrf (reply, "%zu", worker_pool_hosts (self->pool));
+                        scheduler_stats (self->scheduler, reply);
+                        zmsnmp_transport_stats (reply);
+                        snmp_cache_stats (reply);
+                        zmsnmp_rtt_stats (NULL, reply);
+                        host_breaker_stats (reply);
+                        lua_runtime_stats (reply);
+                        zmsnmp_limit_stats (reply);
+                        if (ip) zmsnmp_rtt_stats (ip, reply);
+                        zstr_free (&ip);
+                        zmsg_send (&reply, pipe);
                     }
                     zstr_free (&cmd);
                 }
@@ -370,15 +592,19 @@ zm_metric_server_actor_main_loop (zm_metric_server_t *self, zsock_t *pipe)
                 // message from asset stream
                 zm_proto_t *zmmsg = zm_proto_decode (&msg);
                 if (zm_proto_id (zmmsg) == ZM_PROTO_DEVICE) {
-                    zm_metric_server_asset (self, zmmsg, pipe);
+                    zm_metric_server_asset (self, zmmsg);
                 }
                 zm_proto_destroy (&zmmsg);
             }
             zmsg_destroy (&msg);
         }
-        else if (which != NULL) {
-            // must be host_actor then
-            zsys_debug ("got host actor message");
+        else if ((void *) which == (void *) self->detector) {
+            zmsg_t *msg = zmsg_recv (which);
+            if (msg) s_detected (self, msg);
+            zmsg_destroy (&msg);
+        }
+        else if (which == worker_pool_socket (self->pool)) {
+            zsys_debug ("got host message");
             zmsg_t *msg = zmsg_recv (which);
             char *cmd = zmsg_popstr (msg);
             if (cmd && streq (cmd, "METRIC")) {
@@ -389,7 +615,10 @@ zm_metric_server_actor_main_loop (zm_metric_server_t *self, zsock_t *pipe)
                 char *pollfreq = zmsg_popstr (msg);
                 char *desc = zmsg_popstr (msg);
                 if (type && element && value && units && pollfreq) {
-                    int freq = atoi (pollfreq);
+                    // ttl is given for base polling interval, scale it
+                    int interval = atoi (pollfreq);
+                    int metricttl = ttl * interval / self->polling;
+                    if (metricttl < 1) metricttl = 1;
                     char *topic = zsys_sprintf ("%s@%s", type, element);
                     zhash_t *aux = zhash_new ();
                     zhash_autofree (aux);
@@ -397,7 +626,7 @@ zm_metric_server_actor_main_loop (zm_metric_server_t *self, zsock_t *pipe)
                     if (desc && strlen (desc)) {
                         zhash_insert (aux, "description", desc);
                     }
-                    zmsg_t *metric = zm_proto_encode_metric_v1 (element, time(NULL), ttl*freq, NULL, type, value, units);
+                    zmsg_t *metric = zm_proto_encode_metric_v1 (element, time(NULL), metricttl, NULL, type, value, units);
                     mlm_client_send (self->mlm, topic, &metric);
                     zmsg_destroy (&metric);
                     zhash_destroy (&aux);
@@ -410,6 +639,13 @@ zm_metric_server_actor_main_loop (zm_metric_server_t *self, zsock_t *pipe)
                 zstr_free (&pollfreq);
                 zstr_free (&desc);
             }
+            else if (cmd && streq (cmd, "DONE")) {
+                char *asset = zmsg_popstr (msg);
+                char *rule = zmsg_popstr (msg);
+                scheduler_done (self->scheduler, asset, rule);
+                zstr_free (&asset);
+                zstr_free (&rule);
+            }
             zstr_free (&cmd);
             zmsg_destroy (&msg);
         }
@@ -441,6 +677,41 @@ zm_metric_server_test (bool verbose)
     assert (self);
     zm_metric_server_destroy (&self);
 
+    // assets sharing one ip share its rate limit, the strictest wins
+    {
+        zmsnmp_reset ();
+        self = zm_metric_server_new ();
+        assert (self);
+        zm_metric_server_add_rule (self, "{ \"name\" : \"slow\", \"assets\" : [\"dev1\"], \"snmp_rate\" : 2 }");
+        zm_metric_server_add_rule (self, "{ \"name\" : \"fast\", \"assets\" : [\"dev2\"], \"snmp_rate\" : 50 }");
+        const char *devices [] = { "dev1", "dev2", "dev1", "dev2" };
+        const char *addresses [] = { "127.0.0.1", "127.0.0.1", "127.0.0.2", "127.0.0.2" };
+        const char *limited [] = { "1", "1", "2", "1" };
+        for (int i = 0; i < 4; i++) {
+            zhash_t *ext = zhash_new ();
+            zhash_autofree (ext);
+            zhash_insert (ext, "ip.1", (void *) addresses [i]);
+            zmsg_t *msg = zm_proto_encode_device_v1 (devices [i], time (NULL), 3600, ext);
+            zhash_destroy (&ext);
+            zm_proto_t *device = zm_proto_decode (&msg);
+            assert (device);
+            assert (zm_metric_server_asset (self, device));
+            zm_proto_destroy (&device);
+
+            zmsg_t *stats = zmsg_new ();
+            zmsnmp_limit_stats (stats);
+            char *name = zmsg_popstr (stats);
+            char *value = zmsg_popstr (stats);
+            assert (streq (name, "rate-limited-hosts"));
+            assert (streq (value, limited [i]));
+            zstr_free (&name);
+            zstr_free (&value);
+            zmsg_destroy (&stats);
+        }
+        zm_metric_server_destroy (&self);
+        zmsnmp_reset ();
+    }
+
     // actor test
     static const char *endpoint = "inproc://zm-metric-snmp";
     zactor_t *malamute = zactor_new (mlm_server, (void*) "Malamute");
@@ -523,6 +794,18 @@ zm_metric_server_test (bool verbose)
         zmsg_destroy (&received);
     }
 
+    {
+        zstr_send (server, "STATS");
+        zmsg_t *stats = zmsg_recv (server);
+        assert (stats);
+        char *name = zmsg_popstr (stats);
+        char *value = zmsg_popstr (stats);
+        assert (streq (name, "hosts") && streq (value, "2"));
+        zstr_free (&name);
+        zstr_free (&value);
+        zmsg_destroy (&stats);
+    }
+
     mlm_client_destroy (&asset);
     zclock_sleep (500);
     zactor_destroy (&server);
@@ -0,0 +1,203 @@
+/*  =========================================================================
+    zm_metric_snmpsim - simulated SNMP agents for tests and benchmarks
+
+    Copyright (C) 2016 - 2017 Tomas Halman
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    zm_metric_snmpsim - simulated SNMP agents for tests and benchmarks
+@discuss
+    Serves one snmpwalk file on many UDP ports or loopback addresses, so
+    thousands of hosts can be polled on one box.
+@end
+*/
+
+#include "zm_metric_classes.h"
+
+#include <sys/resource.h>
+#include <arpa/inet.h>
+
+//  Parse non negative number option, returns -1 if not valid
+static int
+s_number (const char *param, int *value)
+{
+    if (!param) return -1;
+    errno = 0;
+    char *end;
+    long number = strtol (param, &end, 10);
+    if (errno || *end || number < 0 || number > INT_MAX) return -1;
+    *value = (int) number;
+    return 0;
+}
+
+int main (int argc, char *argv [])
+{
+    int argn;
+    const char *filename = NULL;
+    const char *address = "127.0.0.1";
+    const char *community = "public";
+    int port = 16100;
+    int count = 1;
+    int latency = 0;
+    int loss = 0;
+    int max_varbinds = 0;
+    bool addresses = false;
+    bool verbose = false;
+
+    for (argn = 1; argn < argc; argn++) {
+        char *param = NULL;
+        if (argn < argc - 1) param = argv [argn + 1];
+        if (streq (argv [argn], "--help") ||  streq (argv [argn], "-h")) {
+            puts ("zm-metric-snmpsim [options] ...");
+            puts ("  --help / -h            this information");
+            puts ("  --verbose / -v         print statistics every second");
+            puts ("  --file / -f            snmpwalk -On output to serve");
+            puts ("  --address / -a         first address to listen on [127.0.0.1]");
+            puts ("  --port / -p            first UDP port, 0 for any free port [16100]");
+            puts ("  --count / -n           number of agents [1]");
+            puts ("  --addresses / -A       agents on consecutive addresses (127.0.0.1,");
+            puts ("                         127.0.0.2 ...) with the same port instead of");
+            puts ("                         consecutive ports");
+            puts ("  --community / -c       accepted community, '*' accepts any [public]");
+            puts ("  --latency / -l         response delay in ms [0]");
+            puts ("  --loss / -L            percent of requests left unanswered [0]");
+            puts ("  --max-varbinds / -m    varbinds per response before tooBig [unlimited]");
+            return 0;
+        }
+        else if (streq (argv [argn], "--verbose") ||  streq (argv [argn], "-v")) {
+            verbose = true;
+        }
+        else if (streq (argv [argn], "--file") ||  streq (argv [argn], "-f")) {
+            if (param) filename = param;
+            ++argn;
+        }
+        else if (streq (argv [argn], "--address") ||  streq (argv [argn], "-a")) {
+            if (param) address = param;
+            ++argn;
+        }
+        else if (streq (argv [argn], "--community") ||  streq (argv [argn], "-c")) {
+            if (param) community = param;
+            ++argn;
+        }
+        else if (streq (argv [argn], "--addresses") ||  streq (argv [argn], "-A")) {
+            addresses = true;
+        }
+        else if (streq (argv [argn], "--port") ||  streq (argv [argn], "-p")) {
+            if (s_number (param, &port) != 0) {
+                printf ("Invalid port '%s'\n", param ? param : "");
+                return 1;
+            }
+            ++argn;
+        }
+        else if (streq (argv [argn], "--count") ||  streq (argv [argn], "-n")) {
+            if (s_number (param, &count) != 0) {
+                printf ("Invalid count '%s'\n", param ? param : "");
+                return 1;
+            }
+            ++argn;
+        }
+        else if (streq (argv [argn], "--latency") ||  streq (argv [argn], "-l")) {
+            if (s_number (param, &latency) != 0) {
+                printf ("Invalid latency '%s'\n", param ? param : "");
+                return 1;
+            }
+            ++argn;
+        }
+        else if (streq (argv [argn], "--loss") ||  streq (argv [argn], "-L")) {
+            if (s_number (param, &loss) != 0) {
+                printf ("Invalid loss '%s'\n", param ? param : "");
+                return 1;
+            }
+            ++argn;
+        }
+        else if (streq (argv [argn], "--max-varbinds") ||  streq (argv [argn], "-m")) {
+            if (s_number (param, &max_varbinds) != 0) {
+                printf ("Invalid max varbinds '%s'\n", param ? param : "");
+                return 1;
+            }
+            ++argn;
+        }
+        else {
+            printf ("Unknown option: %s\n", argv [argn]);
+            return 1;
+        }
+    }
+    if (!filename) {
+        printf ("Walk file is missing, use --file\n");
+        return 1;
+    }
+    if (count < 1 || port + (addresses ? 0 : count - 1) > 65535) {
+        printf ("Invalid number of agents %i\n", count);
+        return 1;
+    }
+    struct in_addr first;
+    if (inet_pton (AF_INET, address, &first) != 1) {
+        printf ("Invalid address '%s'\n", address);
+        return 1;
+    }
+
+    snmpsim_t *sim = snmpsim_new ();
+    int loaded = snmpsim_load (sim, filename);
+    if (loaded < 0) {
+        printf ("Can't read %s\n", filename);
+        snmpsim_destroy (&sim);
+        return 1;
+    }
+    snmpsim_set_community (sim, streq (community, "*") ? NULL : community);
+    snmpsim_set_latency (sim, latency);
+    snmpsim_set_loss (sim, loss);
+    snmpsim_set_max_varbinds (sim, max_varbinds);
+
+    // every agent needs its own socket
+    struct rlimit limit;
+    if (getrlimit (RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < (rlim_t) count + 64) {
+        limit.rlim_cur = (rlim_t) count + 64;
+        if (limit.rlim_max != RLIM_INFINITY && limit.rlim_cur > limit.rlim_max)
+            limit.rlim_cur = limit.rlim_max;
+        setrlimit (RLIMIT_NOFILE, &limit);
+    }
+    for (int i = 0; i < count; i++) {
+        char buffer [INET_ADDRSTRLEN];
+        struct in_addr addr = first;
+        if (addresses)
+            addr.s_addr = htonl (ntohl (first.s_addr) + i);
+        inet_ntop (AF_INET, &addr, buffer, sizeof (buffer));
+        if (!snmpsim_bind (sim, buffer, addresses || port == 0 ? port : port + i)) {
+            printf ("Can't bind agent %i to %s: %s\n", i + 1, buffer, strerror (errno));
+            snmpsim_destroy (&sim);
+            return 1;
+        }
+    }
+    printf ("Serving %zu values on %zu agents, %s ... %s\n",
+        snmpsim_size (sim), snmpsim_agents (sim),
+        snmpsim_endpoint (sim, 0), snmpsim_endpoint (sim, count - 1));
+
+    int64_t start = zclock_mono ();
+    while (!zsys_interrupted) {
+        snmpsim_run (sim, 1000);
+        if (verbose)
+            printf ("requests %" PRIu64 ", dropped %" PRIu64 "\n",
+                snmpsim_requests (sim), snmpsim_dropped (sim));
+    }
+    int64_t elapsed = zclock_mono () - start;
+    printf ("%" PRIu64 " requests in %" PRIi64 " ms, %" PRIu64 " dropped\n",
+        snmpsim_requests (sim), elapsed, snmpsim_dropped (sim));
+    snmpsim_destroy (&sim);
+    return 0;
+}
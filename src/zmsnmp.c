@@ -29,6 +29,107 @@
 
 typedef u_long myoid;
 
+//  Synchronous requests of all threads go through one shared transport,
+//  so thousands of hosts need a few sockets. Calling thread queues its
+//  request and waits for the completion. One of the waiting threads runs
+//  the transport for all of them, the others sleep until their request
+//  completes or the running thread hands the transport over.
+
+typedef struct {
+    const char *host;
+    const snmp_credentials_t *credentials;
+    int command;                // ZMSNMP_GET, ZMSNMP_GETNEXT or ZMSNMP_GETBULK
+    zlist_t *oids;
+    int repetitions;            // max-repetitions of GETBULK
+    int timeout;                // ms
+    int retries;
+    int status;
+    int errstat;                // error status of the response
+    int errindex;
+    int64_t elapsed;            // ms since the request was sent
+    zlist_t *result_oids;       // received when status is ZMSNMP_OK
+    zlist_t *result_values;
+    bool done;
+} sync_request_t;
+
+static pthread_mutex_t s_sync_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_sync_cond = PTHREAD_COND_INITIALIZER;
+static snmp_transport_t *s_sync_transport = NULL;
+static zlist_t *s_sync_queue = NULL;    // requests waiting to be sent
+static zlist_t *s_sync_completed = NULL;// completed by the running thread
+static bool s_sync_running = false;     // transport is run by a thread
+static size_t s_sync_waiting = 0;       // requests not completed yet
+static uint64_t s_sync_requests = 0;
+
+//  Parsed oids are interned, so the string is parsed (and possibly looked
+//  up in MIB tree) only once.
+
+#define ZMSNMP_OID_TABLE_MAX 65536  // max number of interned oids
+
+typedef struct {
+    size_t len;
+    myoid name [];
+} interned_oid_t;
+
+static pthread_mutex_t s_oid_mutex = PTHREAD_MUTEX_INITIALIZER;
+static zhash_t *s_oid_table = NULL;     // string -> interned_oid_t
+
+//  Round trip time of every host is tracked like TCP does (RFC 6298),
+//  timeout of the next request is derived from it. Host which stopped
+//  responding gets no retries until it answers again.
+
+typedef struct {
+    double srtt;        // smoothed round trip time, ms
+    double rttvar;      // round trip time variation, ms
+    int64_t rto;        // timeout of the next request, ms
+    uint64_t samples;
+    uint64_t timeouts;
+    int failures;       // consecutive timeouts
+} host_rtt_t;
+
+static pthread_mutex_t s_rtt_mutex = PTHREAD_MUTEX_INITIALIZER;
+static zhash_t *s_rtt_table = NULL;     // host -> host_rtt_t
+
+//  Requests to one host can be limited by token bucket, requests of the
+//  whole process by number of requests in flight. Every snmp_transport
+//  asks for admission when it takes request from its send queue, requests
+//  above the limits stay queued for their turn, they are never dropped.
+
+typedef struct {
+    double rate;        // requests per second
+    double burst;       // size of the bucket
+    double tokens;      // negative when requests wait for the bucket
+    int64_t updated;    // zclock_mono of last refill
+} host_rate_t;
+
+static pthread_mutex_t s_limit_mutex = PTHREAD_MUTEX_INITIALIZER;
+static zhash_t *s_rate_table = NULL;    // host -> host_rate_t
+static size_t s_inflight = 0;           // requests sent and not answered
+static size_t s_inflight_max = 0;       // 0 = unlimited
+static size_t s_inflight_peak = 0;
+static uint64_t s_rate_delayed = 0;     // requests which waited for a token
+static int64_t s_rate_wait = 0;         // ms requests waited for admission
+static uint64_t s_inflight_delayed = 0; // requests which waited for a slot
+
+//  Deadline of synchronous requests of the calling thread, zclock_mono ms,
+//  0 = none. Caller (lua evaluation) can't wait longer than its budget.
+
+static __thread int64_t s_deadline = 0;
+
+//  net-snmp library and its output settings are initialized once per
+//  process, nothing touches netsnmp_ds settings afterwards.
+
+static pthread_once_t s_init_once = PTHREAD_ONCE_INIT;
+
+//  Asynchronous engine sends requests through snmp_transport, all hosts
+//  share a few UDP sockets instead of net-snmp session per host.
+
+struct _zmsnmp_engine_t {
+    snmp_transport_t *transport;
+    int timeout;                // ms
+    int retries;
+};
+
 //  --------------------------------------------------------------------------
 //  Convert SNMP version (1, 2, 3) to net-snmp enums
 
@@ -63,6 +164,125 @@ int snmp_enum_to_version (int version)
     }
 }
 
+//  --------------------------------------------------------------------------
+//  Initialize net-snmp library
+
+static void
+s_init (void)
+{
+    init_snmp ("zm-snmp-client");
+    netsnmp_ds_set_boolean (NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT, true);
+    netsnmp_ds_set_int (NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_OID_OUTPUT_FORMAT, NETSNMP_OID_OUTPUT_NUMERIC);
+}
+
+void
+zmsnmp_init (void)
+{
+    pthread_once (&s_init_once, s_init);
+}
+
+//  --------------------------------------------------------------------------
+//  Parse numeric oid like ".1.3.6.1" or "1.3.6.1". Returns 0 if the
+//  string is not numeric oid.
+
+static int
+s_parse_numeric (const char *str, myoid *name, size_t *len)
+{
+    size_t n = 0;
+    const char *p = str;
+    if (*p == '.') ++p;
+    if (!*p) return 0;
+    while (*p) {
+        if (*p < '0' || *p > '9' || n >= *len) return 0;
+        myoid value = 0;
+        while (*p >= '0' && *p <= '9') {
+            value = value * 10 + (myoid) (*p - '0');
+            ++p;
+        }
+        name [n++] = value;
+        if (*p == '.') {
+            ++p;
+            if (!*p) return 0;
+        }
+        else
+        if (*p) return 0;
+    }
+    *len = n;
+    return 1;
+}
+
+//  --------------------------------------------------------------------------
+//  Parse oid string using intern table, same contract as read_objid
+
+static int
+s_read_objid (const char *str, myoid *name, size_t *len)
+{
+    if (!str || !name || !len) return 0;
+
+    pthread_mutex_lock (&s_oid_mutex);
+    interned_oid_t *interned = s_oid_table ? (interned_oid_t *) zhash_lookup (s_oid_table, str) : NULL;
+    if (interned && interned->len <= *len) {
+        memcpy (name, interned->name, interned->len * sizeof (myoid));
+        *len = interned->len;
+        pthread_mutex_unlock (&s_oid_mutex);
+        return 1;
+    }
+    pthread_mutex_unlock (&s_oid_mutex);
+
+    size_t parsedlen = *len;
+    if (!s_parse_numeric (str, name, &parsedlen)) {
+        // symbolic name, ask MIB
+        zmsnmp_init ();
+        parsedlen = *len;
+        if (!read_objid (str, name, &parsedlen)) return 0;
+    }
+    *len = parsedlen;
+
+    pthread_mutex_lock (&s_oid_mutex);
+    if (!s_oid_table) {
+        s_oid_table = zhash_new ();
+        assert (s_oid_table);
+    }
+    if (zhash_size (s_oid_table) < ZMSNMP_OID_TABLE_MAX && !zhash_lookup (s_oid_table, str)) {
+        size_t size = sizeof (interned_oid_t) + parsedlen * sizeof (myoid);
+        interned = (interned_oid_t *) zmalloc (size);
+        assert (interned);
+        interned->len = parsedlen;
+        memcpy (interned->name, name, parsedlen * sizeof (myoid));
+        zhash_insert (s_oid_table, str, interned);
+        zhash_freefn (s_oid_table, str, free);
+    }
+    pthread_mutex_unlock (&s_oid_mutex);
+    return 1;
+}
+
+//  --------------------------------------------------------------------------
+//  Format oid in numeric form ".1.3.6.1" into buffer. Returns length of the
+//  string or -1 if buffer is too small.
+
+static int
+s_format_oid (const myoid *name, size_t len, char *buffer, size_t size)
+{
+    char *p = buffer;
+    char *end = buffer + size;
+    for (size_t i = 0; i < len; i++) {
+        // digits of one sub-identifier, reversed
+        char digits [24];
+        int n = 0;
+        myoid value = name [i];
+        do {
+            digits [n++] = (char) ('0' + value % 10);
+            value /= 10;
+        } while (value);
+        if (p + n + 2 > end) return -1;
+        *p++ = '.';
+        while (n) *p++ = digits [--n];
+    }
+    if (p + 1 > end) return -1;
+    *p = 0;
+    return (int) (p - buffer);
+}
+
 //  --------------------------------------------------------------------------
 //  Convert net-snmp oid to char * string like ".1.3.4.6"
 
@@ -70,9 +290,7 @@ char *oid_to_sring (myoid anOID[], int len)
 {
     char buffer[1024];
 
-    netsnmp_ds_set_int(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_OID_OUTPUT_FORMAT, NETSNMP_OID_OUTPUT_NUMERIC);
-    memset (buffer, 0, sizeof (buffer));
-    if(snprint_objid(buffer, sizeof(buffer)-1, anOID, len) == -1) return NULL;
+    if (s_format_oid (anOID, len, buffer, sizeof (buffer)) < 0) return NULL;
     return strdup (buffer);
 }
 
@@ -82,107 +300,939 @@ char *oid_to_sring (myoid anOID[], int len)
 char *var_to_sring (const netsnmp_variable_list *variable)
 {
     char buffer[1024];
-    netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT, true);
     memset (buffer, 0, sizeof (buffer));
     if(snprint_value(buffer, sizeof(buffer)-1, variable->name, variable->name_length, variable) == -1) return NULL;
     return strdup (buffer);
 }
 
 //  --------------------------------------------------------------------------
-//  snmp get version 1 and 2c
+//  Create numeric value
 
-char* zmsnmp_get_v12 (const char* host, const char *oid, const snmp_credentials_t* credentials)
+zmsnmp_value_t *
+zmsnmp_value_new_integer (zmsnmp_type_t type, int64_t integer)
 {
-    struct snmp_session session, *ss;
-    struct snmp_pdu *pdu;
-    struct snmp_pdu *response;
-    char *result = NULL;
-    myoid anOID[MAX_OID_LEN];
-    size_t anOID_len = MAX_OID_LEN;
+    zmsnmp_value_t *self = (zmsnmp_value_t *) zmalloc (sizeof (zmsnmp_value_t));
+    assert (self);
+    self->type = type;
+    self->integer = integer;
+    return self;
+}
 
-    struct variable_list *vars;
-    int status;
+//  --------------------------------------------------------------------------
+//  Create Counter64 value
+
+zmsnmp_value_t *
+zmsnmp_value_new_counter64 (uint64_t counter64)
+{
+    zmsnmp_value_t *self = (zmsnmp_value_t *) zmalloc (sizeof (zmsnmp_value_t));
+    assert (self);
+    self->type = ZMSNMP_TYPE_COUNTER64;
+    self->counter64 = counter64;
+    return self;
+}
+
+//  --------------------------------------------------------------------------
+//  Create string value
+
+zmsnmp_value_t *
+zmsnmp_value_new_string (zmsnmp_type_t type, const char *data, size_t size)
+{
+    zmsnmp_value_t *self = (zmsnmp_value_t *) zmalloc (sizeof (zmsnmp_value_t));
+    assert (self);
+    self->type = type;
+    self->string = (char *) zmalloc (size + 1);
+    assert (self->string);
+    if (size) memcpy (self->string, data, size);
+    self->size = size;
+    return self;
+}
+
+//  --------------------------------------------------------------------------
+//  Destroy the value
+
+void
+zmsnmp_value_destroy (zmsnmp_value_t **self_p)
+{
+    if (!self_p || !*self_p) return;
+    zmsnmp_value_t *self = *self_p;
+    free (self->string);
+    free (self);
+    *self_p = NULL;
+}
+
+//  --------------------------------------------------------------------------
+//  freefn for zhash/zlist
+
+void
+zmsnmp_value_freefn (void *self)
+{
+    zmsnmp_value_t *value = (zmsnmp_value_t *) self;
+    zmsnmp_value_destroy (&value);
+}
+
+//  --------------------------------------------------------------------------
+//  Copy the value
+
+zmsnmp_value_t *
+zmsnmp_value_dup (const zmsnmp_value_t *self)
+{
+    if (!self) return NULL;
+    zmsnmp_value_t *copy;
+    if (self->string)
+        copy = zmsnmp_value_new_string (self->type, self->string, self->size);
+    else {
+        copy = zmsnmp_value_new_integer (self->type, self->integer);
+        copy->counter64 = self->counter64;
+    }
+    return copy;
+}
+
+//  --------------------------------------------------------------------------
+//  Returns true if value is a number
+
+bool
+zmsnmp_value_is_number (const zmsnmp_value_t *self)
+{
+    if (!self) return false;
+    switch (self->type) {
+        case ZMSNMP_TYPE_INTEGER:
+        case ZMSNMP_TYPE_COUNTER32:
+        case ZMSNMP_TYPE_GAUGE32:
+        case ZMSNMP_TYPE_TIMETICKS:
+        case ZMSNMP_TYPE_COUNTER64:
+            return true;
+        default:
+            return false;
+    }
+}
+
+//  --------------------------------------------------------------------------
+//  Returns true if value is SNMP v2c exception (noSuchObject,
+//  noSuchInstance or endOfMibView)
+
+bool
+zmsnmp_value_is_exception (const zmsnmp_value_t *self)
+{
+    if (!self || self->type != ZMSNMP_TYPE_OTHER || !self->string) return false;
+    return streq (self->string, ZMSNMP_NOSUCHOBJECT)
+        || streq (self->string, ZMSNMP_NOSUCHINSTANCE)
+        || streq (self->string, ZMSNMP_ENDOFMIBVIEW);
+}
+
+//  --------------------------------------------------------------------------
+//  Numeric value
+
+double
+zmsnmp_value_number (const zmsnmp_value_t *self)
+{
+    if (!zmsnmp_value_is_number (self)) return 0;
+    if (self->type == ZMSNMP_TYPE_COUNTER64) return (double) self->counter64;
+    return (double) self->integer;
+}
+
+//  --------------------------------------------------------------------------
+//  Value as string
+
+char *
+zmsnmp_value_str (const zmsnmp_value_t *self)
+{
+    if (!self) return NULL;
+    if (self->type == ZMSNMP_TYPE_COUNTER64)
+        return zsys_sprintf ("%" PRIu64, self->counter64);
+    if (zmsnmp_value_is_number (self))
+        return zsys_sprintf ("%" PRIi64, self->integer);
+    return strdup (self->string ? self->string : "");
+}
+
+//  --------------------------------------------------------------------------
+//  Name of the value type
+
+const char *
+zmsnmp_value_type_name (const zmsnmp_value_t *self)
+{
+    if (!self) return NULL;
+    switch (self->type) {
+        case ZMSNMP_TYPE_INTEGER:     return "INTEGER";
+        case ZMSNMP_TYPE_COUNTER32:   return "Counter32";
+        case ZMSNMP_TYPE_GAUGE32:     return "Gauge32";
+        case ZMSNMP_TYPE_TIMETICKS:   return "Timeticks";
+        case ZMSNMP_TYPE_COUNTER64:   return "Counter64";
+        case ZMSNMP_TYPE_OCTETSTRING: return "OCTET STRING";
+        case ZMSNMP_TYPE_OID:         return "OID";
+        case ZMSNMP_TYPE_IPADDRESS:   return "IpAddress";
+        default:                      return "OTHER";
+    }
+}
+
+//  --------------------------------------------------------------------------
+//  Converts net-snmp varbind into value without printing numbers to string
+
+zmsnmp_value_t *
+zmsnmp_value_from_varbind (const struct variable_list *variable)
+{
+    if (!variable) return NULL;
+    switch (variable->type) {
+        case ASN_INTEGER:
+            return zmsnmp_value_new_integer (ZMSNMP_TYPE_INTEGER, *variable->val.integer);
+        case ASN_COUNTER:
+            return zmsnmp_value_new_integer (ZMSNMP_TYPE_COUNTER32, (uint32_t) *variable->val.integer);
+        case ASN_GAUGE:
+            return zmsnmp_value_new_integer (ZMSNMP_TYPE_GAUGE32, (uint32_t) *variable->val.integer);
+        case ASN_TIMETICKS:
+            return zmsnmp_value_new_integer (ZMSNMP_TYPE_TIMETICKS, (uint32_t) *variable->val.integer);
+        case ASN_COUNTER64:
+            return zmsnmp_value_new_counter64 (
+                ((uint64_t) variable->val.counter64->high << 32) | (uint32_t) variable->val.counter64->low);
+        case ASN_OCTET_STR:
+            return zmsnmp_value_new_string (ZMSNMP_TYPE_OCTETSTRING, (const char *) variable->val.string, variable->val_len);
+        case ASN_OBJECT_ID: {
+            char buffer [1024];
+            int len = s_format_oid (variable->val.objid, variable->val_len / sizeof (myoid), buffer, sizeof (buffer));
+            if (len < 0) return NULL;
+            return zmsnmp_value_new_string (ZMSNMP_TYPE_OID, buffer, len);
+        }
+        case ASN_IPADDRESS: {
+            if (variable->val_len != 4) break;
+            char buffer [16];
+            const unsigned char *ip = variable->val.string;
+            int len = snprintf (buffer, sizeof (buffer), "%u.%u.%u.%u", ip [0], ip [1], ip [2], ip [3]);
+            return zmsnmp_value_new_string (ZMSNMP_TYPE_IPADDRESS, buffer, len);
+        }
+        default:
+            break;
+    }
+    char *printed = var_to_sring (variable);
+    if (!printed) return NULL;
+    zmsnmp_value_t *value = zmsnmp_value_new_string (ZMSNMP_TYPE_OTHER, printed, strlen (printed));
+    free (printed);
+    return value;
+}
+
+//  --------------------------------------------------------------------------
+//  Completion of synchronous request, called by the thread running the
+//  shared transport. Received lists are taken over by the request.
+
+static void
+s_sync_complete (int status, zlist_t *oids, zlist_t *values, void *arg)
+{
+    sync_request_t *request = (sync_request_t *) arg;
+    request->status = status;
+    request->errstat = snmp_transport_error (s_sync_transport, &request->errindex);
+    request->elapsed = snmp_transport_elapsed (s_sync_transport);
+    if (status == ZMSNMP_OK) {
+        request->result_oids = zlist_new ();
+        request->result_values = zlist_new ();
+        assert (request->result_oids && request->result_values);
+        char *oid = (char *) zlist_pop (oids);
+        while (oid) {
+            zlist_append (request->result_oids, oid);
+            zlist_freefn (request->result_oids, oid, free, true);
+            oid = (char *) zlist_pop (oids);
+        }
+        zmsnmp_value_t *value = (zmsnmp_value_t *) zlist_pop (values);
+        while (value) {
+            zlist_append (request->result_values, value);
+            zlist_freefn (request->result_values, value, zmsnmp_value_freefn, true);
+            value = (zmsnmp_value_t *) zlist_pop (values);
+        }
+    }
+    zlist_append (s_sync_completed, request);
+}
+
+//  --------------------------------------------------------------------------
+//  Send requests queued by all threads, sync mutex must be locked
+
+static void
+s_sync_flush (void)
+{
+    sync_request_t *request = (sync_request_t *) zlist_pop (s_sync_queue);
+    while (request) {
+        int rc;
+        if (request->command == ZMSNMP_GETBULK)
+            rc = snmp_transport_send_bulk (s_sync_transport, request->host, request->credentials, request->oids,
+                request->repetitions, request->timeout, request->retries, s_sync_complete, request);
+        else
+            rc = snmp_transport_send (s_sync_transport, request->host, request->credentials, request->command,
+                request->oids, request->timeout, request->retries, s_sync_complete, request);
+        if (rc != 0) {
+            request->status = ZMSNMP_ERROR;
+            zlist_append (s_sync_completed, request);
+        }
+        request = (sync_request_t *) zlist_pop (s_sync_queue);
+    }
+}
+
+//  --------------------------------------------------------------------------
+//  Send request through the shared transport and wait for its completion.
+//  Returns ZMSNMP_OK, ZMSNMP_TIMEOUT or ZMSNMP_ERROR.
+
+static int
+s_sync_request (sync_request_t *request)
+{
+    pthread_mutex_lock (&s_sync_mutex);
+    if (!s_sync_transport) {
+        s_sync_transport = snmp_transport_new (0);
+        s_sync_queue = zlist_new ();
+        s_sync_completed = zlist_new ();
+        assert (s_sync_transport && s_sync_queue && s_sync_completed);
+    }
+    ++s_sync_requests;
+    ++s_sync_waiting;
+    zlist_append (s_sync_queue, request);
+    if (s_sync_running)
+        snmp_transport_wake (s_sync_transport);
+
+    while (!request->done) {
+        if (s_sync_running) {
+            pthread_cond_wait (&s_sync_cond, &s_sync_mutex);
+            continue;
+        }
+        // nobody runs the transport, this thread does it until its own
+        // request completes, then another waiting thread takes over
+        s_sync_running = true;
+        while (!request->done) {
+            s_sync_flush ();
+            pthread_mutex_unlock (&s_sync_mutex);
+            snmp_transport_run (s_sync_transport, -1);
+            pthread_mutex_lock (&s_sync_mutex);
+            if (zlist_size (s_sync_completed)) {
+                sync_request_t *completed = (sync_request_t *) zlist_pop (s_sync_completed);
+                while (completed) {
+                    completed->done = true;
+                    completed = (sync_request_t *) zlist_pop (s_sync_completed);
+                }
+                pthread_cond_broadcast (&s_sync_cond);
+            }
+        }
+        s_sync_running = false;
+        pthread_cond_broadcast (&s_sync_cond);
+    }
+    --s_sync_waiting;
+    pthread_mutex_unlock (&s_sync_mutex);
+    return request->status;
+}
+
+//  --------------------------------------------------------------------------
+//  Timeout (ms) and retries of the next request to the host
+
+static void
+s_rtt_params (const char *host, int64_t *timeout, int *retries)
+{
+    *timeout = ZMSNMP_RTO_INITIAL;
+    *retries = ZMSNMP_RETRIES;
+    pthread_mutex_lock (&s_rtt_mutex);
+    host_rtt_t *rtt = s_rtt_table ? (host_rtt_t *) zhash_lookup (s_rtt_table, host) : NULL;
+    if (rtt) {
+        *timeout = rtt->rto;
+        if (rtt->failures) *retries = 0;
+    }
+    pthread_mutex_unlock (&s_rtt_mutex);
+}
+
+//  --------------------------------------------------------------------------
+//  Update round trip estimation of the host. Responses which came after
+//  retransmission are ambiguous (Karn), they only back the timeout off.
+
+static void
+s_rtt_update (const char *host, bool responded, int64_t elapsed, int64_t timeout)
+{
+    pthread_mutex_lock (&s_rtt_mutex);
+    if (!s_rtt_table) {
+        s_rtt_table = zhash_new ();
+        assert (s_rtt_table);
+    }
+    host_rtt_t *rtt = (host_rtt_t *) zhash_lookup (s_rtt_table, host);
+    if (!rtt) {
+        if (zhash_size (s_rtt_table) >= ZMSNMP_RTT_HOSTS_MAX) {
+            pthread_mutex_unlock (&s_rtt_mutex);
+            return;
+        }
+        rtt = (host_rtt_t *) zmalloc (sizeof (host_rtt_t));
+        assert (rtt);
+        rtt->rto = ZMSNMP_RTO_INITIAL;
+        zhash_insert (s_rtt_table, host, rtt);
+        zhash_freefn (s_rtt_table, host, free);
+    }
+    if (!responded) {
+        ++rtt->timeouts;
+        ++rtt->failures;
+    }
+    else
+    if (elapsed >= timeout) {
+        rtt->failures = 0;
+        rtt->rto = rtt->rto * 2 < ZMSNMP_RTO_MAX ? rtt->rto * 2 : ZMSNMP_RTO_MAX;
+    }
+    else {
+        rtt->failures = 0;
+        if (rtt->samples == 0) {
+            rtt->srtt = elapsed;
+            rtt->rttvar = elapsed / 2.0;
+        }
+        else {
+            double delta = rtt->srtt > elapsed ? rtt->srtt - elapsed : elapsed - rtt->srtt;
+            rtt->rttvar = 0.75 * rtt->rttvar + 0.25 * delta;
+            rtt->srtt = 0.875 * rtt->srtt + 0.125 * elapsed;
+        }
+        ++rtt->samples;
+        rtt->rto = (int64_t) (rtt->srtt + (4 * rtt->rttvar > 1 ? 4 * rtt->rttvar : 1));
+        if (rtt->rto < ZMSNMP_RTO_MIN) rtt->rto = ZMSNMP_RTO_MIN;
+        if (rtt->rto > ZMSNMP_RTO_MAX) rtt->rto = ZMSNMP_RTO_MAX;
+    }
+    pthread_mutex_unlock (&s_rtt_mutex);
+}
+
+//  --------------------------------------------------------------------------
+//  Send request and wait for response with timeout and retries estimated
+//  for the host. Response with error status (errstat of the request) is
+//  returned as ZMSNMP_ERROR. Request must be destroyed afterwards.
+
+static int
+s_request (sync_request_t *request, const char *host, const snmp_credentials_t *credentials, int command, zlist_t *oids, int max_repetitions)
+{
+    int64_t timeout;
+    int retries;
+    s_rtt_params (host, &timeout, &retries);
+    memset (request, 0, sizeof (sync_request_t));
+    // time left to the deadline of the thread cuts retries, then timeout
+    bool cut = false;
+    if (s_deadline) {
+        int64_t left = s_deadline - zclock_mono ();
+        if (left <= 0)
+            return ZMSNMP_TIMEOUT;
+        while (retries > 0 && timeout * (retries + 1) > left) {
+            --retries;
+            cut = true;
+        }
+        if (timeout > left) {
+            timeout = left;
+            cut = true;
+        }
+    }
+    request->host = host;
+    request->credentials = credentials;
+    request->command = command;
+    request->oids = oids;
+    request->repetitions = max_repetitions;
+    request->timeout = (int) timeout;
+    request->retries = retries;
+
+    int status = s_sync_request (request);
+    // error without error status was not caused by the agent, cut
+    // request which timed out says nothing about the host
+    if ((status != ZMSNMP_ERROR || request->errstat) && !(cut && status == ZMSNMP_TIMEOUT))
+        s_rtt_update (host, status != ZMSNMP_TIMEOUT, request->elapsed, timeout);
+    return status;
+}
+
+//  --------------------------------------------------------------------------
+//  Set deadline of synchronous requests of the calling thread
+
+void
+zmsnmp_set_deadline (int64_t deadline)
+{
+    s_deadline = deadline;
+}
+
+//  --------------------------------------------------------------------------
+//  Free received oids and values of the request
+
+static void
+s_request_destroy (sync_request_t *request)
+{
+    zlist_destroy (&request->result_oids);
+    zlist_destroy (&request->result_values);
+}
+
+//  --------------------------------------------------------------------------
+//  Limit requests to the host to rate per second with bursts up to burst
+//  requests. Rate 0 removes the limit.
+
+void
+zmsnmp_set_rate (const char *host, double rate, int burst)
+{
+    if (!host) return;
+    pthread_mutex_lock (&s_limit_mutex);
+    if (rate <= 0) {
+        if (s_rate_table) zhash_delete (s_rate_table, host);
+        pthread_mutex_unlock (&s_limit_mutex);
+        return;
+    }
+    if (!s_rate_table) {
+        s_rate_table = zhash_new ();
+        assert (s_rate_table);
+    }
+    host_rate_t *limit = (host_rate_t *) zhash_lookup (s_rate_table, host);
+    if (!limit) {
+        limit = (host_rate_t *) zmalloc (sizeof (host_rate_t));
+        assert (limit);
+        limit->tokens = burst > 1 ? burst : 1;
+        limit->updated = zclock_mono ();
+        zhash_insert (s_rate_table, host, limit);
+        zhash_freefn (s_rate_table, host, free);
+    }
+    limit->rate = rate;
+    limit->burst = burst > 1 ? burst : 1;
+    if (limit->tokens > limit->burst) limit->tokens = limit->burst;
+    pthread_mutex_unlock (&s_limit_mutex);
+}
+
+//  --------------------------------------------------------------------------
+//  Limit number of requests in flight of the whole process, 0 = unlimited
+
+void
+zmsnmp_set_inflight (size_t max)
+{
+    pthread_mutex_lock (&s_limit_mutex);
+    s_inflight_max = max;
+    s_inflight_peak = s_inflight;
+    pthread_mutex_unlock (&s_limit_mutex);
+}
+
+//  --------------------------------------------------------------------------
+//  Admit request to the host which is about to be sent
+
+int64_t
+zmsnmp_limit_acquire (const char *host, int64_t *held)
+{
+    if (!host || !held) return 0;
+    int64_t wait = 0;
+    pthread_mutex_lock (&s_limit_mutex);
+    int64_t now = zclock_mono ();
+    if (s_inflight_max && s_inflight >= s_inflight_max) {
+        if (!*held) ++s_inflight_delayed;
+        wait = -1;
+    }
+    else {
+        host_rate_t *limit = s_rate_table ? (host_rate_t *) zhash_lookup (s_rate_table, host) : NULL;
+        if (limit) {
+            limit->tokens += (now - limit->updated) * limit->rate / 1000.0;
+            if (limit->tokens > limit->burst) limit->tokens = limit->burst;
+            limit->updated = now;
+            if (limit->tokens < 1) {
+                if (!*held) ++s_rate_delayed;
+                wait = (int64_t) ((1 - limit->tokens) * 1000.0 / limit->rate) + 1;
+            }
+            else
+                limit->tokens -= 1;
+        }
+    }
+    if (wait) {
+        if (!*held) *held = now;
+    }
+    else {
+        if (*held) s_rate_wait += now - *held;
+        if (++s_inflight > s_inflight_peak) s_inflight_peak = s_inflight;
+    }
+    pthread_mutex_unlock (&s_limit_mutex);
+    return wait;
+}
+
+//  --------------------------------------------------------------------------
+//  Admitted request completed
+
+void
+zmsnmp_limit_release (void)
+{
+    pthread_mutex_lock (&s_limit_mutex);
+    if (s_inflight) --s_inflight;
+    pthread_mutex_unlock (&s_limit_mutex);
+}
 
-    snmp_sess_init (&session);
-    session.peername = (char *)host;
-    session.version = snmp_version_to_enum (credentials->version);
-    session.community = (unsigned char *) credentials->community;
-    session.community_len = strlen (credentials->community);
+//  --------------------------------------------------------------------------
+//  Add rate and in flight limit counters to the message as name/value
+//  frame pairs
 
-    ss = snmp_open (&session);
-    if (!ss) return NULL;
+void
+zmsnmp_limit_stats (zmsg_t *msg)
+{
+    if (!msg) return;
 
-    pdu = snmp_pdu_create (SNMP_MSG_GET);
-    read_objid (oid, anOID, &anOID_len);
-    snmp_add_null_var(pdu, anOID, anOID_len);
+    pthread_mutex_lock (&s_limit_mutex);
+    zmsg_addstr (msg, "rate-limited-hosts");
+    zmsg_addstrf (msg, "%zu", s_rate_table ? zhash_size (s_rate_table) : 0);
+    zmsg_addstr (msg, "rate-delayed");
+    zmsg_addstrf (msg, "%" PRIu64, s_rate_delayed);
+    zmsg_addstr (msg, "rate-wait");
+    zmsg_addstrf (msg, "%" PRIi64, s_rate_wait);
+    zmsg_addstr (msg, "inflight");
+    zmsg_addstrf (msg, "%zu", s_inflight);
+    zmsg_addstr (msg, "inflight-peak");
+    zmsg_addstrf (msg, "%zu", s_inflight_peak);
+    zmsg_addstr (msg, "inflight-delayed");
+    zmsg_addstrf (msg, "%" PRIu64, s_inflight_delayed);
+    pthread_mutex_unlock (&s_limit_mutex);
+}
 
-    status = snmp_synch_response (ss, pdu, &response);
+//  --------------------------------------------------------------------------
+//  Close sockets of synchronous requests unless some are in flight
 
-    if (status == STAT_SUCCESS && response->errstat == SNMP_ERR_NOERROR) {
-        vars = response->variables;
-        result = var_to_sring (vars);
+void
+zmsnmp_cache_clear (void)
+{
+    // sockets are opened again by the next request
+    pthread_mutex_lock (&s_sync_mutex);
+    if (s_sync_transport && s_sync_waiting == 0) {
+        snmp_transport_destroy (&s_sync_transport);
+        zlist_destroy (&s_sync_queue);
+        zlist_destroy (&s_sync_completed);
     }
-    if (response) snmp_free_pdu (response);
-    snmp_close(ss);
+    pthread_mutex_unlock (&s_sync_mutex);
+}
+
+//  --------------------------------------------------------------------------
+//  Close sockets, drop interned oids, round trip estimations and rate
+//  limits
+
+void
+zmsnmp_reset (void)
+{
+    zmsnmp_cache_clear ();
+
+    pthread_mutex_lock (&s_oid_mutex);
+    zhash_destroy (&s_oid_table);
+    pthread_mutex_unlock (&s_oid_mutex);
+
+    pthread_mutex_lock (&s_rtt_mutex);
+    zhash_destroy (&s_rtt_table);
+    pthread_mutex_unlock (&s_rtt_mutex);
+
+    pthread_mutex_lock (&s_limit_mutex);
+    zhash_destroy (&s_rate_table);
+    pthread_mutex_unlock (&s_limit_mutex);
+}
+
+//  --------------------------------------------------------------------------
+//  Add counters of synchronous requests to the message as name/value frame
+//  pairs
+
+void
+zmsnmp_transport_stats (zmsg_t *msg)
+{
+    if (!msg) return;
+
+    pthread_mutex_lock (&s_sync_mutex);
+    zmsg_addstr (msg, "sockets");
+    zmsg_addstrf (msg, "%zu", snmp_transport_sockets (s_sync_transport));
+    zmsg_addstr (msg, "requests");
+    zmsg_addstrf (msg, "%" PRIu64, s_sync_requests);
+    zmsg_addstr (msg, "requests-waiting");
+    zmsg_addstrf (msg, "%zu", s_sync_waiting);
+    pthread_mutex_unlock (&s_sync_mutex);
+}
+
+//  --------------------------------------------------------------------------
+//  Number of consecutive timeouts of the host
+
+int
+zmsnmp_host_failures (const char *host)
+{
+    if (!host) return 0;
+    pthread_mutex_lock (&s_rtt_mutex);
+    host_rtt_t *rtt = s_rtt_table ? (host_rtt_t *) zhash_lookup (s_rtt_table, host) : NULL;
+    int failures = rtt ? rtt->failures : 0;
+    pthread_mutex_unlock (&s_rtt_mutex);
+    return failures;
+}
+
+//  --------------------------------------------------------------------------
+//  Add round trip estimation to the message as name/value frame pairs
+
+void
+zmsnmp_rtt_stats (const char *host, zmsg_t *msg)
+{
+    if (!msg) return;
+
+    pthread_mutex_lock (&s_rtt_mutex);
+    if (host) {
+        host_rtt_t *rtt = s_rtt_table ? (host_rtt_t *) zhash_lookup (s_rtt_table, host) : NULL;
+        zmsg_addstr (msg, "srtt");
+        zmsg_addstrf (msg, "%.1f", rtt ? rtt->srtt : 0.0);
+        zmsg_addstr (msg, "rttvar");
+        zmsg_addstrf (msg, "%.1f", rtt ? rtt->rttvar : 0.0);
+        zmsg_addstr (msg, "rto");
+        zmsg_addstrf (msg, "%" PRIi64, rtt ? rtt->rto : (int64_t) ZMSNMP_RTO_INITIAL);
+        zmsg_addstr (msg, "rtt-samples");
+        zmsg_addstrf (msg, "%" PRIu64, rtt ? rtt->samples : 0);
+        zmsg_addstr (msg, "rtt-timeouts");
+        zmsg_addstrf (msg, "%" PRIu64, rtt ? rtt->timeouts : 0);
+    }
+    else {
+        uint64_t timeouts = 0;
+        size_t failing = 0;
+        host_rtt_t *rtt = s_rtt_table ? (host_rtt_t *) zhash_first (s_rtt_table) : NULL;
+        while (rtt) {
+            timeouts += rtt->timeouts;
+            if (rtt->failures) ++failing;
+            rtt = (host_rtt_t *) zhash_next (s_rtt_table);
+        }
+        zmsg_addstr (msg, "rtt-hosts");
+        zmsg_addstrf (msg, "%zu", s_rtt_table ? zhash_size (s_rtt_table) : 0);
+        zmsg_addstr (msg, "rtt-failing");
+        zmsg_addstrf (msg, "%zu", failing);
+        zmsg_addstr (msg, "rtt-timeouts");
+        zmsg_addstrf (msg, "%" PRIu64, timeouts);
+    }
+    pthread_mutex_unlock (&s_rtt_mutex);
+}
+
+//  --------------------------------------------------------------------------
+//  snmp get version 1 and 2c
+
+zmsnmp_value_t *zmsnmp_get_v12 (const char* host, const char *oid, const snmp_credentials_t* credentials)
+{
+    zlist_t *oids = zlist_new ();
+    zlist_append (oids, (void *) oid);
+    sync_request_t request;
+    int status = s_request (&request, host, credentials, ZMSNMP_GET, oids, 0);
+    zlist_destroy (&oids);
+
+    zmsnmp_value_t *result = NULL;
+    if (status == ZMSNMP_OK)
+        result = (zmsnmp_value_t *) zlist_pop (request.result_values);
+    s_request_destroy (&request);
     return result;
 }
 
 //  --------------------------------------------------------------------------
 //  snmp get-next version 1 and 2c
 
-void zmsnmp_getnext_v12 (const char* host, const char *oid, const snmp_credentials_t* credentials, char **resultoid, char **resultvalue)
+void zmsnmp_getnext_v12 (const char* host, const char *oid, const snmp_credentials_t* credentials, char **resultoid, zmsnmp_value_t **resultvalue)
 {
-    struct snmp_session session, *ss;
-    struct snmp_pdu *pdu;
-    struct snmp_pdu *response;
-    unsigned long int anOID[MAX_OID_LEN];
-    size_t anOID_len = MAX_OID_LEN;
-    char *nextoid = NULL;
-    char *nextvalue = NULL;
-    struct variable_list *vars;
-    int status;
-
     *resultoid = NULL;
     *resultvalue = NULL;
 
-    snmp_sess_init (&session);
-    session.peername = (char *)host;
-    session.version = snmp_version_to_enum (credentials->version);
-    session.community = (unsigned char *) credentials->community;
-    session.community_len = strlen (credentials->community);
+    zlist_t *oids = zlist_new ();
+    zlist_append (oids, (void *) oid);
+    sync_request_t request;
+    int status = s_request (&request, host, credentials, ZMSNMP_GETNEXT, oids, 0);
+    zlist_destroy (&oids);
 
-    ss = snmp_open (&session);
-    if (!ss) return;
+    if (status == ZMSNMP_OK) {
+        // we should have just one variable
+        char *nextoid = (char *) zlist_pop (request.result_oids);
+        zmsnmp_value_t *nextvalue = (zmsnmp_value_t *) zlist_pop (request.result_values);
+        if (nextoid && nextvalue) {
+            *resultoid = nextoid;
+            *resultvalue = nextvalue;
+        }
+        else {
+            zstr_free (&nextoid);
+            zmsnmp_value_destroy (&nextvalue);
+        }
+    }
+    s_request_destroy (&request);
+}
 
-    pdu = snmp_pdu_create (SNMP_MSG_GETNEXT);
-    read_objid (oid, anOID, &anOID_len);
-    snmp_add_null_var(pdu, anOID, anOID_len);
+//  --------------------------------------------------------------------------
+//  snmp get of many oids version 1 and 2c. Oids are sent in as few PDUs as
+//  possible, PDU is split when agent responds tooBig. Version 1 agents fail
+//  whole PDU when one oid does not exist, such oid is removed and the rest
+//  is asked again.
 
-    status = snmp_synch_response (ss, pdu, &response);
+typedef struct {
+    const char *oid;
+    bool skip;
+} many_item_t;
 
-    if (status == STAT_SUCCESS && response->errstat == SNMP_ERR_NOERROR) {
+zhash_t *zmsnmp_get_many_v12 (const char* host, zlist_t *oids, const snmp_credentials_t* credentials)
+{
+    size_t count = zlist_size (oids);
+    many_item_t *items = (many_item_t *) zmalloc (count * sizeof (many_item_t));
+    assert (items);
+    size_t n = 0;
+    const char *oid = (const char *) zlist_first (oids);
+    while (oid) {
+        myoid name [MAX_OID_LEN];
+        size_t len = MAX_OID_LEN;
+        if (s_read_objid (oid, name, &len)) items [n++].oid = oid;
+        oid = (const char *) zlist_next (oids);
+    }
+    zhash_t *result = zhash_new ();
+    assert (result);
 
-        vars = response->variables; // we should have just one variable
-        nextoid = oid_to_sring (vars->name, vars->name_length);
-        nextvalue = var_to_sring (vars);
+    // stack of ranges [start, end) to be asked
+    size_t *ranges = (size_t *) zmalloc (2 * (n + 1) * sizeof (size_t));
+    assert (ranges);
+    size_t depth = 0;
+    for (size_t start = 0; start < n; start += ZMSNMP_MAX_VARBINDS) {
+        ranges [depth++] = start;
+        ranges [depth++] = start + ZMSNMP_MAX_VARBINDS < n ? start + ZMSNMP_MAX_VARBINDS : n;
     }
-    if (nextoid && nextvalue) {
-        *resultoid = nextoid;
-        *resultvalue = nextvalue;
-    } else {
-        if (nextoid) free (nextoid);
-        if (nextvalue) free (nextvalue);
-        *resultoid = NULL;
-        *resultvalue = NULL;
+    bool failed = false;
+    while (depth && !failed) {
+        size_t end = ranges [--depth];
+        size_t start = ranges [--depth];
+
+        zlist_t *sent_oids = zlist_new ();
+        size_t sent [ZMSNMP_MAX_VARBINDS];
+        size_t nsent = 0;
+        for (size_t i = start; i < end; i++) {
+            if (items [i].skip) continue;
+            zlist_append (sent_oids, (void *) items [i].oid);
+            sent [nsent++] = i;
+        }
+        if (!nsent) {
+            zlist_destroy (&sent_oids);
+            continue;
+        }
+
+        sync_request_t request;
+        int status = s_request (&request, host, credentials, ZMSNMP_GET, sent_oids, 0);
+        zlist_destroy (&sent_oids);
+        if (status == ZMSNMP_OK) {
+            char *name = (char *) zlist_pop (request.result_oids);
+            zmsnmp_value_t *value = (zmsnmp_value_t *) zlist_pop (request.result_values);
+            while (name && value) {
+                if (zmsnmp_value_is_exception (value))
+                    zmsnmp_value_destroy (&value);
+                else {
+                    zhash_update (result, name, value);
+                    zhash_freefn (result, name, zmsnmp_value_freefn);
+                }
+                zstr_free (&name);
+                name = (char *) zlist_pop (request.result_oids);
+                value = (zmsnmp_value_t *) zlist_pop (request.result_values);
+            }
+            zstr_free (&name);
+            zmsnmp_value_destroy (&value);
+        }
+        else
+        if (request.errstat == SNMP_ERR_TOOBIG && nsent > 1) {
+            size_t middle = start + (end - start) / 2;
+            ranges [depth++] = middle;
+            ranges [depth++] = end;
+            ranges [depth++] = start;
+            ranges [depth++] = middle;
+        }
+        else
+        if (request.errstat == SNMP_ERR_NOSUCHNAME && request.errindex > 0 && (size_t) request.errindex <= nsent) {
+            items [sent [request.errindex - 1]].skip = true;
+            ranges [depth++] = start;
+            ranges [depth++] = end;
+        }
+        else
+        if (!request.errstat)
+            failed = true;
+        s_request_destroy (&request);
     }
-    if (response) snmp_free_pdu (response);
-    snmp_close(ss);
+    free (ranges);
+    free (items);
+    if (failed && zhash_size (result) == 0)
+        zhash_destroy (&result);
+    return result;
+}
+
+//  --------------------------------------------------------------------------
+//  snmp walk of subtree version 1 (GETNEXT) and 2c (GETBULK)
+
+zhash_t *zmsnmp_walk_v12 (const char* host, const char *oid, const snmp_credentials_t* credentials, int max_repetitions)
+{
+    myoid root [MAX_OID_LEN];
+    size_t rootlen = MAX_OID_LEN;
+    if (!s_read_objid (oid, root, &rootlen)) return NULL;
+    // oid of the last row, numeric like the received ones
+    char current [1024];
+    if (s_format_oid (root, rootlen, current, sizeof (current)) < 0) return NULL;
+    myoid currentname [MAX_OID_LEN];
+    size_t currentlen = rootlen;
+    memcpy (currentname, root, rootlen * sizeof (myoid));
+
+    zhash_t *result = zhash_new ();
+    assert (result);
+    zlist_t *oids = zlist_new ();
+    assert (oids);
+    bool failed = false;
+    bool done = false;
+    while (!done && zhash_size (result) < ZMSNMP_WALK_MAX) {
+        zlist_purge (oids);
+        zlist_append (oids, current);
+        sync_request_t request;
+        int status;
+        if (credentials->version == 1)
+            status = s_request (&request, host, credentials, ZMSNMP_GETNEXT, oids, 0);
+        else
+            status = s_request (&request, host, credentials, ZMSNMP_GETBULK, oids, max_repetitions);
+        if (status != ZMSNMP_OK) {
+            if (request.errstat == SNMP_ERR_TOOBIG && max_repetitions > 1) {
+                max_repetitions /= 2;
+                s_request_destroy (&request);
+                continue;
+            }
+            // v1 agent reports end of MIB as noSuchName
+            failed = !request.errstat;
+            s_request_destroy (&request);
+            break;
+        }
+        done = zlist_size (request.result_oids) == 0;
+        char *name = (char *) zlist_pop (request.result_oids);
+        zmsnmp_value_t *value = (zmsnmp_value_t *) zlist_pop (request.result_values);
+        while (name && value && !done) {
+            myoid received [MAX_OID_LEN];
+            size_t receivedlen = MAX_OID_LEN;
+            if (zmsnmp_value_is_exception (value)
+            ||  !s_parse_numeric (name, received, &receivedlen)
+            ||  netsnmp_oid_is_subtree (root, rootlen, received, receivedlen) != 0
+            ||  snmp_oid_compare (received, receivedlen, currentname, currentlen) <= 0
+            ||  strlen (name) >= sizeof (current)) {
+                // left the subtree (or agent does not move forward)
+                done = true;
+                break;
+            }
+            strcpy (current, name);
+            memcpy (currentname, received, receivedlen * sizeof (myoid));
+            currentlen = receivedlen;
+            zhash_update (result, name, value);
+            zhash_freefn (result, name, zmsnmp_value_freefn);
+            zstr_free (&name);
+            name = (char *) zlist_pop (request.result_oids);
+            value = (zmsnmp_value_t *) zlist_pop (request.result_values);
+        }
+        zstr_free (&name);
+        zmsnmp_value_destroy (&value);
+        s_request_destroy (&request);
+    }
+    zlist_destroy (&oids);
+    if (failed)
+        zhash_destroy (&result);
+    return result;
+}
+
+//  --------------------------------------------------------------------------
+//  Normalize oid string to numeric form used in results (.1.3.6...)
+
+size_t zmsnmp_oid_parse (const char *oid, unsigned long *name, size_t size)
+{
+    if (!oid || !name) return 0;
+    size_t len = size;
+    if (!s_read_objid (oid, (myoid *) name, &len)) return 0;
+    return len;
+}
+
+//  --------------------------------------------------------------------------
+//  Format oid to numeric string
+
+int zmsnmp_oid_format (const unsigned long *name, size_t len, char *buffer, size_t size)
+{
+    if (!name || !buffer || size == 0) return -1;
+    return s_format_oid ((const myoid *) name, len, buffer, size);
+}
+
+//  --------------------------------------------------------------------------
+//  Normalize oid to numeric string
+
+char *zmsnmp_oid_normalize (const char *oid)
+{
+    if (!oid) return NULL;
+    myoid anOID [MAX_OID_LEN];
+    size_t anOID_len = MAX_OID_LEN;
+    if (!s_read_objid (oid, anOID, &anOID_len)) return NULL;
+    return oid_to_sring (anOID, anOID_len);
 }
 
 //  --------------------------------------------------------------------------
 //  snmp get function
 
-char *zmsnmp_get (const char* host, const char *oid, const snmp_credentials_t *credentials)
+zmsnmp_value_t *zmsnmp_get (const char* host, const char *oid, const snmp_credentials_t *credentials)
 {
     if (!host || !oid || !credentials) return NULL;
     if (credentials->version == 3) {
@@ -193,10 +1243,45 @@ char *zmsnmp_get (const char* host, const char *oid, const snmp_credentials_t *c
     return zmsnmp_get_v12 (host, oid, credentials);
 }
 
+//  --------------------------------------------------------------------------
+//  snmp get of many oids
+
+zhash_t *zmsnmp_get_many (const char* host, zlist_t *oids, const snmp_credentials_t *credentials)
+{
+    if (!host || !oids || !credentials) return NULL;
+    if (credentials->version == 3) {
+        // Not supported yet
+        // TODO: SNMPv3 support
+        return NULL;
+    }
+    if (!zlist_size (oids)) {
+        zhash_t *result = zhash_new ();
+        assert (result);
+        return result;
+    }
+    return zmsnmp_get_many_v12 (host, oids, credentials);
+}
+
+//  --------------------------------------------------------------------------
+//  snmp walk function
+
+zhash_t *zmsnmp_walk (const char* host, const char *oid, const snmp_credentials_t *credentials, int max_repetitions)
+{
+    if (!host || !oid || !credentials) return NULL;
+    if (credentials->version == 3) {
+        // Not supported yet
+        // TODO: SNMPv3 support
+        return NULL;
+    }
+    if (max_repetitions <= 0) max_repetitions = ZMSNMP_MAX_REPETITIONS;
+    if (max_repetitions > ZMSNMP_MAX_VARBINDS) max_repetitions = ZMSNMP_MAX_VARBINDS;
+    return zmsnmp_walk_v12 (host, oid, credentials, max_repetitions);
+}
+
 //  --------------------------------------------------------------------------
 //  snmp getnext function
 
-void zmsnmp_getnext (const char* host, const char *oid, const snmp_credentials_t *credentials, char **resultoid, char **resultvalue)
+void zmsnmp_getnext (const char* host, const char *oid, const snmp_credentials_t *credentials, char **resultoid, zmsnmp_value_t **resultvalue)
 {
     if (!host || !oid || !credentials || !resultoid || !resultvalue) {
         if (resultoid) *resultoid = NULL;
@@ -211,11 +1296,424 @@ void zmsnmp_getnext (const char* host, const char *oid, const snmp_credentials_t
     zmsnmp_getnext_v12 (host, oid, credentials, resultoid, resultvalue);
 }
 
+//  --------------------------------------------------------------------------
+//  Create a new asynchronous engine
+
+zmsnmp_engine_t *
+zmsnmp_engine_new (void)
+{
+    zmsnmp_engine_t *self = (zmsnmp_engine_t *) zmalloc (sizeof (zmsnmp_engine_t));
+    assert (self);
+    self->transport = snmp_transport_new (0);
+    assert (self->transport);
+    self->timeout = SNMP_TRANSPORT_TIMEOUT;
+    self->retries = SNMP_TRANSPORT_RETRIES;
+    return self;
+}
+
+//  --------------------------------------------------------------------------
+//  Destroy the engine, callbacks of requests in flight are called with
+//  ZMSNMP_ERROR status.
+
+void
+zmsnmp_engine_destroy (zmsnmp_engine_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        zmsnmp_engine_t *self = *self_p;
+        snmp_transport_destroy (&self->transport);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+//  --------------------------------------------------------------------------
+//  Set timeout (ms) and number of retries of new requests
+
+void
+zmsnmp_engine_set_timeout (zmsnmp_engine_t *self, int timeout, int retries)
+{
+    if (!self) return;
+    self->timeout = timeout > 0 ? timeout : SNMP_TRANSPORT_TIMEOUT;
+    self->retries = retries >= 0 ? retries : SNMP_TRANSPORT_RETRIES;
+}
+
+//  --------------------------------------------------------------------------
+//  Send asynchronous request, fn is called from zmsnmp_engine_run () when
+//  the response comes or request times out. Returns 0 if request was sent,
+//  -1 otherwise (fn is not called then).
+
+int
+zmsnmp_engine_send (zmsnmp_engine_t *self, const char *host, const snmp_credentials_t *credentials, int command, zlist_t *oids, zmsnmp_fn *fn, void *arg)
+{
+    if (!self) return -1;
+    return snmp_transport_send (self->transport, host, credentials, command, oids, self->timeout, self->retries, fn, arg);
+}
+
+//  --------------------------------------------------------------------------
+//  Asynchronous get of one oid
+
+int
+zmsnmp_engine_get (zmsnmp_engine_t *self, const char *host, const char *oid, const snmp_credentials_t *credentials, zmsnmp_fn *fn, void *arg)
+{
+    if (!oid) return -1;
+    zlist_t *oids = zlist_new ();
+    zlist_append (oids, (void *) oid);
+    int result = zmsnmp_engine_send (self, host, credentials, ZMSNMP_GET, oids, fn, arg);
+    zlist_destroy (&oids);
+    return result;
+}
+
+//  --------------------------------------------------------------------------
+//  Asynchronous getnext of one oid
+
+int
+zmsnmp_engine_getnext (zmsnmp_engine_t *self, const char *host, const char *oid, const snmp_credentials_t *credentials, zmsnmp_fn *fn, void *arg)
+{
+    if (!oid) return -1;
+    zlist_t *oids = zlist_new ();
+    zlist_append (oids, (void *) oid);
+    int result = zmsnmp_engine_send (self, host, credentials, ZMSNMP_GETNEXT, oids, fn, arg);
+    zlist_destroy (&oids);
+    return result;
+}
+
+//  --------------------------------------------------------------------------
+//  Number of requests in flight
+
+size_t
+zmsnmp_engine_pending (zmsnmp_engine_t *self)
+{
+    if (!self) return 0;
+    return snmp_transport_pending (self->transport);
+}
+
+//  --------------------------------------------------------------------------
+//  Send queued requests, wait up to timeout ms for responses and call
+//  callbacks of completed requests. Returns number of completed requests.
+
+size_t
+zmsnmp_engine_run (zmsnmp_engine_t *self, int timeout)
+{
+    if (!self) return 0;
+    return snmp_transport_run (self->transport, timeout);
+}
+
 //  --------------------------------------------------------------------------
 //  Self test of this class
 
+static void
+s_test_result (int status, zlist_t *oids, zlist_t *values, void *arg)
+{
+    int *results = (int *) arg;
+    ++results [status];
+}
+
+//  Polling thread of the stress test, gets oids ending with unique numbers
+//  and reports number of wrong or missing values
+
+#define TEST_THREADS    200
+#define TEST_GETS       20
+
+static void
+s_test_poller (zsock_t *pipe, void *args)
+{
+    const char *host = (const char *) args;
+    zsock_signal (pipe, 0);
+    char *idstr = zstr_recv (pipe);
+    int id = idstr ? atoi (idstr) : 0;
+    zstr_free (&idstr);
+
+    snmp_credentials_t credentials = { 2, "public" };
+    int errors = 0;
+    for (int i = 0; i < TEST_GETS; i++) {
+        int expected = id * 1000 + i;
+        char *oid = zsys_sprintf (".1.3.6.1.4.1.99999.%i", expected);
+        zmsnmp_value_t *value = zmsnmp_get (host, oid, &credentials);
+        char *normalized = zmsnmp_oid_normalize (oid);
+        if (!value || value->type != ZMSNMP_TYPE_INTEGER || value->integer != expected)
+            ++errors;
+        if (!normalized || !streq (normalized, oid))
+            ++errors;
+        zstr_free (&normalized);
+        zmsnmp_value_destroy (&value);
+        zstr_free (&oid);
+    }
+    zstr_sendf (pipe, "%i", errors);
+
+    char *cmd = zstr_recv (pipe);
+    zstr_free (&cmd);
+}
+
 void zmsnmp_test (bool verbose)
 {
-    //@ test is empty
+    printf (" * zmsnmp: ");
+
+    //  @selftest
+    snmp_credentials_t public = { 1, "public" };
+
+    // numeric oids are parsed without MIB and formatted back the same way
+    {
+        unsigned long name [MAX_OID_LEN];
+        char buffer [256];
+        const char *oids [] = { ".1.3.6.1.2.1.1.3.0", "1.3.6.1.4.1.2021.10.1.3.1", ".1.3.6.1.2.1.31.1.1.1.6.4294967295" };
+        for (int i = 0; i < 3; i++) {
+            size_t len = zmsnmp_oid_parse (oids [i], name, MAX_OID_LEN);
+            assert (len > 0);
+            // second parse comes from intern table
+            assert (zmsnmp_oid_parse (oids [i], name, MAX_OID_LEN) == len);
+            assert (zmsnmp_oid_format (name, len, buffer, sizeof (buffer)) > 0);
+            assert (streq (oids [i][0] == '.' ? buffer : buffer + 1, oids [i]));
+        }
+        assert (zmsnmp_oid_parse ("1.3.6.1.2.1.1.3.0", name, 4) == 0);
+        size_t len = zmsnmp_oid_parse (".1.3.6.1", name, MAX_OID_LEN);
+        assert (len == 4);
+        assert (zmsnmp_oid_format (name, len, buffer, 8) == -1);
+        assert (zmsnmp_oid_format (name, len, buffer, 9) == 8);
+        assert (streq (buffer, ".1.3.6.1"));
+        char *normalized = zmsnmp_oid_normalize ("1.3.6.1.2.1.1.1.0");
+        assert (normalized && streq (normalized, ".1.3.6.1.2.1.1.1.0"));
+        zstr_free (&normalized);
+        zmsnmp_reset ();
+    }
+
+    // values keep numbers as numbers
+    {
+        zmsnmp_value_t *value = zmsnmp_value_new_integer (ZMSNMP_TYPE_INTEGER, -5);
+        assert (zmsnmp_value_is_number (value));
+        assert (zmsnmp_value_number (value) == -5);
+        char *str = zmsnmp_value_str (value);
+        assert (streq (str, "-5"));
+        zstr_free (&str);
+        zmsnmp_value_destroy (&value);
+
+        value = zmsnmp_value_new_counter64 (18446744073709551615ULL);
+        str = zmsnmp_value_str (value);
+        assert (streq (str, "18446744073709551615"));
+        assert (streq (zmsnmp_value_type_name (value), "Counter64"));
+        zstr_free (&str);
+        zmsnmp_value_t *copy = zmsnmp_value_dup (value);
+        assert (copy && copy->counter64 == value->counter64);
+        zmsnmp_value_destroy (&copy);
+        zmsnmp_value_destroy (&value);
+
+        value = zmsnmp_value_new_string (ZMSNMP_TYPE_OCTETSTRING, "a\0b", 3);
+        assert (!zmsnmp_value_is_number (value));
+        assert (value->size == 3 && memcmp (value->string, "a\0b", 3) == 0);
+        copy = zmsnmp_value_dup (value);
+        assert (copy->size == 3 && memcmp (copy->string, "a\0b", 3) == 0);
+        zmsnmp_value_destroy (&copy);
+        zmsnmp_value_destroy (&value);
+        assert (value == NULL);
+    }
+
+    // timeout follows round trip time, failing host gets no retries
+    {
+        int64_t timeout;
+        int retries;
+        s_rtt_params ("192.0.2.1", &timeout, &retries);
+        assert (timeout == ZMSNMP_RTO_INITIAL && retries == ZMSNMP_RETRIES);
+        s_rtt_update ("192.0.2.1", true, 100, timeout);
+        s_rtt_params ("192.0.2.1", &timeout, &retries);
+        assert (timeout == 300 && retries == ZMSNMP_RETRIES);
+        for (int i = 0; i < 20; i++)
+            s_rtt_update ("192.0.2.1", true, 10, timeout);
+        s_rtt_params ("192.0.2.1", &timeout, &retries);
+        assert (timeout == ZMSNMP_RTO_MIN);
+        s_rtt_update ("192.0.2.1", false, timeout * 3, timeout);
+        s_rtt_params ("192.0.2.1", &timeout, &retries);
+        assert (timeout == ZMSNMP_RTO_MIN && retries == 0);
+        assert (zmsnmp_host_failures ("192.0.2.1") == 1);
+        // late response (after retransmission) backs the timeout off
+        s_rtt_update ("192.0.2.1", true, 150, timeout);
+        s_rtt_params ("192.0.2.1", &timeout, &retries);
+        assert (timeout == 2 * ZMSNMP_RTO_MIN && retries == ZMSNMP_RETRIES);
+
+        zmsg_t *stats = zmsg_new ();
+        zmsnmp_rtt_stats ("192.0.2.1", stats);
+        assert (zmsg_size (stats) == 10);
+        zmsg_destroy (&stats);
+        stats = zmsg_new ();
+        zmsnmp_rtt_stats (NULL, stats);
+        assert (zmsg_size (stats) == 6);
+        zmsg_destroy (&stats);
+
+        // closing sockets keeps the estimation, reset drops it
+        s_rtt_update ("192.0.2.1", false, timeout * 3, timeout);
+        zmsnmp_cache_clear ();
+        assert (zmsnmp_host_failures ("192.0.2.1") == 1);
+        zmsnmp_reset ();
+        assert (zmsnmp_host_failures ("192.0.2.1") == 0);
+
+        // deadline of the thread cuts the wait for silent host, cut
+        // request is not a failure of the host
+        zmsnmp_set_deadline (zclock_mono () + 200);
+        int64_t start = zclock_mono ();
+        assert (zmsnmp_get ("192.0.2.1", ".1.3.6.1.2.1.1.3.0", &public) == NULL);
+        assert (zclock_mono () - start < ZMSNMP_RTO_INITIAL);
+        assert (zmsnmp_host_failures ("192.0.2.1") == 0);
+        zmsnmp_set_deadline (zclock_mono () - 1);
+        start = zclock_mono ();
+        assert (zmsnmp_get ("192.0.2.1", ".1.3.6.1.2.1.1.3.0", &public) == NULL);
+        assert (zclock_mono () - start < 100);
+        zmsnmp_set_deadline (0);
+        zmsnmp_reset ();
+    }
+
+    // many threads poll at once through the synchronous API, no more than
+    // in flight limit of them wait for the agent
+    {
+        snmpsim_t *sim = snmpsim_new ();
+        for (int i = 0; i < TEST_THREADS; i++) {
+            for (int j = 0; j < TEST_GETS; j++) {
+                char *oid = zsys_sprintf (".1.3.6.1.4.1.99999.%i", i * 1000 + j);
+                char *value = zsys_sprintf ("%i", i * 1000 + j);
+                assert (snmpsim_set (sim, oid, "INTEGER", value) == 0);
+                zstr_free (&oid);
+                zstr_free (&value);
+            }
+        }
+        const char *host = snmpsim_bind (sim, "127.0.0.1", 0);
+        assert (host);
+        zactor_t *responder = zactor_new (snmpsim_actor, sim);
+        assert (responder);
+
+        zmsnmp_set_inflight (16);
+        int64_t start = zclock_mono ();
+        zactor_t *pollers [TEST_THREADS];
+        for (int i = 0; i < TEST_THREADS; i++) {
+            pollers [i] = zactor_new (s_test_poller, (void *) host);
+            assert (pollers [i]);
+        }
+        for (int i = 0; i < TEST_THREADS; i++)
+            zstr_sendf (pollers [i], "%i", i);
+        int errors = 0;
+        for (int i = 0; i < TEST_THREADS; i++) {
+            char *result = zstr_recv (pollers [i]);
+            errors += result ? atoi (result) : TEST_GETS;
+            zstr_free (&result);
+            zactor_destroy (&pollers [i]);
+        }
+        if (verbose)
+            zsys_debug ("%i threads did %i gets in %" PRIi64 " ms, %i errors",
+                TEST_THREADS, TEST_THREADS * TEST_GETS, zclock_mono () - start, errors);
+        assert (errors == 0);
+        zmsg_t *stats = zmsg_new ();
+        zmsnmp_limit_stats (stats);
+        assert (zmsg_size (stats) == 12);
+        char *name = zmsg_popstr (stats);
+        while (name) {
+            char *value = zmsg_popstr (stats);
+            if (streq (name, "inflight"))
+                assert (streq (value, "0"));
+            if (streq (name, "inflight-peak"))
+                assert (atoi (value) > 0 && atoi (value) <= 16);
+            zstr_free (&name);
+            zstr_free (&value);
+            name = zmsg_popstr (stats);
+        }
+        zmsg_destroy (&stats);
+        zmsnmp_set_inflight (0);
+
+        // all threads shared the sockets of one transport
+        stats = zmsg_new ();
+        zmsnmp_transport_stats (stats);
+        assert (zmsg_size (stats) == 6);
+        name = zmsg_popstr (stats);
+        while (name) {
+            char *value = zmsg_popstr (stats);
+            if (streq (name, "sockets"))
+                assert (atoi (value) == SNMP_TRANSPORT_SOCKETS);
+            if (streq (name, "requests"))
+                assert (atoi (value) >= TEST_THREADS * TEST_GETS);
+            if (streq (name, "requests-waiting"))
+                assert (streq (value, "0"));
+            zstr_free (&name);
+            zstr_free (&value);
+            name = zmsg_popstr (stats);
+        }
+        zmsg_destroy (&stats);
+
+        // rate limited host gets the burst at once, the rest waits
+        snmp_credentials_t credentials = { 2, "public" };
+        zmsnmp_set_rate (host, 20, 2);
+        start = zclock_mono ();
+        for (int i = 0; i < 6; i++) {
+            zmsnmp_value_t *value = zmsnmp_get (host, ".1.3.6.1.4.1.99999.0", &credentials);
+            assert (value && value->integer == 0);
+            zmsnmp_value_destroy (&value);
+        }
+        int64_t elapsed = zclock_mono () - start;
+        if (verbose)
+            zsys_debug ("6 gets limited to 20/s took %" PRIi64 " ms", elapsed);
+        assert (elapsed >= 190);
+        zmsnmp_set_rate (host, 0, 0);
+        start = zclock_mono ();
+        for (int i = 0; i < 6; i++) {
+            zmsnmp_value_t *value = zmsnmp_get (host, ".1.3.6.1.4.1.99999.0", &credentials);
+            zmsnmp_value_destroy (&value);
+        }
+        assert (zclock_mono () - start < 200);
+
+        zactor_destroy (&responder);
+        snmpsim_destroy (&sim);
+        zmsnmp_cache_clear ();
+        stats = zmsg_new ();
+        zmsnmp_transport_stats (stats);
+        name = zmsg_popstr (stats);
+        char *sockets = zmsg_popstr (stats);
+        assert (streq (name, "sockets") && streq (sockets, "0"));
+        zstr_free (&name);
+        zstr_free (&sockets);
+        zmsg_destroy (&stats);
+    }
+
+    // asynchronous engine keeps many requests in flight, this agent
+    // never answers so all of them time out at about the same time
+    int port;
+    int fd = socket (AF_INET, SOCK_DGRAM, 0);
+    assert (fd >= 0);
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof (addr);
+    memset (&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    assert (bind (fd, (struct sockaddr *) &addr, sizeof (addr)) == 0);
+    assert (getsockname (fd, (struct sockaddr *) &addr, &addrlen) == 0);
+    port = ntohs (addr.sin_port);
+    char *host = zsys_sprintf ("127.0.0.1:%i", port);
+
+    zmsnmp_engine_t *engine = zmsnmp_engine_new ();
+    assert (engine);
+    zmsnmp_engine_set_timeout (engine, 200, 0);
+    int results [ZMSNMP_ERROR + 1] = { 0, 0, 0 };
+    char *communities [] = { "public", "private", "secret", "other" };
+    for (int i = 0; i < 1000; i++) {
+        snmp_credentials_t cr = { 1 + i % 2, communities [i % 4] };
+        assert (zmsnmp_engine_get (engine, host, ".1.3.6.1.2.1.1.1.0", &cr, s_test_result, results) == 0);
+    }
+    assert (zmsnmp_engine_pending (engine) == 1000);
+    int64_t start = zclock_mono ();
+    size_t completed = 0;
+    while (zmsnmp_engine_pending (engine) && zclock_mono () - start < 5000)
+        completed += zmsnmp_engine_run (engine, 1000);
+    if (verbose)
+        zsys_debug ("1000 requests timed out in %" PRIi64 " ms", zclock_mono () - start);
+    assert (completed == 1000);
+    assert (results [ZMSNMP_TIMEOUT] == 1000);
+    assert (zclock_mono () - start < 2000);
+
+    // destroy completes requests in flight
+    assert (zmsnmp_engine_getnext (engine, host, ".1", &public, s_test_result, results) == 0);
+    zmsnmp_engine_destroy (&engine);
+    assert (results [ZMSNMP_OK] == 0);
+    assert (results [ZMSNMP_TIMEOUT] + results [ZMSNMP_ERROR] == 1001);
+
+    zstr_free (&host);
+    close (fd);
+    zmsnmp_reset ();
+    //  @end
+
+    printf ("OK\n");
 }
 
@@ -35,15 +35,280 @@ typedef struct _snmp_credentials_t {
 #define SNMP_CREDENTIALS_T_DEFINED
 #endif
 
+//  Status of asynchronous request
+#define ZMSNMP_OK               0
+#define ZMSNMP_TIMEOUT          1
+#define ZMSNMP_ERROR            2
+
+//  Request types
+#define ZMSNMP_GET              1
+#define ZMSNMP_GETNEXT          2
+#define ZMSNMP_GETBULK          3
+
+//  Values of SNMP v2c exceptions, the same text net-snmp prints
+#define ZMSNMP_NOSUCHOBJECT     "No Such Object available on this agent at this OID"
+#define ZMSNMP_NOSUCHINSTANCE   "No Such Instance currently exists at this OID"
+#define ZMSNMP_ENDOFMIBVIEW     "No more variables left in this MIB View (It is past the end of the MIB tree)"
+
+struct variable_list;
+
+//  Types of SNMP values
+typedef enum {
+    ZMSNMP_TYPE_OTHER = 0,      // printed by net-snmp
+    ZMSNMP_TYPE_INTEGER,
+    ZMSNMP_TYPE_COUNTER32,
+    ZMSNMP_TYPE_GAUGE32,
+    ZMSNMP_TYPE_TIMETICKS,
+    ZMSNMP_TYPE_COUNTER64,
+    ZMSNMP_TYPE_OCTETSTRING,
+    ZMSNMP_TYPE_OID,
+    ZMSNMP_TYPE_IPADDRESS
+} zmsnmp_type_t;
+
+//  Value of one varbind. Numeric types keep the number, other types keep
+//  the string (raw bytes of OCTET STRING, zero terminated).
+#ifndef ZMSNMP_VALUE_T_DEFINED
+typedef struct _zmsnmp_value_t {
+    zmsnmp_type_t type;
+    int64_t integer;        // INTEGER, Counter32, Gauge32, TimeTicks
+    uint64_t counter64;     // Counter64
+    char *string;           // other types
+    size_t size;            // length of string
+} zmsnmp_value_t;
+#define ZMSNMP_VALUE_T_DEFINED
+#endif
+
+#ifndef ZMSNMP_ENGINE_T_DEFINED
+typedef struct _zmsnmp_engine_t zmsnmp_engine_t;
+#define ZMSNMP_ENGINE_T_DEFINED
+#endif
+
+//  Completion callback of asynchronous request. Status is ZMSNMP_OK,
+//  ZMSNMP_TIMEOUT or ZMSNMP_ERROR. Lists of returned oids and values
+//  (zmsnmp_value_t) are NULL unless status is ZMSNMP_OK and they are valid only
+//  during the call.
+typedef void (zmsnmp_fn) (int status, zlist_t *oids, zlist_t *values, void *arg);
+
+//  Max number of varbinds in one PDU of zmsnmp_get_many
+#define ZMSNMP_MAX_VARBINDS     64
+
+//  Default max-repetitions of GETBULK in zmsnmp_walk
+#define ZMSNMP_MAX_REPETITIONS  25
+
+//  Max number of rows returned by zmsnmp_walk
+#define ZMSNMP_WALK_MAX         10000
+
+//  Round trip based timeout of requests, ms
+#define ZMSNMP_RTO_INITIAL      1000    // host without estimation
+#define ZMSNMP_RTO_MIN          100
+#define ZMSNMP_RTO_MAX          5000
+#define ZMSNMP_RETRIES          2       // retries of responding host
+#define ZMSNMP_RTT_HOSTS_MAX    65536   // hosts with estimation
+
 //  @interface
-//  snmp get function
+//  Initialize net-snmp library and fix its output settings. Called
+//  automatically before the first MIB lookup, safe to call from any thread
+//  any number of times.
+ZM_METRIC_PRIVATE void
+    zmsnmp_init (void);
+
+//  Create numeric value of type INTEGER, Counter32, Gauge32 or TimeTicks
+ZM_METRIC_PRIVATE zmsnmp_value_t *
+    zmsnmp_value_new_integer (zmsnmp_type_t type, int64_t integer);
+
+//  Create Counter64 value
+ZM_METRIC_PRIVATE zmsnmp_value_t *
+    zmsnmp_value_new_counter64 (uint64_t counter64);
+
+//  Create string value of given type, data are copied
+ZM_METRIC_PRIVATE zmsnmp_value_t *
+    zmsnmp_value_new_string (zmsnmp_type_t type, const char *data, size_t size);
+
+//  Create value from net-snmp varbind. Numbers are taken as they are,
+//  types without own representation are printed by net-snmp.
+ZM_METRIC_PRIVATE zmsnmp_value_t *
+    zmsnmp_value_from_varbind (const struct variable_list *variable);
+
+//  Destroy the value
+ZM_METRIC_PRIVATE void
+    zmsnmp_value_destroy (zmsnmp_value_t **self_p);
+
+//  freefn for zhash/zlist
+ZM_METRIC_PRIVATE void
+    zmsnmp_value_freefn (void *self);
+
+//  Create copy of the value
+ZM_METRIC_PRIVATE zmsnmp_value_t *
+    zmsnmp_value_dup (const zmsnmp_value_t *self);
+
+//  Returns true if value is SNMP v2c exception (noSuchObject,
+//  noSuchInstance or endOfMibView)
+ZM_METRIC_PRIVATE bool
+    zmsnmp_value_is_exception (const zmsnmp_value_t *self);
+
+//  Returns true if value is a number
+ZM_METRIC_PRIVATE bool
+    zmsnmp_value_is_number (const zmsnmp_value_t *self);
+
+//  Numeric value, 0 for non-numeric types. Counter64 above 2^53 loses
+//  precision.
+ZM_METRIC_PRIVATE double
+    zmsnmp_value_number (const zmsnmp_value_t *self);
+
+//  Value as newly allocated string, numbers in decimal form
 ZM_METRIC_PRIVATE char *
+    zmsnmp_value_str (const zmsnmp_value_t *self);
+
+//  Name of the value type ("INTEGER", "Counter32", "OCTET STRING", ...)
+ZM_METRIC_PRIVATE const char *
+    zmsnmp_value_type_name (const zmsnmp_value_t *self);
+
+//  snmp get function, returns NULL if host does not respond. Synchronous
+//  requests of all threads share the sockets of one snmp_transport, the
+//  calling thread waits for its response.
+ZM_METRIC_PRIVATE zmsnmp_value_t *
     zmsnmp_get (const char* host, const char *oid, const snmp_credentials_t *credentials);
 
+//  snmp get of many oids in as few requests as possible. Returns hash of
+//  oid (numeric form, see zmsnmp_oid_normalize) -> zmsnmp_value_t for every oid
+//  agent returned, NULL if host does not respond.
+ZM_METRIC_PRIVATE zhash_t *
+    zmsnmp_get_many (const char* host, zlist_t *oids, const snmp_credentials_t *credentials);
+
+//  snmp walk of subtree under oid. Uses GETBULK with max_repetitions
+//  (0 = default) for v2c and GETNEXT for v1. Returns hash of oid -> zmsnmp_value_t
+//  of all rows in the subtree, NULL if host does not respond.
+ZM_METRIC_PRIVATE zhash_t *
+    zmsnmp_walk (const char* host, const char *oid, const snmp_credentials_t *credentials, int max_repetitions);
+
+//  Parse oid (numeric or MIB name) into name array of size elements.
+//  Parsed oids are kept in intern table, so every string is parsed just
+//  once. Returns number of sub-identifiers, 0 if oid is not valid.
+ZM_METRIC_PRIVATE size_t
+    zmsnmp_oid_parse (const char *oid, unsigned long *name, size_t size);
+
+//  Format oid as numeric string ".1.3.6.1" into buffer. Does not depend on
+//  net-snmp output settings. Returns length of string, -1 if buffer is
+//  too small.
+ZM_METRIC_PRIVATE int
+    zmsnmp_oid_format (const unsigned long *name, size_t len, char *buffer, size_t size);
+
+//  Convert oid to numeric string form like ".1.3.6.1.2.1.1.3.0".
+//  Returns NULL if oid is not valid. Caller must free the string.
+ZM_METRIC_PRIVATE char *
+    zmsnmp_oid_normalize (const char *oid);
+
 //  snmp getnext function
 ZM_METRIC_PRIVATE void
-    zmsnmp_getnext (const char* host, const char *oid, const snmp_credentials_t *credentials, char **resultoid, char **resultvalue);
+    zmsnmp_getnext (const char* host, const char *oid, const snmp_credentials_t *credentials, char **resultoid, zmsnmp_value_t **resultvalue);
+
+//  Set deadline (zclock_mono, ms) of synchronous requests of the calling
+//  thread, 0 for none. Retries and timeout of requests are cut to the time
+//  left, request after the deadline times out without being sent.
+ZM_METRIC_PRIVATE void
+    zmsnmp_set_deadline (int64_t deadline);
+
+//  Close sockets of synchronous requests unless some are in flight. They
+//  are opened again by the next request.
+ZM_METRIC_PRIVATE void
+    zmsnmp_cache_clear (void);
+
+//  Close sockets like zmsnmp_cache_clear and drop all state kept for the
+//  whole process: interned oids, round trip estimations and rate limits.
+//  Call it when the process does not poll anymore.
+ZM_METRIC_PRIVATE void
+    zmsnmp_reset (void);
+
+//  Append counters of synchronous requests (sockets, requests,
+//  requests-waiting) to the message as name/value frame pairs
+ZM_METRIC_PRIVATE void
+    zmsnmp_transport_stats (zmsg_t *msg);
+
+//  Number of consecutive requests to the host which timed out
+ZM_METRIC_PRIVATE int
+    zmsnmp_host_failures (const char *host);
+
+//  Append round trip estimation of the host (srtt, rttvar, rto,
+//  rtt-samples, rtt-timeouts) or with NULL host summary of all hosts
+//  (rtt-hosts, rtt-failing, rtt-timeouts) to the message as name/value
+//  frame pairs
+ZM_METRIC_PRIVATE void
+    zmsnmp_rtt_stats (const char *host, zmsg_t *msg);
+
+//  Limit requests to the host to rate per second with bursts up to burst
+//  requests (at least 1). Applies to requests of every snmp_transport,
+//  synchronous and asynchronous ones. Requests above the limit stay in
+//  the send queue for their turn. Retransmissions are not counted. Rate 0
+//  removes the limit.
+ZM_METRIC_PRIVATE void
+    zmsnmp_set_rate (const char *host, double rate, int burst);
+
+//  Limit number of requests in flight of all snmp_transports of the
+//  process, requests above the limit stay in the send queue until a slot
+//  is free. 0 means no limit.
+ZM_METRIC_PRIVATE void
+    zmsnmp_set_inflight (size_t max);
+
+//  Admit request to the host which snmp_transport is about to send. held
+//  is kept by the caller per request, 0 before the first call. Returns 0
+//  when the request can go out (it takes a token and a slot in flight),
+//  ms until the next token of the host, or -1 when all slots are taken.
+//  Every admitted request is followed by zmsnmp_limit_release.
+ZM_METRIC_PRIVATE int64_t
+    zmsnmp_limit_acquire (const char *host, int64_t *held);
+
+//  Admitted request completed, its slot in flight is free
+ZM_METRIC_PRIVATE void
+    zmsnmp_limit_release (void);
+
+//  Append limit counters (rate-limited-hosts, rate-delayed, rate-wait in
+//  ms of all held requests, inflight, inflight-peak since the limit was
+//  set, inflight-delayed) to the message as name/value frame pairs
+ZM_METRIC_PRIVATE void
+    zmsnmp_limit_stats (zmsg_t *msg);
+
+//  Create asynchronous SNMP engine. Engine can have thousands of requests
+//  in flight sent through a few shared UDP sockets (see snmp_transport), it
+//  must be used from one thread only.
+ZM_METRIC_PRIVATE zmsnmp_engine_t *
+    zmsnmp_engine_new (void);
+
+//  Destroy the engine. Callbacks of requests in flight are called with
+//  ZMSNMP_ERROR status.
+ZM_METRIC_PRIVATE void
+    zmsnmp_engine_destroy (zmsnmp_engine_t **self_p);
+
+//  Set request timeout in ms and number of retries for requests sent
+//  from now on. Negative values (zero timeout) mean defaults of
+//  snmp_transport.
+ZM_METRIC_PRIVATE void
+    zmsnmp_engine_set_timeout (zmsnmp_engine_t *self, int timeout, int retries);
+
+//  Send request (ZMSNMP_GET or ZMSNMP_GETNEXT) with all oids in one PDU.
+//  fn is called from zmsnmp_engine_run () once the request completes.
+//  Request is queued and sent by the next zmsnmp_engine_run (). Returns 0
+//  if the request was queued, -1 otherwise (fn is not called).
+ZM_METRIC_PRIVATE int
+    zmsnmp_engine_send (zmsnmp_engine_t *self, const char *host, const snmp_credentials_t *credentials, int command, zlist_t *oids, zmsnmp_fn *fn, void *arg);
+
+//  Send asynchronous get of one oid, see zmsnmp_engine_send ()
+ZM_METRIC_PRIVATE int
+    zmsnmp_engine_get (zmsnmp_engine_t *self, const char *host, const char *oid, const snmp_credentials_t *credentials, zmsnmp_fn *fn, void *arg);
+
+//  Send asynchronous getnext of one oid, see zmsnmp_engine_send ()
+ZM_METRIC_PRIVATE int
+    zmsnmp_engine_getnext (zmsnmp_engine_t *self, const char *host, const char *oid, const snmp_credentials_t *credentials, zmsnmp_fn *fn, void *arg);
+
+//  Number of requests in flight
+ZM_METRIC_PRIVATE size_t
+    zmsnmp_engine_pending (zmsnmp_engine_t *self);
+
+//  Send queued requests, wait up to timeout ms (-1 for default tick) for
+//  responses, call callbacks of completed requests. Returns number of completed requests.
+ZM_METRIC_PRIVATE size_t
+    zmsnmp_engine_run (zmsnmp_engine_t *self, int timeout);
 
+//  Self test of this class
 ZM_METRIC_PRIVATE void
     zmsnmp_test (bool verbose);
 